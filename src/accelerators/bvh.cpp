@@ -216,6 +216,7 @@ BVHAccel::BVHAccel(std::vector<std::shared_ptr<Primitive>> p,
                               (1024.f * 1024.f));
 
     // Compute representation of depth-first traversal of BVH tree
+    this->totalNodes = totalNodes;
     treeBytes += totalNodes * sizeof(LinearBVHNode) + sizeof(*this) +
                  primitives.size() * sizeof(primitives[0]);
     nodes = AllocAligned<LinearBVHNode>(totalNodes);
@@ -659,6 +660,34 @@ int BVHAccel::flattenBVHTree(BVHBuildNode *node, int *offset) {
 
 BVHAccel::~BVHAccel() { FreeAligned(nodes); }
 
+void BVHAccel::Refit(std::vector<std::shared_ptr<Primitive>> orderedPrims) {
+    ProfilePhase _(Prof::AccelConstruction);
+    CHECK(primitives.empty() || primitives.size() == orderedPrims.size());
+    primitives = std::move(orderedPrims);
+    // Children are always stored after their parents in _nodes_, so
+    // visiting the nodes in reverse order updates children first
+    for (int i = totalNodes - 1; i >= 0; --i) {
+        LinearBVHNode *node = &nodes[i];
+        if (node->nPrimitives > 0) {
+            Bounds3f b;
+            for (int j = 0; j < node->nPrimitives; ++j)
+                b = Union(b, primitives[node->primitivesOffset + j]->WorldBound());
+            node->bounds = b;
+        } else
+            node->bounds = Union(nodes[i + 1].bounds,
+                                 nodes[node->secondChildOffset].bounds);
+    }
+}
+
+Float BVHAccel::SAHCost() const {
+    if (!nodes) return 0;
+    Float rootArea = nodes[0].bounds.SurfaceArea();
+    if (rootArea == 0) return 0;
+    Float area = 0;
+    for (int i = 0; i < totalNodes; ++i) area += nodes[i].bounds.SurfaceArea();
+    return area / rootArea;
+}
+
 bool BVHAccel::Intersect(const Ray &ray, SurfaceInteraction *isect) const {
     if (!nodes) return false;
     ProfilePhase p(Prof::AccelIntersect);
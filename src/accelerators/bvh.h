@@ -65,6 +65,19 @@ class BVHAccel : public Aggregate {
     ~BVHAccel();
     bool Intersect(const Ray &ray, SurfaceInteraction *isect) const;
     bool IntersectP(const Ray &ray) const;
+    const std::vector<std::shared_ptr<Primitive>> &GetPrimitives() const {
+        return primitives;
+    }
+    // Replaces the BVH's primitives with _orderedPrims_, which must
+    // correspond one-to-one with the ones returned by GetPrimitives(), and
+    // recomputes node bounds bottom-up without changing the tree topology.
+    void Refit(std::vector<std::shared_ptr<Primitive>> orderedPrims);
+    // Drops the BVH's references to its primitives; it must be refit before
+    // it is used again.
+    void ReleasePrimitives() { primitives.clear(); }
+    // Returns the sum of the surface areas of the BVH's nodes, relative to
+    // the root's; a measure of the tree's quality under the SAH.
+    Float SAHCost() const;
 
   private:
     // BVHAccel Private Methods
@@ -92,6 +105,7 @@ class BVHAccel : public Aggregate {
     const SplitMethod splitMethod;
     std::vector<std::shared_ptr<Primitive>> primitives;
     LinearBVHNode *nodes = nullptr;
+    int totalNodes = 0;
 };
 
 std::shared_ptr<BVHAccel> CreateBVHAccelerator(
@@ -0,0 +1,283 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+
+// accelerators/curvebundle.cpp*
+#include "accelerators/curvebundle.h"
+#include "interaction.h"
+#include "stats.h"
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace pbrt {
+
+STAT_MEMORY_COUNTER("Memory/Curve bundles", curveBundleBytes);
+STAT_PERCENT("Intersections/Curve segment box hits", nBoxHits, nBoxTests);
+
+// CurveBundle Local Definitions
+
+// Operations on a CurveBundle::Width-wide vector of floats.
+#if defined(__AVX__)
+typedef __m256 Lanes;
+static inline Lanes Load(const float *p) { return _mm256_loadu_ps(p); }
+static inline Lanes Splat(float v) { return _mm256_set1_ps(v); }
+static inline Lanes Add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+static inline Lanes Sub(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+static inline Lanes Mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+static inline Lanes Div(Lanes a, Lanes b) { return _mm256_div_ps(a, b); }
+// Like the SSE instructions, Min() and Max() return _b_ if either value is
+// NaN.
+static inline Lanes Min(Lanes a, Lanes b) { return _mm256_min_ps(a, b); }
+static inline Lanes Max(Lanes a, Lanes b) { return _mm256_max_ps(a, b); }
+static inline int LessEqualMask(Lanes a, Lanes b) {
+    return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LE_OQ));
+}
+#elif defined(__SSE2__) || defined(_M_X64)
+typedef __m128 Lanes;
+static inline Lanes Load(const float *p) { return _mm_loadu_ps(p); }
+static inline Lanes Splat(float v) { return _mm_set1_ps(v); }
+static inline Lanes Add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+static inline Lanes Sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+static inline Lanes Mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+static inline Lanes Div(Lanes a, Lanes b) { return _mm_div_ps(a, b); }
+static inline Lanes Min(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+static inline Lanes Max(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+static inline int LessEqualMask(Lanes a, Lanes b) {
+    return _mm_movemask_ps(_mm_cmple_ps(a, b));
+}
+#else
+struct Lanes {
+    float v[CurveBundle::Width];
+};
+#define PBRT_LANEWISE(expr)                             \
+    Lanes r;                                            \
+    for (int i = 0; i < CurveBundle::Width; ++i) expr; \
+    return r
+static inline Lanes Load(const float *p) { PBRT_LANEWISE(r.v[i] = p[i]); }
+static inline Lanes Splat(float v) { PBRT_LANEWISE(r.v[i] = v); }
+static inline Lanes Add(Lanes a, Lanes b) {
+    PBRT_LANEWISE(r.v[i] = a.v[i] + b.v[i]);
+}
+static inline Lanes Sub(Lanes a, Lanes b) {
+    PBRT_LANEWISE(r.v[i] = a.v[i] - b.v[i]);
+}
+static inline Lanes Mul(Lanes a, Lanes b) {
+    PBRT_LANEWISE(r.v[i] = a.v[i] * b.v[i]);
+}
+static inline Lanes Div(Lanes a, Lanes b) {
+    PBRT_LANEWISE(r.v[i] = a.v[i] / b.v[i]);
+}
+static inline Lanes Min(Lanes a, Lanes b) {
+    PBRT_LANEWISE(r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]);
+}
+static inline Lanes Max(Lanes a, Lanes b) {
+    PBRT_LANEWISE(r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]);
+}
+#undef PBRT_LANEWISE
+static inline int LessEqualMask(Lanes a, Lanes b) {
+    int mask = 0;
+    for (int i = 0; i < CurveBundle::Width; ++i)
+        if (a.v[i] <= b.v[i]) mask |= 1 << i;
+    return mask;
+}
+#endif
+
+// Computes the affine map from world space to the unit cube of an oriented
+// box around the curve segment with object-space control points _cp_;
+// returns false if the segment is degenerate.
+static bool ComputeBoxMap(const Point3f cp[4], Float width,
+                          const Transform &worldToObject, float map[12]) {
+    // Align the box with the segment's chord and the direction it bends in
+    Vector3f axis[3];
+    Vector3f chord = cp[3] - cp[0];
+    if (chord.LengthSquared() > 0) {
+        axis[0] = Normalize(chord);
+        Vector3f bend = (cp[1] - cp[0]) + (cp[2] - cp[3]);
+        bend -= Dot(bend, axis[0]) * axis[0];
+        if (bend.LengthSquared() > 0) {
+            axis[1] = Normalize(bend);
+            axis[2] = Cross(axis[0], axis[1]);
+        } else
+            CoordinateSystem(axis[0], &axis[1], &axis[2]);
+    } else {
+        axis[0] = Vector3f(1, 0, 0);
+        axis[1] = Vector3f(0, 1, 0);
+        axis[2] = Vector3f(0, 0, 1);
+    }
+
+    // Bound the segment along each axis; it lies within the convex hull of
+    // its control points, expanded by half of its width. The box is padded
+    // slightly further to account for rounding error in the box tests.
+    Float lo[3], extent[3], maxExtent = 0;
+    for (int k = 0; k < 3; ++k) {
+        lo[k] = Infinity;
+        Float hi = -Infinity;
+        for (int i = 0; i < 4; ++i) {
+            Float d = Dot(axis[k], Vector3f(cp[i]));
+            lo[k] = std::min(lo[k], d);
+            hi = std::max(hi, d);
+        }
+        extent[k] = hi - lo[k];
+        maxExtent = std::max(maxExtent, extent[k]);
+    }
+    Float pad = 0.5f * width + 1e-3f * (maxExtent + width);
+    if (pad == 0) return false;
+
+    // Compose the map from object space to the box with _worldToObject_
+    const Matrix4x4 &m = worldToObject.GetMatrix();
+    for (int k = 0; k < 3; ++k) {
+        Float scale = 1 / (extent[k] + 2 * pad);
+        for (int j = 0; j < 4; ++j) {
+            Float c = 0;
+            for (int i = 0; i < 3; ++i) c += axis[k][i] * m.m[i][j];
+            map[4 * k + j] = c * scale;
+        }
+        map[4 * k + 3] -= (lo[k] - pad) * scale;
+    }
+    return true;
+}
+
+// CurveBundle Method Definitions
+CurveBundle::CurveBundle(const std::shared_ptr<Curve> *c, int n,
+                         const std::shared_ptr<Material> &material,
+                         const MediumInterface &mediumInterface)
+    : nCurves(n), material(material), mediumInterface(mediumInterface) {
+    CHECK(n > 0 && n <= Width);
+    for (int lane = 0; lane < Width; ++lane) {
+        // Lanes without a segment get a map that puts every ray outside of
+        // the unit cube.
+        float map[12] = {0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1};
+        if (lane < n) {
+            curves[lane] = c[lane];
+            curves[lane]->ControlPoints(cpObj[lane]);
+            bounds = Union(bounds, curves[lane]->WorldBound());
+            if (!ComputeBoxMap(cpObj[lane], curves[lane]->MaxWidth(),
+                               *curves[lane]->WorldToObject, map))
+                for (int j = 0; j < 12; ++j) map[j] = (j % 4 == 3) ? -1 : 0;
+        }
+        for (int j = 0; j < 12; ++j) box[j][lane] = map[j];
+    }
+    curveBundleBytes += sizeof(*this);
+}
+
+int CurveBundle::IntersectBoxes(const Ray &r) const {
+    Lanes o[3] = {Splat(r.o.x), Splat(r.o.y), Splat(r.o.z)};
+    Lanes d[3] = {Splat(r.d.x), Splat(r.d.y), Splat(r.d.z)};
+    Lanes zero = Splat(0), one = Splat(1);
+    Lanes tMin = zero, tMax = Splat(r.tMax);
+    for (int k = 0; k < 3; ++k) {
+        // Find the ray's parametric range between the box's slabs along
+        // its _k_th axis
+        const float(*row)[Width] = &box[4 * k];
+        Lanes m0 = Load(row[0]), m1 = Load(row[1]), m2 = Load(row[2]);
+        Lanes ok = Add(Add(Mul(m0, o[0]), Mul(m1, o[1])),
+                       Add(Mul(m2, o[2]), Load(row[3])));
+        Lanes dk = Add(Add(Mul(m0, d[0]), Mul(m1, d[1])), Mul(m2, d[2]));
+        Lanes tNear = Div(Sub(zero, ok), dk), tFar = Div(Sub(one, ok), dk);
+        Lanes t0 = Min(tNear, tFar), t1 = Max(tNear, tFar);
+        // Update _tFar_ to ensure robust ray--box intersection
+        t1 = Mul(t1, Splat(1 + 2 * gamma(3)));
+        tMin = Max(t0, tMin);
+        tMax = Min(t1, tMax);
+    }
+    int mask = LessEqualMask(tMin, tMax) & ((1 << nCurves) - 1);
+    nBoxTests += nCurves;
+    for (int m = mask; m; m &= m - 1) ++nBoxHits;
+    return mask;
+}
+
+bool CurveBundle::Intersect(const Ray &r, SurfaceInteraction *isect) const {
+    bool hit = false;
+    for (int mask = IntersectBoxes(r); mask; mask &= mask - 1) {
+        int lane = CountTrailingZeros(mask);
+        Float tHit;
+        if (curves[lane]->IntersectSegment(r, cpObj[lane], &tHit, isect)) {
+            r.tMax = tHit;
+            hit = true;
+        }
+    }
+    if (!hit) return false;
+    isect->primitive = this;
+    // Initialize _SurfaceInteraction::mediumInterface_ after _Curve_
+    // intersection
+    if (mediumInterface.IsMediumTransition())
+        isect->mediumInterface = mediumInterface;
+    else
+        isect->mediumInterface = MediumInterface(r.medium);
+    return true;
+}
+
+bool CurveBundle::IntersectP(const Ray &r) const {
+    for (int mask = IntersectBoxes(r); mask; mask &= mask - 1) {
+        int lane = CountTrailingZeros(mask);
+        if (curves[lane]->IntersectSegment(r, cpObj[lane], nullptr, nullptr))
+            return true;
+    }
+    return false;
+}
+
+void CurveBundle::ComputeScatteringFunctions(SurfaceInteraction *isect,
+                                             MemoryArena &arena,
+                                             TransportMode mode,
+                                             bool allowMultipleLobes) const {
+    ProfilePhase p(Prof::ComputeScatteringFuncs);
+    if (material)
+        material->ComputeScatteringFunctions(isect, arena, mode,
+                                             allowMultipleLobes);
+    CHECK_GE(Dot(isect->n, isect->shading.n), 0.);
+}
+
+std::vector<std::shared_ptr<Primitive>> CreateCurveBundles(
+    const std::vector<std::shared_ptr<Shape>> &curves,
+    const std::shared_ptr<Material> &material,
+    const MediumInterface &mediumInterface) {
+    // Consecutive segments are adjacent along the curve, so bundling them
+    // in order keeps the bundles' bounds tight.
+    std::vector<std::shared_ptr<Primitive>> bundles;
+    bundles.reserve((curves.size() + CurveBundle::Width - 1) /
+                    CurveBundle::Width);
+    for (size_t i = 0; i < curves.size(); i += CurveBundle::Width) {
+        std::shared_ptr<Curve> bundle[CurveBundle::Width];
+        int n = std::min<int>(CurveBundle::Width, curves.size() - i);
+        for (int j = 0; j < n; ++j)
+            bundle[j] = std::static_pointer_cast<Curve>(curves[i + j]);
+        bundles.push_back(std::make_shared<CurveBundle>(
+            bundle, n, material, mediumInterface));
+    }
+    return bundles;
+}
+
+}  // namespace pbrt
@@ -0,0 +1,105 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_ACCELERATORS_CURVEBUNDLE_H
+#define PBRT_ACCELERATORS_CURVEBUNDLE_H
+
+// accelerators/curvebundle.h*
+#include "pbrt.h"
+#include "primitive.h"
+#include "shapes/curve.h"
+
+namespace pbrt {
+
+// CurveBundle Declarations
+
+// A CurveBundle is a single primitive for a handful of consecutive
+// pre-split curve segments, so that hair doesn't need a BVH leaf for each
+// one. Each segment is bounded by an oriented box aligned with it, stored
+// as the affine map from world space to the box's unit cube; rays are
+// tested against all of the boxes at once with SIMD instructions, and
+// only the segments whose boxes they hit go through the Curve's exact
+// intersection test.
+class CurveBundle : public Primitive {
+  public:
+    // CurveBundle Public Constants
+#if defined(__AVX__)
+    static PBRT_CONSTEXPR int Width = 8;
+#else
+    static PBRT_CONSTEXPR int Width = 4;
+#endif
+
+    // CurveBundle Public Methods
+    CurveBundle(const std::shared_ptr<Curve> *curves, int nCurves,
+                const std::shared_ptr<Material> &material,
+                const MediumInterface &mediumInterface);
+    Bounds3f WorldBound() const { return bounds; }
+    bool Intersect(const Ray &r, SurfaceInteraction *isect) const;
+    bool IntersectP(const Ray &r) const;
+    const AreaLight *GetAreaLight() const { return nullptr; }
+    const Material *GetMaterial() const { return material.get(); }
+    void ComputeScatteringFunctions(SurfaceInteraction *isect,
+                                    MemoryArena &arena, TransportMode mode,
+                                    bool allowMultipleLobes) const;
+
+  private:
+    // CurveBundle Private Methods
+    // Returns a bitmask of the segments whose boxes _r_ overlaps.
+    int IntersectBoxes(const Ray &r) const;
+
+    // CurveBundle Private Data
+    // Rows of the world-to-box maps, stored by lane: _box[4 * i + j][k]_ is
+    // element _j_ of row _i_ of segment _k_'s map.
+    float box[12][Width];
+    Point3f cpObj[Width][4];
+    std::shared_ptr<Curve> curves[Width];
+    int nCurves;
+    Bounds3f bounds;
+    std::shared_ptr<Material> material;
+    MediumInterface mediumInterface;
+};
+
+// Groups the segments created for a "curve" shape into CurveBundles.
+std::vector<std::shared_ptr<Primitive>> CreateCurveBundles(
+    const std::vector<std::shared_ptr<Shape>> &curves,
+    const std::shared_ptr<Material> &material,
+    const MediumInterface &mediumInterface);
+
+}  // namespace pbrt
+
+#endif  // PBRT_ACCELERATORS_CURVEBUNDLE_H
@@ -0,0 +1,146 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+
+// accelerators/instancing.cpp*
+#include "accelerators/instancing.h"
+#include "accelerators/bvh.h"
+#include "stats.h"
+#include <map>
+#include <unordered_map>
+
+namespace pbrt {
+
+STAT_COUNTER("Scene/Instance aggregates reused", nInstanceAggregatesReused);
+STAT_COUNTER("Scene/Top-level BVH builds", nTopLevelBuilds);
+STAT_COUNTER("Scene/Top-level BVH refits", nTopLevelRefits);
+
+// Instancing Local Definitions
+struct CachedInstanceAggregate {
+    uint64_t signature;
+    std::shared_ptr<Primitive> aggregate;
+};
+static std::map<std::string, CachedInstanceAggregate> instanceAggregates;
+
+// The top-level BVH from the previous frame. _order_ maps each position in
+// the BVH's primitive array to the index of the instance stored there.
+struct TopLevelBVHCache {
+    std::shared_ptr<BVHAccel> bvh;
+    std::vector<int> order;
+    Float buildCost = 0;
+};
+static TopLevelBVHCache topLevel;
+
+// A refit top-level BVH is rebuilt once its SAH cost grows by this factor
+// over the cost it had when it was built.
+static PBRT_CONSTEXPR Float MaxRefitCostRatio = 1.5f;
+
+// Instancing Definitions
+uint64_t InstanceSignature(
+    const std::vector<std::shared_ptr<Primitive>> &prims) {
+    // FNV-1a over the primitive count and the bits of each bound
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](uint64_t v) {
+        for (int i = 0; i < 8; ++i) {
+            hash ^= (v >> (8 * i)) & 0xff;
+            hash *= 1099511628211ull;
+        }
+    };
+    mix(prims.size());
+    for (const auto &prim : prims) {
+        Bounds3f b = prim->WorldBound();
+        for (int c = 0; c < 3; ++c) {
+            mix(FloatToBits(b.pMin[c]));
+            mix(FloatToBits(b.pMax[c]));
+        }
+    }
+    return hash;
+}
+
+std::shared_ptr<Primitive> LookupInstanceAggregate(const std::string &name,
+                                                   uint64_t signature) {
+    auto iter = instanceAggregates.find(name);
+    if (iter == instanceAggregates.end() ||
+        iter->second.signature != signature)
+        return nullptr;
+    ++nInstanceAggregatesReused;
+    return iter->second.aggregate;
+}
+
+void CacheInstanceAggregate(const std::string &name, uint64_t signature,
+                            std::shared_ptr<Primitive> aggregate) {
+    instanceAggregates[name] = {signature, std::move(aggregate)};
+}
+
+std::shared_ptr<Primitive> BuildTopLevelBVH(
+    std::vector<std::shared_ptr<Primitive>> instances) {
+    // Refit the previous frame's BVH if it has the same number of instances
+    if (topLevel.bvh && topLevel.order.size() == instances.size()) {
+        std::vector<std::shared_ptr<Primitive>> orderedPrims;
+        orderedPrims.reserve(instances.size());
+        for (int index : topLevel.order) orderedPrims.push_back(instances[index]);
+        topLevel.bvh->Refit(std::move(orderedPrims));
+        Float cost = topLevel.bvh->SAHCost();
+        if (cost <= MaxRefitCostRatio * topLevel.buildCost) {
+            ++nTopLevelRefits;
+            return topLevel.bvh;
+        }
+        VLOG(1) << "Refit top-level BVH cost " << cost << " vs. built cost "
+                << topLevel.buildCost << "; rebuilding";
+    }
+
+    // Build a new top-level BVH and record where each instance ended up
+    ++nTopLevelBuilds;
+    std::unordered_map<const Primitive *, int> instanceIndex;
+    for (size_t i = 0; i < instances.size(); ++i)
+        instanceIndex[instances[i].get()] = i;
+    topLevel.bvh = std::make_shared<BVHAccel>(std::move(instances));
+    const std::vector<std::shared_ptr<Primitive>> &orderedPrims =
+        topLevel.bvh->GetPrimitives();
+    topLevel.order.resize(orderedPrims.size());
+    for (size_t i = 0; i < orderedPrims.size(); ++i)
+        topLevel.order[i] = instanceIndex[orderedPrims[i].get()];
+    topLevel.buildCost = topLevel.bvh->SAHCost();
+    return topLevel.bvh;
+}
+
+void EndInstancingFrame() {
+    if (topLevel.bvh) topLevel.bvh->ReleasePrimitives();
+}
+
+void ClearInstancingCaches() {
+    instanceAggregates.clear();
+    topLevel = TopLevelBVHCache();
+}
+
+}  // namespace pbrt
@@ -0,0 +1,80 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_ACCELERATORS_INSTANCING_H
+#define PBRT_ACCELERATORS_INSTANCING_H
+
+// accelerators/instancing.h*
+#include "pbrt.h"
+#include "primitive.h"
+
+namespace pbrt {
+
+// Two-level acceleration for object instancing. Each object's primitives
+// get their own bottom-level aggregate, shared by all of its instances,
+// and the instances are organized by a top-level BVH over their bounds.
+// Both levels persist across the frames rendered by one process. A
+// top-level BVH over the same number of instances is refit to their new
+// transforms rather than rebuilt. With --reuseinstances, an object whose
+// geometry is unchanged also keeps its bottom-level aggregate; changes to
+// only its materials are then not picked up.
+
+// Returns a hash of the world-space bounds of _prims_, used to decide
+// whether an object's geometry has changed between frames.
+uint64_t InstanceSignature(const std::vector<std::shared_ptr<Primitive>> &prims);
+
+// Returns the bottom-level aggregate cached for the object named _name_
+// in an earlier frame if it had the same signature, or nullptr.
+std::shared_ptr<Primitive> LookupInstanceAggregate(const std::string &name,
+                                                   uint64_t signature);
+void CacheInstanceAggregate(const std::string &name, uint64_t signature,
+                            std::shared_ptr<Primitive> aggregate);
+
+// Returns an aggregate for _instances_, refitting the previous frame's
+// top-level BVH when possible.
+std::shared_ptr<Primitive> BuildTopLevelBVH(
+    std::vector<std::shared_ptr<Primitive>> instances);
+
+// Called once a frame has been rendered so that the top-level BVH cache
+// doesn't keep the frame's primitives alive.
+void EndInstancingFrame();
+void ClearInstancingCaches();
+
+}  // namespace pbrt
+
+#endif  // PBRT_ACCELERATORS_INSTANCING_H
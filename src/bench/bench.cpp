@@ -0,0 +1,239 @@
+//
+// bench.cpp
+//
+// pbrt_bench: runs pbrt's microbenchmarks and scene benchmarks and
+// optionally compares their throughput against a stored baseline.
+//
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <cinttypes>
+#include <fstream>
+#include <map>
+#include <regex>
+#include "bench/bench.h"
+#include "api.h"
+#include "spectrum.h"
+#include "stringprint.h"
+#include <glog/logging.h>
+
+using namespace pbrt;
+
+namespace pbrt {
+
+// Benchmark Local Definitions
+struct Benchmark {
+    std::string name, unit;
+    BenchmarkFunction func;
+};
+
+static std::vector<Benchmark> *benchmarks;
+
+// Benchmark Definitions
+void RegisterBenchmark(const std::string &name, const std::string &unit,
+                       BenchmarkFunction func) {
+    if (!benchmarks) benchmarks = new std::vector<Benchmark>;
+    benchmarks->push_back({name, unit, std::move(func)});
+}
+
+bool BenchmarkState::NextBatch() {
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    if (!started) {
+        started = true;
+        startTime = now;
+        batchEnd = iterations = 1;
+        return skipReason.empty();
+    }
+    seconds = std::chrono::duration<double>(now - startTime).count();
+    if (seconds >= minSeconds || !skipReason.empty()) return false;
+
+    // Double the batch size so that reading the clock is amortized over
+    // more iterations as the benchmark runs.
+    batchSize *= 2;
+    batchEnd = iterations + batchSize;
+    ++iterations;
+    return true;
+}
+
+}  // namespace pbrt
+
+static void usage(const char *msg = nullptr, ...) {
+    if (msg) {
+        va_list args;
+        va_start(args, msg);
+        fprintf(stderr, "pbrt_bench: ");
+        vfprintf(stderr, msg, args);
+        fprintf(stderr, "\n");
+    }
+    fprintf(stderr, R"(usage: pbrt_bench [<options>] [<scene.pbrt>...]
+
+Runs pbrt's microbenchmarks, its built-in scene benchmarks and the given
+scene files, reporting the throughput of each.
+
+Benchmark options:
+  --baseline <file>    Compare throughput to a baseline saved with
+                       --savebaseline; exits with an error if any benchmark
+                       is slower than the baseline by more than the tolerance.
+  --filter <regex>     Only run benchmarks whose names match the given regular
+                       expression.
+  --list               List the benchmarks and exit.
+  --mintime <sec>      Minimum time to run each benchmark for. Default: 1
+  --nthreads <num>     Number of threads used by scene benchmarks.
+                       Default: all cores.
+  --savebaseline <file>
+                       Save the measured throughputs to the given file.
+  --tolerance <frac>   Relative slowdown reported as a regression.
+                       Default: 0.1
+)");
+    exit(1);
+}
+
+// Baseline files have a line for each benchmark with its name and its
+// throughput in items per second, separated by a tab.
+static std::map<std::string, double> ReadBaseline(const std::string &filename) {
+    std::map<std::string, double> baseline;
+    std::ifstream in(filename);
+    if (!in) {
+        fprintf(stderr, "%s: unable to read baseline\n", filename.c_str());
+        exit(1);
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos) continue;
+        baseline[line.substr(0, tab)] = atof(line.c_str() + tab + 1);
+    }
+    return baseline;
+}
+
+static std::string FormatRate(double perSecond) {
+    const char *suffixes[] = {"", "k", "M", "G"};
+    int i = 0;
+    while (perSecond >= 1000 && i < 3) {
+        perSecond /= 1000;
+        ++i;
+    }
+    return StringPrintf("%.2f%s", perSecond, suffixes[i]);
+}
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_stderrthreshold = 1;  // Warning and above.
+
+    std::string baselineFile, saveBaselineFile, filter;
+    double minSeconds = 1, tolerance = 0.1;
+    bool list = false;
+    int nThreads = 0;
+    std::vector<std::string> scenes;
+    for (int i = 1; i < argc; ++i) {
+        auto value = [&]() {
+            if (i + 1 == argc) usage("missing value after %s argument", argv[i]);
+            return argv[++i];
+        };
+        if (!strcmp(argv[i], "--baseline"))
+            baselineFile = value();
+        else if (!strcmp(argv[i], "--filter"))
+            filter = value();
+        else if (!strcmp(argv[i], "--list"))
+            list = true;
+        else if (!strcmp(argv[i], "--mintime"))
+            minSeconds = atof(value());
+        else if (!strcmp(argv[i], "--nthreads"))
+            nThreads = atoi(value());
+        else if (!strcmp(argv[i], "--savebaseline"))
+            saveBaselineFile = value();
+        else if (!strcmp(argv[i], "--tolerance"))
+            tolerance = atof(value());
+        else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h"))
+            usage();
+        else if (argv[i][0] == '-')
+            usage("unknown option \"%s\"", argv[i]);
+        else
+            scenes.push_back(argv[i]);
+    }
+    RegisterBuiltinSceneBenchmarks(nThreads);
+    for (const std::string &scene : scenes)
+        RegisterSceneBenchmark(scene, nThreads);
+
+    std::vector<Benchmark> toRun;
+    std::regex filterRegex(filter.empty() ? ".*" : filter);
+    if (benchmarks)
+        for (const Benchmark &b : *benchmarks)
+            if (std::regex_search(b.name, filterRegex)) toRun.push_back(b);
+    std::stable_sort(toRun.begin(), toRun.end(),
+                     [](const Benchmark &a, const Benchmark &b) {
+                         return a.name < b.name;
+                     });
+    if (list) {
+        for (const Benchmark &b : toRun) printf("%s\n", b.name.c_str());
+        return 0;
+    }
+
+    std::map<std::string, double> baseline;
+    if (!baselineFile.empty()) baseline = ReadBaseline(baselineFile);
+
+    // Microbenchmarks run on a single thread
+    Options options;
+    options.nThreads = 1;
+    options.quiet = true;
+    PbrtOptions = options;
+    SampledSpectrum::Init();
+
+    printf("%-40s %12s %12s %18s %10s\n", "Benchmark", "Iterations",
+           "ns/item", "Throughput", "Baseline");
+    std::map<std::string, double> results;
+    int nRegressions = 0;
+    for (const Benchmark &b : toRun) {
+        BenchmarkState state(minSeconds);
+        b.func(state);
+        if (!state.SkipReason().empty()) {
+            printf("%-40s skipped: %s\n", b.name.c_str(),
+                   state.SkipReason().c_str());
+            continue;
+        }
+        double perSecond = state.Items() / state.Seconds();
+        results[b.name] = perSecond;
+        std::string comparison;
+        auto iter = baseline.find(b.name);
+        if (iter != baseline.end() && iter->second > 0) {
+            double change = perSecond / iter->second - 1;
+            comparison = StringPrintf("%+.1f%%", 100 * change);
+            if (change < -tolerance) {
+                comparison += " REGRESSION";
+                ++nRegressions;
+            }
+        }
+        printf("%-40s %12" PRId64 " %12.1f %18s %10s\n", b.name.c_str(),
+               state.Iterations(), 1e9 * state.Seconds() / state.Items(),
+               (FormatRate(perSecond) + " " + b.unit + "/s").c_str(),
+               comparison.c_str());
+        fflush(stdout);
+    }
+
+    if (!saveBaselineFile.empty()) {
+        // Keep the baseline's entries for benchmarks that weren't run.
+        std::map<std::string, double> saved = baseline;
+        if (saveBaselineFile != baselineFile) saved.clear();
+        for (const auto &r : results) saved[r.first] = r.second;
+        FILE *f = fopen(saveBaselineFile.c_str(), "w");
+        if (!f) {
+            fprintf(stderr, "%s: unable to write baseline\n",
+                    saveBaselineFile.c_str());
+            return 1;
+        }
+        for (const auto &s : saved)
+            fprintf(f, "%s\t%.6g\n", s.first.c_str(), s.second);
+        fclose(f);
+    }
+
+    if (nRegressions > 0) {
+        fprintf(stderr, "%d benchmark%s regressed by more than %.0f%%\n",
+                nRegressions, nRegressions > 1 ? "s" : "", 100 * tolerance);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+//
+// bench.h
+//
+// A minimal harness for pbrt_bench's microbenchmarks and scene benchmarks.
+// Benchmarks are functions that do their setup and then loop while
+// BenchmarkState::KeepRunning() returns true; the time spent in that loop
+// is divided by the number of items (rays, lookups, samples, ...) that
+// were processed.
+//
+
+#ifndef PBRT_BENCH_BENCH_H
+#define PBRT_BENCH_BENCH_H
+
+#include "pbrt.h"
+#include <chrono>
+#include <functional>
+
+namespace pbrt {
+
+// BenchmarkState Declarations
+class BenchmarkState {
+  public:
+    // BenchmarkState Public Methods
+    BenchmarkState(double minSeconds) : minSeconds(minSeconds) {}
+    bool KeepRunning() {
+        if (iterations < batchEnd) {
+            ++iterations;
+            return true;
+        }
+        return NextBatch();
+    }
+    // Each iteration of the benchmark's loop processes _n_ items.
+    void SetItemsPerIteration(int64_t n) { itemsPerIteration = n; }
+    // For benchmarks that count the items that they processed themselves.
+    void AddItems(int64_t n) { extraItems += n; }
+    void Skip(const std::string &reason) { skipReason = reason; }
+
+    int64_t Iterations() const { return iterations; }
+    int64_t Items() const { return iterations * itemsPerIteration + extraItems; }
+    double Seconds() const { return seconds; }
+    const std::string &SkipReason() const { return skipReason; }
+
+  private:
+    // BenchmarkState Private Methods
+    bool NextBatch();
+
+    // BenchmarkState Private Data
+    const double minSeconds;
+    int64_t iterations = 0, batchEnd = 0, batchSize = 1;
+    int64_t itemsPerIteration = 1, extraItems = 0;
+    bool started = false;
+    std::chrono::steady_clock::time_point startTime;
+    double seconds = 0;
+    std::string skipReason;
+};
+
+typedef std::function<void(BenchmarkState &)> BenchmarkFunction;
+
+// Registers a benchmark with the given name; _unit_ describes the items
+// it processes, e.g. "rays".
+void RegisterBenchmark(const std::string &name, const std::string &unit,
+                       BenchmarkFunction func);
+
+struct BenchmarkRegisterer {
+    BenchmarkRegisterer(const char *name, const char *unit,
+                        BenchmarkFunction func) {
+        RegisterBenchmark(name, unit, std::move(func));
+    }
+};
+
+// Registers end-to-end benchmarks that render pbrt's built-in scenes and
+// the given scene file, respectively, using _nThreads_ threads.
+void RegisterBuiltinSceneBenchmarks(int nThreads);
+void RegisterSceneBenchmark(const std::string &filename, int nThreads);
+
+#define PBRT_BENCHMARK(func, name, unit)                           \
+    static void func(BenchmarkState &state);                       \
+    static BenchmarkRegisterer func##Registerer(name, unit, func); \
+    static void func(BenchmarkState &state)
+
+}  // namespace pbrt
+
+#endif  // PBRT_BENCH_BENCH_H
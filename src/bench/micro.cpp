@@ -0,0 +1,435 @@
+//
+// micro.cpp
+//
+// Microbenchmarks for pbrt's performance-critical building blocks:
+// acceleration structures, shapes, texture filtering, BSDF sampling,
+// samplers, film accumulation and the IISPT neural network connection.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench/bench.h"
+#include "accelerators/bvh.h"
+#include "accelerators/curvebundle.h"
+#include "film.h"
+#include "filters/box.h"
+#include "filters/gaussian.h"
+#include "integrators/iisptnnconnector.h"
+#include "materials/glass.h"
+#include "materials/matte.h"
+#include "materials/metal.h"
+#include "materials/mirror.h"
+#include "materials/plastic.h"
+#include "materials/substrate.h"
+#include "materials/uber.h"
+#include "memory.h"
+#include "mipmap.h"
+#include "paramset.h"
+#include "primitive.h"
+#include "reflection.h"
+#include "rng.h"
+#include "samplers/halton.h"
+#include "samplers/random.h"
+#include "samplers/sobol.h"
+#include "samplers/stratified.h"
+#include "samplers/zerotwosequence.h"
+#include "sampling.h"
+#include "shapes/curve.h"
+#include "shapes/sphere.h"
+#include "shapes/triangle.h"
+
+namespace pbrt {
+
+// Microbenchmark Local Definitions
+static const int nQueries = 1024;
+
+static Transform identity;
+
+// Returns the triangles of a sphere tessellated with _nTheta_ x _nPhi_
+// quads and with a bumpy radius, so that the BVH isn't trivially balanced.
+static std::vector<std::shared_ptr<Shape>> BumpySphere(int nTheta, int nPhi) {
+    std::vector<Point3f> p;
+    for (int t = 0; t <= nTheta; ++t) {
+        Float theta = Pi * t / nTheta;
+        for (int ph = 0; ph < nPhi; ++ph) {
+            Float phi = 2 * Pi * ph / nPhi;
+            Float r = 1 + .05f * std::sin(7 * theta) * std::cos(11 * phi);
+            p.push_back(Point3f(0, 0, 0) +
+                        r * SphericalDirection(std::sin(theta),
+                                               std::cos(theta), phi));
+        }
+    }
+    std::vector<int> indices;
+    for (int t = 0; t < nTheta; ++t)
+        for (int ph = 0; ph < nPhi; ++ph) {
+            int v00 = t * nPhi + ph, v01 = t * nPhi + (ph + 1) % nPhi;
+            int v10 = v00 + nPhi, v11 = v01 + nPhi;
+            indices.insert(indices.end(), {v00, v10, v11, v00, v11, v01});
+        }
+    return CreateTriangleMesh(&identity, &identity, false, indices.size() / 3,
+                              indices.data(), p.size(), p.data(), nullptr,
+                              nullptr, nullptr, nullptr, nullptr);
+}
+
+// Rays start outside the unit sphere and point toward random points in a
+// sphere of radius 1.5 around the origin, so that most of them hit it.
+static std::vector<Ray> SphereQueryRays() {
+    RNG rng;
+    std::vector<Ray> rays;
+    for (int i = 0; i < nQueries; ++i) {
+        Point2f u(rng.UniformFloat(), rng.UniformFloat());
+        Point3f o = Point3f(0, 0, 0) + 3 * UniformSampleSphere(u);
+        u = Point2f(rng.UniformFloat(), rng.UniformFloat());
+        Point3f target = Point3f(0, 0, 0) +
+                         1.5f * std::cbrt(rng.UniformFloat()) *
+                             UniformSampleSphere(u);
+        rays.push_back(Ray(o, target - o));
+    }
+    return rays;
+}
+
+static std::shared_ptr<Primitive> BumpySphereBVH() {
+    std::vector<std::shared_ptr<Primitive>> prims;
+    for (const std::shared_ptr<Shape> &tri : BumpySphere(256, 200))
+        prims.push_back(std::make_shared<GeometricPrimitive>(
+            tri, nullptr, nullptr, MediumInterface()));
+    return std::make_shared<BVHAccel>(std::move(prims));
+}
+
+PBRT_BENCHMARK(BVHIntersect, "BVH/Intersect", "rays") {
+    std::shared_ptr<Primitive> bvh = BumpySphereBVH();
+    std::vector<Ray> rays = SphereQueryRays();
+    state.SetItemsPerIteration(rays.size());
+    while (state.KeepRunning()) {
+        for (const Ray &r : rays) {
+            Ray ray = r;
+            SurfaceInteraction isect;
+            bvh->Intersect(ray, &isect);
+        }
+    }
+}
+
+PBRT_BENCHMARK(BVHIntersectP, "BVH/IntersectP", "rays") {
+    std::shared_ptr<Primitive> bvh = BumpySphereBVH();
+    std::vector<Ray> rays = SphereQueryRays();
+    state.SetItemsPerIteration(rays.size());
+    while (state.KeepRunning())
+        for (const Ray &r : rays) bvh->IntersectP(r);
+}
+
+PBRT_BENCHMARK(TriangleIntersect, "Triangle/Intersect", "rays") {
+    int indices[3] = {0, 1, 2};
+    Point3f p[3] = {Point3f(-1, -1, 0), Point3f(1, -.5f, .2f),
+                    Point3f(0, 1, -.1f)};
+    std::shared_ptr<Shape> tri = CreateTriangleMesh(
+        &identity, &identity, false, 1, indices, 3, p, nullptr, nullptr,
+        nullptr, nullptr, nullptr)[0];
+    std::vector<Ray> rays = SphereQueryRays();
+    state.SetItemsPerIteration(rays.size());
+    while (state.KeepRunning()) {
+        for (const Ray &ray : rays) {
+            Float tHit;
+            SurfaceInteraction isect;
+            tri->Intersect(ray, &tHit, &isect);
+        }
+    }
+}
+
+// Returns the segments of a ball of hair: single-segment cylinder curves
+// growing out of the unit sphere with random bends.
+static std::vector<std::shared_ptr<Shape>> HairBall(int nStrands) {
+    RNG rng;
+    std::vector<std::shared_ptr<Shape>> segments;
+    for (int i = 0; i < nStrands; ++i) {
+        Vector3f dir = UniformSampleSphere(
+            Point2f(rng.UniformFloat(), rng.UniformFloat()));
+        Vector3f bend = .1f * UniformSampleSphere(
+            Point2f(rng.UniformFloat(), rng.UniformFloat()));
+        ParamSet params;
+        std::unique_ptr<Point3f[]> P(new Point3f[4]);
+        for (int j = 0; j < 4; ++j)
+            P[j] = Point3f(0, 0, 0) + (1 + .15f * j) * dir + Float(j) * bend;
+        params.AddPoint3f("P", std::move(P), 4);
+        std::unique_ptr<Float[]> width(new Float[1]{.01f});
+        params.AddFloat("width", std::move(width), 1);
+        std::unique_ptr<std::string[]> type(new std::string[1]{"cylinder"});
+        params.AddString("type", std::move(type), 1);
+        std::vector<std::shared_ptr<Shape>> s =
+            CreateCurveShape(&identity, &identity, false, params);
+        segments.insert(segments.end(), s.begin(), s.end());
+    }
+    return segments;
+}
+
+static void BenchmarkHairBall(BenchmarkState &state, bool bundles) {
+    std::vector<std::shared_ptr<Shape>> segments = HairBall(20000);
+    std::vector<std::shared_ptr<Primitive>> prims;
+    if (bundles)
+        prims = CreateCurveBundles(segments, nullptr, MediumInterface());
+    else
+        for (const std::shared_ptr<Shape> &s : segments)
+            prims.push_back(std::make_shared<GeometricPrimitive>(
+                s, nullptr, nullptr, MediumInterface()));
+    BVHAccel bvh(std::move(prims));
+    std::vector<Ray> rays = SphereQueryRays();
+    state.SetItemsPerIteration(rays.size());
+    while (state.KeepRunning()) {
+        for (const Ray &r : rays) {
+            Ray ray = r;
+            SurfaceInteraction isect;
+            bvh.Intersect(ray, &isect);
+        }
+    }
+}
+
+PBRT_BENCHMARK(CurveIntersect, "Curve/Intersect/segments", "rays") {
+    BenchmarkHairBall(state, false);
+}
+
+PBRT_BENCHMARK(CurveBundleIntersect, "Curve/Intersect/bundles", "rays") {
+    BenchmarkHairBall(state, true);
+}
+
+static std::unique_ptr<MIPMap<RGBSpectrum>> CheckerboardMIPMap(bool doTri) {
+    Point2i res(1024, 1024);
+    std::vector<RGBSpectrum> texels(res.x * res.y);
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x) {
+            Float rgb[3] = {Float(x) / res.x, Float(y) / res.y,
+                            ((x / 16) + (y / 16)) % 2 ? 1.f : .1f};
+            texels[y * res.x + x] = RGBSpectrum::FromRGB(rgb);
+        }
+    return std::unique_ptr<MIPMap<RGBSpectrum>>(new MIPMap<RGBSpectrum>(
+        res, texels.data(), doTri, 8.f, ImageWrap::Repeat));
+}
+
+PBRT_BENCHMARK(MIPMapTrilinear, "MIPMap/Lookup/Trilinear", "lookups") {
+    std::unique_ptr<MIPMap<RGBSpectrum>> mipmap = CheckerboardMIPMap(true);
+    RNG rng;
+    std::vector<Point2f> st(nQueries);
+    std::vector<Float> width(nQueries);
+    for (int i = 0; i < nQueries; ++i) {
+        st[i] = Point2f(rng.UniformFloat(), rng.UniformFloat());
+        width[i] = .01f * rng.UniformFloat();
+    }
+    state.SetItemsPerIteration(nQueries);
+    while (state.KeepRunning())
+        for (int i = 0; i < nQueries; ++i) mipmap->Lookup(st[i], width[i]);
+}
+
+PBRT_BENCHMARK(MIPMapEWA, "MIPMap/Lookup/EWA", "lookups") {
+    std::unique_ptr<MIPMap<RGBSpectrum>> mipmap = CheckerboardMIPMap(false);
+    RNG rng;
+    std::vector<Point2f> st(nQueries);
+    std::vector<Vector2f> dstdx(nQueries), dstdy(nQueries);
+    for (int i = 0; i < nQueries; ++i) {
+        st[i] = Point2f(rng.UniformFloat(), rng.UniformFloat());
+        // Anisotropic footprints, as seen at grazing angles.
+        dstdx[i] = Vector2f(.004f * rng.UniformFloat(), .001f);
+        dstdy[i] = Vector2f(.0005f, .02f * rng.UniformFloat());
+    }
+    state.SetItemsPerIteration(nQueries);
+    while (state.KeepRunning())
+        for (int i = 0; i < nQueries; ++i)
+            mipmap->Lookup(st[i], dstdx[i], dstdy[i]);
+}
+
+// Registers a BSDF::Sample_f() benchmark for each of the commonly used
+// materials with their default parameters.
+static bool RegisterBSDFBenchmarks() {
+    typedef Material *(*CreateMaterialFunc)(const TextureParams &);
+    std::vector<std::pair<const char *, CreateMaterialFunc>> materials = {
+        {"glass",
+         [](const TextureParams &tp) -> Material * {
+             return CreateGlassMaterial(tp);
+         }},
+        {"matte",
+         [](const TextureParams &tp) -> Material * {
+             return CreateMatteMaterial(tp);
+         }},
+        {"metal",
+         [](const TextureParams &tp) -> Material * {
+             return CreateMetalMaterial(tp);
+         }},
+        {"mirror",
+         [](const TextureParams &tp) -> Material * {
+             return CreateMirrorMaterial(tp);
+         }},
+        {"plastic",
+         [](const TextureParams &tp) -> Material * {
+             return CreatePlasticMaterial(tp);
+         }},
+        {"substrate",
+         [](const TextureParams &tp) -> Material * {
+             return CreateSubstrateMaterial(tp);
+         }},
+        {"uber",
+         [](const TextureParams &tp) -> Material * {
+             return CreateUberMaterial(tp);
+         }}};
+    for (const auto &m : materials) {
+        CreateMaterialFunc create = m.second;
+        RegisterBenchmark(
+            std::string("BSDF/Sample_f/") + m.first, "samples",
+            [create](BenchmarkState &state) {
+                ParamSet geomParams, materialParams;
+                std::map<std::string, std::shared_ptr<Texture<Float>>>
+                    floatTextures;
+                std::map<std::string, std::shared_ptr<Texture<Spectrum>>>
+                    spectrumTextures;
+                TextureParams tp(geomParams, materialParams, floatTextures,
+                                 spectrumTextures);
+                std::unique_ptr<Material> material(create(tp));
+
+                // Find a surface point to sample the BSDF at
+                Sphere sphere(&identity, &identity, false, 1, -1, 1, 360);
+                Ray ray(Point3f(.3f, .2f, -3), Vector3f(0, 0, 1));
+                Float tHit;
+                SurfaceInteraction isect;
+                CHECK(sphere.Intersect(ray, &tHit, &isect, true));
+                MemoryArena arena;
+                material->ComputeScatteringFunctions(
+                    &isect, arena, TransportMode::Radiance, true);
+
+                RNG rng;
+                std::vector<Point2f> u(nQueries);
+                for (Point2f &s : u)
+                    s = Point2f(rng.UniformFloat(), rng.UniformFloat());
+                Vector3f wo = -ray.d;
+                state.SetItemsPerIteration(nQueries);
+                while (state.KeepRunning()) {
+                    for (const Point2f &s : u) {
+                        Vector3f wi;
+                        Float pdf;
+                        BxDFType sampledType;
+                        isect.bsdf->Sample_f(wo, &wi, s, &pdf, BSDF_ALL,
+                                             &sampledType);
+                    }
+                }
+            });
+    }
+    return true;
+}
+
+static bool bsdfBenchmarksRegistered = RegisterBSDFBenchmarks();
+
+// Generates the samples that a path tracer with a few bounces would
+// request for each of the pixel samples in a 64x64 block of pixels.
+static void BenchmarkSampler(BenchmarkState &state, Sampler &sampler) {
+    Bounds2i pixels(Point2i(0, 0), Point2i(64, 64));
+    auto pixelIter = begin(pixels);
+    state.SetItemsPerIteration(sampler.samplesPerPixel);
+    while (state.KeepRunning()) {
+        sampler.StartPixel(*pixelIter);
+        do {
+            for (int i = 0; i < 8; ++i) {
+                sampler.Get1D();
+                sampler.Get2D();
+            }
+        } while (sampler.StartNextSample());
+        if (++pixelIter == end(pixels)) pixelIter = begin(pixels);
+    }
+}
+
+static const Bounds2i samplerBounds(Point2i(0, 0), Point2i(64, 64));
+
+PBRT_BENCHMARK(SamplerHalton, "Sampler/halton", "samples") {
+    HaltonSampler sampler(16, samplerBounds);
+    BenchmarkSampler(state, sampler);
+}
+
+PBRT_BENCHMARK(SamplerRandom, "Sampler/random", "samples") {
+    RandomSampler sampler(16);
+    BenchmarkSampler(state, sampler);
+}
+
+PBRT_BENCHMARK(SamplerSobol, "Sampler/sobol", "samples") {
+    SobolSampler sampler(16, samplerBounds);
+    BenchmarkSampler(state, sampler);
+}
+
+PBRT_BENCHMARK(SamplerStratified, "Sampler/stratified", "samples") {
+    StratifiedSampler sampler(4, 4, true, 8);
+    BenchmarkSampler(state, sampler);
+}
+
+PBRT_BENCHMARK(SamplerZeroTwo, "Sampler/02sequence", "samples") {
+    ZeroTwoSequenceSampler sampler(16, 8);
+    BenchmarkSampler(state, sampler);
+}
+
+static void BenchmarkFilmTile(BenchmarkState &state,
+                              std::unique_ptr<Filter> filter) {
+    Film film(Point2i(256, 256), Bounds2f(Point2f(0, 0), Point2f(1, 1)),
+              std::move(filter), 35.f, "pbrt_bench.pfm", 1.f);
+    Bounds2i tileBounds(Point2i(64, 64), Point2i(80, 80));
+    std::unique_ptr<FilmTile> tile = film.GetFilmTile(tileBounds);
+    RNG rng;
+    std::vector<Point2f> pFilm(nQueries);
+    for (Point2f &p : pFilm)
+        p = Point2f(64 + 16 * rng.UniformFloat(), 64 + 16 * rng.UniformFloat());
+    Float rgb[3] = {.5f, .25f, 1.f};
+    Spectrum L = Spectrum::FromRGB(rgb);
+    state.SetItemsPerIteration(nQueries);
+    while (state.KeepRunning())
+        for (const Point2f &p : pFilm) tile->AddSample(p, L);
+}
+
+PBRT_BENCHMARK(FilmAddSampleBox, "Film/AddSample/box", "samples") {
+    BenchmarkFilmTile(state, std::unique_ptr<Filter>(
+                                 new BoxFilter(Vector2f(.5f, .5f))));
+}
+
+PBRT_BENCHMARK(FilmAddSampleGaussian, "Film/AddSample/gaussian", "samples") {
+    BenchmarkFilmTile(state, std::unique_ptr<Filter>(new GaussianFilter(
+                                 Vector2f(2, 2), 2.f)));
+}
+
+// The network is replaced with a stub that echoes the intensity
+// hemisphere back, so that this measures the cost of serializing the
+// auxiliary buffers and of the pipe round trip rather than inference.
+static const char *nnStubScript = R"(import sys
+n = %d
+inp, out = sys.stdin.buffer, sys.stdout.buffer
+while True:
+    data = inp.read(7 * n * n * 4)
+    if len(data) < 7 * n * n * 4:
+        break
+    out.write(data[:3 * n * n * 4])
+    out.write(b"x\n")
+    out.flush()
+)";
+
+PBRT_BENCHMARK(IisptNnRoundTrip, "IISPT/NnConnector/RoundTrip", "requests") {
+    if (system("python3 -c pass > /dev/null 2>&1") != 0) {
+        state.Skip("python3 is not available");
+        return;
+    }
+    const char *stubPath = "pbrt_bench_nn_stub.py";
+    FILE *f = fopen(stubPath, "w");
+    if (!f) {
+        state.Skip("unable to write the network stub");
+        return;
+    }
+    int hemiSize = PbrtOptions.iisptHemiSize;
+    fprintf(f, nnStubScript, hemiSize);
+    fclose(f);
+    setenv("IISPT_STDIO_NET_PY_PATH", stubPath, 1);
+
+    IisptNnConnector connector;
+    IntensityFilm intensity(hemiSize, hemiSize);
+    DistanceFilm distance(hemiSize, hemiSize);
+    NormalFilm normals(hemiSize, hemiSize);
+    while (state.KeepRunning()) {
+        int status;
+        connector.communicate(&intensity, &distance, &normals, status);
+        if (status != 0) {
+            state.Skip("the network stub failed");
+            break;
+        }
+    }
+    connector.sendEOF();
+    remove(stubPath);
+}
+
+}  // namespace pbrt
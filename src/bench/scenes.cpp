@@ -0,0 +1,162 @@
+//
+// scenes.cpp
+//
+// End-to-end benchmarks that parse and render complete scenes; their
+// throughput is measured in rays traced per second.
+//
+
+#include <stdio.h>
+#include "bench/bench.h"
+#include "api.h"
+#include "parser.h"
+#include "stats.h"
+
+namespace pbrt {
+
+// Scene Benchmark Local Definitions
+static const char *benchImageFile = "pbrt_bench_scene.pfm";
+
+// A small box lit by an area light, with diffuse, glossy and specular
+// objects and a subdivision surface.
+static const char *pathScene = R"(
+LookAt 0 1 4.5  0 .8 0  0 1 0
+Camera "perspective" "float fov" 45
+Film "image" "integer xresolution" 96 "integer yresolution" 72
+Sampler "halton" "integer pixelsamples" 8
+Integrator "%s" "integer maxdepth" 5
+WorldBegin
+AttributeBegin
+Translate 0 2.49 0
+AreaLightSource "diffuse" "rgb L" [8 8 8]
+Shape "trianglemesh" "integer indices" [0 1 2 0 2 3]
+    "point P" [-.5 0 -.5  .5 0 -.5  .5 0 .5  -.5 0 .5]
+AttributeEnd
+Material "matte" "rgb Kd" [.6 .6 .6]
+Shape "trianglemesh" "integer indices" [0 1 2 0 2 3  4 5 6 4 6 7  0 3 7 0 7 4]
+    "point P" [-1.5 0 -1.5  1.5 0 -1.5  1.5 0 1.5  -1.5 0 1.5
+               -1.5 2.5 -1.5  1.5 2.5 -1.5  1.5 2.5 1.5  -1.5 2.5 1.5]
+AttributeBegin
+Material "matte" "rgb Kd" [.6 .1 .1]
+Shape "trianglemesh" "integer indices" [0 1 2 0 2 3]
+    "point P" [-1.5 0 -1.5  -1.5 0 1.5  -1.5 2.5 1.5  -1.5 2.5 -1.5]
+Material "matte" "rgb Kd" [.1 .6 .1]
+Shape "trianglemesh" "integer indices" [0 1 2 0 2 3]
+    "point P" [1.5 0 -1.5  1.5 2.5 -1.5  1.5 2.5 1.5  1.5 0 1.5]
+AttributeEnd
+AttributeBegin
+Translate -.7 .5 -.3
+Material "plastic" "rgb Kd" [.2 .3 .6] "float roughness" .05
+Shape "sphere" "float radius" .5
+AttributeEnd
+AttributeBegin
+Translate .7 .4 .4
+Material "glass"
+Shape "sphere" "float radius" .4
+AttributeEnd
+AttributeBegin
+Translate .2 1.4 -.8
+Scale .4 .4 .4
+Material "metal" "float roughness" .1
+Shape "loopsubdiv" "integer levels" 4 "integer indices"
+    [0 1 2  0 2 3  0 3 4  0 4 1  5 2 1  5 3 2  5 4 3  5 1 4]
+    "point P" [0 1 0  1 0 0  0 0 1  -1 0 0  0 0 -1  0 -1 0]
+AttributeEnd
+WorldEnd
+)";
+
+// A homogeneous scattering medium in front of a diffuse backdrop.
+static const char *volpathScene = R"(
+LookAt 0 1 5  0 .5 0  0 1 0
+Camera "perspective" "float fov" 40
+Film "image" "integer xresolution" 96 "integer yresolution" 72
+Sampler "halton" "integer pixelsamples" 8
+Integrator "volpath" "integer maxdepth" 8
+WorldBegin
+LightSource "infinite" "rgb L" [.3 .35 .4]
+LightSource "spot" "point from" [2 4 3] "point to" [0 .5 0]
+    "float coneangle" 30 "rgb I" [40 40 40]
+MakeNamedMedium "smoke" "string type" "homogeneous"
+    "rgb sigma_a" [.2 .2 .2] "rgb sigma_s" [1.5 1.5 1.5] "float g" .4
+AttributeBegin
+MediumInterface "smoke" ""
+Material ""
+Translate 0 .8 0
+Shape "sphere" "float radius" 1
+AttributeEnd
+Material "matte" "rgb Kd" [.5 .5 .5]
+Shape "trianglemesh" "integer indices" [0 1 2 0 2 3]
+    "point P" [-5 -.5 -5  5 -.5 -5  5 -.5 5  -5 -.5 5]
+WorldEnd
+)";
+
+static std::string WriteBuiltinScene(const std::string &name,
+                                     const std::string &text) {
+    std::string filename = "pbrt_bench_" + name + ".pbrt";
+    FILE *f = fopen(filename.c_str(), "w");
+    if (!f) return "";
+    fputs(text.c_str(), f);
+    fclose(f);
+    return filename;
+}
+
+// Renders _filename_ once per iteration and counts the camera and shadow
+// rays that were traced, as reported by the scene's intersection counters.
+static void RenderScene(BenchmarkState &state, const std::string &filename,
+                        int nThreads) {
+    if (filename.empty()) {
+        state.Skip("unable to write the scene file");
+        return;
+    }
+    Options saved = PbrtOptions;
+    Options options;
+    options.nThreads = nThreads;
+    options.quiet = true;
+    options.imageFile = benchImageFile;
+    state.SetItemsPerIteration(0);
+    while (state.KeepRunning()) {
+        ClearStats();
+        pbrtInit(options);
+        ParseFile(filename);
+        pbrtCleanup();
+        state.AddItems(
+            GetStatsCounter("Intersections/Regular ray intersection tests") +
+            GetStatsCounter("Intersections/Shadow ray intersection tests"));
+    }
+    ClearStats();
+    remove(benchImageFile);
+    PbrtOptions = saved;
+}
+
+// Scene Benchmark Definitions
+void RegisterBuiltinSceneBenchmarks(int nThreads) {
+    struct {
+        const char *name, *format, *integrator;
+    } scenes[] = {{"bdpt", pathScene, "bdpt"},
+                  {"path", pathScene, "path"},
+                  {"volpath", volpathScene, ""}};
+    for (const auto &s : scenes) {
+        char text[4096];
+        snprintf(text, sizeof(text), s.format, s.integrator);
+        std::string name = s.name, sceneText = text;
+        RegisterBenchmark("Scene/builtin/" + name, "rays",
+                          [name, sceneText, nThreads](BenchmarkState &state) {
+                              std::string filename =
+                                  WriteBuiltinScene(name, sceneText);
+                              RenderScene(state, filename, nThreads);
+                              if (!filename.empty()) remove(filename.c_str());
+                          });
+    }
+}
+
+void RegisterSceneBenchmark(const std::string &filename, int nThreads) {
+    // Name the benchmark after the scene file's name, without the directory
+    size_t slash = filename.find_last_of('/');
+    std::string base =
+        slash == std::string::npos ? filename : filename.substr(slash + 1);
+    RegisterBenchmark("Scene/" + base, "rays",
+                      [filename, nThreads](BenchmarkState &state) {
+                          RenderScene(state, filename, nThreads);
+                      });
+}
+
+}  // namespace pbrt
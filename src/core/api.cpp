@@ -39,10 +39,15 @@
 #include "film.h"
 #include "medium.h"
 #include "stats.h"
+#include "geomcache.h"
+#include "imageio.h"
+#include "texcache.h"
 
 // API Additional Headers
 #include "accelerators/bvh.h"
+#include "accelerators/curvebundle.h"
 #include "accelerators/kdtreeaccel.h"
+#include "accelerators/instancing.h"
 #include "cameras/environment.h"
 #include "cameras/orthographic.h"
 #include "cameras/perspective.h"
@@ -60,6 +65,7 @@
 #include "integrators/path.h"
 #include "integrators/sppm.h"
 #include "integrators/volpath.h"
+#include "integrators/wavefront.h"
 #include "integrators/whitted.h"
 #include "lights/diffuse.h"
 #include "lights/distant.h"
@@ -181,6 +187,8 @@ struct RenderOptions {
     std::map<std::string, std::shared_ptr<Medium>> namedMedia;
     std::vector<std::shared_ptr<Light>> lights;
     std::vector<std::shared_ptr<Primitive>> primitives;
+    // Object instances, which go in the scene's top-level BVH
+    std::vector<std::shared_ptr<Primitive>> instancePrimitives;
     std::map<std::string, std::vector<std::shared_ptr<Primitive>>> instances;
     std::vector<std::shared_ptr<Primitive>> *currentInstance = nullptr;
     bool haveScatteringMedia = false;
@@ -292,8 +300,8 @@ class TransformCache {
 
     void Clear() {
         transformCacheBytes += arena.TotalAllocated() + hashTable.size() * sizeof(Transform *);
-        hashTable.resize(512);
         hashTable.clear();
+        hashTable.resize(512);
         hashTableOccupancy = 0;
         arena.Reset();
     }
@@ -538,6 +546,34 @@ std::vector<std::shared_ptr<Shape>> MakeShapes(const std::string &name,
     return shapes;
 }
 
+// Returns a function that creates the triangles of the shapes that can be
+// tessellated on demand, or an empty function for other shapes or if the
+// shape's parameters are invalid.
+static ShapeTessellator MakeShapeTessellator(const std::string &name,
+                                             const Transform *object2world,
+                                             const Transform *world2object,
+                                             bool reverseOrientation,
+                                             const ParamSet &paramSet,
+                                             Bounds3f *worldBound) {
+    if (name == "heightfield")
+        return CreateHeightfieldTessellator(object2world, world2object,
+                                            reverseOrientation, paramSet,
+                                            worldBound);
+    else if (name == "loopsubdiv")
+        return CreateLoopSubdivTessellator(object2world, world2object,
+                                           reverseOrientation, paramSet,
+                                           worldBound);
+    else if (name == "nurbs")
+        return CreateNURBSTessellator(object2world, world2object,
+                                      reverseOrientation, paramSet,
+                                      worldBound);
+    return nullptr;
+}
+
+static bool IsTessellatedShape(const std::string &name) {
+    return name == "heightfield" || name == "loopsubdiv" || name == "nurbs";
+}
+
 STAT_COUNTER("Scene/Materials created", nMaterialsCreated);
 
 std::shared_ptr<Material> MakeMaterial(const std::string &name,
@@ -599,6 +635,7 @@ std::shared_ptr<Material> MakeMaterial(const std::string &name,
 
     if ((name == "subsurface" || name == "kdsubsurface") &&
         (renderOptions->IntegratorName != "path" &&
+         renderOptions->IntegratorName != "wavefront" &&
          (renderOptions->IntegratorName != "volpath")))
         Warning(
             "Subsurface scattering material \"%s\" used, but \"%s\" "
@@ -684,9 +721,12 @@ std::shared_ptr<Texture<Spectrum>> MakeSpectrumTexture(
     return std::shared_ptr<Texture<Spectrum>>(tex);
 }
 
-std::shared_ptr<Medium> MakeMedium(const std::string &name,
-                                   const ParamSet &paramSet,
-                                   const Transform &medium2world) {
+// If _densityVolume_ is provided, it holds the already-encoded inline
+// "density" values of a heterogeneous medium.
+std::shared_ptr<Medium> MakeMedium(
+    const std::string &name, const ParamSet &paramSet,
+    const Transform &medium2world,
+    std::unique_ptr<GridVolume> densityVolume = nullptr) {
     Float sig_a_rgb[3] = {.0011f, .0024f, .014f},
           sig_s_rgb[3] = {2.55f, 3.21f, 3.77f};
     Spectrum sig_a = Spectrum::FromRGB(sig_a_rgb),
@@ -704,28 +744,43 @@ std::shared_ptr<Medium> MakeMedium(const std::string &name,
     if (name == "homogeneous") {
         m = new HomogeneousMedium(sig_a, sig_s, g);
     } else if (name == "heterogeneous") {
-        int nitems;
-        const Float *data = paramSet.FindFloat("density", &nitems);
-        if (!data) {
-            Error("No \"density\" values provided for heterogeneous medium?");
-            return NULL;
-        }
-        int nx = paramSet.FindOneInt("nx", 1);
-        int ny = paramSet.FindOneInt("ny", 1);
-        int nz = paramSet.FindOneInt("nz", 1);
         Point3f p0 = paramSet.FindOnePoint3f("p0", Point3f(0.f, 0.f, 0.f));
         Point3f p1 = paramSet.FindOnePoint3f("p1", Point3f(1.f, 1.f, 1.f));
-        if (nitems != nx * ny * nz) {
-            Error(
-                "GridDensityMedium has %d density values; expected nx*ny*nz = "
-                "%d",
-                nitems, nx * ny * nz);
-            return NULL;
+        std::string filename = paramSet.FindOneFilename("filename", "");
+        std::unique_ptr<GridVolume> volume;
+        if (!filename.empty()) {
+            // Use density values from a volume file
+            volume = GridVolume::Read(filename);
+            if (!volume) return NULL;
+        } else {
+            int nitems;
+            const Float *data = paramSet.FindFloat("density", &nitems);
+            if (!data) {
+                Error("No \"density\" values provided for heterogeneous medium?");
+                return NULL;
+            }
+            int nx = paramSet.FindOneInt("nx", 1);
+            int ny = paramSet.FindOneInt("ny", 1);
+            int nz = paramSet.FindOneInt("nz", 1);
+            if (nitems != nx * ny * nz) {
+                Error(
+                    "GridDensityMedium has %d density values; expected nx*ny*nz = "
+                    "%d",
+                    nitems, nx * ny * nz);
+                return NULL;
+            }
+            GridEncoding encoding;
+            if (!ParseGridEncoding(paramSet.FindOneString("encoding", "float"),
+                                   &encoding))
+                return NULL;
+            volume = densityVolume
+                         ? std::move(densityVolume)
+                         : GridVolume::Encode(nx, ny, nz, data, encoding);
         }
         Transform data2Medium = Translate(Vector3f(p0)) *
                                 Scale(p1.x - p0.x, p1.y - p0.y, p1.z - p0.z);
-        m = new GridDensityMedium(sig_a, sig_s, g, nx, ny, nz,
-                                  medium2world * data2Medium, data);
+        m = new GridDensityMedium(sig_a, sig_s, g, std::move(volume),
+                                  medium2world * data2Medium);
     } else
         Warning("Medium \"%s\" unknown.", name.c_str());
     paramSet.ReportUnused();
@@ -911,6 +966,13 @@ void pbrtInit(const Options &opt) {
     ParallelInit();  // Threads must be launched before the profiler is
                      // initialized.
     InitProfiler();
+    if (!PbrtOptions.statsFile.empty())
+        InitStatsTelemetry(PbrtOptions.statsFile, PbrtOptions.statsInterval);
+    if (PbrtOptions.textureCacheMB > 0)
+        TextureTileCache::Init(int64_t(PbrtOptions.textureCacheMB) << 20);
+    if (PbrtOptions.geometryCacheMB > 0)
+        GeometryCache::Init(int64_t(PbrtOptions.geometryCacheMB) << 20);
+    InitImageIO();
 }
 
 void pbrtCleanup() {
@@ -920,8 +982,14 @@ void pbrtCleanup() {
     else if (currentApiState == APIState::WorldBlock)
         Error("pbrtCleanup() called while inside world block.");
     currentApiState = APIState::Uninitialized;
+    // Finish writing the images that are still queued before exiting.
+    CleanupImageIO();
+    CleanupStatsTelemetry();
     ParallelCleanup();
     CleanupProfiler();
+    TextureTileCache::Cleanup();
+    ClearInstancingCaches();
+    GeometryCache::Cleanup();
 }
 
 void pbrtIdentity() {
@@ -1132,9 +1200,48 @@ void pbrtMakeNamedMedium(const std::string &name, const ParamSet &params) {
     VERIFY_INITIALIZED("MakeNamedMedium");
     WARN_IF_ANIMATED_TRANSFORM("MakeNamedMedium");
     std::string type = params.FindOneString("type", "");
-    if (type == "")
+    if (type == "") {
         Error("No parameter string \"type\" found in MakeNamedMedium");
-    else {
+    } else if (PbrtOptions.toPly && type == "heterogeneous") {
+        int nitems;
+        const Float *data = params.FindFloat("density", &nitems);
+        GridEncoding encoding;
+        if (data && nitems >= 4096 &&
+            ParseGridEncoding(params.FindOneString("encoding", "float"),
+                              &encoding) &&
+            nitems == params.FindOneInt("nx", 1) * params.FindOneInt("ny", 1) *
+                          params.FindOneInt("nz", 1)) {
+            // Move the density values of large media to a volume file
+            static int count = 1;
+            const char *volumePrefix =
+                getenv("VOLUME_PREFIX") ? getenv("VOLUME_PREFIX") : "volume";
+            std::string fn =
+                StringPrintf("%s_%05d.pbrtvol", volumePrefix, count++);
+            std::unique_ptr<GridVolume> volume = GridVolume::Encode(
+                params.FindOneInt("nx", 1), params.FindOneInt("ny", 1),
+                params.FindOneInt("nz", 1), data, encoding);
+            if (!volume->Write(fn))
+                Error("Unable to write volume file \"%s\"", fn.c_str());
+            // The medium reuses the encoded volume rather than encoding
+            // the density values again
+            std::shared_ptr<Medium> medium =
+                MakeMedium(type, params, curTransform[0], std::move(volume));
+            if (medium) renderOptions->namedMedia[name] = medium;
+
+            ParamSet ps = params;
+            ps.EraseFloat("density");
+            ps.EraseInt("nx");
+            ps.EraseInt("ny");
+            ps.EraseInt("nz");
+            ps.EraseString("encoding");
+            printf("%*sMakeNamedMedium \"%s\" \"string filename\" \"%s\" ",
+                   catIndentCount, "", name.c_str(), fn.c_str());
+            ps.Print(catIndentCount);
+            printf("\n");
+            return;
+        }
+    }
+    if (type != "") {
         std::shared_ptr<Medium> medium =
             MakeMedium(type, params, curTransform[0]);
         if (medium) renderOptions->namedMedia[name] = medium;
@@ -1378,7 +1485,24 @@ void pbrtShape(const std::string &name, const ParamSet &params) {
         printf("\n");
     }
 
-    if (!curTransform.IsAnimated()) {
+    if (!curTransform.IsAnimated() && GeometryCache::Get() &&
+        graphicsState.areaLight == "" && IsTessellatedShape(name) &&
+        !PbrtOptions.cat && !PbrtOptions.toPly) {
+        // Initialize _prims_ for shape that's tessellated on demand
+        Transform *ObjToWorld = transformCache.Lookup(curTransform[0]);
+        Transform *WorldToObj = transformCache.Lookup(Inverse(curTransform[0]));
+        Bounds3f worldBound;
+        ShapeTessellator tessellate = MakeShapeTessellator(
+            name, ObjToWorld, WorldToObj, graphicsState.reverseOrientation,
+            params, &worldBound);
+        if (!tessellate) return;
+        std::shared_ptr<Material> mtl = graphicsState.GetMaterialForShape(params);
+        params.ReportUnused();
+        MediumInterface mi = graphicsState.CreateMediumInterface();
+        prims.push_back(std::make_shared<TessellatedPrimitive>(
+            std::move(tessellate), worldBound, ObjToWorld, WorldToObj,
+            graphicsState.reverseOrientation, mtl, mi));
+    } else if (!curTransform.IsAnimated()) {
         // Initialize _prims_ and _areaLights_ for static shape
 
         // Create shapes for shape _name_
@@ -1391,17 +1515,23 @@ void pbrtShape(const std::string &name, const ParamSet &params) {
         std::shared_ptr<Material> mtl = graphicsState.GetMaterialForShape(params);
         params.ReportUnused();
         MediumInterface mi = graphicsState.CreateMediumInterface();
-        prims.reserve(shapes.size());
-        for (auto s : shapes) {
-            // Possibly create area light for shape
-            std::shared_ptr<AreaLight> area;
-            if (graphicsState.areaLight != "") {
-                area = MakeAreaLight(graphicsState.areaLight, curTransform[0],
-                                     mi, graphicsState.areaLightParams, s);
-                if (area) areaLights.push_back(area);
+        if (name == "curve" && graphicsState.areaLight == "")
+            // Intersect the curve's segments a bundle at a time
+            prims = CreateCurveBundles(shapes, mtl, mi);
+        else {
+            prims.reserve(shapes.size());
+            for (auto s : shapes) {
+                // Possibly create area light for shape
+                std::shared_ptr<AreaLight> area;
+                if (graphicsState.areaLight != "") {
+                    area = MakeAreaLight(graphicsState.areaLight,
+                                         curTransform[0], mi,
+                                         graphicsState.areaLightParams, s);
+                    if (area) areaLights.push_back(area);
+                }
+                prims.push_back(
+                    std::make_shared<GeometricPrimitive>(s, mtl, area, mi));
             }
-            prims.push_back(
-                std::make_shared<GeometricPrimitive>(s, mtl, area, mi));
         }
     } else {
         // Initialize _prims_ and _areaLights_ for animated shape
@@ -1420,10 +1550,14 @@ void pbrtShape(const std::string &name, const ParamSet &params) {
         std::shared_ptr<Material> mtl = graphicsState.GetMaterialForShape(params);
         params.ReportUnused();
         MediumInterface mi = graphicsState.CreateMediumInterface();
-        prims.reserve(shapes.size());
-        for (auto s : shapes)
-            prims.push_back(
-                std::make_shared<GeometricPrimitive>(s, mtl, nullptr, mi));
+        if (name == "curve")
+            prims = CreateCurveBundles(shapes, mtl, mi);
+        else {
+            prims.reserve(shapes.size());
+            for (auto s : shapes)
+                prims.push_back(
+                    std::make_shared<GeometricPrimitive>(s, mtl, nullptr, mi));
+        }
 
         // Create single _TransformedPrimitive_ for _prims_
 
@@ -1606,11 +1740,22 @@ void pbrtObjectInstance(const std::string &name) {
     if (in.empty()) return;
     ++nObjectInstancesUsed;
     if (in.size() > 1) {
-        // Create aggregate for instance _Primitive_s
-        std::shared_ptr<Primitive> accel(
-            MakeAccelerator(renderOptions->AcceleratorName, std::move(in),
-                            renderOptions->AcceleratorParams));
-        if (!accel) accel = std::make_shared<BVHAccel>(in);
+        // Create aggregate for instance _Primitive_s, or reuse the one
+        // built for the same geometry in an earlier frame
+        uint64_t signature = 0;
+        std::shared_ptr<Primitive> accel;
+        if (PbrtOptions.reuseInstances) {
+            signature = InstanceSignature(in);
+            accel = LookupInstanceAggregate(name, signature);
+        }
+        if (!accel) {
+            accel = MakeAccelerator(renderOptions->AcceleratorName,
+                                    std::move(in),
+                                    renderOptions->AcceleratorParams);
+            if (!accel) accel = std::make_shared<BVHAccel>(in);
+            if (PbrtOptions.reuseInstances)
+                CacheInstanceAggregate(name, signature, accel);
+        }
         in.clear();
         in.push_back(accel);
     }
@@ -1626,7 +1771,7 @@ void pbrtObjectInstance(const std::string &name) {
         InstanceToWorld[1], renderOptions->transformEndTime);
     std::shared_ptr<Primitive> prim(
         std::make_shared<TransformedPrimitive>(in[0], animatedInstanceToWorld));
-    renderOptions->primitives.push_back(prim);
+    renderOptions->instancePrimitives.push_back(prim);
 }
 
 void pbrtWorldEnd() {
@@ -1668,15 +1813,23 @@ void pbrtWorldEnd() {
     // Clean up after rendering. Do this before reporting stats so that
     // destructors can run and update stats as needed.
     graphicsState = GraphicsState();
-    transformCache.Clear();
     currentApiState = APIState::OptionsBlock;
-    ImageTexture<Float, Float>::ClearCache();
-    ImageTexture<RGBSpectrum, Spectrum>::ClearCache();
+    // Instance aggregates kept for later frames refer to cached transforms
+    // and textures, so those caches are only cleared when they aren't kept.
+    if (!PbrtOptions.reuseInstances) {
+        transformCache.Clear();
+        ImageTexture<Float, Float>::ClearCache();
+        ImageTexture<RGBSpectrum, Spectrum>::ClearCache();
+    }
     renderOptions.reset(new RenderOptions);
+    EndInstancingFrame();
 
     if (!PbrtOptions.cat && !PbrtOptions.toPly) {
         MergeWorkerThreadStats();
         ReportThreadStats();
+        WriteStatsTelemetry(true);
+        if (!PbrtOptions.profileFile.empty())
+            WriteProfile(PbrtOptions.profileFile);
         if (!PbrtOptions.quiet) {
             PrintStats(stdout);
             ReportProfilerResults(stdout);
@@ -1692,12 +1845,22 @@ void pbrtWorldEnd() {
 }
 
 Scene *RenderOptions::MakeScene() {
-    std::shared_ptr<Primitive> accelerator =
-        MakeAccelerator(AcceleratorName, std::move(primitives), AcceleratorParams);
-    if (!accelerator) accelerator = std::make_shared<BVHAccel>(primitives);
+    std::shared_ptr<Primitive> accelerator;
+    if (!primitives.empty() || instancePrimitives.empty()) {
+        accelerator = MakeAccelerator(AcceleratorName, std::move(primitives),
+                                      AcceleratorParams);
+        if (!accelerator) accelerator = std::make_shared<BVHAccel>(primitives);
+    }
+    if (!instancePrimitives.empty()) {
+        // Build the top-level BVH over the object instances and the
+        // aggregate for the rest of the scene's primitives
+        if (accelerator) instancePrimitives.push_back(accelerator);
+        accelerator = BuildTopLevelBVH(std::move(instancePrimitives));
+    }
     Scene *scene = new Scene(accelerator, lights);
     // Erase primitives and lights from _RenderOptions_
     primitives.clear();
+    instancePrimitives.clear();
     lights.clear();
     return scene;
 }
@@ -1726,6 +1889,9 @@ Integrator *RenderOptions::MakeIntegrator() const {
         integrator = CreatePathIntegrator(IntegratorParams, sampler, camera);
     else if (IntegratorName == "volpath")
         integrator = CreateVolPathIntegrator(IntegratorParams, sampler, camera);
+    else if (IntegratorName == "wavefront")
+        integrator =
+            CreateWavefrontPathIntegrator(IntegratorParams, sampler, camera);
     else if (IntegratorName == "bdpt") {
         integrator = CreateBDPTIntegrator(IntegratorParams, sampler, camera);
     } else if (IntegratorName == "mlt") {
@@ -33,9 +33,15 @@
 
 // core/bssrdf.cpp*
 #include "bssrdf.h"
+#include "fileutil.h"
 #include "interpolation.h"
 #include "parallel.h"
 #include "scene.h"
+#include "stats.h"
+#include <cinttypes>
+#include <fstream>
+#include <map>
+#include <mutex>
 
 namespace pbrt {
 
@@ -174,6 +180,82 @@ void ComputeBeamDiffusionBSSRDF(Float g, Float eta, BSSRDFTable *t) {
     }, t->nRhoSamples);
 }
 
+STAT_COUNTER("Scene/BSSRDF tables computed", nBSSRDFTablesComputed);
+STAT_COUNTER("Scene/BSSRDF tables read from cache", nBSSRDFTablesRead);
+
+// Beam diffusion table files start with a magic string followed by the
+// number of rho and radius samples and _sizeof(Float)_, after which the
+// table's arrays are stored in the order they're declared in.
+static const char BSSRDFTableMagic[8] = {'P', 'B', 'R', 'T', 'S', 'S', 'S',
+                                         '1'};
+
+static std::vector<std::pair<Float *, size_t>> BSSRDFTableArrays(
+    const BSSRDFTable &t) {
+    size_t nProfile = size_t(t.nRhoSamples) * t.nRadiusSamples;
+    return {{t.rhoSamples.get(), t.nRhoSamples},
+            {t.radiusSamples.get(), t.nRadiusSamples},
+            {t.profile.get(), nProfile},
+            {t.rhoEff.get(), t.nRhoSamples},
+            {t.profileCDF.get(), nProfile}};
+}
+
+static bool ReadBSSRDFTable(const std::string &filename, BSSRDFTable *t) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) return false;
+    char magic[8];
+    int32_t header[3];
+    in.read(magic, sizeof(magic));
+    in.read((char *)header, sizeof(header));
+    if (!in || memcmp(magic, BSSRDFTableMagic, sizeof(magic)) != 0 ||
+        header[0] != t->nRhoSamples || header[1] != t->nRadiusSamples ||
+        header[2] != (int32_t)sizeof(Float))
+        return false;
+    for (const auto &array : BSSRDFTableArrays(*t))
+        in.read((char *)array.first, array.second * sizeof(Float));
+    return bool(in) && in.peek() == EOF;
+}
+
+static bool WriteBSSRDFTable(const std::string &filename,
+                             const BSSRDFTable &t) {
+    int32_t header[3] = {t.nRhoSamples, t.nRadiusSamples,
+                          (int32_t)sizeof(Float)};
+    return WriteFileAtomically(filename, [&](std::ostream &out) {
+        out.write(BSSRDFTableMagic, sizeof(BSSRDFTableMagic));
+        out.write((const char *)header, sizeof(header));
+        for (const auto &array : BSSRDFTableArrays(t))
+            out.write((const char *)array.first, array.second * sizeof(Float));
+    });
+}
+
+std::shared_ptr<const BSSRDFTable> GetBeamDiffusionBSSRDF(Float g, Float eta) {
+    static std::mutex mutex;
+    static std::map<std::pair<Float, Float>, std::shared_ptr<const BSSRDFTable>>
+        tables;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<const BSSRDFTable> &table = tables[std::make_pair(g, eta)];
+    if (table) return table;
+
+    std::unique_ptr<BSSRDFTable> t(new BSSRDFTable(100, 64));
+    std::string filename;
+    if (!PbrtOptions.bssrdfCacheDir.empty())
+        // Name the file after the parameters' exact bit patterns
+        filename = StringPrintf(
+            "%s/beamdiffusion-%016" PRIx64 "-%016" PRIx64 ".pbrtsss",
+            PbrtOptions.bssrdfCacheDir.c_str(), uint64_t(FloatToBits(g)),
+            uint64_t(FloatToBits(eta)));
+    if (!filename.empty() && ReadBSSRDFTable(filename, t.get()))
+        ++nBSSRDFTablesRead;
+    else {
+        ComputeBeamDiffusionBSSRDF(g, eta, t.get());
+        ++nBSSRDFTablesComputed;
+        if (!filename.empty() && !WriteBSSRDFTable(filename, *t))
+            Warning("%s: unable to write BSSRDF table cache",
+                    filename.c_str());
+    }
+    table = std::move(t);
+    return table;
+}
+
 void SubsurfaceFromDiffuse(const BSSRDFTable &t, const Spectrum &rhoEff,
                            const Spectrum &mfp, Spectrum *sigma_a,
                            Spectrum *sigma_s) {
@@ -174,6 +174,10 @@ Float BeamDiffusionSS(Float sigma_s, Float sigma_a, Float g, Float eta,
 Float BeamDiffusionMS(Float sigma_s, Float sigma_a, Float g, Float eta,
                       Float r);
 void ComputeBeamDiffusionBSSRDF(Float g, Float eta, BSSRDFTable *t);
+// Returns the beam diffusion table for the given parameters. It's computed
+// once per process for each _(g, eta)_ and, with the --bssrdfcache
+// option, read from and written to files in the given directory.
+std::shared_ptr<const BSSRDFTable> GetBeamDiffusionBSSRDF(Float g, Float eta);
 void SubsurfaceFromDiffuse(const BSSRDFTable &table, const Spectrum &rhoEff,
                            const Spectrum &mfp, Spectrum *sigma_a,
                            Spectrum *sigma_s);
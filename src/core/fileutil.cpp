@@ -33,10 +33,17 @@
 
 // core/fileutil.cpp*
 #include "fileutil.h"
+#include <atomic>
+#include <cstdio>
 #include <cstdlib>
 #include <climits>
-#ifndef PBRT_IS_WINDOWS
+#include <fstream>
+#ifdef PBRT_IS_WINDOWS
+#include <process.h>
+#define getpid _getpid
+#else
 #include <libgen.h>
+#include <unistd.h>
 #endif
 
 namespace pbrt {
@@ -126,4 +133,21 @@ void SetSearchDirectory(const std::string &dirname) {
     searchDirectory = dirname;
 }
 
+bool WriteFileAtomically(const std::string &filename,
+                         const std::function<void(std::ostream &)> &write) {
+    // The process id keeps concurrent renders from sharing a temporary
+    // file; the counter does the same for threads within this process.
+    static std::atomic<int> counter{0};
+    std::string tmpFilename = filename + ".tmp." + std::to_string(getpid()) +
+                              "." + std::to_string(counter++);
+    std::ofstream out(tmpFilename, std::ios::binary);
+    if (out) write(out);
+    out.close();
+    if (!out.good() || rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+        remove(tmpFilename.c_str());
+        return false;
+    }
+    return true;
+}
+
 }  // namespace pbrt
@@ -42,6 +42,8 @@
 #include "pbrt.h"
 #include <string>
 #include <cctype>
+#include <functional>
+#include <iosfwd>
 #include <string.h>
 
 namespace pbrt {
@@ -53,6 +55,14 @@ std::string ResolveFilename(const std::string &filename);
 std::string DirectoryContaining(const std::string &filename);
 void SetSearchDirectory(const std::string &dirname);
 
+// Calls _write_ to fill a uniquely named temporary file next to _filename_
+// and then renames it to _filename_, so that readers of _filename_ never
+// see a partially written file even if several processes write it at
+// once. Returns false, leaving no temporary file behind, if writing or
+// renaming fails.
+bool WriteFileAtomically(const std::string &filename,
+                         const std::function<void(std::ostream &)> &write);
+
 inline bool HasExtension(const std::string &value, const std::string &ending) {
     if (ending.size() > value.size()) return false;
     return std::equal(
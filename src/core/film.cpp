@@ -62,6 +62,14 @@ Film::Film(const Point2i &resolution, const Bounds2f &cropWindow,
     pixels = std::unique_ptr<Pixel[]>(new Pixel[croppedPixelBounds.Area()]);
     filmPixelMemory += croppedPixelBounds.Area() * sizeof(Pixel);
 
+    // Allocate block locks and per-thread splat buffers
+    Vector2i extent = croppedPixelBounds.Diagonal();
+    int blockSize = 1 << LogBlockSize;
+    nBlocksX = (extent.x + blockSize - 1) >> LogBlockSize;
+    int nBlocksY = (extent.y + blockSize - 1) >> LogBlockSize;
+    blockMutexes.reset(new std::mutex[std::max(1, nBlocksX * nBlocksY)]);
+    splatBuffers.resize(MaxThreadIndex() + 1);
+
     // Precompute filter weight table
     int offset = 0;
     for (int y = 0; y < filterTableWidth; ++y) {
@@ -116,6 +124,12 @@ std::shared_ptr<FilmTile> Film::GetFilmTileShared(const Bounds2i &sampleBounds)
 }
 
 void Film::Clear() {
+    for (SplatBuffer &buffer : splatBuffers) {
+        buffer.splats.clear();
+        if (buffer.image)
+            std::fill(&buffer.image[0],
+                      &buffer.image[3 * croppedPixelBounds.Area()], Float(0));
+    }
     for (Point2i p : croppedPixelBounds) {
         Pixel &pixel = GetPixel(p);
         for (int c = 0; c < 3; ++c)
@@ -135,16 +149,33 @@ void Film::MergeFilmTile(std::shared_ptr<FilmTile> tile) {
 void Film::MergeFilmTile(FilmTile* tile) {
     ProfilePhase p(Prof::MergeFilmTile);
     VLOG(1) << "Merging film tile " << tile->pixelBounds;
-    std::lock_guard<std::mutex> lock(mutex);
-    for (Point2i pixel : tile->GetPixelBounds()) {
-        // Merge _pixel_ into _Film::pixels_
-        const FilmTilePixel &tilePixel = tile->GetPixel(pixel);
-        Pixel &mergePixel = GetPixel(pixel);
-        Float xyz[3];
-        tilePixel.contribSum.ToXYZ(xyz);
-        for (int i = 0; i < 3; ++i) mergePixel.xyz[i] += xyz[i];
-        mergePixel.filterWeightSum += tilePixel.filterWeightSum;
-    }
+    Bounds2i tileBounds = tile->GetPixelBounds();
+    if (tileBounds.pMin.x >= tileBounds.pMax.x ||
+        tileBounds.pMin.y >= tileBounds.pMax.y)
+        return;
+
+    // Merge the tile one film block at a time, holding only that block's
+    // lock
+    Point2i b0 = BlockCoords(tileBounds.pMin);
+    Point2i b1 = BlockCoords(tileBounds.pMax - Vector2i(1, 1));
+    for (int by = b0.y; by <= b1.y; ++by)
+        for (int bx = b0.x; bx <= b1.x; ++bx) {
+            Point2i blockMin = croppedPixelBounds.pMin +
+                               Vector2i(bx << LogBlockSize, by << LogBlockSize);
+            Bounds2i blockBounds(
+                blockMin, blockMin + Vector2i(1 << LogBlockSize,
+                                              1 << LogBlockSize));
+            std::lock_guard<std::mutex> lock(blockMutexes[by * nBlocksX + bx]);
+            for (Point2i pixel : Intersect(tileBounds, blockBounds)) {
+                // Merge _pixel_ into _Film::pixels_
+                const FilmTilePixel &tilePixel = tile->GetPixel(pixel);
+                Pixel &mergePixel = GetPixel(pixel);
+                Float xyz[3];
+                tilePixel.contribSum.ToXYZ(xyz);
+                for (int i = 0; i < 3; ++i) mergePixel.xyz[i] += xyz[i];
+                mergePixel.filterWeightSum += tilePixel.filterWeightSum;
+            }
+        }
 }
 
 void Film::SetImage(const Spectrum *img) const {
@@ -177,10 +208,83 @@ void Film::AddSplat(const Point2f &p, Spectrum v) {
     if (!InsideExclusive((Point2i)p, croppedPixelBounds)) return;
     if (v.y() > maxSampleLuminance)
         v *= maxSampleLuminance / v.y();
-    Float xyz[3];
-    v.ToXYZ(xyz);
-    Pixel &pixel = GetPixel((Point2i)p);
-    for (int i = 0; i < 3; ++i) pixel.splatXYZ[i].Add(xyz[i]);
+
+    // Record the splat in this thread's buffer
+    DCHECK_LT(ThreadIndex, (int)splatBuffers.size() - 1);
+    if (!IsParallelThread()) {
+        std::lock_guard<std::mutex> lock(sharedSplatMutex);
+        AddSplatToBuffer(splatBuffers.back(), p, v);
+    } else if (ThreadIndex == 0) {
+#ifndef NDEBUG
+        // Catch any other thread that's using buffer zero concurrently.
+        CHECK(!splatBufferZeroBusy.exchange(true));
+#endif  // !NDEBUG
+        AddSplatToBuffer(splatBuffers[0], p, v);
+#ifndef NDEBUG
+        splatBufferZeroBusy = false;
+#endif  // !NDEBUG
+    } else
+        AddSplatToBuffer(splatBuffers[ThreadIndex], p, v);
+}
+
+void Film::AddSplatToBuffer(SplatBuffer &buffer, const Point2f &p,
+                            const Spectrum &v) {
+    if (useSplatImages) {
+        if (!buffer.image) {
+            buffer.image.reset(new Float[3 * croppedPixelBounds.Area()]());
+            filmPixelMemory += 3 * croppedPixelBounds.Area() * sizeof(Float);
+        }
+        Float xyz[3];
+        v.ToXYZ(xyz);
+        Float *dst = &buffer.image[3 * PixelOffset((Point2i)p)];
+        for (int c = 0; c < 3; ++c) dst[c] += xyz[c];
+        return;
+    }
+    PendingSplat splat;
+    splat.pixelOffset = PixelOffset((Point2i)p);
+    Point2i block = BlockCoords((Point2i)p);
+    splat.block = block.y * nBlocksX + block.x;
+    v.ToXYZ(splat.xyz);
+    buffer.splats.push_back(splat);
+    if (buffer.splats.size() >= SplatBufferSize) FlushSplats(buffer);
+}
+
+void Film::FlushSplats(SplatBuffer &buffer) {
+    std::vector<PendingSplat> &splats = buffer.splats;
+    std::sort(splats.begin(), splats.end(),
+              [](const PendingSplat &a, const PendingSplat &b) {
+                  return a.block < b.block;
+              });
+    for (size_t i = 0; i < splats.size();) {
+        int block = splats[i].block;
+        std::lock_guard<std::mutex> lock(blockMutexes[block]);
+        for (; i < splats.size() && splats[i].block == block; ++i) {
+            Pixel &pixel = pixels[splats[i].pixelOffset];
+            for (int c = 0; c < 3; ++c) pixel.splatXYZ[c] += splats[i].xyz[c];
+        }
+    }
+    splats.clear();
+}
+
+void Film::FlushAllSplats() {
+    for (SplatBuffer &buffer : splatBuffers) FlushSplats(buffer);
+    if (!useSplatImages) return;
+
+    // Sum the per-thread splat images into _pixels_, one row at a time
+    int width = croppedPixelBounds.pMax.x - croppedPixelBounds.pMin.x;
+    int height = croppedPixelBounds.pMax.y - croppedPixelBounds.pMin.y;
+    ParallelFor([&](int64_t y) {
+        for (SplatBuffer &buffer : splatBuffers) {
+            if (!buffer.image) continue;
+            Float *row = &buffer.image[3 * y * width];
+            Pixel *pixelRow = &pixels[y * width];
+            for (int x = 0; x < width; ++x)
+                for (int c = 0; c < 3; ++c) {
+                    pixelRow[x].splatXYZ[c] += row[3 * x + c];
+                    row[3 * x + c] = 0;
+                }
+        }
+    }, height, 8);
 }
 
 // ============================================================================
@@ -188,6 +292,7 @@ std::unique_ptr<Float[]> Film::to_rgb_array(Float splatScale) {
     // Convert image to RGB and compute final pixel values
     LOG(INFO) <<
         "Converting image to RGB and computing final weighted pixel values";
+    FlushAllSplats();
     std::unique_ptr<Float[]> rgb(new Float[3 * croppedPixelBounds.Area()]);
     int offset = 0;
     for (Point2i p : croppedPixelBounds) {
@@ -208,9 +313,7 @@ std::unique_ptr<Float[]> Film::to_rgb_array(Float splatScale) {
 
         // Add splat value at pixel
         Float splatRGB[3];
-        Float splatXYZ[3] = {pixel.splatXYZ[0], pixel.splatXYZ[1],
-                             pixel.splatXYZ[2]};
-        XYZToRGB(splatXYZ, splatRGB);
+        XYZToRGB(pixel.splatXYZ, splatRGB);
         rgb[3 * offset] += splatScale * splatRGB[0];
         rgb[3 * offset + 1] += splatScale * splatRGB[1];
         rgb[3 * offset + 2] += splatScale * splatRGB[2];
@@ -231,7 +334,93 @@ void Film::WriteImage(Float splatScale) {
     // Write RGB image
     LOG(INFO) << "Writing image " << filename << " with bounds " <<
         croppedPixelBounds;
-    pbrt::WriteImage(filename, &rgb[0], croppedPixelBounds, fullResolution);
+    pbrt::WriteImageAsync(filename, std::move(rgb), croppedPixelBounds,
+                          fullResolution);
+}
+
+// Film checkpoint file header; followed by the _Pixel_ array.
+struct FilmCheckpointHeader {
+    char magic[8];
+    int32_t version, floatSize;
+    int32_t bounds[4];
+    int64_t samplesPerPixel, samplesTaken;
+};
+static const char FilmCheckpointMagic[8] = {'P', 'B', 'R', 'T',
+                                            'C', 'K', 'P', 'T'};
+static PBRT_CONSTEXPR int32_t FilmCheckpointVersion = 1;
+
+bool Film::SaveCheckpoint(const std::string &filename,
+                          int64_t samplesPerPixel, int64_t samplesTaken) {
+    FlushAllSplats();
+    FilmCheckpointHeader header;
+    memcpy(header.magic, FilmCheckpointMagic, sizeof(header.magic));
+    header.version = FilmCheckpointVersion;
+    header.floatSize = sizeof(Float);
+    header.bounds[0] = croppedPixelBounds.pMin.x;
+    header.bounds[1] = croppedPixelBounds.pMin.y;
+    header.bounds[2] = croppedPixelBounds.pMax.x;
+    header.bounds[3] = croppedPixelBounds.pMax.y;
+    header.samplesPerPixel = samplesPerPixel;
+    header.samplesTaken = samplesTaken;
+
+    // Write to a temporary file and rename it so that an interruption
+    // while writing leaves the previous checkpoint intact
+    std::string tmpFilename = filename + ".tmp";
+    FILE *f = fopen(tmpFilename.c_str(), "wb");
+    if (!f) {
+        Error("%s: unable to open checkpoint file for writing",
+              tmpFilename.c_str());
+        return false;
+    }
+    size_t nPixels = croppedPixelBounds.Area();
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(pixels.get(), sizeof(Pixel), nPixels, f) == nPixels;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+        Error("%s: error writing checkpoint file", filename.c_str());
+        remove(tmpFilename.c_str());
+        return false;
+    }
+    LOG(INFO) << "Wrote checkpoint " << filename << " after " << samplesTaken
+              << " samples per pixel";
+    return true;
+}
+
+bool Film::LoadCheckpoint(const std::string &filename,
+                          int64_t samplesPerPixel, int64_t *samplesTaken) {
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) return false;
+    FilmCheckpointHeader header;
+    size_t nPixels = croppedPixelBounds.Area();
+    bool ok = fread(&header, sizeof(header), 1, f) == 1;
+    if (ok &&
+        (memcmp(header.magic, FilmCheckpointMagic, sizeof(header.magic)) != 0 ||
+         header.version != FilmCheckpointVersion ||
+         header.floatSize != sizeof(Float) ||
+         header.bounds[0] != croppedPixelBounds.pMin.x ||
+         header.bounds[1] != croppedPixelBounds.pMin.y ||
+         header.bounds[2] != croppedPixelBounds.pMax.x ||
+         header.bounds[3] != croppedPixelBounds.pMax.y ||
+         header.samplesPerPixel != samplesPerPixel)) {
+        Warning("%s: checkpoint doesn't match the current film and sampler; "
+                "ignoring it", filename.c_str());
+        fclose(f);
+        return false;
+    }
+    std::unique_ptr<Pixel[]> loaded(new Pixel[nPixels]);
+    ok = ok && fread(loaded.get(), sizeof(Pixel), nPixels, f) == nPixels;
+    fclose(f);
+    if (!ok) {
+        Warning("%s: checkpoint file is truncated; ignoring it",
+                filename.c_str());
+        return false;
+    }
+    Clear();
+    pixels = std::move(loaded);
+    *samplesTaken = header.samplesTaken;
+    LOG(INFO) << "Resuming from checkpoint " << filename << " at "
+              << *samplesTaken << " samples per pixel";
+    return true;
 }
 
 // ============================================================================
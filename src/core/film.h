@@ -55,33 +55,107 @@ struct FilmTilePixel {
     Float filterWeightSum = 0.f;
 };
 
+// VarianceEstimator Declarations
+// Running mean and variance of a pixel's sample luminances (using
+// Welford's algorithm), used to decide when adaptive sampling can stop
+// taking samples in the pixel.
+class VarianceEstimator {
+  public:
+    // VarianceEstimator Public Methods
+    void Add(Float x) {
+        ++n;
+        double delta = x - mean;
+        mean += delta / n;
+        m2 += delta * (x - mean);
+    }
+    int64_t Count() const { return n; }
+    Float Mean() const { return mean; }
+    Float Variance() const { return n > 1 ? m2 / (n - 1) : 0; }
+    // Returns the standard error of the mean relative to the mean.
+    Float RelativeError() const {
+        if (n < 2) return Infinity;
+        if (mean == 0) return m2 == 0 ? 0 : Infinity;
+        return std::sqrt(Variance() / n) / std::abs(mean);
+    }
+
+  private:
+    // VarianceEstimator Private Data
+    int64_t n = 0;
+    double mean = 0, m2 = 0;
+};
+
 // Film Declarations
 class Film {
 
 private:
   // Film Private Data
   struct Pixel {
-      Pixel() { xyz[0] = xyz[1] = xyz[2] = filterWeightSum = 0; }
+      Pixel() {
+          xyz[0] = xyz[1] = xyz[2] = filterWeightSum = 0;
+          splatXYZ[0] = splatXYZ[1] = splatXYZ[2] = 0;
+      }
       Float xyz[3];
       Float filterWeightSum;
-      AtomicFloat splatXYZ[3];
+      Float splatXYZ[3];
       Float pad;
   };
   std::unique_ptr<Pixel[]> pixels;
   static PBRT_CONSTEXPR int filterTableWidth = 16;
   Float filterTable[filterTableWidth * filterTableWidth];
-  std::mutex mutex;
   const Float scale;
   const Float maxSampleLuminance;
 
+  // The film's pixels are divided into square blocks that each have their
+  // own lock, so that tile merges and splat flushes only contend with
+  // each other where they actually overlap.
+  static PBRT_CONSTEXPR int LogBlockSize = 4;
+  int nBlocksX;
+  std::unique_ptr<std::mutex[]> blockMutexes;
+
+  // Splats are collected in per-thread buffers (indexed by _ThreadIndex_)
+  // and applied to _pixels_ in batches, sorted by block. With
+  // _useSplatImages_, each thread instead accumulates splats into its own
+  // full-resolution _image_, and the images are summed into _pixels_ only
+  // when all splats are flushed. Threads that pbrt didn't launch (e.g.
+  // IILE's thread pool) all have a _ThreadIndex_ of zero, so they share
+  // the last buffer under _sharedSplatMutex_ instead.
+  struct PendingSplat {
+      int pixelOffset, block;
+      Float xyz[3];
+  };
+  struct
+#ifdef PBRT_HAVE_ALIGNAS
+  alignas(PBRT_L1_CACHE_LINE_SIZE)
+#endif // PBRT_HAVE_ALIGNAS
+      SplatBuffer {
+      std::vector<PendingSplat> splats;
+      std::unique_ptr<Float[]> image;
+  };
+  static PBRT_CONSTEXPR size_t SplatBufferSize = 4096;
+  std::vector<SplatBuffer> splatBuffers;
+  std::mutex sharedSplatMutex;
+  bool useSplatImages = false;
+#ifndef NDEBUG
+  // Set while the thread that owns buffer zero is using it.
+  std::atomic<bool> splatBufferZeroBusy{false};
+#endif  // !NDEBUG
+
   // Film Private Methods
-  Pixel &GetPixel(const Point2i &p) {
+  void AddSplatToBuffer(SplatBuffer &buffer, const Point2f &p,
+                        const Spectrum &v);
+  int PixelOffset(const Point2i &p) const {
       CHECK(InsideExclusive(p, croppedPixelBounds));
       int width = croppedPixelBounds.pMax.x - croppedPixelBounds.pMin.x;
-      int offset = (p.x - croppedPixelBounds.pMin.x) +
-                   (p.y - croppedPixelBounds.pMin.y) * width;
-      return pixels[offset];
+      return (p.x - croppedPixelBounds.pMin.x) +
+             (p.y - croppedPixelBounds.pMin.y) * width;
+  }
+  Pixel &GetPixel(const Point2i &p) { return pixels[PixelOffset(p)]; }
+  Point2i BlockCoords(const Point2i &p) const {
+      return Point2i((p.x - croppedPixelBounds.pMin.x) >> LogBlockSize,
+                     (p.y - croppedPixelBounds.pMin.y) >> LogBlockSize);
   }
+  void FlushSplats(SplatBuffer &buffer);
+  void FlushAllSplats();
 
   std::unique_ptr<Float[]> to_rgb_array(Float splatScale);
 
@@ -108,10 +182,28 @@ public:
 
   void SetImage(const Spectrum *img) const;
 
+  // AddSplat() may be called from any thread; threads that pbrt didn't
+  // launch share a single locked splat buffer. It must not run
+  // concurrently with Clear() or image output, which apply all pending
+  // splats.
   void AddSplat(const Point2f &p, Spectrum v);
+  // Switches AddSplat() to per-thread splat images, which avoid all
+  // synchronization between splatting threads at the cost of one image's
+  // worth of memory per thread. Suited to integrators like MLT that splat
+  // every sample.
+  void UseThreadSplatImages() { useSplatImages = true; }
 
   void WriteImage(Float splatScale = 1);
 
+  // Checkpoints hold the film's pixel accumulators along with the number
+  // of samples per pixel taken so far, so that an interrupted progressive
+  // render can be resumed. Like image output, SaveCheckpoint() must not
+  // run concurrently with AddSplat().
+  bool SaveCheckpoint(const std::string &filename, int64_t samplesPerPixel,
+                      int64_t samplesTaken);
+  bool LoadCheckpoint(const std::string &filename, int64_t samplesPerPixel,
+                      int64_t *samplesTaken);
+
   void WriteImage(Float splatScale, std::string out_filename);
 
   void Clear();
@@ -207,7 +299,29 @@ class FilmTile {
     }
     Bounds2i GetPixelBounds() const { return pixelBounds; }
 
+    // Per-pixel sample statistics are only kept for tiles that are
+    // rendered adaptively. They're indexed by the pixel a sample was
+    // taken for, which may be outside of _pixelBounds_ when the filter
+    // is wider than a pixel.
+    void EnableSampleStats(const Bounds2i &sampleBounds) {
+        statsBounds = sampleBounds;
+        sampleStats.resize(std::max(0, sampleBounds.Area()));
+    }
+    void AddSampleLuminance(const Point2i &p, Float y) {
+        sampleStats[StatsOffset(p)].Add(y);
+    }
+    const VarianceEstimator &GetSampleStats(const Point2i &p) const {
+        return sampleStats[StatsOffset(p)];
+    }
+
   private:
+    // FilmTile Private Methods
+    int StatsOffset(const Point2i &p) const {
+        CHECK(InsideExclusive(p, statsBounds));
+        int width = statsBounds.pMax.x - statsBounds.pMin.x;
+        return (p.x - statsBounds.pMin.x) + (p.y - statsBounds.pMin.y) * width;
+    }
+
     // FilmTile Private Data
     const Bounds2i pixelBounds;
     const Vector2f filterRadius, invFilterRadius;
@@ -215,6 +329,8 @@ class FilmTile {
     const int filterTableSize;
     std::vector<FilmTilePixel> pixels;
     const Float maxSampleLuminance;
+    Bounds2i statsBounds;
+    std::vector<VarianceEstimator> sampleStats;
     friend class Film;
 };
 
@@ -0,0 +1,250 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+
+// core/geomcache.cpp*
+#include "geomcache.h"
+#include "accelerators/bvh.h"
+#include "shapes/triangle.h"
+#include "stats.h"
+
+namespace pbrt {
+
+STAT_PERCENT("Geometry/Tessellation cache hits", nTessellationHits,
+             nTessellationLookups);
+STAT_COUNTER("Geometry/Tessellations", nTessellations);
+STAT_COUNTER("Geometry/Triangles tessellated", nTrianglesTessellated);
+STAT_COUNTER("Geometry/Tessellations evicted", nTessellationEvictions);
+STAT_PERCENT("Geometry/Deferred shapes tessellated", nShapesTessellated,
+             nDeferredShapes);
+STAT_MEMORY_COUNTER("Memory/Geometry cache (resident)", residentGeometryBytes);
+
+// GeometryCache Local Definitions
+
+// SurfaceInteractions found with a tessellation may still be in use after
+// it has been evicted, so they refer to this shape rather than to one of
+// its triangles. Only its orientation is used, which matches theirs.
+class TessellationShape : public Shape {
+  public:
+    TessellationShape(const Transform *ObjectToWorld,
+                      const Transform *WorldToObject, bool reverseOrientation,
+                      const Bounds3f &worldBound)
+        : Shape(ObjectToWorld, WorldToObject, reverseOrientation),
+          worldBound(worldBound) {}
+    Bounds3f ObjectBound() const { return (*WorldToObject)(worldBound); }
+    Bounds3f WorldBound() const { return worldBound; }
+    bool Intersect(const Ray &ray, Float *tHit, SurfaceInteraction *isect,
+                   bool testAlphaTexture) const {
+        LOG(FATAL) << "TessellationShape::Intersect() shouldn't be called";
+        return false;
+    }
+    Float Area() const {
+        LOG(FATAL) << "TessellationShape::Area() shouldn't be called";
+        return 0;
+    }
+    Interaction Sample(const Point2f &u, Float *pdf) const {
+        LOG(FATAL) << "TessellationShape::Sample() shouldn't be called";
+        return Interaction();
+    }
+
+  private:
+    const Bounds3f worldBound;
+};
+
+// Approximates the memory used by a tessellation with _nTriangles_
+// triangles: the triangles, their primitives and BVH nodes, and the mesh's
+// vertex indices and roughly half as many vertices as triangles.
+static int64_t TessellationBytes(size_t nTriangles) {
+    const int64_t sharedPtrOverhead = 2 * sizeof(void *);
+    const int64_t perTriangle =
+        sizeof(Triangle) + sizeof(GeometricPrimitive) +
+        2 * (sizeof(std::shared_ptr<Primitive>) + sharedPtrOverhead) +
+        2 * sizeof(Bounds3f) + 3 * sizeof(int) +
+        (sizeof(Point3f) + sizeof(Normal3f) + sizeof(Point2f)) / 2;
+    return sizeof(BVHAccel) + nTriangles * perTriangle;
+}
+
+// GeometryCache Method Definitions
+GeometryCache *GeometryCache::cache = nullptr;
+
+void GeometryCache::Init(int64_t maxBytes) {
+    CHECK(cache == nullptr);
+    cache = new GeometryCache(maxBytes);
+}
+
+void GeometryCache::Cleanup() {
+    // Primitives that outlive the cache keep their tessellations until
+    // they're destroyed.
+    delete cache;
+    cache = nullptr;
+}
+
+void GeometryCache::Insert(const TessellatedPrimitive *prim, int64_t nBytes) {
+    std::vector<std::shared_ptr<Primitive>> evicted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        prim->lastUse = ++clock;
+        resident[prim] = nBytes;
+        residentBytes += nBytes;
+        residentGeometryBytes += nBytes;
+
+        // Evict the least recently used tessellations of other shapes until
+        // the budget is met; a single shape's tessellation is kept even if
+        // it exceeds the budget by itself.
+        while (residentBytes > maxBytes) {
+            auto lru = resident.end();
+            for (auto iter = resident.begin(); iter != resident.end(); ++iter)
+                if (iter->first != prim &&
+                    (lru == resident.end() ||
+                     iter->first->lastUse < lru->first->lastUse))
+                    lru = iter;
+            if (lru == resident.end()) break;
+            evicted.push_back(lru->first->Evict());
+            residentBytes -= lru->second;
+            residentGeometryBytes -= lru->second;
+            ++nTessellationEvictions;
+            resident.erase(lru);
+        }
+    }
+    // The evicted BVHs are freed here, outside of the lock, unless rays are
+    // still traversing them.
+}
+
+void GeometryCache::Remove(const TessellatedPrimitive *prim) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iter = resident.find(prim);
+    if (iter == resident.end()) return;
+    residentBytes -= iter->second;
+    residentGeometryBytes -= iter->second;
+    resident.erase(iter);
+}
+
+// TessellatedPrimitive Method Definitions
+TessellatedPrimitive::TessellatedPrimitive(
+    ShapeTessellator tessellate, const Bounds3f &worldBound,
+    const Transform *ObjectToWorld, const Transform *WorldToObject,
+    bool reverseOrientation, const std::shared_ptr<Material> &material,
+    const MediumInterface &mediumInterface)
+    : tessellate(std::move(tessellate)),
+      // The triangles' vertices are computed with rounding error, so they
+      // may lie slightly outside of the shape's bounds.
+      worldBound(Expand(worldBound, 1e-4f * worldBound.Diagonal().Length())),
+      shape(std::make_shared<TessellationShape>(
+          ObjectToWorld, WorldToObject, reverseOrientation,
+          this->worldBound)),
+      material(material),
+      mediumInterface(mediumInterface) {
+    ++nDeferredShapes;
+}
+
+TessellatedPrimitive::~TessellatedPrimitive() {
+    if (GeometryCache::Get()) GeometryCache::Get()->Remove(this);
+}
+
+std::shared_ptr<Primitive> TessellatedPrimitive::Tessellation(
+    const Ray &r) const {
+    GeometryCache *cache = GeometryCache::Get();
+    if (cache) {
+        // Avoid writing to _lastUse_ when it's already current, so that
+        // threads tracing rays against the same shape don't contend for it.
+        uint64_t now = cache->Now();
+        if (lastUse.load(std::memory_order_relaxed) != now)
+            lastUse.store(now, std::memory_order_relaxed);
+    }
+    std::shared_ptr<Primitive> triangles = std::atomic_load(&bvh);
+    if (triangles) {
+        ++nTessellationLookups;
+        ++nTessellationHits;
+        return triangles;
+    }
+    // Don't tessellate the shape for rays that miss its bounds.
+    if (!worldBound.IntersectP(r)) return nullptr;
+    ++nTessellationLookups;
+
+    int64_t nBytes;
+    {
+        std::lock_guard<std::mutex> lock(tessellateMutex);
+        // Another thread may have tessellated the shape in the meantime.
+        triangles = std::atomic_load(&bvh);
+        if (triangles) return triangles;
+
+        // Only the first tessellation counts toward the triangle mesh
+        // statistics; later ones re-create the same meshes.
+        CountTriangleMeshStats = !everTessellated;
+        std::vector<std::shared_ptr<Shape>> shapes = tessellate();
+        CountTriangleMeshStats = true;
+        std::vector<std::shared_ptr<Primitive>> prims;
+        prims.reserve(shapes.size());
+        for (const std::shared_ptr<Shape> &s : shapes)
+            prims.push_back(std::make_shared<GeometricPrimitive>(
+                s, material, nullptr, mediumInterface));
+        triangles = std::make_shared<BVHAccel>(std::move(prims));
+        std::atomic_store(&bvh, triangles);
+
+        nBytes = TessellationBytes(shapes.size());
+        ++nTessellations;
+        nTrianglesTessellated += shapes.size();
+        if (!everTessellated) {
+            everTessellated = true;
+            ++nShapesTessellated;
+        }
+    }
+    if (cache) cache->Insert(this, nBytes);
+    return triangles;
+}
+
+bool TessellatedPrimitive::Intersect(const Ray &r,
+                                     SurfaceInteraction *isect) const {
+    std::shared_ptr<Primitive> triangles = Tessellation(r);
+    if (!triangles || !triangles->Intersect(r, isect)) return false;
+    isect->primitive = this;
+    isect->shape = shape.get();
+    return true;
+}
+
+bool TessellatedPrimitive::IntersectP(const Ray &r) const {
+    std::shared_ptr<Primitive> triangles = Tessellation(r);
+    return triangles && triangles->IntersectP(r);
+}
+
+void TessellatedPrimitive::ComputeScatteringFunctions(
+    SurfaceInteraction *isect, MemoryArena &arena, TransportMode mode,
+    bool allowMultipleLobes) const {
+    ProfilePhase p(Prof::ComputeScatteringFuncs);
+    if (material)
+        material->ComputeScatteringFunctions(isect, arena, mode,
+                                             allowMultipleLobes);
+    CHECK_GE(Dot(isect->n, isect->shading.n), 0.);
+}
+
+}  // namespace pbrt
@@ -0,0 +1,142 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_CORE_GEOMCACHE_H
+#define PBRT_CORE_GEOMCACHE_H
+
+// core/geomcache.h*
+#include "pbrt.h"
+#include "primitive.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+namespace pbrt {
+
+class TessellatedPrimitive;
+
+// GeometryCache Declarations
+
+// The GeometryCache holds the triangles of shapes that are tessellated on
+// demand within a fixed memory budget. When a new tessellation exceeds
+// the budget, the least recently used tessellations of other shapes are
+// freed; those shapes are tessellated again if rays reach them later.
+class GeometryCache {
+  public:
+    // GeometryCache Public Methods
+    static void Init(int64_t maxBytes);
+    static void Cleanup();
+    // Returns the process-wide cache, or nullptr if shapes are tessellated
+    // when they're created.
+    static GeometryCache *Get() { return cache; }
+
+    int64_t ResidentBytes() const { return residentBytes; }
+
+  private:
+    friend class TessellatedPrimitive;
+
+    // GeometryCache Private Methods
+    GeometryCache(int64_t maxBytes) : maxBytes(maxBytes) {}
+    // Recency of use is measured by a clock that only advances when a
+    // shape is tessellated, so that rays don't all update shared state.
+    uint64_t Now() const { return clock.load(std::memory_order_relaxed); }
+    void Insert(const TessellatedPrimitive *prim, int64_t nBytes);
+    void Remove(const TessellatedPrimitive *prim);
+
+    // GeometryCache Private Data
+    static GeometryCache *cache;
+    const int64_t maxBytes;
+    std::atomic<uint64_t> clock{0};
+    std::atomic<int64_t> residentBytes{0};
+    std::mutex mutex;
+    std::unordered_map<const TessellatedPrimitive *, int64_t> resident;
+};
+
+// TessellatedPrimitive Declarations
+
+// A TessellatedPrimitive stands in for a shape that's refined into
+// triangles. The shape isn't tessellated until a ray reaches its bounds,
+// at which point a BVH is built over its triangles and registered with the
+// GeometryCache, which may free it again later.
+class TessellatedPrimitive : public Primitive {
+  public:
+    // TessellatedPrimitive Public Methods
+    TessellatedPrimitive(ShapeTessellator tessellate,
+                         const Bounds3f &worldBound,
+                         const Transform *ObjectToWorld,
+                         const Transform *WorldToObject,
+                         bool reverseOrientation,
+                         const std::shared_ptr<Material> &material,
+                         const MediumInterface &mediumInterface);
+    ~TessellatedPrimitive();
+    Bounds3f WorldBound() const { return worldBound; }
+    bool Intersect(const Ray &r, SurfaceInteraction *isect) const;
+    bool IntersectP(const Ray &r) const;
+    const AreaLight *GetAreaLight() const { return nullptr; }
+    const Material *GetMaterial() const { return material.get(); }
+    void ComputeScatteringFunctions(SurfaceInteraction *isect,
+                                    MemoryArena &arena, TransportMode mode,
+                                    bool allowMultipleLobes) const;
+    bool IsTessellated() const { return std::atomic_load(&bvh) != nullptr; }
+
+  private:
+    friend class GeometryCache;
+
+    // TessellatedPrimitive Private Methods
+    std::shared_ptr<Primitive> Tessellation(const Ray &r) const;
+    std::shared_ptr<Primitive> Evict() const {
+        return std::atomic_exchange(&bvh, std::shared_ptr<Primitive>());
+    }
+
+    // TessellatedPrimitive Private Data
+    const ShapeTessellator tessellate;
+    const Bounds3f worldBound;
+    std::shared_ptr<Shape> shape;
+    std::shared_ptr<Material> material;
+    MediumInterface mediumInterface;
+    // _bvh_ is only accessed with the atomic shared_ptr functions so that
+    // rays that are traversing an evicted BVH keep it alive.
+    mutable std::shared_ptr<Primitive> bvh;
+    mutable std::mutex tessellateMutex;
+    mutable bool everTessellated = false;
+    mutable std::atomic<uint64_t> lastUse{0};
+};
+
+}  // namespace pbrt
+
+#endif  // PBRT_CORE_GEOMCACHE_H
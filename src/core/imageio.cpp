@@ -35,10 +35,23 @@
 #include "ext/lodepng.h"
 #include "ext/targa.h"
 #include "fileutil.h"
+#include "parallel.h"
 #include "spectrum.h"
-
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <ImfChannelList.h>
+#include <ImfFrameBuffer.h>
+#include <ImfHeader.h>
+#include <ImfOutputFile.h>
 #include <ImfRgba.h>
 #include <ImfRgbaFile.h>
+#include <ImfThreading.h>
+#include <ImfTiledOutputFile.h>
+#include <half.h>
 
 namespace pbrt {
 
@@ -55,10 +68,50 @@ static bool WriteImagePFM(const std::string &filename, const Float *rgb,
                           int xres, int yres);
 static RGBSpectrum *ReadImagePFM(const std::string &filename, int *xres,
                                  int *yres);
+static void WaitForImageWrite(const std::string &name);
+static std::unique_ptr<ImageRowReader> CreatePFMRowReader(
+    const std::string &filename);
+
+// ImageWriter Declarations
+struct ImageWriteJob {
+    std::string name;
+    std::unique_ptr<Float[]> rgb;
+    Bounds2i outputBounds;
+    Point2i totalResolution;
+};
+
+class ImageWriter {
+  public:
+    // ImageWriter Public Methods
+    void Enqueue(ImageWriteJob job);
+    void Wait(const std::string *name);
+    void Stop();
+
+  private:
+    // ImageWriter Private Methods
+    bool Pending(const std::string &name) const;
+    void WorkerLoop();
+
+    // ImageWriter Private Data
+    // Writing a few images at once lets one's compression overlap another's
+    // file I/O; EXR compression itself is spread over OpenEXR's threads.
+    static PBRT_CONSTEXPR int nWriterThreads = 2;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<ImageWriteJob> queue;
+    std::vector<std::string> writing;
+    std::vector<std::thread> threads;
+    bool stopping = false;
+};
+
+// The writer is never destroyed, so that images queued when the program
+// exits can't reach a destroyed queue.
+static ImageWriter *imageWriter = new ImageWriter;
 
 // ImageIO Function Definitions
 std::unique_ptr<RGBSpectrum[]> ReadImage(const std::string &name,
                                          Point2i *resolution) {
+    WaitForImageWrite(name);
     if (HasExtension(name, ".exr"))
         return std::unique_ptr<RGBSpectrum[]>(
             ReadImageEXR(name, &resolution->x, &resolution->y));
@@ -121,10 +174,111 @@ void WriteImage(const std::string &name, const Float *rgb,
     }
 }
 
+void WriteImageAsync(const std::string &name, std::unique_ptr<Float[]> rgb,
+                     const Bounds2i &outputBounds,
+                     const Point2i &totalResolution) {
+    ImageWriteJob job;
+    job.name = name;
+    job.rgb = std::move(rgb);
+    job.outputBounds = outputBounds;
+    job.totalResolution = totalResolution;
+    imageWriter->Enqueue(std::move(job));
+}
+
+void FlushImageWrites() { imageWriter->Wait(nullptr); }
+
+static void WaitForImageWrite(const std::string &name) {
+    imageWriter->Wait(&name);
+}
+
+void InitImageIO() {
+    int nThreads = PbrtOptions.imageIOThreads;
+    Imf::setGlobalThreadCount(nThreads > 0 ? nThreads : NumSystemCores());
+}
+
+void CleanupImageIO() { imageWriter->Stop(); }
+
+// ImageWriter Method Definitions
+void ImageWriter::Enqueue(ImageWriteJob job) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Replace an older image for the same file that's still waiting; it
+    // would be overwritten immediately anyway.
+    bool replaced = false;
+    for (ImageWriteJob &queued : queue)
+        if (queued.name == job.name) {
+            queued = std::move(job);
+            replaced = true;
+            break;
+        }
+    if (!replaced) queue.push_back(std::move(job));
+    if (threads.empty())
+        for (int i = 0; i < nWriterThreads; ++i)
+            threads.push_back(std::thread(&ImageWriter::WorkerLoop, this));
+    cv.notify_all();
+}
+
+bool ImageWriter::Pending(const std::string &name) const {
+    for (const std::string &w : writing)
+        if (w == name) return true;
+    for (const ImageWriteJob &job : queue)
+        if (job.name == name) return true;
+    return false;
+}
+
+void ImageWriter::Wait(const std::string *name) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&]() {
+        return name ? !Pending(*name) : (queue.empty() && writing.empty());
+    });
+}
+
+void ImageWriter::Stop() {
+    std::vector<std::thread> stopped;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        cv.notify_all();
+        stopped.swap(threads);
+    }
+    // Threads write all of the queued images before they exit.
+    for (std::thread &thread : stopped) thread.join();
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = false;
+}
+
+void ImageWriter::WorkerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        // Find the first queued image whose file isn't being written by
+        // another thread, so that writes of each file stay in order.
+        auto job = queue.end();
+        cv.wait(lock, [&]() {
+            for (job = queue.begin(); job != queue.end(); ++job)
+                if (std::find(writing.begin(), writing.end(), job->name) ==
+                    writing.end())
+                    return true;
+            return stopping && queue.empty();
+        });
+        if (job == queue.end()) return;
+
+        ImageWriteJob current = std::move(*job);
+        queue.erase(job);
+        writing.push_back(current.name);
+        lock.unlock();
+        WriteImage(current.name, current.rgb.get(), current.outputBounds,
+                   current.totalResolution);
+        current.rgb.reset();
+        lock.lock();
+        writing.erase(std::find(writing.begin(), writing.end(), current.name));
+        cv.notify_all();
+    }
+}
+
 RGBSpectrum *ReadImageEXR(const std::string &name, int *width, int *height,
                           Bounds2i *dataWindow, Bounds2i *displayWindow) {
     using namespace Imf;
     using namespace Imath;
+    WaitForImageWrite(name);
     try {
         RgbaInputFile file(name.c_str());
         Box2i dw = file.dataWindow();
@@ -161,31 +315,138 @@ RGBSpectrum *ReadImageEXR(const std::string &name, int *width, int *height,
     return NULL;
 }
 
-static void WriteImageEXR(const std::string &name, const Float *pixels,
-                          int xRes, int yRes, int totalXRes, int totalYRes,
-                          int xOffset, int yOffset) {
+class EXRRowReader : public ImageRowReader {
+  public:
+    EXRRowReader(const std::string &name) : file(name.c_str()) {
+        Imath::Box2i dw = file.dataWindow();
+        dataOrigin = Point2i(dw.min.x, dw.min.y);
+        resolution = Point2i(dw.max.x - dw.min.x + 1, dw.max.y - dw.min.y + 1);
+    }
+    bool ReadRows(int y0, int y1, RGBSpectrum *rows) {
+        using namespace Imf;
+        int width = resolution.x;
+        pixels.resize(width * (y1 - y0));
+        try {
+            // Point the frame buffer's origin at the data window's, so
+            // that row _y0_ lands at the start of _pixels_.
+            file.setFrameBuffer(
+                &pixels[0] - dataOrigin.x - (dataOrigin.y + y0) * width, 1,
+                width);
+            file.readPixels(dataOrigin.y + y0, dataOrigin.y + y1 - 1);
+        } catch (const std::exception &e) {
+            Error("Unable to read rows of image file: %s", e.what());
+            return false;
+        }
+        for (size_t i = 0; i < pixels.size(); ++i) {
+            Float frgb[3] = {pixels[i].r, pixels[i].g, pixels[i].b};
+            rows[i] = RGBSpectrum::FromRGB(frgb);
+        }
+        return true;
+    }
+
+  private:
+    Imf::RgbaInputFile file;
+    Point2i dataOrigin;
+    std::vector<Imf::Rgba> pixels;
+};
+
+class MemoryRowReader : public ImageRowReader {
+  public:
+    MemoryRowReader(std::unique_ptr<RGBSpectrum[]> image, const Point2i &res)
+        : image(std::move(image)) {
+        resolution = res;
+    }
+    bool ReadRows(int y0, int y1, RGBSpectrum *rows) {
+        std::copy(&image[y0 * resolution.x], &image[y1 * resolution.x], rows);
+        return true;
+    }
+
+  private:
+    std::unique_ptr<RGBSpectrum[]> image;
+};
+
+std::unique_ptr<ImageRowReader> CreateImageRowReader(const std::string &name) {
+    WaitForImageWrite(name);
+    if (HasExtension(name, ".exr")) {
+        try {
+            return std::unique_ptr<ImageRowReader>(new EXRRowReader(name));
+        } catch (const std::exception &e) {
+            Error("Unable to read image file \"%s\": %s", name.c_str(),
+                  e.what());
+            return nullptr;
+        }
+    } else if (HasExtension(name, ".pfm"))
+        return CreatePFMRowReader(name);
+
+    Point2i res;
+    std::unique_ptr<RGBSpectrum[]> image = ReadImage(name, &res);
+    if (!image) return nullptr;
+    return std::unique_ptr<ImageRowReader>(
+        new MemoryRowReader(std::move(image), res));
+}
+
+template <typename T>
+static void WriteEXRChannels(const std::string &name, Imf::PixelType type,
+                             const Float *pixels, int xRes, int yRes,
+                             int totalXRes, int totalYRes, int xOffset,
+                             int yOffset) {
     using namespace Imf;
     using namespace Imath;
 
-    Rgba *hrgba = new Rgba[xRes * yRes];
-    for (int i = 0; i < xRes * yRes; ++i)
-        hrgba[i] = Rgba(pixels[3 * i], pixels[3 * i + 1], pixels[3 * i + 2]);
+    std::vector<T> data(3 * xRes * yRes);
+    for (size_t i = 0; i < data.size(); ++i) data[i] = T(pixels[i]);
 
     // OpenEXR uses inclusive pixel bounds.
     Box2i displayWindow(V2i(0, 0), V2i(totalXRes - 1, totalYRes - 1));
     Box2i dataWindow(V2i(xOffset, yOffset),
                      V2i(xOffset + xRes - 1, yOffset + yRes - 1));
-
+    Header header(displayWindow, dataWindow);
+    // An opaque alpha channel is written too, as RgbaOutputFile's
+    // WRITE_RGBA mode did.
+    const char *channels[4] = {"R", "G", "B", "A"};
+    for (const char *c : channels) header.channels().insert(c, Channel(type));
+
+    // The frame buffer is addressed with absolute pixel coordinates, so its
+    // base is offset to the data window's origin.
+    FrameBuffer frameBuffer;
+    size_t xStride = 3 * sizeof(T), yStride = xRes * xStride;
+    char *base = (char *)&data[0] - xOffset * xStride - yOffset * yStride;
+    for (int c = 0; c < 3; ++c)
+        frameBuffer.insert(channels[c], Slice(type, base + c * sizeof(T),
+                                              xStride, yStride));
+    // Zero strides make every pixel's alpha read the same value.
+    T one = T(1);
+    frameBuffer.insert("A", Slice(type, (char *)&one, 0, 0));
+
+    // Both kinds of file compress their blocks of pixels in parallel using
+    // OpenEXR's global thread pool; see InitImageIO().
     try {
-        RgbaOutputFile file(name.c_str(), displayWindow, dataWindow,
-                            WRITE_RGBA);
-        file.setFrameBuffer(hrgba - xOffset - yOffset * xRes, 1, xRes);
-        file.writePixels(yRes);
+        int tileSize = PbrtOptions.exrTileSize;
+        if (tileSize > 0) {
+            header.setTileDescription(
+                TileDescription(tileSize, tileSize, ONE_LEVEL));
+            TiledOutputFile file(name.c_str(), header);
+            file.setFrameBuffer(frameBuffer);
+            file.writeTiles(0, file.numXTiles() - 1, 0, file.numYTiles() - 1);
+        } else {
+            OutputFile file(name.c_str(), header);
+            file.setFrameBuffer(frameBuffer);
+            file.writePixels(yRes);
+        }
     } catch (const std::exception &exc) {
         Error("Error writing \"%s\": %s", name.c_str(), exc.what());
     }
+}
 
-    delete[] hrgba;
+static void WriteImageEXR(const std::string &name, const Float *pixels,
+                          int xRes, int yRes, int totalXRes, int totalYRes,
+                          int xOffset, int yOffset) {
+    if (PbrtOptions.exrFloat)
+        WriteEXRChannels<float>(name, Imf::FLOAT, pixels, xRes, yRes,
+                                totalXRes, totalYRes, xOffset, yOffset);
+    else
+        WriteEXRChannels<half>(name, Imf::HALF, pixels, xRes, yRes, totalXRes,
+                               totalYRes, xOffset, yOffset);
 }
 
 // TGA Function Definitions
@@ -292,29 +553,6 @@ static RGBSpectrum *ReadImagePNG(const std::string &name, int *width,
  * (http://people.csail.mit.edu/jiawen/)
  */
 
-static PBRT_CONSTEXPR bool hostLittleEndian =
-#if defined(__BYTE_ORDER__)
-  #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-    true
-  #elif __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
-    false
-  #else
-    #error "__BYTE_ORDER__ defined but has unexpected value"
-  #endif
-#else
-  #if defined(__LITTLE_ENDIAN__) || defined(__i386__) || defined(__x86_64__) || \
-      defined(WIN32)
-    true
-  #elif defined(__BIG_ENDIAN__)
-    false
-  #elif defined(__sparc) || defined(__sparc__)
-    false
-  #else
-    #error "Can't detect machine endian-ness at compile-time."
-  #endif
-#endif
-    ;
-
 #define BUFFER_SIZE 80
 
 static inline int isWhitespace(char c) {
@@ -397,7 +635,7 @@ static RGBSpectrum *ReadImagePFM(const std::string &filename, int *xres,
 
     // apply endian conversian and scale if appropriate
     fileLittleEndian = (scale < 0.f);
-    if (hostLittleEndian ^ fileLittleEndian) {
+    if (HostIsLittleEndian() ^ fileLittleEndian) {
         uint8_t bytes[4];
         for (unsigned int i = 0; i < nFloats; ++i) {
             memcpy(bytes, &data[i], 4);
@@ -434,6 +672,96 @@ fail:
     return nullptr;
 }
 
+class PFMRowReader : public ImageRowReader {
+  public:
+    PFMRowReader(FILE *fp, int nChannels, float scale, const Point2i &res)
+        : fp(fp), nChannels(nChannels), scale(scale), dataOffset(ftell(fp)) {
+        resolution = res;
+    }
+    ~PFMRowReader() { fclose(fp); }
+    bool ReadRows(int y0, int y1, RGBSpectrum *rows) {
+        // The file's rows run from the bottom of the image to the top, so
+        // rows [y0, y1) are stored contiguously and in reverse order.
+        size_t rowFloats = size_t(nChannels) * resolution.x;
+        data.resize(rowFloats * (y1 - y0));
+        if (fseek(fp,
+                  dataOffset + long(sizeof(float) * rowFloats *
+                                    (resolution.y - y1)),
+                  SEEK_SET) != 0 ||
+            fread(&data[0], sizeof(float), data.size(), fp) != data.size()) {
+            Error("Error reading rows %d-%d of PFM file", y0, y1 - 1);
+            return false;
+        }
+
+        bool fileLittleEndian = (scale < 0.f);
+        for (int y = y0; y < y1; ++y) {
+            float *row = &data[rowFloats * (y1 - 1 - y)];
+            if (HostIsLittleEndian() ^ fileLittleEndian) {
+                uint8_t bytes[4];
+                for (size_t i = 0; i < rowFloats; ++i) {
+                    memcpy(bytes, &row[i], 4);
+                    std::swap(bytes[0], bytes[3]);
+                    std::swap(bytes[1], bytes[2]);
+                    memcpy(&row[i], bytes, 4);
+                }
+            }
+            RGBSpectrum *dst = &rows[(y - y0) * resolution.x];
+            for (int x = 0; x < resolution.x; ++x) {
+                if (nChannels == 1)
+                    dst[x] = RGBSpectrum(std::abs(scale) * row[x]);
+                else {
+                    Float frgb[3] = {std::abs(scale) * row[3 * x],
+                                     std::abs(scale) * row[3 * x + 1],
+                                     std::abs(scale) * row[3 * x + 2]};
+                    dst[x] = RGBSpectrum::FromRGB(frgb);
+                }
+            }
+        }
+        return true;
+    }
+
+  private:
+    FILE *fp;
+    const int nChannels;
+    const float scale;
+    const long dataOffset;
+    std::vector<float> data;
+};
+
+static std::unique_ptr<ImageRowReader> CreatePFMRowReader(
+    const std::string &filename) {
+    char buffer[BUFFER_SIZE];
+    int nChannels;
+    Point2i res;
+    float scale;
+
+    FILE *fp = fopen(filename.c_str(), "rb");
+    if (!fp) goto fail;
+
+    // Read the header; the reader takes over the file from there.
+    if (readWord(fp, buffer, BUFFER_SIZE) == -1) goto fail;
+    if (strcmp(buffer, "Pf") == 0)
+        nChannels = 1;
+    else if (strcmp(buffer, "PF") == 0)
+        nChannels = 3;
+    else
+        goto fail;
+    if (readWord(fp, buffer, BUFFER_SIZE) == -1) goto fail;
+    res.x = atoi(buffer);
+    if (readWord(fp, buffer, BUFFER_SIZE) == -1) goto fail;
+    res.y = atoi(buffer);
+    if (readWord(fp, buffer, BUFFER_SIZE) == -1) goto fail;
+    if (sscanf(buffer, "%f", &scale) != 1 || res.x <= 0 || res.y <= 0)
+        goto fail;
+    return std::unique_ptr<ImageRowReader>(
+        new PFMRowReader(fp, nChannels, scale, res));
+
+fail:
+    Error("Error reading PFM file \"%s\"", filename.c_str());
+    if (fp) fclose(fp);
+    return nullptr;
+}
+
 static bool WriteImagePFM(const std::string &filename, const Float *rgb,
                           int width, int height) {
     FILE *fp;
@@ -445,7 +773,10 @@ static bool WriteImagePFM(const std::string &filename, const Float *rgb,
         return false;
     }
 
-    std::unique_ptr<float[]> scanline(new float[3 * width]);
+    // Stage the whole raster, so that it's written with a single call.
+    // This also converts it to 32-bit floats in case Float is 'double'.
+    size_t rowSize = 3 * size_t(width);
+    std::unique_ptr<float[]> raster(new float[rowSize * height]);
 
     // only write 3 channel PFMs here...
     if (fprintf(fp, "PF\n") < 0) goto fail;
@@ -454,7 +785,7 @@ static bool WriteImagePFM(const std::string &filename, const Float *rgb,
     if (fprintf(fp, "%d %d\n", width, height) < 0) goto fail;
 
     // write the scale, which encodes endianness
-    scale = hostLittleEndian ? -1.f : 1.f;
+    scale = HostIsLittleEndian() ? -1.f : 1.f;
     if (fprintf(fp, "%f\n", scale) < 0) goto fail;
 
     // write the data from bottom left to upper right as specified by
@@ -462,15 +793,13 @@ static bool WriteImagePFM(const std::string &filename, const Float *rgb,
     // The raster is a sequence of pixels, packed one after another, with no
     // delimiters of any kind. They are grouped by row, with the pixels in each
     // row ordered left to right and the rows ordered bottom to top.
-    for (int y = height - 1; y >= 0; y--) {
-        // in case Float is 'double', copy into a staging buffer that's
-        // definitely a 32-bit float...
-        for (int x = 0; x < 3 * width; ++x)
-            scanline[x] = rgb[y * width * 3 + x];
-        if (fwrite(&scanline[0], sizeof(float), width * 3, fp) <
-            (size_t)(width * 3))
-            goto fail;
+    for (int y = 0; y < height; ++y) {
+        float *row = &raster[rowSize * (height - 1 - y)];
+        for (size_t x = 0; x < rowSize; ++x) row[x] = rgb[y * rowSize + x];
     }
+    if (fwrite(&raster[0], sizeof(float), rowSize * height, fp) <
+        rowSize * height)
+        goto fail;
 
     fclose(fp);
     return true;
@@ -55,6 +55,39 @@ RGBSpectrum *ReadImageEXR(const std::string &name, int *width,
 void WriteImage(const std::string &name, const Float *rgb,
                 const Bounds2i &outputBounds, const Point2i &totalResolution);
 
+// Queues _rgb_ to be written to _name_ by a background thread and returns
+// immediately. A queued image that hasn't been started yet is replaced by
+// a later one with the same name, and ReadImage() waits for pending writes
+// of the file that it reads.
+void WriteImageAsync(const std::string &name, std::unique_ptr<Float[]> rgb,
+                     const Bounds2i &outputBounds,
+                     const Point2i &totalResolution);
+// Waits until all of the images queued by WriteImageAsync() are written.
+void FlushImageWrites();
+
+void InitImageIO();
+void CleanupImageIO();
+
+// ImageRowReader Declarations
+// Reads an image a band of rows at a time, so that images too large to
+// keep in memory can be processed in a single pass. EXR and PFM files are
+// read incrementally; images in other formats are read when opened.
+class ImageRowReader {
+  public:
+    // ImageRowReader Interface
+    virtual ~ImageRowReader() {}
+    Point2i Resolution() const { return resolution; }
+    // Reads rows [y0, y1), counted from the top of the image, into _rows_,
+    // which must have room for (y1 - y0) * Resolution().x pixels.
+    virtual bool ReadRows(int y0, int y1, RGBSpectrum *rows) = 0;
+
+  protected:
+    // ImageRowReader Protected Data
+    Point2i resolution;
+};
+
+std::unique_ptr<ImageRowReader> CreateImageRowReader(const std::string &name);
+
 }  // namespace pbrt
 
 #endif  // PBRT_CORE_IMAGEIO_H
@@ -41,12 +41,20 @@
 #include "integrator.h"
 #include "progressreporter.h"
 #include "camera.h"
+#include "lightdistrib.h"
 #include "stats.h"
+#include <chrono>
 
 namespace pbrt {
 
 STAT_COUNTER("Integrator/Camera rays traced", nCameraRays);
 
+// Size of the square tiles SamplerIntegrator::Render() divides the image
+// into
+static PBRT_CONSTEXPR int RenderTileSize = 16;
+STAT_PERCENT("Integrator/Adaptive sampling budget used", nAdaptiveSamples,
+             nAdaptiveBudget);
+
 // Integrator Method Definitions
 Integrator::~Integrator() {}
 
@@ -105,6 +113,23 @@ Spectrum UniformSampleOneLight(const Interaction &it, const Scene &scene,
                           scene, sampler, arena, handleMedia) / lightPdf;
 }
 
+Spectrum UniformSampleOneLight(const Interaction &it, const Scene &scene,
+                               MemoryArena &arena, Sampler &sampler,
+                               const LightDistribution &lightDistrib,
+                               bool handleMedia) {
+    ProfilePhase p(Prof::DirectLighting);
+    // Choose a single light to sample from _lightDistrib_
+    if (scene.lights.empty()) return Spectrum(0.f);
+    Float lightPdf;
+    int lightNum = lightDistrib.Sample(it.p, it.n, sampler.Get1D(), &lightPdf);
+    if (lightPdf == 0) return Spectrum(0.f);
+    const std::shared_ptr<Light> &light = scene.lights[lightNum];
+    Point2f uLight = sampler.Get2D();
+    Point2f uScattering = sampler.Get2D();
+    return EstimateDirect(it, uScattering, *light, uLight,
+                          scene, sampler, arena, handleMedia) / lightPdf;
+}
+
 Spectrum EstimateDirect(const Interaction &it, const Point2f &uScattering,
                         const Light &light, const Point2f &uLight,
                         const Scene &scene, Sampler &sampler,
@@ -227,105 +252,20 @@ std::unique_ptr<Distribution1D> ComputeLightPowerDistribution(
 void SamplerIntegrator::Render(const Scene &scene, bool writeFile)
 {
     Preprocess(scene, *sampler);
+    if (PbrtOptions.progressive || PbrtOptions.timeBudget > 0 ||
+        !PbrtOptions.checkpointFile.empty()) {
+        RenderProgressive(scene, writeFile);
+        return;
+    }
     // Render image tiles in parallel
 
     // Compute number of tiles, _nTiles_, to use for parallel rendering
-    Bounds2i sampleBounds = camera->film->GetSampleBounds();
-    Vector2i sampleExtent = sampleBounds.Diagonal();
-    const int tileSize = 16;
-    Point2i nTiles((sampleExtent.x + tileSize - 1) / tileSize,
-                   (sampleExtent.y + tileSize - 1) / tileSize);
+    Point2i nTiles = NumRenderTiles();
     ProgressReporter reporter(nTiles.x * nTiles.y, "Rendering");
     {
         ParallelFor2D([&](Point2i tile) {
-            // Render section of image corresponding to _tile_
-
-            // Allocate _MemoryArena_ for tile
-            MemoryArena arena;
-
-            // Get sampler instance for tile
-            int seed = tile.y * nTiles.x + tile.x;
-            std::unique_ptr<Sampler> tileSampler = sampler->Clone(seed);
-
-            // Compute sample bounds for tile
-            int x0 = sampleBounds.pMin.x + tile.x * tileSize;
-            int x1 = std::min(x0 + tileSize, sampleBounds.pMax.x);
-            int y0 = sampleBounds.pMin.y + tile.y * tileSize;
-            int y1 = std::min(y0 + tileSize, sampleBounds.pMax.y);
-            Bounds2i tileBounds(Point2i(x0, y0), Point2i(x1, y1));
-
-            // Get _FilmTile_ for tile
-            std::unique_ptr<FilmTile> filmTile =
-                camera->film->GetFilmTile(tileBounds);
-
-            // Loop over pixels in tile to render them
-            for (Point2i pixel : tileBounds) {
-                {
-                    ProfilePhase pp(Prof::StartPixel);
-                    tileSampler->StartPixel(pixel);
-                }
-
-                // Do this check after the StartPixel() call; this keeps
-                // the usage of RNG values from (most) Samplers that use
-                // RNGs consistent, which improves reproducability /
-                // debugging.
-                if (!InsideExclusive(pixel, pixelBounds))
-                    continue;
-
-                do {
-                    // Initialize _CameraSample_ for current sample
-                    CameraSample cameraSample =
-                        tileSampler->GetCameraSample(pixel);
-
-                    // Generate camera ray for current sample
-                    RayDifferential ray;
-                    Float rayWeight =
-                        camera->GenerateRayDifferential(cameraSample, &ray);
-                    ray.ScaleDifferentials(
-                        1 / std::sqrt((Float)tileSampler->samplesPerPixel));
-                    ++nCameraRays;
-
-                    // Evaluate radiance along camera ray
-                    Spectrum L(0.f);
-                    if (rayWeight > 0) L = Li(ray, scene, *tileSampler, arena);
-
-                    // Issue warning if unexpected radiance value returned
-                    if (L.HasNaNs()) {
-                        LOG(ERROR) << StringPrintf(
-                            "Not-a-number radiance value returned "
-                            "for pixel (%d, %d), sample %d. Setting to black.",
-                            pixel.x, pixel.y,
-                            (int)tileSampler->CurrentSampleNumber());
-                        L = Spectrum(0.f);
-                    } else if (L.y() < -1e-5) {
-                        LOG(ERROR) << StringPrintf(
-                            "Negative luminance value, %f, returned "
-                            "for pixel (%d, %d), sample %d. Setting to black.",
-                            L.y(), pixel.x, pixel.y,
-                            (int)tileSampler->CurrentSampleNumber());
-                        L = Spectrum(0.f);
-                    } else if (std::isinf(L.y())) {
-                          LOG(ERROR) << StringPrintf(
-                            "Infinite luminance value returned "
-                            "for pixel (%d, %d), sample %d. Setting to black.",
-                            pixel.x, pixel.y,
-                            (int)tileSampler->CurrentSampleNumber());
-                        L = Spectrum(0.f);
-                    }
-                    VLOG(1) << "Camera sample: " << cameraSample << " -> ray: " <<
-                        ray << " -> L = " << L;
-
-                    // Add camera ray's contribution to image
-                    filmTile->AddSample(cameraSample.pFilm, L, rayWeight);
-
-                    // Free _MemoryArena_ memory from computing image sample
-                    // value
-                    arena.Reset();
-                } while (tileSampler->StartNextSample());
-            }
-
-            // Merge image tile into _Film_
-            camera->film->MergeFilmTile(std::move(filmTile));
+            RenderTile(scene, tile, 0, sampler->samplesPerPixel,
+                       adaptiveThreshold > 0);
             reporter.Update();
         }, nTiles);
         reporter.Done();
@@ -338,6 +278,264 @@ void SamplerIntegrator::Render(const Scene &scene, bool writeFile)
     }
 }
 
+Point2i SamplerIntegrator::NumRenderTiles() const {
+    Vector2i sampleExtent = camera->film->GetSampleBounds().Diagonal();
+    return Point2i((sampleExtent.x + RenderTileSize - 1) / RenderTileSize,
+                   (sampleExtent.y + RenderTileSize - 1) / RenderTileSize);
+}
+
+void SamplerIntegrator::RenderTile(const Scene &scene, const Point2i &tile,
+                                   int64_t firstSample, int64_t nSamples,
+                                   bool adaptive) const {
+    // Render section of image corresponding to _tile_
+
+    // Allocate _MemoryArena_ for tile
+    MemoryArena arena;
+
+    // Get sampler instance for tile; samples starting past the first one
+    // (in later progressive rounds) use a different seed for each
+    // starting sample so that samplers that draw from an RNG don't
+    // repeat the random numbers of earlier rounds
+    Bounds2i sampleBounds = camera->film->GetSampleBounds();
+    Point2i nTiles = NumRenderTiles();
+    int seed = int((firstSample * nTiles.y + tile.y) * nTiles.x + tile.x);
+    std::unique_ptr<Sampler> tileSampler = sampler->Clone(seed);
+
+    // Compute sample bounds for tile
+    int x0 = sampleBounds.pMin.x + tile.x * RenderTileSize;
+    int x1 = std::min(x0 + RenderTileSize, sampleBounds.pMax.x);
+    int y0 = sampleBounds.pMin.y + tile.y * RenderTileSize;
+    int y1 = std::min(y0 + RenderTileSize, sampleBounds.pMax.y);
+    Bounds2i tileBounds(Point2i(x0, y0), Point2i(x1, y1));
+
+    // Get _FilmTile_ for tile
+    std::unique_ptr<FilmTile> filmTile = camera->film->GetFilmTile(tileBounds);
+
+    if (adaptive)
+        RenderTileAdaptive(scene, tileBounds, *tileSampler, filmTile.get(),
+                           arena);
+    else {
+        // Loop over pixels in tile to render them
+        for (Point2i pixel : tileBounds) {
+            {
+                ProfilePhase pp(Prof::StartPixel);
+                tileSampler->StartPixel(pixel);
+            }
+
+            // Do this check after the StartPixel() call; this keeps
+            // the usage of RNG values from (most) Samplers that use
+            // RNGs consistent, which improves reproducability /
+            // debugging.
+            if (!InsideExclusive(pixel, pixelBounds))
+                continue;
+
+            if (firstSample > 0 && !tileSampler->SetSampleNumber(firstSample))
+                continue;
+            int64_t taken = 0;
+            do {
+                RenderSample(scene, pixel, *tileSampler, filmTile.get(),
+                             arena);
+            } while (++taken < nSamples && tileSampler->StartNextSample());
+        }
+    }
+
+    // Merge image tile into _Film_
+    camera->film->MergeFilmTile(std::move(filmTile));
+}
+
+void SamplerIntegrator::RenderProgressive(const Scene &scene, bool writeFile) {
+    // Each round takes the next range of sample indices in every pixel.
+    // Samplers whose samples only depend on the index (Halton, Sobol)
+    // thus take the same set of samples as a single pass would. Samplers
+    // that draw from an RNG are seeded differently in each round by
+    // RenderTile(), including after resuming from a checkpoint, so their
+    // rounds are independent.
+    Film *film = camera->film;
+    const int64_t samplesPerPixel = sampler->samplesPerPixel;
+    const std::string &checkpointFile = PbrtOptions.checkpointFile;
+    if (adaptiveThreshold > 0)
+        Warning("Adaptive sampling isn't supported with progressive "
+                "rendering; sampling all pixels uniformly.");
+
+    // Resume from an earlier checkpoint if there is one
+    int64_t samplesTaken = 0;
+    if (!checkpointFile.empty())
+        film->LoadCheckpoint(checkpointFile, samplesPerPixel, &samplesTaken);
+
+    Point2i nTiles = NumRenderTiles();
+    int64_t roundSamples = std::max<int64_t>(1, samplesPerPixel / 16);
+    int64_t nRounds =
+        (samplesPerPixel - samplesTaken + roundSamples - 1) / roundSamples;
+    auto startTime = std::chrono::steady_clock::now();
+    auto lastCheckpointTime = startTime;
+    auto secondsSince = [](std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration<Float>(std::chrono::steady_clock::now() -
+                                            t).count();
+    };
+    ProgressReporter reporter(nRounds * nTiles.x * nTiles.y, "Rendering");
+    while (samplesTaken < samplesPerPixel) {
+        // Render one round of samples over the whole image
+        int64_t nSamples =
+            std::min(roundSamples, samplesPerPixel - samplesTaken);
+        ParallelFor2D([&](Point2i tile) {
+            RenderTile(scene, tile, samplesTaken, nSamples, false);
+            reporter.Update();
+        }, nTiles);
+        samplesTaken += nSamples;
+
+        bool outOfTime = PbrtOptions.timeBudget > 0 &&
+                         secondsSince(startTime) >= PbrtOptions.timeBudget;
+        if (outOfTime && samplesTaken < samplesPerPixel)
+            Warning("Time budget of %f seconds exhausted after %d of %d "
+                    "samples per pixel.", PbrtOptions.timeBudget,
+                    (int)samplesTaken, (int)samplesPerPixel);
+        if (outOfTime || samplesTaken == samplesPerPixel) break;
+
+        // Periodically save the checkpoint and the intermediate image
+        if (secondsSince(lastCheckpointTime) >= PbrtOptions.checkpointInterval) {
+            if (!checkpointFile.empty())
+                film->SaveCheckpoint(checkpointFile, samplesPerPixel,
+                                     samplesTaken);
+            if (writeFile) film->WriteImage();
+            lastCheckpointTime = std::chrono::steady_clock::now();
+        }
+    }
+    reporter.Done();
+    LOG(INFO) << "Rendering finished with " << samplesTaken
+              << " samples per pixel";
+
+    if (!checkpointFile.empty())
+        film->SaveCheckpoint(checkpointFile, samplesPerPixel, samplesTaken);
+    if (writeFile) film->WriteImage();
+}
+
+Float SamplerIntegrator::RenderSample(const Scene &scene, const Point2i &pixel,
+                                      Sampler &tileSampler, FilmTile *filmTile,
+                                      MemoryArena &arena) const {
+    // Initialize _CameraSample_ for current sample
+    CameraSample cameraSample = tileSampler.GetCameraSample(pixel);
+
+    // Generate camera ray for current sample
+    RayDifferential ray;
+    Float rayWeight = camera->GenerateRayDifferential(cameraSample, &ray);
+    ray.ScaleDifferentials(1 / std::sqrt((Float)tileSampler.samplesPerPixel));
+    ++nCameraRays;
+
+    // Evaluate radiance along camera ray
+    Spectrum L(0.f);
+    if (rayWeight > 0) L = Li(ray, scene, tileSampler, arena);
+
+    // Issue warning if unexpected radiance value returned
+    if (L.HasNaNs()) {
+        LOG(ERROR) << StringPrintf(
+            "Not-a-number radiance value returned "
+            "for pixel (%d, %d), sample %d. Setting to black.",
+            pixel.x, pixel.y, (int)tileSampler.CurrentSampleNumber());
+        L = Spectrum(0.f);
+    } else if (L.y() < -1e-5) {
+        LOG(ERROR) << StringPrintf(
+            "Negative luminance value, %f, returned "
+            "for pixel (%d, %d), sample %d. Setting to black.",
+            L.y(), pixel.x, pixel.y, (int)tileSampler.CurrentSampleNumber());
+        L = Spectrum(0.f);
+    } else if (std::isinf(L.y())) {
+        LOG(ERROR) << StringPrintf(
+            "Infinite luminance value returned "
+            "for pixel (%d, %d), sample %d. Setting to black.",
+            pixel.x, pixel.y, (int)tileSampler.CurrentSampleNumber());
+        L = Spectrum(0.f);
+    }
+    VLOG(1) << "Camera sample: " << cameraSample << " -> ray: " << ray
+            << " -> L = " << L;
+
+    // Add camera ray's contribution to image
+    filmTile->AddSample(cameraSample.pFilm, L, rayWeight);
+
+    // Free _MemoryArena_ memory from computing image sample value
+    arena.Reset();
+    return rayWeight * L.y();
+}
+
+void SamplerIntegrator::RenderTileAdaptive(const Scene &scene,
+                                           const Bounds2i &tileBounds,
+                                           Sampler &tileSampler,
+                                           FilmTile *filmTile,
+                                           MemoryArena &arena) const {
+    // Samples are taken in rounds. Every pixel gets _adaptiveMinSamples_
+    // samples in the first round; after each round, pixels whose relative
+    // error (and that of their neighbors in the tile) is below
+    // _adaptiveThreshold_ stop, and the rest get twice as many samples in
+    // the next round, up to the sampler's sample count.
+    filmTile->EnableSampleStats(tileBounds);
+    const int64_t samplesPerPixel = tileSampler.samplesPerPixel;
+    int width = tileBounds.pMax.x - tileBounds.pMin.x;
+    std::vector<int64_t> samplesTaken(std::max(0, tileBounds.Area()), 0);
+    std::vector<bool> active(samplesTaken.size(), true);
+    auto offset = [&](const Point2i &p) {
+        return (p.x - tileBounds.pMin.x) + (p.y - tileBounds.pMin.y) * width;
+    };
+    for (Point2i pixel : tileBounds)
+        if (!InsideExclusive(pixel, pixelBounds)) active[offset(pixel)] = false;
+
+    int64_t roundSamples = std::min<int64_t>(adaptiveMinSamples, samplesPerPixel);
+    bool anyActive = true;
+    while (anyActive) {
+        // Take up to _roundSamples_ more samples in each active pixel
+        for (Point2i pixel : tileBounds) {
+            int o = offset(pixel);
+            if (!active[o]) continue;
+            {
+                ProfilePhase pp(Prof::StartPixel);
+                tileSampler.StartPixel(pixel);
+            }
+            if (!tileSampler.SetSampleNumber(samplesTaken[o])) {
+                active[o] = false;
+                nAdaptiveBudget += samplesPerPixel;
+                continue;
+            }
+            for (int64_t i = 0; i < roundSamples; ++i) {
+                filmTile->AddSampleLuminance(
+                    pixel, RenderSample(scene, pixel, tileSampler, filmTile,
+                                        arena));
+                ++samplesTaken[o];
+                ++nAdaptiveSamples;
+                if (!tileSampler.StartNextSample()) break;
+            }
+        }
+
+        // Deactivate pixels that have converged or used all of their samples
+        std::vector<bool> wasActive = active;
+        anyActive = false;
+        for (Point2i pixel : tileBounds) {
+            int o = offset(pixel);
+            if (!wasActive[o]) continue;
+            bool converged = samplesTaken[o] >= samplesPerPixel;
+            if (!converged) {
+                // Require the pixel's neighbors to have converged as well, so
+                // that isolated pixels with unluckily similar samples keep
+                // sampling
+                Float maxError = 0;
+                for (int dy = -1; dy <= 1; ++dy)
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        Point2i p(pixel.x + dx, pixel.y + dy);
+                        if (InsideExclusive(p, tileBounds) &&
+                            InsideExclusive(p, pixelBounds))
+                            maxError = std::max(
+                                maxError,
+                                filmTile->GetSampleStats(p).RelativeError());
+                    }
+                converged = maxError < adaptiveThreshold;
+            }
+            if (converged) {
+                active[o] = false;
+                nAdaptiveBudget += samplesPerPixel;
+            } else
+                anyActive = true;
+        }
+        roundSamples *= 2;
+    }
+}
+
 // SamplerIntegrator Method Definitions
 void SamplerIntegrator::Render(const Scene &scene) {
     Render(scene, true);
@@ -65,6 +65,10 @@ Spectrum UniformSampleOneLight(const Interaction &it, const Scene &scene,
                                MemoryArena &arena, Sampler &sampler,
                                bool handleMedia = false,
                                const Distribution1D *lightDistrib = nullptr);
+Spectrum UniformSampleOneLight(const Interaction &it, const Scene &scene,
+                               MemoryArena &arena, Sampler &sampler,
+                               const LightDistribution &lightDistrib,
+                               bool handleMedia = false);
 Spectrum EstimateDirect(const Interaction &it, const Point2f &uShading,
                         const Light &light, const Point2f &uLight,
                         const Scene &scene, Sampler &sampler,
@@ -82,6 +86,13 @@ class SamplerIntegrator : public Integrator {
                       const Bounds2i &pixelBounds)
         : camera(camera), sampler(sampler), pixelBounds(pixelBounds) {}
     virtual void Preprocess(const Scene &scene, Sampler &sampler) {}
+    // Enables adaptive sampling: pixels stop taking samples once the
+    // relative error of their luminance drops below _threshold_, after
+    // at least _minSamples_ samples.
+    void SetAdaptiveSampling(Float threshold, int minSamples) {
+        adaptiveThreshold = threshold;
+        adaptiveMinSamples = std::max(2, minSamples);
+    }
     void Render(const Scene &scene, bool writeFile);
     void Render(const Scene &scene);
     virtual Spectrum Li(const RayDifferential &ray, const Scene &scene,
@@ -101,8 +112,23 @@ class SamplerIntegrator : public Integrator {
     std::shared_ptr<const Camera> camera;
     const Bounds2i pixelBounds;
 
+    // SamplerIntegrator Private Methods
+    Point2i NumRenderTiles() const;
+    void RenderTile(const Scene &scene, const Point2i &tile,
+                    int64_t firstSample, int64_t nSamples,
+                    bool adaptive) const;
+    void RenderProgressive(const Scene &scene, bool writeFile);
+    Float RenderSample(const Scene &scene, const Point2i &pixel,
+                       Sampler &tileSampler, FilmTile *filmTile,
+                       MemoryArena &arena) const;
+    void RenderTileAdaptive(const Scene &scene, const Bounds2i &tileBounds,
+                            Sampler &tileSampler, FilmTile *filmTile,
+                            MemoryArena &arena) const;
+
     // SamplerIntegrator Private Data
     std::shared_ptr<Sampler> sampler;
+    Float adaptiveThreshold = 0;
+    int adaptiveMinSamples = 8;
 
 };
 
@@ -346,17 +346,31 @@ Float InvertCatmullRom(int n, const Float *x, const Float *values, Float u) {
 
 // Fourier Interpolation Definitions
 Float Fourier(const Float *a, int m, double cosPhi) {
-    double value = 0.0;
-    // Initialize cosine iterates
-    double cosKMinusOnePhi = cosPhi;
-    double cosKPhi = 1;
-    for (int k = 0; k < m; ++k) {
-        // Add the current summand and update the cosine iterates
-        value += a[k] * cosKPhi;
-        double cosKPlusOnePhi = 2 * cosPhi * cosKPhi - cosKMinusOnePhi;
-        cosKMinusOnePhi = cosKPhi;
-        cosKPhi = cosKPlusOnePhi;
+    // Initialize cosine iterates for four consecutive terms
+    double cos2Phi = 2 * cosPhi * cosPhi - 1;
+    double cos3Phi = 2 * cosPhi * cos2Phi - cosPhi;
+    double cos4Phi = 2 * cos2Phi * cos2Phi - 1;
+    double cosKPhi[4] = {1, cosPhi, cos2Phi, cos3Phi};
+    double cosKMinusFourPhi[4] = {cos4Phi, cos3Phi, cos2Phi, cosPhi};
+
+    // Sum four terms at a time; each lane advances its own cosine iterate
+    // using $\cos((k+4)\phi) = 2 \cos(4\phi) \cos(k\phi) - \cos((k-4)\phi)$
+    // so that the lanes are independent and the loop can be vectorized
+    double sum[4] = {0, 0, 0, 0};
+    int k = 0;
+    for (; k + 4 <= m; k += 4) {
+        for (int j = 0; j < 4; ++j) {
+            sum[j] += a[k + j] * cosKPhi[j];
+            double cosKPlusFourPhi =
+                2 * cos4Phi * cosKPhi[j] - cosKMinusFourPhi[j];
+            cosKMinusFourPhi[j] = cosKPhi[j];
+            cosKPhi[j] = cosKPlusFourPhi;
+        }
     }
+    double value = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+
+    // Add the remaining terms
+    for (int j = 0; k < m; ++k, ++j) value += a[k] * cosKPhi[j];
     return value;
 }
 
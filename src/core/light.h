@@ -58,6 +58,20 @@ inline bool IsDeltaLight(int flags) {
            flags & (int)LightFlags::DeltaDirection;
 }
 
+// LightBounds bounds where and in which directions a light emits, for
+// LightBVHLightDistribution. All emission starts inside _bounds_, and the
+// surface normals of the emitter lie within the cone of directions around
+// _w_ with angle cosine _cosTheta_o_; light leaves at most
+// acos(_cosTheta_e_) from the normal (from either side if _twoSided_).
+// _phi_ estimates the light's power.
+struct LightBounds {
+    Bounds3f bounds;
+    Float phi = 0;
+    Vector3f w = Vector3f(0, 0, 1);
+    Float cosTheta_o = -1, cosTheta_e = 0;
+    bool twoSided = false;
+};
+
 // Light Declarations
 class Light {
   public:
@@ -69,6 +83,9 @@ class Light {
                                Vector3f *wi, Float *pdf,
                                VisibilityTester *vis) const = 0;
     virtual Spectrum Power() const = 0;
+    // Returns false for lights that can't be bounded in space, like
+    // distant and infinite lights.
+    virtual bool Bounds(LightBounds *lb) const { return false; }
     virtual void Preprocess(const Scene &scene) {}
     virtual Spectrum Le(const RayDifferential &r) const;
     virtual Float Pdf_Li(const Interaction &ref, const Vector3f &wi) const = 0;
@@ -38,12 +38,23 @@
 #include "parallel.h"
 #include "scene.h"
 #include "stats.h"
+#include <algorithm>
 #include <numeric>
 
 namespace pbrt {
 
 LightDistribution::~LightDistribution() {}
 
+int LightDistribution::Sample(const Point3f &p, const Normal3f &n, Float u,
+                              Float *pmf) const {
+    return Lookup(p)->SampleDiscrete(u, pmf);
+}
+
+Float LightDistribution::Pmf(const Point3f &p, const Normal3f &n,
+                             int lightIndex) const {
+    return Lookup(p)->DiscretePDF(lightIndex);
+}
+
 std::unique_ptr<LightDistribution> CreateLightSampleDistribution(
     const std::string &name, const Scene &scene) {
     if (name == "uniform" || scene.lights.size() == 1)
@@ -55,6 +66,9 @@ std::unique_ptr<LightDistribution> CreateLightSampleDistribution(
     else if (name == "spatial")
         return std::unique_ptr<LightDistribution>{
             new SpatialLightDistribution(scene)};
+    else if (name == "lightbvh")
+        return std::unique_ptr<LightDistribution>{
+            new LightBVHLightDistribution(scene)};
     else {
         Error(
             "Light sample distribution type \"%s\" unknown. Using \"spatial\".",
@@ -298,4 +312,299 @@ SpatialLightDistribution::ComputeDistribution(Point3i pi) const {
     return new Distribution1D(&lightContrib[0], int(lightContrib.size()));
 }
 
+///////////////////////////////////////////////////////////////////////////
+// LightBVHLightDistribution
+
+STAT_MEMORY_COUNTER("Memory/Light BVH", lightBVHBytes);
+STAT_INT_DISTRIBUTION("Integrator/Light BVH depth", lightBVHDepth);
+
+static Float SafeACos(Float x) { return std::acos(Clamp(x, -1, 1)); }
+static Float SafeSqrt(Float x) { return std::sqrt(std::max((Float)0, x)); }
+
+// cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of
+// angles _a_ and _b_
+static Float CosSubClamped(Float sinA, Float cosA, Float sinB, Float cosB) {
+    return (cosA > cosB) ? 1 : cosA * cosB + sinA * sinB;
+}
+static Float SinSubClamped(Float sinA, Float cosA, Float sinB, Float cosB) {
+    return (cosA > cosB) ? 0 : sinA * cosB - cosA * sinB;
+}
+
+static Float AngleBetween(const Vector3f &v1, const Vector3f &v2) {
+    if (Dot(v1, v2) < 0)
+        return Pi - 2 * std::asin(Clamp((v1 + v2).Length() / 2, -1, 1));
+    return 2 * std::asin(Clamp((v2 - v1).Length() / 2, -1, 1));
+}
+
+// Returns the LightBounds of two lights' emission together
+static LightBounds Union(const LightBounds &a, const LightBounds &b) {
+    if (a.phi == 0) return b;
+    if (b.phi == 0) return a;
+    LightBounds lb;
+    lb.bounds = Union(a.bounds, b.bounds);
+    lb.phi = a.phi + b.phi;
+    lb.cosTheta_e = std::min(a.cosTheta_e, b.cosTheta_e);
+    lb.twoSided = a.twoSided || b.twoSided;
+
+    // Find the smallest cone of normals that contains both children's
+    Float thetaA = SafeACos(a.cosTheta_o), thetaB = SafeACos(b.cosTheta_o);
+    Float thetaD = AngleBetween(a.w, b.w);
+    if (std::min(thetaD + thetaB, Pi) <= thetaA) {
+        lb.w = a.w;
+        lb.cosTheta_o = a.cosTheta_o;
+    } else if (std::min(thetaD + thetaA, Pi) <= thetaB) {
+        lb.w = b.w;
+        lb.cosTheta_o = b.cosTheta_o;
+    } else {
+        Float thetaO = (thetaA + thetaD + thetaB) / 2;
+        Vector3f wr = Cross(a.w, b.w);
+        if (thetaO >= Pi || wr.LengthSquared() == 0) {
+            lb.w = a.w;
+            lb.cosTheta_o = -1;
+        } else {
+            lb.w = Normalize(Rotate(Degrees(thetaO - thetaA), wr)(a.w));
+            lb.cosTheta_o = std::cos(thetaO);
+        }
+    }
+    return lb;
+}
+
+// Conservatively estimates the contribution of the lights bounded by _lb_
+// at point _p_ with normal _n_
+static Float Importance(const LightBounds &lb, const Point3f &p,
+                        const Normal3f &n) {
+    Point3f pc = (lb.bounds.pMin + lb.bounds.pMax) / 2;
+    Float d2 = DistanceSquared(p, pc);
+    d2 = std::max(d2, lb.bounds.Diagonal().Length() / 2);
+
+    // Bound the angle between the emitter normals and the direction to _p_
+    Vector3f wi = d2 > 0 ? Normalize(p - pc) : Vector3f(0, 0, 1);
+    Float cosTheta_w = Dot(lb.w, wi);
+    if (lb.twoSided) cosTheta_w = std::abs(cosTheta_w);
+    Float sinTheta_w = SafeSqrt(1 - cosTheta_w * cosTheta_w);
+
+    // Bound the angle subtended by the light bounds at _p_
+    Point3f center;
+    Float radius;
+    lb.bounds.BoundingSphere(&center, &radius);
+    Float cosTheta_b = -1;
+    Float dc2 = DistanceSquared(p, center);
+    if (dc2 > radius * radius)
+        cosTheta_b = SafeSqrt(1 - radius * radius / dc2);
+    Float sinTheta_b = SafeSqrt(1 - cosTheta_b * cosTheta_b);
+
+    // Compute the minimum angle to _p_ over all emitter normals and points
+    Float sinTheta_o = SafeSqrt(1 - lb.cosTheta_o * lb.cosTheta_o);
+    Float cosTheta_x =
+        CosSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, lb.cosTheta_o);
+    Float sinTheta_x =
+        SinSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, lb.cosTheta_o);
+    Float cosThetap =
+        CosSubClamped(sinTheta_x, cosTheta_x, sinTheta_b, cosTheta_b);
+    if (cosThetap <= lb.cosTheta_e) return 0;
+
+    Float importance = lb.phi * cosThetap / d2;
+    // Account for the cosine factor at a surface receiving point
+    if (n != Normal3f(0, 0, 0)) {
+        Float cosTheta_i = AbsDot(wi, n);
+        Float sinTheta_i = SafeSqrt(1 - cosTheta_i * cosTheta_i);
+        importance *=
+            CosSubClamped(sinTheta_i, cosTheta_i, sinTheta_b, cosTheta_b);
+    }
+    return std::max<Float>(importance, 0);
+}
+
+// Surface-area-orientation cost of a BVH node with bounds _lb_, relative
+// to the extent of its parent _bounds_ along the split dimension _dim_
+static Float EvaluateCost(const LightBounds &lb, const Bounds3f &bounds,
+                          int dim) {
+    Float theta_o = SafeACos(lb.cosTheta_o), theta_e = SafeACos(lb.cosTheta_e);
+    Float theta_w = std::min(theta_o + theta_e, Pi);
+    Float sinTheta_o = SafeSqrt(1 - lb.cosTheta_o * lb.cosTheta_o);
+    Float M_omega = 2 * Pi * (1 - lb.cosTheta_o) +
+                    Pi / 2 * (2 * theta_w * sinTheta_o -
+                              std::cos(theta_o - 2 * theta_w) -
+                              2 * theta_o * sinTheta_o + lb.cosTheta_o);
+    Vector3f d = bounds.Diagonal();
+    Float Kr = d[dim] > 0 ? MaxComponent(d) / d[dim] : 1;
+    return lb.phi * M_omega * Kr * lb.bounds.SurfaceArea();
+}
+
+LightBVHLightDistribution::LightBVHLightDistribution(const Scene &scene)
+    : lightBitTrails(scene.lights.size(), uint64_t(UnsampledLight)),
+      powerDistrib(ComputeLightPowerDistribution(scene)) {
+    ProfilePhase _(Prof::LightDistribCreation);
+    std::vector<std::pair<int, LightBounds>> bvhLights;
+    for (size_t i = 0; i < scene.lights.size(); ++i) {
+        LightBounds lb;
+        if (!scene.lights[i]->Bounds(&lb)) {
+            unboundedLights.push_back(i);
+            lightBitTrails[i] = UnboundedLight;
+        } else if (lb.phi > 0)
+            bvhLights.push_back(std::make_pair(int(i), lb));
+    }
+    if (!bvhLights.empty()) {
+        nodes.reserve(2 * bvhLights.size() - 1);
+        BuildBVH(bvhLights, 0, bvhLights.size(), 0, 0);
+    }
+    lightBVHBytes += nodes.size() * sizeof(LightBVHNode) +
+                     lightBitTrails.size() * sizeof(uint64_t);
+}
+
+int LightBVHLightDistribution::BuildBVH(
+    std::vector<std::pair<int, LightBounds>> &bvhLights, int start, int end,
+    uint64_t bitTrail, int depth) {
+    if (end - start == 1) {
+        // Create leaf node for a single light
+        int nodeIndex = nodes.size();
+        nodes.push_back({bvhLights[start].second, bvhLights[start].first,
+                         true});
+        lightBitTrails[bvhLights[start].first] = bitTrail;
+        ReportValue(lightBVHDepth, depth);
+        return nodeIndex;
+    }
+
+    // Choose the split with the lowest cost over bucketed light centroids
+    Bounds3f bounds, centroidBounds;
+    for (int i = start; i < end; ++i) {
+        const Bounds3f &b = bvhLights[i].second.bounds;
+        bounds = Union(bounds, b);
+        centroidBounds = Union(centroidBounds, (b.pMin + b.pMax) / 2);
+    }
+    // Past _MaxSAHDepth_, split by count so that the bit trails fit in 64
+    // bits whatever the light distribution.
+    const int MaxSAHDepth = 24;
+    const int nBuckets = 12;
+    Float minCost = Infinity;
+    int minCostSplitBucket = -1, minCostSplitDim = -1;
+    auto bucketIndex = [&](const LightBounds &lb, int dim) {
+        Point3f pc = (lb.bounds.pMin + lb.bounds.pMax) / 2;
+        int b = nBuckets * centroidBounds.Offset(pc)[dim];
+        return Clamp(b, 0, nBuckets - 1);
+    };
+    for (int dim = 0; depth < MaxSAHDepth && dim < 3; ++dim) {
+        if (centroidBounds.pMax[dim] == centroidBounds.pMin[dim]) continue;
+        LightBounds bucketLightBounds[nBuckets];
+        for (int i = start; i < end; ++i) {
+            int b = bucketIndex(bvhLights[i].second, dim);
+            bucketLightBounds[b] =
+                Union(bucketLightBounds[b], bvhLights[i].second);
+        }
+        for (int i = 0; i < nBuckets - 1; ++i) {
+            LightBounds b0, b1;
+            for (int j = 0; j <= i; ++j)
+                b0 = Union(b0, bucketLightBounds[j]);
+            for (int j = i + 1; j < nBuckets; ++j)
+                b1 = Union(b1, bucketLightBounds[j]);
+            Float cost = EvaluateCost(b0, bounds, dim) +
+                         EvaluateCost(b1, bounds, dim);
+            if (cost < minCost) {
+                minCost = cost;
+                minCostSplitBucket = i;
+                minCostSplitDim = dim;
+            }
+        }
+    }
+
+    // Partition lights according to the chosen split
+    int mid;
+    if (minCostSplitDim == -1)
+        mid = (start + end) / 2;
+    else {
+        auto pmid = std::partition(
+            &bvhLights[start], &bvhLights[end - 1] + 1,
+            [&](const std::pair<int, LightBounds> &l) {
+                return bucketIndex(l.second, minCostSplitDim) <=
+                       minCostSplitBucket;
+            });
+        mid = pmid - &bvhLights[0];
+        if (mid == start || mid == end) mid = (start + end) / 2;
+    }
+
+    // Build children; the first one immediately follows its parent
+    int nodeIndex = nodes.size();
+    nodes.push_back({LightBounds(), -1, false});
+    int child0 = BuildBVH(bvhLights, start, mid, bitTrail, depth + 1);
+    CHECK_EQ(nodeIndex + 1, child0);
+    int child1 = BuildBVH(bvhLights, mid, end,
+                          bitTrail | (uint64_t(1) << depth), depth + 1);
+    nodes[nodeIndex].lightBounds =
+        Union(nodes[child0].lightBounds, nodes[child1].lightBounds);
+    nodes[nodeIndex].childOrLightIndex = child1;
+    return nodeIndex;
+}
+
+const Distribution1D *LightBVHLightDistribution::Lookup(
+    const Point3f &p) const {
+    return powerDistrib.get();
+}
+
+int LightBVHLightDistribution::Sample(const Point3f &p, const Normal3f &n,
+                                      Float u, Float *pmf) const {
+    ProfilePhase _(Prof::LightDistribLookup);
+    // Possibly choose one of the unbounded lights
+    Float pInfinite = PInfinite();
+    if (u < pInfinite) {
+        int nUnbounded = unboundedLights.size();
+        int index = std::min(int(u / pInfinite * nUnbounded), nUnbounded - 1);
+        *pmf = pInfinite / nUnbounded;
+        return unboundedLights[index];
+    }
+    *pmf = 0;
+    if (nodes.empty()) return -1;
+
+    // Descend the BVH, choosing children in proportion to their importance
+    u = std::min((u - pInfinite) / (1 - pInfinite), OneMinusEpsilon);
+    Float nodePmf = 1 - pInfinite;
+    int nodeIndex = 0;
+    while (!nodes[nodeIndex].isLeaf) {
+        const LightBVHNode &node = nodes[nodeIndex];
+        int children[2] = {nodeIndex + 1, node.childOrLightIndex};
+        Float ci[2] = {Importance(nodes[children[0]].lightBounds, p, n),
+                       Importance(nodes[children[1]].lightBounds, p, n)};
+        if (ci[0] == 0 && ci[1] == 0) return -1;
+        Float p0 = ci[0] / (ci[0] + ci[1]);
+        if (u < p0) {
+            u = std::min(u / p0, OneMinusEpsilon);
+            nodePmf *= p0;
+            nodeIndex = children[0];
+        } else {
+            u = std::min((u - p0) / (1 - p0), OneMinusEpsilon);
+            nodePmf *= 1 - p0;
+            nodeIndex = children[1];
+        }
+    }
+    // A root leaf is only chosen if it can contribute at all
+    if (nodeIndex == 0 && Importance(nodes[0].lightBounds, p, n) == 0)
+        return -1;
+    *pmf = nodePmf;
+    return nodes[nodeIndex].childOrLightIndex;
+}
+
+Float LightBVHLightDistribution::Pmf(const Point3f &p, const Normal3f &n,
+                                     int lightIndex) const {
+    uint64_t bitTrail = lightBitTrails[lightIndex];
+    if (bitTrail == UnboundedLight) return PInfinite() / unboundedLights.size();
+    if (bitTrail == UnsampledLight) return 0;
+
+    // Follow the light's bit trail down the BVH, accumulating the
+    // probabilities of the choices that Sample() would make
+    Float pmf = 1 - PInfinite();
+    int nodeIndex = 0;
+    while (!nodes[nodeIndex].isLeaf) {
+        const LightBVHNode &node = nodes[nodeIndex];
+        int children[2] = {nodeIndex + 1, node.childOrLightIndex};
+        Float ci[2] = {Importance(nodes[children[0]].lightBounds, p, n),
+                       Importance(nodes[children[1]].lightBounds, p, n)};
+        int child = bitTrail & 1;
+        if (ci[child] == 0) return 0;
+        pmf *= ci[child] / (ci[0] + ci[1]);
+        nodeIndex = children[child];
+        bitTrail >>= 1;
+    }
+    if (nodeIndex == 0 && Importance(nodes[0].lightBounds, p, n) == 0)
+        return 0;
+    return pmf;
+}
+
 }  // namespace pbrt
@@ -35,6 +35,7 @@
 
 #include "pbrt.h"
 #include "geometry.h"
+#include "light.h"
 #include "sampling.h"
 #include <atomic>
 #include <functional>
@@ -54,6 +55,17 @@ class LightDistribution {
     // Given a point |p| in space, this method returns a (hopefully
     // effective) sampling distribution for light sources at that point.
     virtual const Distribution1D *Lookup(const Point3f &p) const = 0;
+
+    // Samples a light for the point |p| with surface normal |n| (zero for
+    // points in participating media), returning its index in Scene::lights
+    // and the probability of having chosen it in |*pmf|. |*pmf| is zero if
+    // no light could be chosen. Pmf() returns the probability of
+    // Sample() choosing the given light. The default implementations use
+    // the distribution returned by Lookup().
+    virtual int Sample(const Point3f &p, const Normal3f &n, Float u,
+                       Float *pmf) const;
+    virtual Float Pmf(const Point3f &p, const Normal3f &n,
+                      int lightIndex) const;
 };
 
 std::unique_ptr<LightDistribution> CreateLightSampleDistribution(
@@ -124,6 +136,53 @@ class SpatialLightDistribution : public LightDistribution {
     size_t hashTableSize;
 };
 
+// LightBVHLightDistribution samples lights by descending a bounding volume
+// hierarchy built over the lights' LightBounds. At each node it picks a
+// child with probability proportional to a conservative estimate of the
+// child's contribution at the receiving point, which accounts for
+// distance, power and emission direction. Sampling a light and computing
+// its probability both take O(log N) time for N lights, and the
+// hierarchy takes O(N) memory. Lights that can't be bounded (distant and
+// infinite lights) are chosen uniformly, with a probability given by
+// their share of the light count, counting the whole hierarchy as one.
+class LightBVHLightDistribution : public LightDistribution {
+  public:
+    LightBVHLightDistribution(const Scene &scene);
+    // Lookup() has no point-specific answer; it returns a power-based
+    // distribution for callers that need a Distribution1D.
+    const Distribution1D *Lookup(const Point3f &p) const;
+    int Sample(const Point3f &p, const Normal3f &n, Float u,
+               Float *pmf) const;
+    Float Pmf(const Point3f &p, const Normal3f &n, int lightIndex) const;
+
+  private:
+    // LightBVHLightDistribution Private Declarations
+    struct LightBVHNode {
+        LightBounds lightBounds;
+        // Index of the second child for interior nodes (the first child
+        // immediately follows its parent); light index for leaves
+        int childOrLightIndex;
+        bool isLeaf;
+    };
+    int BuildBVH(std::vector<std::pair<int, LightBounds>> &bvhLights,
+                 int start, int end, uint64_t bitTrail, int depth);
+    Float PInfinite() const {
+        if (unboundedLights.empty()) return 0;
+        return Float(unboundedLights.size()) /
+               Float(unboundedLights.size() + (nodes.empty() ? 0 : 1));
+    }
+
+    // LightBVHLightDistribution Private Data
+    std::vector<int> unboundedLights;
+    std::vector<LightBVHNode> nodes;
+    // Path from the root to each light's leaf, one bit per level, with
+    // _UnboundedLight_ and _UnsampledLight_ marking lights not in the BVH
+    std::vector<uint64_t> lightBitTrails;
+    static PBRT_CONSTEXPR uint64_t UnboundedLight = ~uint64_t(0);
+    static PBRT_CONSTEXPR uint64_t UnsampledLight = ~uint64_t(0) - 1;
+    std::unique_ptr<Distribution1D> powerDistrib;
+};
+
 }  // namespace pbrt
 
 #endif  // PBRT_CORE_LIGHTDISTRIB_H
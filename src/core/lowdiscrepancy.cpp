@@ -423,6 +423,31 @@ ScrambledRadicalInverseSpecialized(const uint16_t *perm, uint64_t a) {
         OneMinusEpsilon);
 }
 
+// Batched version of _ScrambledRadicalInverseSpecialized()_; the digit
+// loop is inlined here so that the base is a compile-time constant for
+// all _n_ values.
+template <int base>
+static void ScrambledRadicalInverseSpecialized(const uint16_t *perm,
+                                               const uint64_t *a, int n,
+                                               Float *result) {
+    const Float invBase = (Float)1 / (Float)base;
+    const Float permOffset = invBase * perm[0] / (1 - invBase);
+    for (int i = 0; i < n; ++i) {
+        uint64_t ai = a[i], reversedDigits = 0;
+        Float invBaseN = 1;
+        while (ai) {
+            uint64_t next = ai / base;
+            uint64_t digit = ai - next * base;
+            DCHECK_LT(perm[digit], base);
+            reversedDigits = reversedDigits * base + perm[digit];
+            invBaseN *= invBase;
+            ai = next;
+        }
+        result[i] =
+            std::min(invBaseN * (reversedDigits + permOffset), OneMinusEpsilon);
+    }
+}
+
 // Low Discrepancy Function Definitions
 Float RadicalInverse(int baseIndex, uint64_t a) {
     switch (baseIndex) {
@@ -4562,4 +4587,158 @@ Float ScrambledRadicalInverse(int baseIndex, uint64_t a, const uint16_t *perm) {
     }
 }
 
+void ScrambledRadicalInverse(int baseIndex, const uint64_t *a, int n,
+                             const uint16_t *perm, Float *result) {
+    // Only the low dimensions, which samplers request most often, get
+    // specialized batch implementations.
+    switch (baseIndex) {
+    case 0:
+        ScrambledRadicalInverseSpecialized<2>(perm, a, n, result);
+        break;
+    case 1:
+        ScrambledRadicalInverseSpecialized<3>(perm, a, n, result);
+        break;
+    case 2:
+        ScrambledRadicalInverseSpecialized<5>(perm, a, n, result);
+        break;
+    case 3:
+        ScrambledRadicalInverseSpecialized<7>(perm, a, n, result);
+        break;
+    case 4:
+        ScrambledRadicalInverseSpecialized<11>(perm, a, n, result);
+        break;
+    case 5:
+        ScrambledRadicalInverseSpecialized<13>(perm, a, n, result);
+        break;
+    case 6:
+        ScrambledRadicalInverseSpecialized<17>(perm, a, n, result);
+        break;
+    case 7:
+        ScrambledRadicalInverseSpecialized<19>(perm, a, n, result);
+        break;
+    case 8:
+        ScrambledRadicalInverseSpecialized<23>(perm, a, n, result);
+        break;
+    case 9:
+        ScrambledRadicalInverseSpecialized<29>(perm, a, n, result);
+        break;
+    case 10:
+        ScrambledRadicalInverseSpecialized<31>(perm, a, n, result);
+        break;
+    case 11:
+        ScrambledRadicalInverseSpecialized<37>(perm, a, n, result);
+        break;
+    case 12:
+        ScrambledRadicalInverseSpecialized<41>(perm, a, n, result);
+        break;
+    case 13:
+        ScrambledRadicalInverseSpecialized<43>(perm, a, n, result);
+        break;
+    case 14:
+        ScrambledRadicalInverseSpecialized<47>(perm, a, n, result);
+        break;
+    case 15:
+        ScrambledRadicalInverseSpecialized<53>(perm, a, n, result);
+        break;
+    case 16:
+        ScrambledRadicalInverseSpecialized<59>(perm, a, n, result);
+        break;
+    case 17:
+        ScrambledRadicalInverseSpecialized<61>(perm, a, n, result);
+        break;
+    case 18:
+        ScrambledRadicalInverseSpecialized<67>(perm, a, n, result);
+        break;
+    case 19:
+        ScrambledRadicalInverseSpecialized<71>(perm, a, n, result);
+        break;
+    case 20:
+        ScrambledRadicalInverseSpecialized<73>(perm, a, n, result);
+        break;
+    case 21:
+        ScrambledRadicalInverseSpecialized<79>(perm, a, n, result);
+        break;
+    case 22:
+        ScrambledRadicalInverseSpecialized<83>(perm, a, n, result);
+        break;
+    case 23:
+        ScrambledRadicalInverseSpecialized<89>(perm, a, n, result);
+        break;
+    case 24:
+        ScrambledRadicalInverseSpecialized<97>(perm, a, n, result);
+        break;
+    case 25:
+        ScrambledRadicalInverseSpecialized<101>(perm, a, n, result);
+        break;
+    case 26:
+        ScrambledRadicalInverseSpecialized<103>(perm, a, n, result);
+        break;
+    case 27:
+        ScrambledRadicalInverseSpecialized<107>(perm, a, n, result);
+        break;
+    case 28:
+        ScrambledRadicalInverseSpecialized<109>(perm, a, n, result);
+        break;
+    case 29:
+        ScrambledRadicalInverseSpecialized<113>(perm, a, n, result);
+        break;
+    case 30:
+        ScrambledRadicalInverseSpecialized<127>(perm, a, n, result);
+        break;
+    case 31:
+        ScrambledRadicalInverseSpecialized<131>(perm, a, n, result);
+        break;
+    default:
+        for (int i = 0; i < n; ++i)
+            result[i] = ScrambledRadicalInverse(baseIndex, a[i], perm);
+        break;
+    }
+}
+
+void SobolSample(const int64_t *indices, int n, int dimension,
+                 Float *samples) {
+    CHECK_LT(dimension, NumSobolDimensions) <<
+        "Integrator has consumed too many Sobol' dimensions; you "
+        "may want to use a Sampler without a dimension limit like "
+        "\"02sequence.\"";
+    // Find the highest index bit used by the batch so that the inner
+    // loops below have a fixed trip count and no data-dependent branches;
+    // each block of samples is then computed in parallel across SIMD
+    // lanes by the compiler.
+    uint64_t allBits = 0;
+    for (int i = 0; i < n; ++i) allBits |= (uint64_t)indices[i];
+    int nBits = allBits ? Log2Int(allBits) + 1 : 0;
+#ifdef PBRT_FLOAT_AS_DOUBLE
+    typedef uint64_t SobolBits;
+    const SobolBits *matrix = &SobolMatrices64[dimension * SobolMatrixSize];
+#else
+    typedef uint32_t SobolBits;
+    const SobolBits *matrix = &SobolMatrices32[dimension * SobolMatrixSize];
+#endif
+    const int BlockSize = 8;
+    for (int start = 0; start < n; start += BlockSize) {
+        int count = std::min(BlockSize, n - start);
+        const int64_t *blockIndices = indices + start;
+        SobolBits v[BlockSize] = {0};
+        for (int b = 0; b < nBits; ++b)
+            for (int i = 0; i < count; ++i)
+                v[i] ^= matrix[b] &
+                        ((SobolBits)0 - (SobolBits)((blockIndices[i] >> b) & 1));
+        for (int i = 0; i < count; ++i) {
+#ifdef PBRT_FLOAT_AS_DOUBLE
+            samples[start + i] =
+                std::min(v[i] * (1.0 / (1ULL << SobolMatrixSize)),
+                         DoubleOneMinusEpsilon);
+#elif !defined(PBRT_HAVE_HEX_FP_CONSTANTS)
+            samples[start + i] = std::min(
+                v[i] * 2.3283064365386963e-10f /* 1/2^32 */,
+                FloatOneMinusEpsilon);
+#else
+            samples[start + i] =
+                std::min(v[i] * 0x1p-32f /* 1/2^32 */, FloatOneMinusEpsilon);
+#endif
+        }
+    }
+}
+
 }  // namespace pbrt
@@ -52,6 +52,8 @@ std::vector<uint16_t> ComputeRadicalInversePermutations(RNG &rng);
 static PBRT_CONSTEXPR int PrimeTableSize = 1000;
 extern const int Primes[PrimeTableSize];
 Float ScrambledRadicalInverse(int baseIndex, uint64_t a, const uint16_t *perm);
+void ScrambledRadicalInverse(int baseIndex, const uint64_t *a, int n,
+                             const uint16_t *perm, Float *result);
 extern const int PrimeSums[PrimeTableSize];
 inline void Sobol2D(int nSamplesPerPixelSample, int nPixelSamples,
                     Point2f *samples, RNG &rng);
@@ -62,6 +64,7 @@ inline float SobolSampleFloat(int64_t index, int dimension,
                               uint32_t scramble = 0);
 inline double SobolSampleDouble(int64_t index, int dimension,
                                 uint64_t scramble = 0);
+void SobolSample(const int64_t *indices, int n, int dimension, Float *samples);
 
 // Low Discrepancy Inline Functions
 inline uint32_t ReverseBits32(uint32_t n) {
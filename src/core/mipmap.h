@@ -44,6 +44,7 @@
 #include "texture.h"
 #include "stats.h"
 #include "parallel.h"
+#include "texcache.h"
 
 namespace pbrt {
 
@@ -65,10 +66,11 @@ class MIPMap {
     // MIPMap Public Methods
     MIPMap(const Point2i &resolution, const T *data, bool doTri = false,
            Float maxAniso = 8.f, ImageWrap wrapMode = ImageWrap::Repeat);
+    ~MIPMap();
     int Width() const { return resolution[0]; }
     int Height() const { return resolution[1]; }
-    int Levels() const { return pyramid.size(); }
-    const T &Texel(int level, int s, int t) const;
+    int Levels() const { return levelResolution.size(); }
+    T Texel(int level, int s, int t) const;
     T Lookup(const Point2f &st, Float width = 0.f) const;
     T Lookup(const Point2f &st, Vector2f dstdx, Vector2f dstdy) const;
 
@@ -101,13 +103,22 @@ class MIPMap {
     }
     T triangle(int level, const Point2f &st) const;
     T EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const;
+    void MoveLevelsToTileCache();
 
     // MIPMap Private Data
     const bool doTrilinear;
     const Float maxAnisotropy;
     const ImageWrap wrapMode;
     Point2i resolution;
+    std::vector<Point2i> levelResolution;
     std::vector<std::unique_ptr<BlockedArray<T>>> pyramid;
+    // When the texture tile cache is enabled, the pyramid entries for
+    // levels larger than a single tile are released and their texels are
+    // found through the cache instead.
+    TextureTileCache *tileCache = nullptr;
+    std::vector<int> levelFirstTile, levelTilesU;
+    static PBRT_CONSTEXPR int LogTileSize = 6;
+    static PBRT_CONSTEXPR int TileSize = 1 << LogTileSize;
     static PBRT_CONSTEXPR int WeightLUTSize = 128;
     static Float weightLut[WeightLUTSize];
 };
@@ -184,16 +195,19 @@ MIPMap<T>::MIPMap(const Point2i &res, const T *img, bool doTrilinear,
     // Initialize levels of MIPMap from image
     int nLevels = 1 + Log2Int(std::max(resolution[0], resolution[1]));
     pyramid.resize(nLevels);
+    levelResolution.resize(nLevels);
 
     // Initialize most detailed level of MIPMap
     pyramid[0].reset(
         new BlockedArray<T>(resolution[0], resolution[1],
                             resampledImage ? resampledImage.get() : img));
+    levelResolution[0] = resolution;
     for (int i = 1; i < nLevels; ++i) {
         // Initialize $i$th MIPMap level from $i-1$st level
         int sRes = std::max(1, pyramid[i - 1]->uSize() / 2);
         int tRes = std::max(1, pyramid[i - 1]->vSize() / 2);
         pyramid[i].reset(new BlockedArray<T>(sRes, tRes));
+        levelResolution[i] = Point2i(sRes, tRes);
 
         // Filter four texels from finer level of pyramid
         ParallelFor([&](int t) {
@@ -214,31 +228,86 @@ MIPMap<T>::MIPMap(const Point2i &res, const T *img, bool doTrilinear,
             weightLut[i] = std::exp(-alpha * r2) - std::exp(-alpha);
         }
     }
-    mipMapMemory += (4 * resolution[0] * resolution[1] * sizeof(T)) / 3;
+
+    tileCache = TextureTileCache::Get();
+    if (tileCache)
+        MoveLevelsToTileCache();
+    else
+        mipMapMemory += (4 * resolution[0] * resolution[1] * sizeof(T)) / 3;
+}
+
+template <typename T>
+MIPMap<T>::~MIPMap() {
+    // The cache may already have been shut down, in which case the tiles
+    // went with it.
+    if (!tileCache || tileCache != TextureTileCache::Get()) return;
+    for (int i = 0; i < Levels(); ++i) {
+        if (pyramid[i]) continue;
+        int nTilesV = (levelResolution[i][1] + TileSize - 1) >> LogTileSize;
+        tileCache->FreeTiles(levelFirstTile[i], levelTilesU[i] * nTilesV);
+    }
+}
+
+template <typename T>
+void MIPMap<T>::MoveLevelsToTileCache() {
+    levelFirstTile.resize(Levels(), -1);
+    levelTilesU.resize(Levels(), 0);
+    std::vector<T> tile(TileSize * TileSize);
+    for (int i = 0; i < Levels(); ++i) {
+        const BlockedArray<T> &l = *pyramid[i];
+        // Levels that fit in a single tile are cheap enough to keep
+        // resident.
+        if (l.uSize() * l.vSize() <= TileSize * TileSize) {
+            mipMapMemory += l.uSize() * l.vSize() * sizeof(T);
+            continue;
+        }
+        int nTilesU = (l.uSize() + TileSize - 1) >> LogTileSize;
+        int nTilesV = (l.vSize() + TileSize - 1) >> LogTileSize;
+        levelTilesU[i] = nTilesU;
+        for (int tv = 0; tv < nTilesV; ++tv)
+            for (int tu = 0; tu < nTilesU; ++tu) {
+                // Copy texels for tile $(tu,tv)$, padding at the edges
+                for (int t = 0; t < TileSize; ++t)
+                    for (int s = 0; s < TileSize; ++s) {
+                        int ls = tu * TileSize + s, lt = tv * TileSize + t;
+                        tile[t * TileSize + s] =
+                            (ls < l.uSize() && lt < l.vSize()) ? l(ls, lt)
+                                                               : T(0.f);
+                    }
+                int tileId = tileCache->AddTile(tile.data(),
+                                                tile.size() * sizeof(T));
+                if (tu == 0 && tv == 0) levelFirstTile[i] = tileId;
+            }
+        pyramid[i].reset();
+    }
 }
 
 template <typename T>
-const T &MIPMap<T>::Texel(int level, int s, int t) const {
-    CHECK_LT(level, pyramid.size());
-    const BlockedArray<T> &l = *pyramid[level];
+T MIPMap<T>::Texel(int level, int s, int t) const {
+    CHECK_LT(level, Levels());
+    const Point2i &res = levelResolution[level];
     // Compute texel $(s,t)$ accounting for boundary conditions
     switch (wrapMode) {
     case ImageWrap::Repeat:
-        s = Mod(s, l.uSize());
-        t = Mod(t, l.vSize());
+        s = Mod(s, res[0]);
+        t = Mod(t, res[1]);
         break;
     case ImageWrap::Clamp:
-        s = Clamp(s, 0, l.uSize() - 1);
-        t = Clamp(t, 0, l.vSize() - 1);
+        s = Clamp(s, 0, res[0] - 1);
+        t = Clamp(t, 0, res[1] - 1);
         break;
     case ImageWrap::Black: {
-        static const T black = 0.f;
-        if (s < 0 || s >= (int)l.uSize() || t < 0 || t >= (int)l.vSize())
-            return black;
+        if (s < 0 || s >= res[0] || t < 0 || t >= res[1]) return T(0.f);
         break;
     }
     }
-    return l(s, t);
+    if (pyramid[level]) return (*pyramid[level])(s, t);
+
+    // Look up texel $(s,t)$ through the texture tile cache
+    int tileId = levelFirstTile[level] +
+                 (t >> LogTileSize) * levelTilesU[level] + (s >> LogTileSize);
+    const T *tile = (const T *)tileCache->GetTile(tileId);
+    return tile[(t & (TileSize - 1)) * TileSize + (s & (TileSize - 1))];
 }
 
 template <typename T>
@@ -263,8 +332,8 @@ T MIPMap<T>::Lookup(const Point2f &st, Float width) const {
 template <typename T>
 T MIPMap<T>::triangle(int level, const Point2f &st) const {
     level = Clamp(level, 0, Levels() - 1);
-    Float s = st[0] * pyramid[level]->uSize() - 0.5f;
-    Float t = st[1] * pyramid[level]->vSize() - 0.5f;
+    Float s = st[0] * levelResolution[level][0] - 0.5f;
+    Float t = st[1] * levelResolution[level][1] - 0.5f;
     int s0 = std::floor(s), t0 = std::floor(t);
     Float ds = s - s0, dt = t - t0;
     return (1 - ds) * (1 - dt) * Texel(level, s0, t0) +
@@ -306,12 +375,12 @@ template <typename T>
 T MIPMap<T>::EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const {
     if (level >= Levels()) return Texel(Levels() - 1, 0, 0);
     // Convert EWA coordinates to appropriate scale for level
-    st[0] = st[0] * pyramid[level]->uSize() - 0.5f;
-    st[1] = st[1] * pyramid[level]->vSize() - 0.5f;
-    dst0[0] *= pyramid[level]->uSize();
-    dst0[1] *= pyramid[level]->vSize();
-    dst1[0] *= pyramid[level]->uSize();
-    dst1[1] *= pyramid[level]->vSize();
+    st[0] = st[0] * levelResolution[level][0] - 0.5f;
+    st[1] = st[1] * levelResolution[level][1] - 0.5f;
+    dst0[0] *= levelResolution[level][0];
+    dst0[1] *= levelResolution[level][1];
+    dst1[0] *= levelResolution[level][0];
+    dst1[1] *= levelResolution[level][1];
 
     // Compute ellipse coefficients to bound EWA filter region
     Float A = dst0[1] * dst0[1] + dst1[1] * dst1[1] + 1;
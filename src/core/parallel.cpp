@@ -35,7 +35,7 @@
 #include "parallel.h"
 #include "memory.h"
 #include "stats.h"
-#include <list>
+#include <deque>
 #include <thread>
 #include <condition_variable>
 
@@ -43,14 +43,14 @@ namespace pbrt {
 
 // Parallel Local Definitions
 static std::vector<std::thread> threads;
-static bool shutdownThreads = false;
+static std::atomic<bool> shutdownThreads{false};
+static PBRT_THREAD_LOCAL bool parallelThread;
 class ParallelForLoop;
-static ParallelForLoop *workList = nullptr;
-static std::mutex workListMutex;
 
 // Bookkeeping variables to help with the implementation of
 // MergeWorkerThreadStats().
-static std::atomic<bool> reportWorkerStats{false};
+// Incremented each time the main thread asks the workers for their stats.
+static std::atomic<int> reportGeneration{0};
 // Number of workers that still need to report their stats.
 static std::atomic<int> reporterCount;
 // After kicking the workers to report their stats, the main thread waits
@@ -58,6 +58,8 @@ static std::atomic<int> reporterCount;
 static std::condition_variable reportDoneCondition;
 static std::mutex reportDoneMutex;
 
+STAT_COUNTER("Parallel/Tasks stolen", nTasksStolen);
+
 class ParallelForLoop {
   public:
     // ParallelForLoop Public Methods
@@ -66,13 +68,15 @@ class ParallelForLoop {
         : func1D(std::move(func1D)),
           maxIndex(maxIndex),
           chunkSize(chunkSize),
-          profilerState(profilerState) {}
+          profilerState(profilerState),
+          remaining(maxIndex) {}
     ParallelForLoop(const std::function<void(Point2i)> &f, const Point2i &count,
                     uint64_t profilerState)
         : func2D(f),
           maxIndex(count.x * count.y),
           chunkSize(1),
-          profilerState(profilerState) {
+          profilerState(profilerState),
+          remaining(maxIndex) {
         nX = count.x;
     }
 
@@ -83,16 +87,57 @@ class ParallelForLoop {
     const int64_t maxIndex;
     const int chunkSize;
     uint64_t profilerState;
-    int64_t nextIndex = 0;
-    int activeWorkers = 0;
-    ParallelForLoop *next = nullptr;
+    // Number of loop iterations that haven't finished running yet
+    std::atomic<int64_t> remaining;
     int nX = -1;
 
     // ParallelForLoop Private Methods
-    bool Finished() const {
-        return nextIndex >= maxIndex && activeWorkers == 0;
+    bool Finished() const { return remaining.load() == 0; }
+};
+
+// A contiguous range of iterations of a _ParallelForLoop_. Ranges are
+// split in half until they are no larger than the loop's chunk size; the
+// halves that aren't run right away go on the current thread's
+// _WorkQueue_, where they may be stolen by other threads.
+struct RangeTask {
+    ParallelForLoop *loop;
+    int64_t indexStart, indexEnd;
+};
+
+// Each thread has its own double-ended queue of tasks. The owner pushes
+// and pops at the back, so it works on the most recently split (smallest,
+// cache-warm) ranges, while thieves take from the front, where the
+// largest ranges are. Each queue has its own lock, so threads only
+// contend when one of them is stealing from another.
+struct
+#ifdef PBRT_HAVE_ALIGNAS
+alignas(PBRT_L1_CACHE_LINE_SIZE)
+#endif // PBRT_HAVE_ALIGNAS
+    WorkQueue {
+    std::mutex mutex;
+    std::deque<RangeTask> tasks;
+    // Number of tasks in _tasks_, readable without holding _mutex_
+    std::atomic<int> size{0};
+};
+// The queues are allocated with AllocAligned(), since operator new isn't
+// required to respect their alignment before C++17.
+struct WorkQueuesDeleter {
+    int count;
+    void operator()(WorkQueue *queues) const {
+        for (int i = 0; i < count; ++i) queues[i].~WorkQueue();
+        FreeAligned(queues);
     }
 };
+static std::unique_ptr<WorkQueue[], WorkQueuesDeleter> workQueues;
+static int nWorkQueues = 0;
+
+// Idle workers sleep on _workCondition_. _workEpoch_ is incremented
+// whenever new tasks are pushed; a worker only goes to sleep if it hasn't
+// changed since it last looked for work, so wakeups can't be lost.
+static std::atomic<uint64_t> workEpoch{0};
+static std::atomic<int> nSleepingWorkers{0};
+static std::mutex workMutex;
+static std::condition_variable workCondition;
 
 void Barrier::Wait() {
     std::unique_lock<std::mutex> lock(mutex);
@@ -107,11 +152,126 @@ void Barrier::Wait() {
         cv.wait(lock, [this] { return count == 0; });
 }
 
-static std::condition_variable workListCondition;
+static WorkQueue &LocalWorkQueue() {
+    // Threads that weren't launched by ParallelInit() have a _ThreadIndex_
+    // of zero and share the main thread's queue.
+    DCHECK_LT(ThreadIndex, nWorkQueues);
+    return workQueues[ThreadIndex];
+}
+
+static void PushTask(const RangeTask &task) {
+    WorkQueue &queue = LocalWorkQueue();
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(task);
+        queue.size = (int)queue.tasks.size();
+    }
+
+    // Wake up a sleeping worker, if there is one
+    ++workEpoch;
+    if (nSleepingWorkers > 0) {
+        std::lock_guard<std::mutex> lock(workMutex);
+        workCondition.notify_one();
+    }
+}
+
+// Pops the most recently pushed task from the current thread's queue. If
+// _loop_ is non-null, only a task from that loop is returned.
+static bool PopTask(ParallelForLoop *loop, RangeTask *task) {
+    WorkQueue &queue = LocalWorkQueue();
+    if (queue.size == 0) return false;
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty() || (loop && queue.tasks.back().loop != loop))
+        return false;
+    *task = queue.tasks.back();
+    queue.tasks.pop_back();
+    queue.size = (int)queue.tasks.size();
+    return true;
+}
+
+// Takes the oldest task from another thread's queue. If _loop_ is
+// non-null, only a task from that loop is returned.
+static bool StealTask(ParallelForLoop *loop, RangeTask *task) {
+    for (int i = 1; i < nWorkQueues; ++i) {
+        WorkQueue &victim = workQueues[(ThreadIndex + i) % nWorkQueues];
+        if (victim.size == 0) continue;
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        auto iter = victim.tasks.begin();
+        if (loop)
+            iter = std::find_if(
+                victim.tasks.begin(), victim.tasks.end(),
+                [loop](const RangeTask &t) { return t.loop == loop; });
+        if (iter == victim.tasks.end()) continue;
+        *task = *iter;
+        victim.tasks.erase(iter);
+        victim.size = (int)victim.tasks.size();
+        ++nTasksStolen;
+        return true;
+    }
+    return false;
+}
+
+static void RunTask(RangeTask task) {
+    ParallelForLoop &loop = *task.loop;
+    // Split off the upper half of the range until it's no larger than the
+    // loop's chunk size, leaving the other halves for this thread or for
+    // thieves
+    while (task.indexEnd - task.indexStart > loop.chunkSize) {
+        int64_t nChunks =
+            (task.indexEnd - task.indexStart + loop.chunkSize - 1) /
+            loop.chunkSize;
+        int64_t indexMid = task.indexStart + (nChunks / 2) * loop.chunkSize;
+        PushTask({task.loop, indexMid, task.indexEnd});
+        task.indexEnd = indexMid;
+    }
+
+    // Run loop indices in _[indexStart, indexEnd)_
+    uint64_t oldState = ProfilerState;
+    ProfilerState = loop.profilerState;
+    for (int64_t index = task.indexStart; index < task.indexEnd; ++index) {
+        if (loop.func1D) {
+            loop.func1D(index);
+        }
+        // Handle other types of loops
+        else {
+            CHECK(loop.func2D);
+            loop.func2D(Point2i(index % loop.nX, index / loop.nX));
+        }
+    }
+    ProfilerState = oldState;
+
+    // Update _loop_ to reflect completion of iterations
+    loop.remaining -= task.indexEnd - task.indexStart;
+}
+
+// Runs _loop_ to completion, with the calling thread working on the
+// loop's tasks until all of them have finished. The caller only runs
+// tasks that belong to _loop_ while waiting, so that it doesn't start
+// unrelated work while its own stack frame (and any per-thread state it's
+// using) is suspended.
+static void RunLoop(ParallelForLoop &loop) {
+    RunTask({&loop, 0, loop.maxIndex});
+    RangeTask task;
+    // Threads that aren't workers, such as the main thread, also merge
+    // their stats here when asked to, so that stats snapshots taken during
+    // rendering include their work.
+    static PBRT_THREAD_LOCAL int lastReportGeneration;
+    while (!loop.Finished()) {
+        if (ThreadIndex == 0 && reportGeneration != lastReportGeneration) {
+            lastReportGeneration = reportGeneration;
+            ReportThreadStats();
+        }
+        if (PopTask(&loop, &task) || StealTask(&loop, &task))
+            RunTask(task);
+        else
+            std::this_thread::yield();
+    }
+}
 
 static void workerThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
     LOG(INFO) << "Started execution in worker thread " << tIndex;
     ThreadIndex = tIndex;
+    parallelThread = true;
 
     // Give the profiler a chance to do per-thread initialization for
     // the worker thread before the profiling system actually stops running.
@@ -126,56 +286,36 @@ static void workerThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
     // the threads have cleared it.
     barrier.reset();
 
-    std::unique_lock<std::mutex> lock(workListMutex);
+    int lastReportGeneration = reportGeneration;
     while (!shutdownThreads) {
-        if (reportWorkerStats) {
+        if (reportGeneration != lastReportGeneration) {
+            lastReportGeneration = reportGeneration;
             ReportThreadStats();
+            std::lock_guard<std::mutex> lock(reportDoneMutex);
             if (--reporterCount == 0)
                 // Once all worker threads have merged their stats, wake up
                 // the main thread.
                 reportDoneCondition.notify_one();
-            // Now sleep again.
-            workListCondition.wait(lock);
-        } else if (!workList) {
-            // Sleep until there are more tasks to run
-            workListCondition.wait(lock);
-        } else {
-            // Get work from _workList_ and run loop iterations
-            ParallelForLoop &loop = *workList;
-
-            // Run a chunk of loop iterations for _loop_
-
-            // Find the set of loop iterations to run next
-            int64_t indexStart = loop.nextIndex;
-            int64_t indexEnd =
-                std::min(indexStart + loop.chunkSize, loop.maxIndex);
-
-            // Update _loop_ to reflect iterations this thread will run
-            loop.nextIndex = indexEnd;
-            if (loop.nextIndex == loop.maxIndex) workList = loop.next;
-            loop.activeWorkers++;
-
-            // Run loop indices in _[indexStart, indexEnd)_
-            lock.unlock();
-            for (int64_t index = indexStart; index < indexEnd; ++index) {
-                uint64_t oldState = ProfilerState;
-                ProfilerState = loop.profilerState;
-                if (loop.func1D) {
-                    loop.func1D(index);
-                }
-                // Handle other types of loops
-                else {
-                    CHECK(loop.func2D);
-                    loop.func2D(Point2i(index % loop.nX, index / loop.nX));
-                }
-                ProfilerState = oldState;
-            }
-            lock.lock();
-
-            // Update _loop_ to reflect completion of iterations
-            loop.activeWorkers--;
-            if (loop.Finished()) workListCondition.notify_all();
+            continue;
+        }
+
+        // Run a task from this thread's queue or steal one from another
+        // thread
+        uint64_t epoch = workEpoch;
+        RangeTask task;
+        if (PopTask(nullptr, &task) || StealTask(nullptr, &task)) {
+            RunTask(task);
+            continue;
         }
+
+        // Sleep until there are more tasks to run
+        std::unique_lock<std::mutex> lock(workMutex);
+        ++nSleepingWorkers;
+        workCondition.wait(lock, [&]() {
+            return workEpoch != epoch || shutdownThreads ||
+                   reportGeneration != lastReportGeneration;
+        });
+        --nSleepingWorkers;
     }
     LOG(INFO) << "Exiting worker thread " << tIndex;
 }
@@ -191,55 +331,16 @@ void ParallelFor(std::function<void(int64_t)> func, int64_t count,
         return;
     }
 
-    // Create and enqueue _ParallelForLoop_ for this loop
+    // Create a _ParallelForLoop_ for this loop and run it
     ParallelForLoop loop(std::move(func), count, chunkSize,
                          CurrentProfilerState());
-    workListMutex.lock();
-    loop.next = workList;
-    workList = &loop;
-    workListMutex.unlock();
-
-    // Notify worker threads of work to be done
-    std::unique_lock<std::mutex> lock(workListMutex);
-    workListCondition.notify_all();
-
-    // Help out with parallel loop iterations in the current thread
-    while (!loop.Finished()) {
-        // Run a chunk of loop iterations for _loop_
-
-        // Find the set of loop iterations to run next
-        int64_t indexStart = loop.nextIndex;
-        int64_t indexEnd = std::min(indexStart + loop.chunkSize, loop.maxIndex);
-
-        // Update _loop_ to reflect iterations this thread will run
-        loop.nextIndex = indexEnd;
-        if (loop.nextIndex == loop.maxIndex) workList = loop.next;
-        loop.activeWorkers++;
-
-        // Run loop indices in _[indexStart, indexEnd)_
-        lock.unlock();
-        for (int64_t index = indexStart; index < indexEnd; ++index) {
-            uint64_t oldState = ProfilerState;
-            ProfilerState = loop.profilerState;
-            if (loop.func1D) {
-                loop.func1D(index);
-            }
-            // Handle other types of loops
-            else {
-                CHECK(loop.func2D);
-                loop.func2D(Point2i(index % loop.nX, index / loop.nX));
-            }
-            ProfilerState = oldState;
-        }
-        lock.lock();
-
-        // Update _loop_ to reflect completion of iterations
-        loop.activeWorkers--;
-    }
+    RunLoop(loop);
 }
 
 PBRT_THREAD_LOCAL int ThreadIndex;
 
+bool IsParallelThread() { return parallelThread; }
+
 int MaxThreadIndex() {
     return PbrtOptions.nThreads == 0 ? NumSystemCores() : PbrtOptions.nThreads;
 }
@@ -254,48 +355,7 @@ void ParallelFor2D(std::function<void(Point2i)> func, const Point2i &count) {
     }
 
     ParallelForLoop loop(std::move(func), count, CurrentProfilerState());
-    {
-        std::lock_guard<std::mutex> lock(workListMutex);
-        loop.next = workList;
-        workList = &loop;
-    }
-
-    std::unique_lock<std::mutex> lock(workListMutex);
-    workListCondition.notify_all();
-
-    // Help out with parallel loop iterations in the current thread
-    while (!loop.Finished()) {
-        // Run a chunk of loop iterations for _loop_
-
-        // Find the set of loop iterations to run next
-        int64_t indexStart = loop.nextIndex;
-        int64_t indexEnd = std::min(indexStart + loop.chunkSize, loop.maxIndex);
-
-        // Update _loop_ to reflect iterations this thread will run
-        loop.nextIndex = indexEnd;
-        if (loop.nextIndex == loop.maxIndex) workList = loop.next;
-        loop.activeWorkers++;
-
-        // Run loop indices in _[indexStart, indexEnd)_
-        lock.unlock();
-        for (int64_t index = indexStart; index < indexEnd; ++index) {
-            uint64_t oldState = ProfilerState;
-            ProfilerState = loop.profilerState;
-            if (loop.func1D) {
-                loop.func1D(index);
-            }
-            // Handle other types of loops
-            else {
-                CHECK(loop.func2D);
-                loop.func2D(Point2i(index % loop.nX, index / loop.nX));
-            }
-            ProfilerState = oldState;
-        }
-        lock.lock();
-
-        // Update _loop_ to reflect completion of iterations
-        loop.activeWorkers--;
-    }
+    RunLoop(loop);
 }
 
 int NumSystemCores() {
@@ -306,6 +366,13 @@ void ParallelInit() {
     CHECK_EQ(threads.size(), 0);
     int nThreads = MaxThreadIndex();
     ThreadIndex = 0;
+    parallelThread = true;
+
+    nWorkQueues = nThreads;
+    WorkQueue *queues = AllocAligned<WorkQueue>(nWorkQueues);
+    for (int i = 0; i < nWorkQueues; ++i) new (&queues[i]) WorkQueue;
+    workQueues = std::unique_ptr<WorkQueue[], WorkQueuesDeleter>(
+        queues, WorkQueuesDeleter{nWorkQueues});
 
     // Create a barrier so that we can be sure all worker threads get past
     // their call to ProfilerWorkerThreadInit() before we return from this
@@ -325,31 +392,37 @@ void ParallelCleanup() {
     if (threads.empty()) return;
 
     {
-        std::lock_guard<std::mutex> lock(workListMutex);
+        std::lock_guard<std::mutex> lock(workMutex);
         shutdownThreads = true;
-        workListCondition.notify_all();
+        workCondition.notify_all();
     }
 
     for (std::thread &thread : threads) thread.join();
     threads.erase(threads.begin(), threads.end());
     shutdownThreads = false;
+    workQueues.reset();
+    nWorkQueues = 0;
 }
 
 void MergeWorkerThreadStats() {
-    std::unique_lock<std::mutex> lock(workListMutex);
+    // Stats snapshots may be requested concurrently with the main thread's
+    // merge at the end of rendering.
+    static std::mutex mergeMutex;
+    std::lock_guard<std::mutex> mergeLock(mergeMutex);
     std::unique_lock<std::mutex> doneLock(reportDoneMutex);
     // Set up state so that the worker threads will know that we would like
     // them to report their thread-specific stats when they wake up.
-    reportWorkerStats = true;
     reporterCount = threads.size();
-
-    // Wake up the worker threads.
-    workListCondition.notify_all();
+    if (reporterCount == 0) return;
+    {
+        std::lock_guard<std::mutex> lock(workMutex);
+        ++reportGeneration;
+        // Wake up the worker threads.
+        workCondition.notify_all();
+    }
 
     // Wait for all of them to merge their stats.
-    reportDoneCondition.wait(lock, []() { return reporterCount == 0; });
-
-    reportWorkerStats = false;
+    reportDoneCondition.wait(doneLock, []() { return reporterCount == 0; });
 }
 
 }  // namespace pbrt
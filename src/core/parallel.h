@@ -101,6 +101,10 @@ class Barrier {
 void ParallelFor(std::function<void(int64_t)> func, int64_t count,
                  int chunkSize = 1);
 extern PBRT_THREAD_LOCAL int ThreadIndex;
+// Returns true for the thread that called ParallelInit() and the worker
+// threads that it launched; other threads also have a _ThreadIndex_ of
+// zero.
+bool IsParallelThread();
 void ParallelFor2D(std::function<void(Point2i)> func, const Point2i &count);
 int MaxThreadIndex();
 int NumSystemCores();
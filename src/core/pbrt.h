@@ -148,6 +148,7 @@ class VisibilityTester;
 class AreaLight;
 struct Distribution1D;
 class Distribution2D;
+class LightDistribution;
 //#define PBRT_FLOAT_AS_DOUBLE
 #ifdef PBRT_FLOAT_AS_DOUBLE
 typedef double Float;
@@ -169,6 +170,44 @@ struct Options {
     bool quiet = false;
     bool cat = false, toPly = false;
     std::string imageFile;
+    // Memory budget for the texture tile cache; 0 keeps all MIP maps
+    // resident.
+    int textureCacheMB = 0;
+    // Memory budget for the triangles of subdivision surfaces, NURBS and
+    // heightfields, which are then tessellated when rays first reach them;
+    // 0 tessellates them when they're created.
+    int geometryCacheMB = 0;
+    // Threads that compress EXR images; 0 uses one per core. Write EXR
+    // channels as 32-bit floats rather than halfs if _exrFloat_ is set,
+    // and in square tiles of _exrTileSize_ pixels rather than in
+    // scanlines if it's nonzero.
+    int imageIOThreads = 0;
+    bool exrFloat = false;
+    int exrTileSize = 0;
+    // Keep object instance aggregates across frames when their geometry
+    // is unchanged.
+    bool reuseInstances = false;
+    // Write collapsed profile stacks and a Chrome trace of the profiler's
+    // samples to files starting with _profileFile_, if set. Profiling can
+    // start paused and is toggled at runtime with SIGUSR1.
+    std::string profileFile;
+    bool profilePaused = false;
+    // Append snapshots of all statistics to _statsFile_ (as CSV if it ends
+    // in ".csv", and as lines of JSON otherwise) every _statsInterval_
+    // seconds and at the end of each frame.
+    std::string statsFile;
+    Float statsInterval = 10;
+    // Directory in which subsurface scattering profile tables are stored
+    // for reuse by later runs, if set.
+    std::string bssrdfCacheDir;
+    // Progressive rendering: SamplerIntegrators render every tile in rounds
+    // of samples, stopping early once _timeBudget_ seconds have passed (if
+    // nonzero) and saving to _checkpointFile_ (if set) at least every
+    // _checkpointInterval_ seconds.
+    bool progressive = false;
+    Float timeBudget = 0;
+    std::string checkpointFile;
+    Float checkpointInterval = 300;
     int referenceTiles = -1;
     int referencePixelSamples = 4096;
     int iisptHemiSize = 32;
@@ -176,6 +215,9 @@ struct Options {
     // IILE quality settings
     int iileIndirectTasks = 16;
     int iileDirectSamples = 16;
+    // Relative error at which the direct pass stops sampling a pixel;
+    // 0 samples every pixel in every pass
+    Float iileDirectAdaptive = 0;
     std::string iileDSampler = std::string("random"); // can also be "sobol" or "halton" or "lowdiscrepancy"
     // IILE control directory
     char* iileControl = NULL;
@@ -235,6 +277,15 @@ inline double BitsToFloat(uint64_t ui) {
     return f;
 }
 
+// Returns true if the host stores multi-byte values least significant byte
+// first.
+inline bool HostIsLittleEndian() {
+    uint32_t one = 1;
+    uint8_t first;
+    memcpy(&first, &one, 1);
+    return first == 1;
+}
+
 inline float NextFloatUp(float v) {
     // Handle infinity and negative zero for _NextFloatUp()_
     if (std::isinf(v) && v > 0.) return v;
@@ -40,6 +40,7 @@
 
 // core/progressreporter.h*
 #include "pbrt.h"
+#include "stats.h"
 #include <atomic>
 #include <chrono>
 #include <thread>
@@ -53,8 +54,10 @@ class ProgressReporter {
     ProgressReporter(int64_t totalWork, const std::string &title);
     ~ProgressReporter();
     void Update(int64_t num = 1) {
-        if (num == 0 || PbrtOptions.quiet) return;
-        workDone += num;
+        bool telemetry = !PbrtOptions.statsFile.empty();
+        if (num == 0 || (PbrtOptions.quiet && !telemetry)) return;
+        int64_t done = workDone += num;
+        if (telemetry) ReportStatsProgress(title, Float(done) / totalWork);
     }
     Float ElapsedMS() const {
         std::chrono::system_clock::time_point now =
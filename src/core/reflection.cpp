@@ -278,7 +278,7 @@ std::string MicrofacetTransmission::ToString() const {
 
 FresnelBlend::FresnelBlend(const Spectrum &Rd, const Spectrum &Rs,
                            MicrofacetDistribution *distribution)
-    : BxDF(BxDFType(BSDF_REFLECTION | BSDF_GLOSSY)),
+    : BxDF(BxDFType(BSDF_REFLECTION | BSDF_GLOSSY), BxDFKind::FresnelBlend),
       Rd(Rd),
       Rs(Rs),
       distribution(distribution) {}
@@ -388,13 +388,27 @@ Float BxDF::Pdf(const Vector3f &wo, const Vector3f &wi) const {
     return SameHemisphere(wo, wi) ? AbsCosTheta(wi) * InvPi : 0;
 }
 
+Spectrum LambertianReflection::Sample_f(const Vector3f &wo, Vector3f *wi,
+                                        const Point2f &u, Float *pdf,
+                                        BxDFType *sampledType) const {
+    // Cosine-sample the hemisphere, flipping the direction if necessary
+    *wi = CosineSampleHemisphere(u);
+    if (wo.z < 0) wi->z *= -1;
+    *pdf = LambertianReflection::Pdf(wo, *wi);
+    return LambertianReflection::f(wo, *wi);
+}
+
+Float LambertianReflection::Pdf(const Vector3f &wo, const Vector3f &wi) const {
+    return SameHemisphere(wo, wi) ? AbsCosTheta(wi) * InvPi : 0;
+}
+
 Spectrum LambertianTransmission::Sample_f(const Vector3f &wo, Vector3f *wi,
                                           const Point2f &u, Float *pdf,
                                           BxDFType *sampledType) const {
     *wi = CosineSampleHemisphere(u);
     if (wo.z > 0) wi->z *= -1;
-    *pdf = Pdf(wo, *wi);
-    return f(wo, *wi);
+    *pdf = LambertianTransmission::Pdf(wo, *wi);
+    return LambertianTransmission::f(wo, *wi);
 }
 
 Float LambertianTransmission::Pdf(const Vector3f &wo,
@@ -413,7 +427,7 @@ Spectrum MicrofacetReflection::Sample_f(const Vector3f &wo, Vector3f *wi,
 
     // Compute PDF of _wi_ for microfacet reflection
     *pdf = distribution->Pdf(wo, wh) / (4 * Dot(wo, wh));
-    return f(wo, *wi);
+    return MicrofacetReflection::f(wo, *wi);
 }
 
 Float MicrofacetReflection::Pdf(const Vector3f &wo, const Vector3f &wi) const {
@@ -429,8 +443,8 @@ Spectrum MicrofacetTransmission::Sample_f(const Vector3f &wo, Vector3f *wi,
     Vector3f wh = distribution->Sample_wh(wo, u);
     Float eta = CosTheta(wo) > 0 ? (etaA / etaB) : (etaB / etaA);
     if (!Refract(wo, (Normal3f)wh, eta, wi)) return 0;
-    *pdf = Pdf(wo, *wi);
-    return f(wo, *wi);
+    *pdf = MicrofacetTransmission::Pdf(wo, *wi);
+    return MicrofacetTransmission::f(wo, *wi);
 }
 
 Float MicrofacetTransmission::Pdf(const Vector3f &wo,
@@ -463,8 +477,8 @@ Spectrum FresnelBlend::Sample_f(const Vector3f &wo, Vector3f *wi,
         *wi = Reflect(wo, wh);
         if (!SameHemisphere(wo, *wi)) return Spectrum(0.f);
     }
-    *pdf = Pdf(wo, *wi);
-    return f(wo, *wi);
+    *pdf = FresnelBlend::Pdf(wo, *wi);
+    return FresnelBlend::f(wo, *wi);
 }
 
 Float FresnelBlend::Pdf(const Vector3f &wo, const Vector3f &wi) const {
@@ -682,6 +696,102 @@ Spectrum BxDF::rho(int nSamples, const Point2f *u1, const Point2f *u2) const {
     return r / (Pi * nSamples);
 }
 
+// BxDF Dispatch Functions
+
+// The BSDF methods call the BxDFs that pbrt's materials use through these
+// functions, which switch on _BxDF::kind_ and call the concrete class's
+// method directly so that it can be inlined; other BxDFs are called
+// virtually.
+static inline Spectrum BxDFf(const BxDF *bxdf, const Vector3f &wo,
+                             const Vector3f &wi) {
+    switch (bxdf->kind) {
+    case BxDFKind::SpecularReflection:
+    case BxDFKind::SpecularTransmission:
+    case BxDFKind::FresnelSpecular:
+        return Spectrum(0.f);
+    case BxDFKind::LambertianReflection:
+        return static_cast<const LambertianReflection *>(bxdf)
+            ->LambertianReflection::f(wo, wi);
+    case BxDFKind::LambertianTransmission:
+        return static_cast<const LambertianTransmission *>(bxdf)
+            ->LambertianTransmission::f(wo, wi);
+    case BxDFKind::OrenNayar:
+        return static_cast<const OrenNayar *>(bxdf)->OrenNayar::f(wo, wi);
+    case BxDFKind::MicrofacetReflection:
+        return static_cast<const MicrofacetReflection *>(bxdf)
+            ->MicrofacetReflection::f(wo, wi);
+    case BxDFKind::MicrofacetTransmission:
+        return static_cast<const MicrofacetTransmission *>(bxdf)
+            ->MicrofacetTransmission::f(wo, wi);
+    case BxDFKind::FresnelBlend:
+        return static_cast<const FresnelBlend *>(bxdf)->FresnelBlend::f(wo, wi);
+    default:
+        return bxdf->f(wo, wi);
+    }
+}
+
+static inline Spectrum BxDFSample_f(const BxDF *bxdf, const Vector3f &wo,
+                                    Vector3f *wi, const Point2f &u,
+                                    Float *pdf, BxDFType *sampledType) {
+    switch (bxdf->kind) {
+    case BxDFKind::SpecularReflection:
+        return static_cast<const SpecularReflection *>(bxdf)
+            ->SpecularReflection::Sample_f(wo, wi, u, pdf, sampledType);
+    case BxDFKind::SpecularTransmission:
+        return static_cast<const SpecularTransmission *>(bxdf)
+            ->SpecularTransmission::Sample_f(wo, wi, u, pdf, sampledType);
+    case BxDFKind::FresnelSpecular:
+        return static_cast<const FresnelSpecular *>(bxdf)
+            ->FresnelSpecular::Sample_f(wo, wi, u, pdf, sampledType);
+    case BxDFKind::LambertianReflection:
+        return static_cast<const LambertianReflection *>(bxdf)
+            ->LambertianReflection::Sample_f(wo, wi, u, pdf, sampledType);
+    case BxDFKind::LambertianTransmission:
+        return static_cast<const LambertianTransmission *>(bxdf)
+            ->LambertianTransmission::Sample_f(wo, wi, u, pdf, sampledType);
+    case BxDFKind::MicrofacetReflection:
+        return static_cast<const MicrofacetReflection *>(bxdf)
+            ->MicrofacetReflection::Sample_f(wo, wi, u, pdf, sampledType);
+    case BxDFKind::MicrofacetTransmission:
+        return static_cast<const MicrofacetTransmission *>(bxdf)
+            ->MicrofacetTransmission::Sample_f(wo, wi, u, pdf, sampledType);
+    case BxDFKind::FresnelBlend:
+        return static_cast<const FresnelBlend *>(bxdf)
+            ->FresnelBlend::Sample_f(wo, wi, u, pdf, sampledType);
+    default:
+        return bxdf->Sample_f(wo, wi, u, pdf, sampledType);
+    }
+}
+
+static inline Float BxDFPdf(const BxDF *bxdf, const Vector3f &wo,
+                            const Vector3f &wi) {
+    switch (bxdf->kind) {
+    case BxDFKind::SpecularReflection:
+    case BxDFKind::SpecularTransmission:
+    case BxDFKind::FresnelSpecular:
+        return 0;
+    case BxDFKind::LambertianReflection:
+        return static_cast<const LambertianReflection *>(bxdf)
+            ->LambertianReflection::Pdf(wo, wi);
+    case BxDFKind::LambertianTransmission:
+        return static_cast<const LambertianTransmission *>(bxdf)
+            ->LambertianTransmission::Pdf(wo, wi);
+    case BxDFKind::OrenNayar:
+        return bxdf->BxDF::Pdf(wo, wi);
+    case BxDFKind::MicrofacetReflection:
+        return static_cast<const MicrofacetReflection *>(bxdf)
+            ->MicrofacetReflection::Pdf(wo, wi);
+    case BxDFKind::MicrofacetTransmission:
+        return static_cast<const MicrofacetTransmission *>(bxdf)
+            ->MicrofacetTransmission::Pdf(wo, wi);
+    case BxDFKind::FresnelBlend:
+        return static_cast<const FresnelBlend *>(bxdf)->FresnelBlend::Pdf(wo,
+                                                                          wi);
+    default:
+        return bxdf->Pdf(wo, wi);
+    }
+}
+
 // BSDF Method Definitions
 Spectrum BSDF::f(const Vector3f &woW, const Vector3f &wiW,
                  BxDFType flags) const {
@@ -689,12 +799,11 @@ Spectrum BSDF::f(const Vector3f &woW, const Vector3f &wiW,
     Vector3f wi = WorldToLocal(wiW), wo = WorldToLocal(woW);
     if (wo.z == 0) return 0.;
     bool reflect = Dot(wiW, ng) * Dot(woW, ng) > 0;
+    BxDFType sideFlags = reflect ? BSDF_REFLECTION : BSDF_TRANSMISSION;
     Spectrum f(0.f);
     for (int i = 0; i < nBxDFs; ++i)
-        if (bxdfs[i]->MatchesFlags(flags) &&
-            ((reflect && (bxdfs[i]->type & BSDF_REFLECTION)) ||
-             (!reflect && (bxdfs[i]->type & BSDF_TRANSMISSION))))
-            f += bxdfs[i]->f(wo, wi);
+        if (MatchesFlags(i, flags) && (bxdfTypes[i] & sideFlags))
+            f += BxDFf(bxdfs[i], wo, wi);
     return f;
 }
 
@@ -702,7 +811,7 @@ Spectrum BSDF::rho(int nSamples, const Point2f *samples1,
                    const Point2f *samples2, BxDFType flags) const {
     Spectrum ret(0.f);
     for (int i = 0; i < nBxDFs; ++i)
-        if (bxdfs[i]->MatchesFlags(flags))
+        if (MatchesFlags(i, flags))
             ret += bxdfs[i]->rho(nSamples, samples1, samples2);
     return ret;
 }
@@ -711,7 +820,7 @@ Spectrum BSDF::rho(const Vector3f &wo, int nSamples, const Point2f *samples,
                    BxDFType flags) const {
     Spectrum ret(0.f);
     for (int i = 0; i < nBxDFs; ++i)
-        if (bxdfs[i]->MatchesFlags(flags))
+        if (MatchesFlags(i, flags))
             ret += bxdfs[i]->rho(wo, nSamples, samples);
     return ret;
 }
@@ -721,23 +830,33 @@ Spectrum BSDF::Sample_f(const Vector3f &woWorld, Vector3f *wiWorld,
                         BxDFType *sampledType) const {
     ProfilePhase pp(Prof::BSDFSampling);
     // Choose which _BxDF_ to sample
-    int matchingComps = NumComponents(type);
+    int matchingComps, comp;
+    BxDF *bxdf = nullptr;
+    if (nBxDFs == 1) {
+        // Most BSDFs have a single lobe, which needs no selection
+        matchingComps = MatchesFlags(0, type) ? 1 : 0;
+        comp = 0;
+        bxdf = bxdfs[0];
+    } else {
+        matchingComps = NumComponents(type);
+        comp = std::min((int)std::floor(u[0] * matchingComps),
+                        matchingComps - 1);
+    }
     if (matchingComps == 0) {
         *pdf = 0;
         if (sampledType) *sampledType = BxDFType(0);
         return Spectrum(0);
     }
-    int comp =
-        std::min((int)std::floor(u[0] * matchingComps), matchingComps - 1);
 
     // Get _BxDF_ pointer for chosen component
-    BxDF *bxdf = nullptr;
-    int count = comp;
-    for (int i = 0; i < nBxDFs; ++i)
-        if (bxdfs[i]->MatchesFlags(type) && count-- == 0) {
-            bxdf = bxdfs[i];
-            break;
-        }
+    if (nBxDFs > 1) {
+        int count = comp;
+        for (int i = 0; i < nBxDFs; ++i)
+            if (MatchesFlags(i, type) && count-- == 0) {
+                bxdf = bxdfs[i];
+                break;
+            }
+    }
     CHECK_NOTNULL(bxdf);
     VLOG(2) << "BSDF::Sample_f chose comp = " << comp << " / matching = " <<
         matchingComps << ", bxdf: " << bxdf->ToString();
@@ -751,7 +870,7 @@ Spectrum BSDF::Sample_f(const Vector3f &woWorld, Vector3f *wiWorld,
     if (wo.z == 0) return 0.;
     *pdf = 0;
     if (sampledType) *sampledType = bxdf->type;
-    Spectrum f = bxdf->Sample_f(wo, &wi, uRemapped, pdf, sampledType);
+    Spectrum f = BxDFSample_f(bxdf, wo, &wi, uRemapped, pdf, sampledType);
     VLOG(2) << "For wo = " << wo << ", sampled f = " << f << ", pdf = "
             << *pdf << ", ratio = " << ((*pdf > 0) ? (f / *pdf) : Spectrum(0.))
             << ", wi = " << wi;
@@ -764,19 +883,18 @@ Spectrum BSDF::Sample_f(const Vector3f &woWorld, Vector3f *wiWorld,
     // Compute overall PDF with all matching _BxDF_s
     if (!(bxdf->type & BSDF_SPECULAR) && matchingComps > 1)
         for (int i = 0; i < nBxDFs; ++i)
-            if (bxdfs[i] != bxdf && bxdfs[i]->MatchesFlags(type))
-                *pdf += bxdfs[i]->Pdf(wo, wi);
+            if (bxdfs[i] != bxdf && MatchesFlags(i, type))
+                *pdf += BxDFPdf(bxdfs[i], wo, wi);
     if (matchingComps > 1) *pdf /= matchingComps;
 
     // Compute value of BSDF for sampled direction
     if (!(bxdf->type & BSDF_SPECULAR) && matchingComps > 1) {
         bool reflect = Dot(*wiWorld, ng) * Dot(woWorld, ng) > 0;
+        BxDFType sideFlags = reflect ? BSDF_REFLECTION : BSDF_TRANSMISSION;
         f = 0.;
         for (int i = 0; i < nBxDFs; ++i)
-            if (bxdfs[i]->MatchesFlags(type) &&
-                ((reflect && (bxdfs[i]->type & BSDF_REFLECTION)) ||
-                 (!reflect && (bxdfs[i]->type & BSDF_TRANSMISSION))))
-                f += bxdfs[i]->f(wo, wi);
+            if (MatchesFlags(i, type) && (bxdfTypes[i] & sideFlags))
+                f += BxDFf(bxdfs[i], wo, wi);
     }
     VLOG(2) << "Overall f = " << f << ", pdf = " << *pdf << ", ratio = "
             << ((*pdf > 0) ? (f / *pdf) : Spectrum(0.));
@@ -792,9 +910,9 @@ Float BSDF::Pdf(const Vector3f &woWorld, const Vector3f &wiWorld,
     Float pdf = 0.f;
     int matchingComps = 0;
     for (int i = 0; i < nBxDFs; ++i)
-        if (bxdfs[i]->MatchesFlags(flags)) {
+        if (MatchesFlags(i, flags)) {
             ++matchingComps;
-            pdf += bxdfs[i]->Pdf(wo, wi);
+            pdf += BxDFPdf(bxdfs[i], wo, wi);
         }
     Float v = matchingComps > 0 ? pdf / matchingComps : 0.f;
     return v;
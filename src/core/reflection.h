@@ -126,28 +126,62 @@ enum BxDFType {
                BSDF_TRANSMISSION,
 };
 
+// Identifies the concrete class of the BxDFs that _BSDF_ dispatches to
+// without a virtual call; BxDFs defined elsewhere are _Other_. Classes
+// that derive from one of these and override its methods must pass
+// _BxDFKind::Other_ to the _BxDF_ constructor.
+enum class BxDFKind : uint8_t {
+    Other,
+    SpecularReflection,
+    SpecularTransmission,
+    FresnelSpecular,
+    LambertianReflection,
+    LambertianTransmission,
+    OrenNayar,
+    MicrofacetReflection,
+    MicrofacetTransmission,
+    FresnelBlend
+};
+
 struct FourierBSDFTable {
     // FourierBSDFTable Public Data
     Float eta;
     int mMax;
-    int nChannels;
+    int nChannels = 0;
     int nMu;
-    Float *mu;
-    int *m;
-    int *aOffset;
-    Float *a;
-    Float *a0;
-    Float *cdf;
-    Float *recip;
+    const Float *mu = nullptr;
+    const int *m = nullptr;
+    const int *aOffset = nullptr;
+    const Float *a = nullptr;
+    const Float *a0 = nullptr;
+    const Float *cdf = nullptr;
+    const Float *recip = nullptr;
 
     // FourierBSDFTable Public Methods
+    FourierBSDFTable() = default;
+    FourierBSDFTable(const FourierBSDFTable &) = delete;
+    FourierBSDFTable &operator=(const FourierBSDFTable &) = delete;
+    ~FourierBSDFTable();
     static bool Read(const std::string &filename, FourierBSDFTable *table);
+    // Returns the table for the given file, reading it if no other material
+    // is currently using it. Tables that couldn't be read have no channels.
+    static std::shared_ptr<FourierBSDFTable> Get(const std::string &filename);
     const Float *GetAk(int offsetI, int offsetO, int *mptr) const {
         *mptr = m[offsetO * nMu + offsetI];
         return a + aOffset[offsetO * nMu + offsetI];
     }
     bool GetWeightsAndOffset(Float cosTheta, int *offset,
                              Float weights[4]) const;
+
+  private:
+    // FourierBSDFTable Private Data
+    // When the file can be memory-mapped, _mu_, _cdf_ and _a_ point into
+    // the mapping; all other arrays are stored in _floatData_ and
+    // _intData_.
+    void *mappedData = nullptr;
+    size_t mappedLength = 0;
+    std::vector<Float> floatData;
+    std::vector<int> intData;
 };
 
 class BSDF {
@@ -159,10 +193,7 @@ class BSDF {
           ng(si.n),
           ss(Normalize(si.shading.dpdu)),
           ts(Cross(ns, ss)) {}
-    void Add(BxDF *b) {
-        CHECK_LT(nBxDFs, MaxBxDFs);
-        bxdfs[nBxDFs++] = b;
-    }
+    void Add(BxDF *b);
     int NumComponents(BxDFType flags = BSDF_ALL) const;
     Vector3f WorldToLocal(const Vector3f &v) const {
         return Vector3f(Dot(v, ss), Dot(v, ts), Dot(v, ns));
@@ -191,12 +222,19 @@ class BSDF {
   private:
     // BSDF Private Methods
     ~BSDF() {}
+    bool MatchesFlags(int i, BxDFType t) const {
+        return (bxdfTypes[i] & t) == bxdfTypes[i];
+    }
 
     // BSDF Private Data
     const Normal3f ns, ng;
     const Vector3f ss, ts;
     int nBxDFs = 0;
     static PBRT_CONSTEXPR int MaxBxDFs = 8;
+    // The BxDFs' types are stored alongside the pointers so that BxDFs
+    // that don't match the requested flags are skipped without loading
+    // them.
+    uint8_t bxdfTypes[MaxBxDFs];
     BxDF *bxdfs[MaxBxDFs];
     friend class MixMaterial;
 };
@@ -211,7 +249,8 @@ class BxDF {
   public:
     // BxDF Interface
     virtual ~BxDF() {}
-    BxDF(BxDFType type) : type(type) {}
+    BxDF(BxDFType type, BxDFKind kind = BxDFKind::Other)
+        : type(type), kind(kind) {}
     bool MatchesFlags(BxDFType t) const { return (type & t) == type; }
     virtual Spectrum f(const Vector3f &wo, const Vector3f &wi) const = 0;
     virtual Spectrum Sample_f(const Vector3f &wo, Vector3f *wi,
@@ -226,6 +265,7 @@ class BxDF {
 
     // BxDF Public Data
     const BxDFType type;
+    const BxDFKind kind;
 };
 
 inline std::ostream &operator<<(std::ostream &os, const BxDF &bxdf) {
@@ -304,7 +344,8 @@ class SpecularReflection : public BxDF {
   public:
     // SpecularReflection Public Methods
     SpecularReflection(const Spectrum &R, Fresnel *fresnel)
-        : BxDF(BxDFType(BSDF_REFLECTION | BSDF_SPECULAR)),
+        : BxDF(BxDFType(BSDF_REFLECTION | BSDF_SPECULAR),
+               BxDFKind::SpecularReflection),
           R(R),
           fresnel(fresnel) {}
     Spectrum f(const Vector3f &wo, const Vector3f &wi) const {
@@ -326,7 +367,8 @@ class SpecularTransmission : public BxDF {
     // SpecularTransmission Public Methods
     SpecularTransmission(const Spectrum &T, Float etaA, Float etaB,
                          TransportMode mode)
-        : BxDF(BxDFType(BSDF_TRANSMISSION | BSDF_SPECULAR)),
+        : BxDF(BxDFType(BSDF_TRANSMISSION | BSDF_SPECULAR),
+               BxDFKind::SpecularTransmission),
           T(T),
           etaA(etaA),
           etaB(etaB),
@@ -353,7 +395,8 @@ class FresnelSpecular : public BxDF {
     // FresnelSpecular Public Methods
     FresnelSpecular(const Spectrum &R, const Spectrum &T, Float etaA,
                     Float etaB, TransportMode mode)
-        : BxDF(BxDFType(BSDF_REFLECTION | BSDF_TRANSMISSION | BSDF_SPECULAR)),
+        : BxDF(BxDFType(BSDF_REFLECTION | BSDF_TRANSMISSION | BSDF_SPECULAR),
+               BxDFKind::FresnelSpecular),
           R(R),
           T(T),
           etaA(etaA),
@@ -378,10 +421,15 @@ class LambertianReflection : public BxDF {
   public:
     // LambertianReflection Public Methods
     LambertianReflection(const Spectrum &R)
-        : BxDF(BxDFType(BSDF_REFLECTION | BSDF_DIFFUSE)), R(R) {}
+        : BxDF(BxDFType(BSDF_REFLECTION | BSDF_DIFFUSE),
+               BxDFKind::LambertianReflection),
+          R(R) {}
     Spectrum f(const Vector3f &wo, const Vector3f &wi) const;
     Spectrum rho(const Vector3f &, int, const Point2f *) const { return R; }
     Spectrum rho(int, const Point2f *, const Point2f *) const { return R; }
+    Spectrum Sample_f(const Vector3f &wo, Vector3f *wi, const Point2f &u,
+                      Float *pdf, BxDFType *sampledType) const;
+    Float Pdf(const Vector3f &wo, const Vector3f &wi) const;
     std::string ToString() const;
 
   private:
@@ -393,7 +441,9 @@ class LambertianTransmission : public BxDF {
   public:
     // LambertianTransmission Public Methods
     LambertianTransmission(const Spectrum &T)
-        : BxDF(BxDFType(BSDF_TRANSMISSION | BSDF_DIFFUSE)), T(T) {}
+        : BxDF(BxDFType(BSDF_TRANSMISSION | BSDF_DIFFUSE),
+               BxDFKind::LambertianTransmission),
+          T(T) {}
     Spectrum f(const Vector3f &wo, const Vector3f &wi) const;
     Spectrum rho(const Vector3f &, int, const Point2f *) const { return T; }
     Spectrum rho(int, const Point2f *, const Point2f *) const { return T; }
@@ -412,7 +462,8 @@ class OrenNayar : public BxDF {
     // OrenNayar Public Methods
     Spectrum f(const Vector3f &wo, const Vector3f &wi) const;
     OrenNayar(const Spectrum &R, Float sigma)
-        : BxDF(BxDFType(BSDF_REFLECTION | BSDF_DIFFUSE)), R(R) {
+        : BxDF(BxDFType(BSDF_REFLECTION | BSDF_DIFFUSE), BxDFKind::OrenNayar),
+          R(R) {
         sigma = Radians(sigma);
         Float sigma2 = sigma * sigma;
         A = 1.f - (sigma2 / (2.f * (sigma2 + 0.33f)));
@@ -431,7 +482,8 @@ class MicrofacetReflection : public BxDF {
     // MicrofacetReflection Public Methods
     MicrofacetReflection(const Spectrum &R,
                          MicrofacetDistribution *distribution, Fresnel *fresnel)
-        : BxDF(BxDFType(BSDF_REFLECTION | BSDF_GLOSSY)),
+        : BxDF(BxDFType(BSDF_REFLECTION | BSDF_GLOSSY),
+               BxDFKind::MicrofacetReflection),
           R(R),
           distribution(distribution),
           fresnel(fresnel) {}
@@ -454,7 +506,8 @@ class MicrofacetTransmission : public BxDF {
     MicrofacetTransmission(const Spectrum &T,
                            MicrofacetDistribution *distribution, Float etaA,
                            Float etaB, TransportMode mode)
-        : BxDF(BxDFType(BSDF_TRANSMISSION | BSDF_GLOSSY)),
+        : BxDF(BxDFType(BSDF_TRANSMISSION | BSDF_GLOSSY),
+               BxDFKind::MicrofacetTransmission),
           T(T),
           distribution(distribution),
           etaA(etaA),
@@ -517,10 +570,16 @@ class FourierBSDF : public BxDF {
 };
 
 // BSDF Inline Method Definitions
+inline void BSDF::Add(BxDF *b) {
+    CHECK_LT(nBxDFs, MaxBxDFs);
+    bxdfTypes[nBxDFs] = b->type;
+    bxdfs[nBxDFs++] = b;
+}
+
 inline int BSDF::NumComponents(BxDFType flags) const {
     int num = 0;
     for (int i = 0; i < nBxDFs; ++i)
-        if (bxdfs[i]->MatchesFlags(flags)) ++num;
+        if (MatchesFlags(i, flags)) ++num;
     return num;
 }
 
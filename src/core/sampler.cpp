@@ -133,33 +133,49 @@ Point2f PixelSampler::Get2D() {
         return Point2f(rng.UniformFloat(), rng.UniformFloat());
 }
 
+void GlobalSampler::SampleDimensions(const int64_t *indices, int n,
+                                     int dimension, Float *samples) const {
+    for (int i = 0; i < n; ++i)
+        samples[i] = SampleDimension(indices[i], dimension);
+}
+
 void GlobalSampler::StartPixel(const Point2i &p) {
     ProfilePhase _(Prof::StartPixel);
     Sampler::StartPixel(p);
     dimension = 0;
     intervalSampleIndex = GetIndexForSample(0);
+    blockSize = 0;
     // Compute _arrayEndDim_ for dimensions used for array samples
     arrayEndDim =
         arrayStartDim + sampleArray1D.size() + 2 * sampleArray2D.size();
+    if (samples1DArraySizes.empty() && samples2DArraySizes.empty()) return;
+
+    // Compute sample indices for the array samples
+    int maxArraySize = 0;
+    for (int n : samples1DArraySizes) maxArraySize = std::max(maxArraySize, n);
+    for (int n : samples2DArraySizes) maxArraySize = std::max(maxArraySize, n);
+    std::vector<int64_t> indices(maxArraySize * samplesPerPixel);
+    for (size_t j = 0; j < indices.size(); ++j)
+        indices[j] = GetIndexForSample(j);
 
     // Compute 1D array samples for _GlobalSampler_
     for (size_t i = 0; i < samples1DArraySizes.size(); ++i) {
         int nSamples = samples1DArraySizes[i] * samplesPerPixel;
-        for (int j = 0; j < nSamples; ++j) {
-            int64_t index = GetIndexForSample(j);
-            sampleArray1D[i][j] = SampleDimension(index, arrayStartDim + i);
-        }
+        SampleDimensions(&indices[0], nSamples, arrayStartDim + i,
+                         &sampleArray1D[i][0]);
     }
 
     // Compute 2D array samples for _GlobalSampler_
     int dim = arrayStartDim + samples1DArraySizes.size();
+    std::vector<Float> x, y;
     for (size_t i = 0; i < samples2DArraySizes.size(); ++i) {
         int nSamples = samples2DArraySizes[i] * samplesPerPixel;
-        for (int j = 0; j < nSamples; ++j) {
-            int64_t idx = GetIndexForSample(j);
-            sampleArray2D[i][j].x = SampleDimension(idx, dim);
-            sampleArray2D[i][j].y = SampleDimension(idx, dim + 1);
-        }
+        x.resize(nSamples);
+        y.resize(nSamples);
+        SampleDimensions(&indices[0], nSamples, dim, &x[0]);
+        SampleDimensions(&indices[0], nSamples, dim + 1, &y[0]);
+        for (int j = 0; j < nSamples; ++j)
+            sampleArray2D[i][j] = Point2f(x[j], y[j]);
         dim += 2;
     }
     CHECK_EQ(arrayEndDim, dim);
@@ -177,19 +193,45 @@ bool GlobalSampler::SetSampleNumber(int64_t sampleNum) {
     return Sampler::SetSampleNumber(sampleNum);
 }
 
+Float GlobalSampler::GetSample(int dim) {
+    // Find the precomputed dimension for _dim_, skipping array dimensions
+    int d = (dim < arrayStartDim) ? dim : dim - arrayEndDim + arrayStartDim;
+    if (d >= nPrecomputedDimensions || currentPixelSampleIndex >= samplesPerPixel)
+        return SampleDimension(intervalSampleIndex, dim);
+
+    // Start a new block of pixel samples if needed
+    int64_t offset = currentPixelSampleIndex - blockStart;
+    if (offset < 0 || offset >= blockSize) {
+        blockStart = currentPixelSampleIndex -
+                     currentPixelSampleIndex % sampleBlockSize;
+        blockSize = std::min<int64_t>(sampleBlockSize,
+                                      samplesPerPixel - blockStart);
+        for (int i = 0; i < blockSize; ++i)
+            blockIndices[i] = GetIndexForSample(blockStart + i);
+        std::fill(blockDimensionValid.begin(), blockDimensionValid.end(), 0);
+        offset = currentPixelSampleIndex - blockStart;
+    }
+
+    Float *samples = &blockSamples[d * sampleBlockSize];
+    if (!blockDimensionValid[d]) {
+        SampleDimensions(blockIndices, blockSize, dim, samples);
+        blockDimensionValid[d] = 1;
+    }
+    return samples[offset];
+}
+
 Float GlobalSampler::Get1D() {
     ProfilePhase _(Prof::GetSample);
     if (dimension >= arrayStartDim && dimension < arrayEndDim)
         dimension = arrayEndDim;
-    return SampleDimension(intervalSampleIndex, dimension++);
+    return GetSample(dimension++);
 }
 
 Point2f GlobalSampler::Get2D() {
     ProfilePhase _(Prof::GetSample);
     if (dimension + 1 >= arrayStartDim && dimension < arrayEndDim)
         dimension = arrayEndDim;
-    Point2f p(SampleDimension(intervalSampleIndex, dimension),
-              SampleDimension(intervalSampleIndex, dimension + 1));
+    Point2f p(GetSample(dimension), GetSample(dimension + 1));
     dimension += 2;
     return p;
 }
@@ -111,16 +111,39 @@ class GlobalSampler : public Sampler {
     bool SetSampleNumber(int64_t sampleNum);
     Float Get1D();
     Point2f Get2D();
-    GlobalSampler(int64_t samplesPerPixel) : Sampler(samplesPerPixel) {}
+    GlobalSampler(int64_t samplesPerPixel, int nPrecomputedDimensions = 0)
+        : Sampler(samplesPerPixel),
+          nPrecomputedDimensions(nPrecomputedDimensions),
+          blockSamples(nPrecomputedDimensions * sampleBlockSize),
+          blockDimensionValid(nPrecomputedDimensions) {}
     virtual int64_t GetIndexForSample(int64_t sampleNum) const = 0;
     virtual Float SampleDimension(int64_t index, int dimension) const = 0;
+    // Computes the sample values for the given dimension for all |n|
+    // sample indices. Samplers override this with implementations that
+    // amortize per-dimension work over the batch.
+    virtual void SampleDimensions(const int64_t *indices, int n, int dimension,
+                                  Float *samples) const;
 
   private:
+    // GlobalSampler Private Methods
+    Float GetSample(int dim);
+
     // GlobalSampler Private Data
     int dimension;
     int64_t intervalSampleIndex;
     static const int arrayStartDim = 5;
     int arrayEndDim;
+    // The first _nPrecomputedDimensions_ dimensions returned by Get1D()
+    // and Get2D() are computed with SampleDimensions() for blocks of
+    // _sampleBlockSize_ consecutive pixel samples at a time, the first
+    // time each dimension is requested in a block.
+    static const int sampleBlockSize = 64;
+    const int nPrecomputedDimensions;
+    int64_t blockStart = 0;
+    int blockSize = 0;
+    int64_t blockIndices[sampleBlockSize];
+    std::vector<Float> blockSamples;
+    std::vector<uint8_t> blockDimensionValid;
 };
 
 }  // namespace pbrt
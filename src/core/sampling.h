@@ -67,6 +67,8 @@ struct Distribution1D {
             for (int i = 1; i < n + 1; ++i) cdf[i] /= funcInt;
         }
     }
+    Distribution1D(const Float *f, const Float *c, Float funcInt, int n)
+        : func(f, f + n), cdf(c, c + n + 1), funcInt(funcInt) {}
     int Count() const { return (int)func.size(); }
     Float SampleContinuous(Float u, Float *pdf, int *off = nullptr) const {
         // Find surrounding CDF segments and _offset_
@@ -124,6 +126,10 @@ class Distribution2D {
   public:
     // Distribution2D Public Methods
     Distribution2D(const Float *data, int nu, int nv);
+    Distribution2D(std::vector<std::unique_ptr<Distribution1D>> conditional,
+                   std::unique_ptr<Distribution1D> marginal)
+        : pConditionalV(std::move(conditional)),
+          pMarginal(std::move(marginal)) {}
     Point2f SampleContinuous(const Point2f &u, Float *pdf) const {
         Float pdfs[2];
         int v;
@@ -139,6 +145,8 @@ class Distribution2D {
             Clamp(int(p[1] * pMarginal->Count()), 0, pMarginal->Count() - 1);
         return pConditionalV[iv]->func[iu] / pMarginal->funcInt;
     }
+    const Distribution1D &Conditional(int v) const { return *pConditionalV[v]; }
+    const Distribution1D &Marginal() const { return *pMarginal; }
 
   private:
     // Distribution2D Private Data
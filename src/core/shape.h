@@ -44,6 +44,7 @@
 #include "interaction.h"
 #include "memory.h"
 #include "transform.h"
+#include <functional>
 
 namespace pbrt {
 
@@ -82,12 +83,23 @@ class Shape {
     // used in this case.
     virtual Float SolidAngle(const Point3f &p, int nSamples = 512) const;
 
+    // Bounds the shape's oriented geometric normals: they all lie within
+    // the cone of directions around |*w| with angle cosine |*cosTheta|.
+    // Returns false if no useful bound is known.
+    virtual bool NormalBounds(Vector3f *w, Float *cosTheta) const {
+        return false;
+    }
+
     // Shape Public Data
     const Transform *ObjectToWorld, *WorldToObject;
     const bool reverseOrientation;
     const bool transformSwapsHandedness;
 };
 
+// Shapes that are refined into triangle meshes can defer the refinement
+// until it's needed; calling a _ShapeTessellator_ creates the triangles.
+typedef std::function<std::vector<std::shared_ptr<Shape>>()> ShapeTessellator;
+
 }  // namespace pbrt
 
 #endif  // PBRT_CORE_SHAPE_H
@@ -40,6 +40,8 @@
 #include <functional>
 #include <mutex>
 #include <type_traits>
+#include <thread>
+#include "fileutil.h"
 #include "parallel.h"
 #include "stringprint.h"
 #ifdef PBRT_HAVE_ITIMER
@@ -71,14 +73,42 @@ static std::array<ProfileSample, profileHashSize> profileSamples;
 
 static std::chrono::system_clock::time_point profileStartTime;
 
+// When writing a profile, each sample is also recorded as a
+// _ProfileTraceSample_. Samples are stored in a buffer that is allocated
+// up front, again because the signal handler can't allocate memory; once
+// it's full, later samples are only counted in _profileSamples_.
+static const size_t profileTraceCapacity = 1 << 21;
+static std::unique_ptr<ProfileTraceSample[]> profileTrace;
+static std::atomic<uint64_t> profileTraceCount{0};
+static std::atomic<uint32_t> nextProfilerThread{0};
+static PBRT_THREAD_LOCAL int profilerThread = -1;
+static std::chrono::steady_clock::time_point profileTraceStartTime;
+static std::atomic<bool> profilerSampling{true};
+static bool profilerToggleInstalled = false;
+static const int profileSamplesPerSecond = 100;
+
 #ifdef PBRT_HAVE_ITIMER
 static void ReportProfileSample(int, siginfo_t *, void *);
+static void ToggleProfilerSampling(int);
 #endif  // PBRT_HAVE_ITIMER
 
+// Telemetry Local Variables
+static std::mutex statsMutex;
+static std::mutex telemetryMutex;
+static FILE *telemetryFile;
+static bool telemetryCSV;
+static int telemetryFrame;
+static std::chrono::steady_clock::time_point telemetryStartTime;
+static std::mutex progressMutex;
+static std::map<std::string, double> telemetryProgress;
+static std::thread telemetryThread;
+static std::mutex telemetryExitMutex;
+static std::condition_variable telemetryExitCondition;
+static bool telemetryExit;
+
 // Statistics Definitions
 void ReportThreadStats() {
-    static std::mutex mutex;
-    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<std::mutex> lock(statsMutex);
     StatRegisterer::CallCallbacks(statsAccumulator);
 }
 
@@ -86,9 +116,20 @@ void StatRegisterer::CallCallbacks(StatsAccumulator &accum) {
     for (auto func : *funcs) func(accum);
 }
 
-void PrintStats(FILE *dest) { statsAccumulator.Print(dest); }
+void PrintStats(FILE *dest) {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    statsAccumulator.Print(dest);
+}
+
+void ClearStats() {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    statsAccumulator.Clear();
+}
 
-void ClearStats() { statsAccumulator.Clear(); }
+int64_t GetStatsCounter(const std::string &name) {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return statsAccumulator.Counter(name);
+}
 
 static void getCategoryAndTitle(const std::string &str, std::string *category,
                                 std::string *title) {
@@ -186,6 +227,98 @@ void StatsAccumulator::Print(FILE *dest) {
     }
 }
 
+static std::string JSONEscape(const std::string &str) {
+    std::string escaped;
+    for (char c : str) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+static std::string CSVEscape(const std::string &str) {
+    if (str.find_first_of(",\"\n") == std::string::npos) return str;
+    std::string escaped = "\"";
+    for (char c : str) {
+        if (c == '"') escaped += '"';
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+void StatsAccumulator::WriteTelemetry(
+    FILE *dest, bool csv, double time, int frame, bool endOfFrame,
+    const std::map<std::string, double> &profile,
+    const std::map<std::string, double> &progress) const {
+    if (csv) {
+        std::string prefix = StringPrintf("%.3f,%d,%d,", time, frame,
+                                          int(endOfFrame));
+        auto write = [&](const char *type, const std::string &name,
+                         const std::string &value) {
+            fprintf(dest, "%s%s,%s,%s\n", prefix.c_str(), type,
+                    CSVEscape(name).c_str(), value.c_str());
+        };
+        for (const auto &c : counters)
+            write("counter", c.first, StringPrintf("%" PRId64 ",", c.second));
+        for (const auto &c : memoryCounters)
+            write("memory", c.first, StringPrintf("%" PRId64 ",", c.second));
+        for (const auto &p : percentages)
+            write("percentage", p.first,
+                  StringPrintf("%" PRId64 ",%" PRId64, p.second.first,
+                               p.second.second));
+        for (const auto &r : ratios)
+            write("ratio", r.first,
+                  StringPrintf("%" PRId64 ",%" PRId64, r.second.first,
+                               r.second.second));
+        for (const auto &p : profile)
+            write("profile", p.first, StringPrintf("%.2f,", p.second));
+        for (const auto &p : progress)
+            write("progress", p.first, StringPrintf("%.4f,", p.second));
+        return;
+    }
+
+    // Write the snapshot as a single line of JSON
+    auto writeObject = [&](const char *name, const std::string &members) {
+        fprintf(dest, ", \"%s\": {%s}", name, members.c_str());
+    };
+    auto member = [](std::string *members, const std::string &name,
+                     const std::string &value) {
+        if (!members->empty()) *members += ", ";
+        *members += "\"" + JSONEscape(name) + "\": " + value;
+    };
+    fprintf(dest, "{\"time\": %.3f, \"frame\": %d, \"final\": %s", time,
+            frame, endOfFrame ? "true" : "false");
+    std::string members;
+    for (const auto &c : counters)
+        member(&members, c.first, StringPrintf("%" PRId64, c.second));
+    writeObject("counters", members);
+    members.clear();
+    for (const auto &c : memoryCounters)
+        member(&members, c.first, StringPrintf("%" PRId64, c.second));
+    writeObject("memory", members);
+    members.clear();
+    for (const auto &p : percentages)
+        member(&members, p.first,
+               StringPrintf("[%" PRId64 ", %" PRId64 "]", p.second.first,
+                            p.second.second));
+    writeObject("percentages", members);
+    members.clear();
+    for (const auto &r : ratios)
+        member(&members, r.first,
+               StringPrintf("[%" PRId64 ", %" PRId64 "]", r.second.first,
+                            r.second.second));
+    writeObject("ratios", members);
+    members.clear();
+    for (const auto &p : profile)
+        member(&members, p.first, StringPrintf("%.2f", p.second));
+    writeObject("profile", members);
+    members.clear();
+    for (const auto &p : progress)
+        member(&members, p.first, StringPrintf("%.4f", p.second));
+    writeObject("progress", members);
+    fprintf(dest, "}\n");
+}
+
 void StatsAccumulator::Clear() {
     counters.clear();
     memoryCounters.clear();
@@ -212,10 +345,15 @@ void InitProfiler() {
     // would cause dynamic memory allocation, which is illegal in a signal
     // handler).
     ProfilerState = ProfToBits(Prof::SceneConstruction);
+    profilerThread = nextProfilerThread++;
 
+    if (!PbrtOptions.profileFile.empty())
+        profileTrace.reset(new ProfileTraceSample[profileTraceCapacity]);
     ClearProfiler();
+    profilerSampling = !PbrtOptions.profilePaused;
 
     profileStartTime = std::chrono::system_clock::now();
+    profileTraceStartTime = std::chrono::steady_clock::now();
 // Set timer to periodically interrupt the system for profiling
 #ifdef PBRT_HAVE_ITIMER
     struct sigaction sa;
@@ -225,9 +363,22 @@ void InitProfiler() {
     sigemptyset(&sa.sa_mask);
     sigaction(SIGPROF, &sa, NULL);
 
+    // SIGUSR1 pauses and resumes profiling of a running render. Its
+    // handler is only installed if a profile is being written, so that
+    // SIGUSR1 otherwise keeps its default action.
+    if (!PbrtOptions.profileFile.empty() || PbrtOptions.profilePaused) {
+        struct sigaction saToggle;
+        memset(&saToggle, 0, sizeof(saToggle));
+        saToggle.sa_handler = ToggleProfilerSampling;
+        saToggle.sa_flags = SA_RESTART;
+        sigemptyset(&saToggle.sa_mask);
+        sigaction(SIGUSR1, &saToggle, NULL);
+        profilerToggleInstalled = true;
+    }
+
     static struct itimerval timer;
     timer.it_interval.tv_sec = 0;
-    timer.it_interval.tv_usec = 1000000 / 100;  // 100 Hz sampling
+    timer.it_interval.tv_usec = 1000000 / profileSamplesPerSecond;
     timer.it_value = timer.it_interval;
 
     CHECK_EQ(setitimer(ITIMER_PROF, &timer, NULL), 0)
@@ -254,6 +405,7 @@ void ProfilerWorkerThreadInit() {
     // happen now, rather than in the signal handler, where this isn't
     // allowed.
     ProfilerState = ProfToBits(Prof::SceneConstruction);
+    profilerThread = nextProfilerThread++;
 #endif  // PBRT_HAVE_ITIMER
 }
 
@@ -262,6 +414,11 @@ void ClearProfiler() {
         ps.profilerState = 0;
         ps.count = 0;
     }
+    if (profileTrace) {
+        profileTraceCount = 0;
+        memset(profileTrace.get(), 0,
+               profileTraceCapacity * sizeof(ProfileTraceSample));
+    }
 }
 
 void CleanupProfiler() {
@@ -274,13 +431,18 @@ void CleanupProfiler() {
 
     CHECK_EQ(setitimer(ITIMER_PROF, &timer, NULL), 0)
         << "Timer could not be disabled: " << strerror(errno);
+    if (profilerToggleInstalled) {
+        signal(SIGUSR1, SIG_DFL);
+        profilerToggleInstalled = false;
+    }
 #endif  // PBRT_HAVE_ITIMER
     profilerRunning = false;
+    profileTrace.reset();
 }
 
 #ifdef PBRT_HAVE_ITIMER
 static void ReportProfileSample(int, siginfo_t *, void *) {
-    if (profilerSuspendCount > 0) return;
+    if (profilerSuspendCount > 0 || !profilerSampling) return;
     if (ProfilerState == 0) return;  // A ProgressReporter thread, most likely.
 
     uint64_t h = std::hash<uint64_t>{}(ProfilerState) % (profileHashSize - 1);
@@ -295,7 +457,24 @@ static void ReportProfileSample(int, siginfo_t *, void *) {
     CHECK_NE(count, profileHashSize) << "Profiler hash table filled up!";
     profileSamples[h].profilerState = ProfilerState;
     ++profileSamples[h].count;
+
+    // Record the sample in the trace, if there's space left
+    if (!profileTrace) return;
+    uint64_t index = profileTraceCount++;
+    if (index >= profileTraceCapacity) return;
+    // Threads that weren't started by ParallelInit() are numbered when
+    // they're first sampled.
+    if (profilerThread == -1) profilerThread = nextProfilerThread++;
+    int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                     std::chrono::steady_clock::now() - profileTraceStartTime)
+                     .count();
+    ProfileTraceSample &sample = profileTrace[index];
+    sample.thread = profilerThread;
+    sample.time = uint32_t(us / 100);
+    sample.profilerState = ProfilerState;
 }
+
+static void ToggleProfilerSampling(int) { profilerSampling = !profilerSampling; }
 #endif  // PBRT_HAVE_ITIMER
 
 static std::string timeString(float pct, std::chrono::system_clock::time_point now) {
@@ -391,4 +570,218 @@ void ReportProfilerResults(FILE *dest) {
 #endif
 }
 
+// Returns the names of the categories active in _profilerState_, from
+// outermost to innermost.
+static std::vector<const char *> ProfileStack(uint64_t profilerState) {
+    std::vector<const char *> stack;
+    for (int b = 0; b < (int)Prof::NumProfCategories; ++b)
+        if (profilerState & (1ull << b)) stack.push_back(ProfNames[b]);
+    return stack;
+}
+
+// Writes one line per profiler state with its categories separated by
+// semicolons followed by its sample count, as used by flame graph tools.
+bool WriteCollapsedStacks(const std::string &filename,
+                          const std::map<uint64_t, uint64_t> &stateCounts) {
+    FILE *f = fopen(filename.c_str(), "w");
+    if (!f) return false;
+    for (const auto &sc : stateCounts) {
+        if (sc.second == 0) continue;
+        std::vector<const char *> stack = ProfileStack(sc.first);
+        for (size_t i = 0; i < stack.size(); ++i)
+            fprintf(f, "%s%s", i > 0 ? ";" : "", stack[i]);
+        fprintf(f, " %" PRIu64 "\n", sc.second);
+    }
+    return fclose(f) == 0;
+}
+
+// Writes the recorded samples as complete ("X") events in the Chrome
+// trace event format, which can be viewed in chrome://tracing or
+// Perfetto. Consecutive samples on a thread with a category in common
+// are merged into a single event for that category.
+bool WriteChromeTrace(const std::string &filename,
+                      std::vector<ProfileTraceSample> samples) {
+    std::stable_sort(samples.begin(), samples.end(),
+                     [](const ProfileTraceSample &a,
+                        const ProfileTraceSample &b) {
+                         return a.thread < b.thread ||
+                                (a.thread == b.thread && a.time < b.time);
+                     });
+
+    FILE *f = fopen(filename.c_str(), "w");
+    if (!f) return false;
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool first = true;
+    auto emit = [&](const char *name, uint32_t thread, uint32_t start,
+                    uint32_t end) {
+        fprintf(f,
+                "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, "
+                "\"tid\": %u, \"ts\": %" PRIu64 ", \"dur\": %" PRIu64 "}",
+                first ? "" : ",\n", JSONEscape(name).c_str(), thread,
+                uint64_t(start) * 100, uint64_t(end - start) * 100);
+        first = false;
+    };
+
+    // A sample accounts for the time until the next one; a longer gap
+    // means that the thread was idle or that sampling was paused.
+    const uint32_t period = 10000 / profileSamplesPerSecond;
+    std::vector<std::pair<const char *, uint32_t>> open;
+    auto close = [&](size_t depth, uint32_t thread, uint32_t end) {
+        while (open.size() > depth) {
+            emit(open.back().first, thread, open.back().second, end);
+            open.pop_back();
+        }
+    };
+    for (size_t i = 0; i < samples.size(); ++i) {
+        const ProfileTraceSample &s = samples[i];
+        if (i > 0 && (samples[i - 1].thread != s.thread ||
+                      s.time - samples[i - 1].time > 2 * period))
+            close(0, samples[i - 1].thread, samples[i - 1].time + period);
+        std::vector<const char *> stack = ProfileStack(s.profilerState);
+        size_t common = 0;
+        while (common < open.size() && common < stack.size() &&
+               open[common].first == stack[common])
+            ++common;
+        close(common, s.thread, s.time);
+        for (size_t d = common; d < stack.size(); ++d)
+            open.push_back(std::make_pair(stack[d], s.time));
+    }
+    if (!samples.empty())
+        close(0, samples.back().thread, samples.back().time + period);
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0;
+}
+
+bool WriteProfile(const std::string &prefix) {
+#ifdef PBRT_HAVE_ITIMER
+    std::string folded = prefix + ".folded", trace = prefix + ".trace.json";
+    std::map<uint64_t, uint64_t> stateCounts;
+    for (const ProfileSample &ps : profileSamples)
+        if (ps.count > 0) stateCounts[ps.profilerState] += ps.count;
+    if (!WriteCollapsedStacks(folded, stateCounts)) {
+        Error("%s: unable to write profile", folded.c_str());
+        return false;
+    }
+    if (!profileTrace) return true;
+
+    uint64_t nSamples = std::min<uint64_t>(profileTraceCount,
+                                           profileTraceCapacity);
+    if (profileTraceCount > profileTraceCapacity)
+        Warning("Profile trace buffer filled up; only the first %" PRIu64
+                " of %" PRIu64 " samples are in \"%s\".",
+                nSamples, uint64_t(profileTraceCount), trace.c_str());
+    std::vector<ProfileTraceSample> samples;
+    samples.reserve(nSamples);
+    for (uint64_t i = 0; i < nSamples; ++i)
+        if (profileTrace[i].profilerState != 0)
+            samples.push_back(profileTrace[i]);
+    if (!WriteChromeTrace(trace, std::move(samples))) {
+        Error("%s: unable to write profile trace", trace.c_str());
+        return false;
+    }
+    return true;
+#else
+    Error("Profiling isn't supported on this system.");
+    return false;
+#endif  // PBRT_HAVE_ITIMER
+}
+
+
+// Returns the CPU time spent in each profiling category, in seconds,
+// attributing each sample to its innermost category.
+static std::map<std::string, double> ProfileTimes() {
+    std::map<std::string, double> times;
+#ifdef PBRT_HAVE_ITIMER
+    for (const ProfileSample &ps : profileSamples) {
+        if (ps.count == 0) continue;
+        times[ProfNames[Log2Int(ps.profilerState)]] +=
+            double(ps.count) / profileSamplesPerSecond;
+    }
+#endif  // PBRT_HAVE_ITIMER
+    return times;
+}
+
+void InitStatsTelemetry(const std::string &filename, Float interval) {
+    CHECK(!telemetryFile);
+    telemetryFile = fopen(filename.c_str(), "w");
+    if (!telemetryFile) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        return;
+    }
+    telemetryCSV = HasExtension(filename, "csv");
+    if (telemetryCSV)
+        fprintf(telemetryFile, "time,frame,final,type,name,value,total\n");
+    telemetryFrame = 0;
+    telemetryStartTime = std::chrono::steady_clock::now();
+    if (interval <= 0) return;
+
+    // Launch thread to periodically write snapshots; see the
+    // ProgressReporter constructor for why the profiler is suspended.
+    telemetryExit = false;
+    SuspendProfiler();
+    std::shared_ptr<Barrier> barrier = std::make_shared<Barrier>(2);
+    telemetryThread = std::thread([interval, barrier]() {
+        ProfilerWorkerThreadInit();
+        ProfilerState = 0;
+        barrier->Wait();
+        std::chrono::milliseconds period(int64_t(1000 * interval));
+        std::unique_lock<std::mutex> lock(telemetryExitMutex);
+        while (!telemetryExitCondition.wait_for(
+            lock, period, []() { return telemetryExit; })) {
+            lock.unlock();
+            WriteStatsTelemetry(false);
+            lock.lock();
+        }
+    });
+    barrier->Wait();
+    ResumeProfiler();
+}
+
+void WriteStatsTelemetry(bool endOfFrame) {
+    std::lock_guard<std::mutex> lock(telemetryMutex);
+    if (!telemetryFile) return;
+    // At the end of a frame, the caller has already merged the threads'
+    // statistics.
+    if (!endOfFrame) MergeWorkerThreadStats();
+    double time = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - telemetryStartTime)
+                      .count();
+    // Progress is reported from within rendering tasks, so it has its own
+    // mutex; _telemetryMutex_ is held while waiting for those tasks.
+    std::map<std::string, double> progress;
+    {
+        std::lock_guard<std::mutex> progressLock(progressMutex);
+        progress = telemetryProgress;
+        if (endOfFrame) telemetryProgress.clear();
+    }
+    {
+        std::lock_guard<std::mutex> statsLock(statsMutex);
+        statsAccumulator.WriteTelemetry(telemetryFile, telemetryCSV, time,
+                                        telemetryFrame, endOfFrame,
+                                        ProfileTimes(), progress);
+    }
+    fflush(telemetryFile);
+    if (endOfFrame) ++telemetryFrame;
+}
+
+void ReportStatsProgress(const std::string &title, Float fraction) {
+    std::lock_guard<std::mutex> lock(progressMutex);
+    telemetryProgress[title] = fraction;
+}
+
+void CleanupStatsTelemetry() {
+    if (telemetryThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(telemetryExitMutex);
+            telemetryExit = true;
+        }
+        telemetryExitCondition.notify_one();
+        telemetryThread.join();
+    }
+    if (telemetryFile) {
+        fclose(telemetryFile);
+        telemetryFile = nullptr;
+    }
+}
+
 }  // namespace pbrt
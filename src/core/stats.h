@@ -67,6 +67,11 @@ class StatRegisterer {
 void PrintStats(FILE *dest);
 void ClearStats();
 void ReportThreadStats();
+int64_t GetStatsCounter(const std::string &name);
+void InitStatsTelemetry(const std::string &filename, Float interval);
+void WriteStatsTelemetry(bool endOfFrame);
+void ReportStatsProgress(const std::string &title, Float fraction);
+void CleanupStatsTelemetry();
 
 class StatsAccumulator {
   public:
@@ -117,6 +122,14 @@ class StatsAccumulator {
     }
 
     void Print(FILE *file);
+    int64_t Counter(const std::string &name) const {
+        auto iter = counters.find(name);
+        return iter == counters.end() ? 0 : iter->second;
+    }
+    void WriteTelemetry(FILE *dest, bool csv, double time, int frame,
+                        bool endOfFrame,
+                        const std::map<std::string, double> &profile,
+                        const std::map<std::string, double> &progress) const;
     void Clear();
 
   private:
@@ -142,6 +155,10 @@ enum class Prof {
     MIPMapCreation,
 
     IntegratorRender,
+    IILEAuxRender,
+    IILENormalize,
+    IILENNCommunicate,
+    IILEHemisphereSampling,
     SamplerIntegratorLi,
     SPPMCameraPass,
     SPPMGridConstruction,
@@ -197,6 +214,10 @@ static const char *ProfNames[] = {
     "MIP map generation",
 
     "Integrator::Render()",
+    "IILE auxiliary render",
+    "IILE map normalization",
+    "IILE NN communication",
+    "IILE hemisphere sampling",
     "SamplerIntegrator::Li()",
     "SPPM camera pass",
     "SPPM grid construction",
@@ -272,6 +293,22 @@ void SuspendProfiler();
 void ResumeProfiler();
 void ProfilerWorkerThreadInit();
 void ReportProfilerResults(FILE *dest);
+bool WriteProfile(const std::string &prefix);
+
+// A profiler sample recorded along with the time and the thread it was
+// taken on, so that per-thread timelines can be reconstructed.
+struct ProfileTraceSample {
+    uint64_t profilerState;
+    uint32_t thread;
+    // Time since the profiler was initialized, in units of 100us.
+    uint32_t time;
+};
+// WriteProfile() uses these to write the recorded profile; they are
+// exposed so that their output can be checked for given samples.
+bool WriteCollapsedStacks(const std::string &filename,
+                          const std::map<uint64_t, uint64_t> &stateCounts);
+bool WriteChromeTrace(const std::string &filename,
+                      std::vector<ProfileTraceSample> samples);
 void ClearProfiler();
 void CleanupProfiler();
 
@@ -0,0 +1,221 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+
+// core/texcache.cpp*
+#include "texcache.h"
+#include "stats.h"
+#include <stdio.h>
+
+namespace pbrt {
+
+STAT_PERCENT("Texture/Tile cache hits", nTileHits, nTileLookups);
+STAT_COUNTER("Texture/Tiles paged in", nTileLoads);
+STAT_COUNTER("Texture/Tiles evicted", nTileEvictions);
+STAT_MEMORY_COUNTER("Memory/Texture tile cache (resident)", residentTileBytes);
+
+// TextureTileCache Local Definitions
+struct TileHandle {
+    // Tile ids are stored plus one so that zero-initialized handles are
+    // empty.
+    int tileIdPlusOne;
+    int generation;
+    const void *data;
+};
+static PBRT_CONSTEXPR int NumTileHandles = 16;
+static PBRT_THREAD_LOCAL TileHandle tileHandles[NumTileHandles];
+
+static bool SeekBackingFile(FILE *f, int64_t offset) {
+#ifdef PBRT_IS_WINDOWS
+    return _fseeki64(f, offset, SEEK_SET) == 0;
+#else
+    return fseeko(f, offset, SEEK_SET) == 0;
+#endif
+}
+
+// TextureTileCache Method Definitions
+TextureTileCache *TextureTileCache::cache = nullptr;
+std::atomic<int> TextureTileCache::generation{1};
+
+void TextureTileCache::Init(int64_t maxBytes) {
+    CHECK(cache == nullptr);
+    FILE *f = tmpfile();
+    if (!f) {
+        Error("Unable to create texture cache backing file: %s. Texture "
+              "tiles will be kept in memory.", strerror(errno));
+        return;
+    }
+    cache = new TextureTileCache(maxBytes, f);
+}
+
+void TextureTileCache::Cleanup() {
+    delete cache;
+    cache = nullptr;
+    // Make sure that no thread's tile handles refer to the old cache.
+    ++generation;
+}
+
+TextureTileCache::TextureTileCache(int64_t maxBytes, FILE *backingFile)
+    : maxBytes(maxBytes), backingFile(backingFile) {}
+
+TextureTileCache::~TextureTileCache() { fclose(backingFile); }
+
+int TextureTileCache::AddTile(const void *data, size_t nBytes) {
+    std::lock_guard<std::mutex> lock(tilesMutex);
+    int tileId = nTiles;
+    CHECK_LT(tileId / TileChunkSize, MaxTileChunks)
+        << "Too many texture tiles";
+    if (tileId % TileChunkSize == 0)
+        tileChunks[tileId / TileChunkSize].reset(new Tile[TileChunkSize]);
+    Tile &tile = GetTileRecord(tileId);
+    tile.fileOffset = backingFileSize;
+    tile.nBytes = nBytes;
+    {
+        std::lock_guard<std::mutex> fileLock(fileMutex);
+        if (!SeekBackingFile(backingFile, backingFileSize) ||
+            fwrite(data, 1, nBytes, backingFile) != nBytes)
+            LOG(FATAL) << "Unable to write texture tile to backing file: "
+                       << strerror(errno);
+    }
+    backingFileSize += nBytes;
+    ++nTiles;
+    return tileId;
+}
+
+void TextureTileCache::FreeTiles(int firstTile, int count) {
+    std::lock_guard<std::mutex> lock(tilesMutex);
+    for (int tileId = firstTile; tileId < firstTile + count; ++tileId) {
+        Tile &tile = GetTileRecord(tileId);
+        tile.freed = true;
+        // A thread that still has the tile pinned may be reading its data;
+        // Release() frees it once the last pin is dropped.
+        if (tile.pinCount == 0) FreeTileData(tileId);
+    }
+}
+
+void TextureTileCache::FreeTileData(int tileId) {
+    Tile &tile = GetTileRecord(tileId);
+    std::lock_guard<std::mutex> tileLock(stripeMutex[tileId % NumStripes]);
+    if (tile.data && tile.pinCount == 0) {
+        tile.data.reset();
+        residentBytes -= tile.nBytes;
+        residentTileBytes -= tile.nBytes;
+    }
+}
+
+const void *TextureTileCache::GetTile(int tileId) {
+    ++nTileLookups;
+    // Check the calling thread's tile handles before going to the shared
+    // cache.
+    TileHandle &handle = tileHandles[tileId & (NumTileHandles - 1)];
+    int currentGeneration = generation.load(std::memory_order_relaxed);
+    if (handle.generation == currentGeneration) {
+        if (handle.tileIdPlusOne == tileId + 1) {
+            ++nTileHits;
+            return handle.data;
+        }
+        if (handle.tileIdPlusOne != 0) Release(handle.tileIdPlusOne - 1);
+    }
+    handle.data = Acquire(tileId);
+    handle.tileIdPlusOne = tileId + 1;
+    handle.generation = currentGeneration;
+    return handle.data;
+}
+
+const uint8_t *TextureTileCache::Acquire(int tileId) {
+    DCHECK_LT(tileId, nTiles.load());
+    Tile &tile = GetTileRecord(tileId);
+    const uint8_t *data;
+    bool loaded = false;
+    {
+        std::lock_guard<std::mutex> lock(stripeMutex[tileId % NumStripes]);
+        CHECK(!tile.freed);
+        ++tile.pinCount;
+        tile.referenced = true;
+        if (tile.data)
+            ++nTileHits;
+        else {
+            // Page the tile in from the backing file
+            std::unique_ptr<uint8_t[]> tileData(new uint8_t[tile.nBytes]);
+            {
+                std::lock_guard<std::mutex> fileLock(fileMutex);
+                if (!SeekBackingFile(backingFile, tile.fileOffset) ||
+                    fread(tileData.get(), 1, tile.nBytes, backingFile) !=
+                        tile.nBytes)
+                    LOG(FATAL) << "Unable to read texture tile from backing "
+                                  "file: " << strerror(errno);
+            }
+            tile.data = std::move(tileData);
+            residentBytes += tile.nBytes;
+            residentTileBytes += tile.nBytes;
+            ++nTileLoads;
+            loaded = true;
+        }
+        data = tile.data.get();
+    }
+    if (loaded && residentBytes > maxBytes) EvictToBudget();
+    return data;
+}
+
+void TextureTileCache::Release(int tileId) {
+    Tile &tile = GetTileRecord(tileId);
+    // Give recently used tiles a second chance before they're evicted.
+    tile.referenced = true;
+    // Both this and FreeTiles() set their flag before checking the other's,
+    // so at least one of them sees that the tile's data can be freed.
+    if (--tile.pinCount == 0 && tile.freed) FreeTileData(tileId);
+}
+
+void TextureTileCache::EvictToBudget() {
+    std::lock_guard<std::mutex> lock(tilesMutex);
+    // Two trips around the clock are enough to clear every reference bit
+    // and then reach every unpinned tile; if the budget still isn't met,
+    // all of the resident tiles are pinned by some thread's tile handles
+    // and the cache temporarily grows past it.
+    int n = nTiles;
+    for (int i = 0; i < 2 * n && residentBytes > maxBytes; ++i) {
+        clockHand = (clockHand + 1) % n;
+        Tile &tile = GetTileRecord(clockHand);
+        if (tile.pinCount > 0 || tile.referenced.exchange(false)) continue;
+        std::lock_guard<std::mutex> tileLock(
+            stripeMutex[clockHand % NumStripes]);
+        if (tile.data && tile.pinCount == 0) {
+            tile.data.reset();
+            residentBytes -= tile.nBytes;
+            residentTileBytes -= tile.nBytes;
+            ++nTileEvictions;
+        }
+    }
+}
+
+}  // namespace pbrt
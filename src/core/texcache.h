@@ -0,0 +1,120 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_CORE_TEXCACHE_H
+#define PBRT_CORE_TEXCACHE_H
+
+// core/texcache.h*
+#include "pbrt.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace pbrt {
+
+// TextureTileCache Declarations
+
+// The TextureTileCache holds MIP map tiles within a fixed memory budget.
+// Tiles are written to a backing file when they are registered and are
+// then paged back in on demand, evicting the least recently used unpinned
+// tiles (approximated with the clock algorithm) when the budget is
+// exceeded. Each thread pins a handful of recently used tiles through
+// its own tile handles, so that most lookups don't touch any shared state.
+class TextureTileCache {
+  public:
+    // TextureTileCache Public Methods
+    static void Init(int64_t maxBytes);
+    static void Cleanup();
+    // Returns the process-wide cache, or nullptr if caching is disabled.
+    static TextureTileCache *Get() { return cache; }
+
+    ~TextureTileCache();
+    int AddTile(const void *data, size_t nBytes);
+    // Frees the given tiles; the data of tiles that are still pinned by a
+    // thread is freed when they are released.
+    void FreeTiles(int firstTile, int nTiles);
+    // Returns the data for the given tile. The pointer remains valid until
+    // the calling thread's next call to GetTile().
+    const void *GetTile(int tileId);
+    int64_t ResidentBytes() const { return residentBytes; }
+
+  private:
+    struct Tile {
+        int64_t fileOffset = 0;
+        size_t nBytes = 0;
+        std::unique_ptr<uint8_t[]> data;
+        std::atomic<int> pinCount{0};
+        std::atomic<bool> referenced{false};
+        std::atomic<bool> freed{false};
+    };
+
+    // TextureTileCache Private Methods
+    TextureTileCache(int64_t maxBytes, FILE *backingFile);
+    Tile &GetTileRecord(int tileId) {
+        return tileChunks[tileId / TileChunkSize][tileId % TileChunkSize];
+    }
+    const uint8_t *Acquire(int tileId);
+    void Release(int tileId);
+    void EvictToBudget();
+    void FreeTileData(int tileId);
+
+    // TextureTileCache Private Data
+    static TextureTileCache *cache;
+    static std::atomic<int> generation;
+    const int64_t maxBytes;
+    std::atomic<int64_t> residentBytes{0};
+    FILE *backingFile;
+    int64_t backingFileSize = 0;
+    std::mutex fileMutex;
+    // Tiles are stored in fixed-size chunks that never move, so that
+    // lookups can proceed while new tiles are being registered.
+    // Registration and eviction are serialized by _tilesMutex_; loading
+    // and unloading individual tiles only takes the tile's stripe lock.
+    static PBRT_CONSTEXPR int TileChunkSize = 4096;
+    static PBRT_CONSTEXPR int MaxTileChunks = 16384;
+    std::unique_ptr<Tile[]> tileChunks[MaxTileChunks];
+    std::atomic<int> nTiles{0};
+    std::mutex tilesMutex;
+    int clockHand = 0;
+    static PBRT_CONSTEXPR int NumStripes = 64;
+    std::mutex stripeMutex[NumStripes];
+};
+
+}  // namespace pbrt
+
+#endif  // PBRT_CORE_TEXCACHE_H
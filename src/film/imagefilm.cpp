@@ -115,7 +115,8 @@ void ImageFilm::pbrt_write_image(std::string filename) {
         }
     }
 
-    pbrt::WriteImage(filename, &rgb[0], cropped_pixel_bounds, full_resolution);
+    pbrt::WriteImageAsync(filename, std::move(rgb), cropped_pixel_bounds,
+                          full_resolution);
 
 }
 
@@ -154,7 +155,8 @@ void ImageFilm::writeLDR(std::string filename, float gain)
         }
     }
 
-    pbrt::WriteImage(filename, &rgb[0], cropped_pixel_bounds, full_resolution);
+    pbrt::WriteImageAsync(filename, std::move(rgb), cropped_pixel_bounds,
+                          full_resolution);
 }
 
 // ============================================================================
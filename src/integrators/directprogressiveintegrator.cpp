@@ -77,6 +77,8 @@ void DirectProgressiveIntegrator::RenderOnePass(
     std::unique_ptr<FilmTile> filmTile =
         camera->film->GetFilmTile(tileBounds);
 
+    bool adaptive = PbrtOptions.iileDirectAdaptive > 0;
+
     for (Point2i pixel : tileBounds) {
         {
             sampler->StartPixel(pixel);
@@ -89,6 +91,13 @@ void DirectProgressiveIntegrator::RenderOnePass(
         if (!InsideExclusive(pixel, pixelBounds))
             continue;
 
+        // Skip pixels that have already converged; the statistics are
+        // shared by all threads rendering into _filmMonitor_
+        if (adaptive &&
+            filmMonitor->is_converged(pixel, adaptiveMinPasses,
+                                      PbrtOptions.iileDirectAdaptive))
+            continue;
+
         // Run the pixel loop only once to force rendering a single pass
         {
             // Initialize _CameraSample_ for current sample
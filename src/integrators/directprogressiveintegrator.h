@@ -18,6 +18,10 @@ public:
     std::unique_ptr<Sampler> sampler;
     std::vector<int> nLightSamples;
     const int maxDepth = 5;
+    // When PbrtOptions.iileDirectAdaptive is set, pixels are skipped once
+    // the film monitor holds this many samples for them (from any thread)
+    // with a relative error below the threshold
+    const int adaptiveMinPasses = 4;
 
     // Constructor ============================================================
     DirectProgressiveIntegrator(
@@ -36,6 +36,7 @@
 #include "bssrdf.h"
 #include "camera.h"
 #include "film.h"
+#include "imageio.h"
 #include "interaction.h"
 #include "paramset.h"
 #include "scene.h"
@@ -404,7 +405,8 @@ void IISPTIntegrator::render_normal_2(const Scene &scene) {
                             sampler,
                             i,
                             camera->film->GetSampleBounds(),
-                            nnConnector
+                            nnConnector,
+                            lightSampleStrategy
                             )
                         );
             if (i % 2 == 0) {
@@ -460,7 +462,7 @@ void IISPTIntegrator::render_reference(const Scene &scene) {
     write_info_file(IISPT_REFERENCE_DIRECTORY + IISPT_REFERENCE_TRAIN_INFO);
 
     // Create the auxiliary integrator for intersection-view
-    this->dintegrator = std::shared_ptr<IISPTdIntegrator>(CreateIISPTdIntegrator(dcamera, 13));
+    this->dintegrator = std::shared_ptr<IISPTdIntegrator>(CreateIISPTdIntegrator(dcamera, 13, lightSampleStrategy));
     // Preprocess on auxiliary integrator
     dintegrator->Preprocess(scene);
 
@@ -777,6 +779,8 @@ void IISPTIntegrator::directoryControlThread(
                 indirectFilmMonitor->merge_into(directFilmMonitor.get());
         combinedFilm->to_intensity_film()->pbrt_write(combinedOutPath);
 
+        // The GUI reads the files as soon as it's told to refresh
+        FlushImageWrites();
         std::cout << "#REFRESH!" << std::endl;
 
         if (renderingFinished) {
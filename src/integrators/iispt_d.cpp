@@ -147,14 +147,13 @@ Spectrum IISPTdIntegrator::Li(const RayDifferential &r,
             continue;
         }
 
-        const Distribution1D *distrib = lightDistribution->Lookup(isect.p);
-
         // Sample illumination from lights to find path contribution.
         // (But skip this for perfectly specular BSDFs.)
         if (isect.bsdf->NumComponents(BxDFType(BSDF_ALL & ~BSDF_SPECULAR)) >
             0) {
             Spectrum Ld = beta * UniformSampleOneLight(isect, scene, arena,
-                                                       sampler, false, distrib);
+                                                       sampler,
+                                                       *lightDistribution);
             VLOG(2) << "Sampled direct lighting Ld = " << Ld;
             CHECK_GE(Ld.y(), 0.f);
             L += Ld;
@@ -196,8 +195,8 @@ Spectrum IISPTdIntegrator::Li(const RayDifferential &r,
             beta *= S / pdf;
 
             // Account for the direct subsurface scattering component
-            L += beta * UniformSampleOneLight(pi, scene, arena, sampler, false,
-                                              lightDistribution->Lookup(pi.p));
+            L += beta * UniformSampleOneLight(pi, scene, arena, sampler,
+                                              *lightDistribution);
 
             // Account for the indirect subsurface scattering component
             Spectrum f = pi.bsdf->Sample_f(pi.wo, &wi, sampler.Get2D(), &pdf,
@@ -229,6 +228,8 @@ void IISPTdIntegrator::RenderView(
         Sampler* sampler
         )
 {
+    ProfilePhase _(Prof::IILEAuxRender);
+
     // There is no preprocess here.
     // It must have already been called by the host.
 
@@ -347,6 +348,8 @@ void IISPTdIntegrator::RenderView(
         Camera* camera
         )
 {
+    ProfilePhase _(Prof::IILEAuxRender);
+
     // There is no preprocess here.
     // It must have already been called by the host.
 
@@ -499,7 +502,8 @@ DistanceFilm* IISPTdIntegrator::get_distance_film() {
 
 // Factory ====================================================================
 std::shared_ptr<IISPTdIntegrator> CreateIISPTdIntegrator(
-    std::shared_ptr<Camera> camera, int seed) {
+    std::shared_ptr<Camera> camera, int seed,
+    const std::string &lightSampleStrategy) {
 
     LOG(INFO) << "CreateIISPTdIntegrator: in";
     int maxDepth = 3; // NOTE Hard-coded "maxdepth"
@@ -526,7 +530,8 @@ std::shared_ptr<IISPTdIntegrator> CreateIISPTdIntegrator(
 
     std::shared_ptr<Sampler> sampler (samplerPtr);
 
-    std::shared_ptr<IISPTdIntegrator> result (new IISPTdIntegrator(maxDepth, camera, sampler, pixelBounds));
+    std::shared_ptr<IISPTdIntegrator> result (new IISPTdIntegrator(
+            maxDepth, camera, sampler, pixelBounds, lightSampleStrategy));
 
     return result;
 }
@@ -72,7 +72,7 @@ private:
   std::unique_ptr<NormalFilm> normal_film;
 
   const Float rrThreshold = 0.5;
-  const std::string lightSampleStrategy = std::string("spatial");
+  const std::string lightSampleStrategy;
   std::unique_ptr<LightDistribution> lightDistribution;
 
 public:
@@ -83,12 +83,15 @@ public:
     IISPTdIntegrator(int maxDepth,
                              std::shared_ptr<Camera> camera,
                              std::shared_ptr<Sampler> sampler,
-                             const Bounds2i &pixelBounds) :
+                             const Bounds2i &pixelBounds,
+                             const std::string &lightSampleStrategy =
+                                 "spatial") :
         SamplerIntegrator(camera, sampler, pixelBounds),
         camera(camera),
         sampler_internal(sampler),
         pixelBounds(pixelBounds),
-        maxDepth(maxDepth)
+        maxDepth(maxDepth),
+        lightSampleStrategy(lightSampleStrategy)
     {
         distance_film = std::unique_ptr<DistanceFilm>(
             new DistanceFilm(
@@ -160,7 +163,8 @@ public:
 };
 
 std::shared_ptr<IISPTdIntegrator> CreateIISPTdIntegrator(
-    std::shared_ptr<Camera> camera, int seed
+    std::shared_ptr<Camera> camera, int seed,
+    const std::string &lightSampleStrategy = "spatial"
 );
 
 }  // namespace pbrt
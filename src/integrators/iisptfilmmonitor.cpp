@@ -18,6 +18,8 @@ IisptFilmMonitor::IisptFilmMonitor(
             row.push_back(pix);
         }
         pixels.push_back(row);
+        sample_stats.push_back(
+                    std::vector<VarianceEstimator>(film_diagonal.x + 1));
     }
 }
 
@@ -38,6 +40,7 @@ void IisptFilmMonitor::add_sample(Point2i pt, Spectrum s, double weight)
         pix.b += rgb[2];
 
         (pixels[fy])[fx] = pix;
+        (sample_stats[fy])[fx].Add(weight * s.y());
     }, pt.x, pt.y);
 
 }
@@ -66,6 +69,7 @@ void IisptFilmMonitor::add_n_samples(
             pix.b += rgb[2];
 
             (pixels[fy])[fx] = pix;
+            (sample_stats[fy])[fx].Add(weights[i] * ss[i].y());
         }, pt.x, pt.y);
     }
 
@@ -73,6 +77,26 @@ void IisptFilmMonitor::add_n_samples(
 
 // ============================================================================
 
+bool IisptFilmMonitor::is_converged(
+        Point2i pt,
+        int min_samples,
+        Float max_relative_error
+        )
+{
+    std::unique_lock<std::recursive_mutex> lock (mutex);
+
+    bool converged = false;
+    execute_on_pixel([&](int fx, int fy) {
+        const VarianceEstimator &stats = (sample_stats[fy])[fx];
+        converged = stats.Count() >= min_samples &&
+                stats.RelativeError() < max_relative_error;
+    }, pt.x, pt.y);
+
+    return converged;
+}
+
+// ============================================================================
+
 void IisptFilmMonitor::addFromIntensityFilm(
         IntensityFilm* intensityFilm
         )
@@ -25,6 +25,12 @@ private:
 
     std::vector<std::vector<IisptPixel>> pixels;
 
+    // Luminance statistics of the samples added to each pixel with
+    // add_sample() and add_n_samples(). They live here, behind the
+    // monitor's lock, so that all threads rendering into the film see
+    // the same per-pixel sample counts.
+    std::vector<std::vector<VarianceEstimator>> sample_stats;
+
     // The bounds of the film are taken inclusively
     Bounds2i film_bounds;
 
@@ -59,6 +65,11 @@ public:
             std::vector<double> &weights
             );
 
+    // Returns true if at least <min_samples> samples were added to the
+    // pixel and their relative standard error is below
+    // <max_relative_error>
+    bool is_converged(Point2i pt, int min_samples, Float max_relative_error);
+
     std::shared_ptr<IntensityFilm> to_intensity_film();
 
     std::shared_ptr<IntensityFilm> to_intensity_film_reversed();
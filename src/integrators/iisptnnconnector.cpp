@@ -1,9 +1,14 @@
+#include <chrono>
 #include <cstdlib>
 #include <iostream>
 #include "iisptnnconnector.h"
+#include "stats.h"
 
 namespace pbrt {
 
+STAT_COUNTER("IILE/NN requests", nNnRequests);
+STAT_COUNTER("IILE/NN request time (us)", nnRequestMicroseconds);
+
 // ============================================================================
 // Constructor
 IisptNnConnector::IisptNnConnector() {
@@ -129,6 +134,10 @@ std::unique_ptr<IntensityFilm> IisptNnConnector::communicate(
         int &status
         )
 {
+    ProfilePhase _(Prof::IILENNCommunicate);
+    std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+
     // Write rasters
     pipe_image_film(intensity->get_image_film());
     pipe_image_film(normals->get_image_film());
@@ -137,6 +146,10 @@ std::unique_ptr<IntensityFilm> IisptNnConnector::communicate(
     // Read output from child process
     int st = -1;
     std::unique_ptr<IntensityFilm> output_film = read_image_film(st);
+    ++nNnRequests;
+    nnRequestMicroseconds +=
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
     if (st) {
         std::cerr << "iisptnnconnector.cpp: An error occurred when reading output image" << std::endl;
         status = 1;
@@ -1,5 +1,6 @@
 #include "iisptrenderrunner.h"
 #include "lightdistrib.h"
+#include "stats.h"
 
 #include <chrono>
 #include <csignal>
@@ -146,6 +147,7 @@ Spectrum IisptRenderRunner::sample_hemisphere(
         HemisphericCamera** cameras
         )
 {
+    ProfilePhase _(Prof::IILEHemisphereSampling);
     Spectrum L(0.f);
 
     int samples_taken = 0;
@@ -186,7 +188,8 @@ IisptRenderRunner::IisptRenderRunner(std::shared_ptr<IisptScheduleMonitor> sched
         std::shared_ptr<Sampler> sampler,
         int thread_no,
         Bounds2i pixel_bounds,
-        std::shared_ptr<IisptNnConnector> nnConnector)
+        std::shared_ptr<IisptNnConnector> nnConnector,
+        const std::string &lightSampleStrategy)
 {
     this->schedule_monitor = schedule_monitor;
 
@@ -209,19 +212,21 @@ IisptRenderRunner::IisptRenderRunner(std::shared_ptr<IisptScheduleMonitor> sched
     this->thread_no = thread_no;
 
     this->main_camera = main_camera;
+
+    this->light_sample_strategy = lightSampleStrategy;
 }
 
 // ============================================================================
 
 void IisptRenderRunner::run(const Scene &scene)
 {
+    ProfilePhase _(Prof::IntegratorRender);
+
     // dintegrator
     std::shared_ptr<IISPTdIntegrator> d_integrator = CreateIISPTdIntegrator(
-                this->dcamera, 17 * thread_no + 243);
+                this->dcamera, 17 * thread_no + 243, light_sample_strategy);
 
     d_integrator->Preprocess(scene);
-    lightDistribution =
-            CreateLightSampleDistribution(std::string("spatial"), scene);
 
     Point3f mainCameraOrigin = main_camera->getCameraWorldPosition();
 
@@ -590,6 +595,10 @@ void IisptRenderRunner::run(const Scene &scene)
         }
 
         std::cout << "#INDPROGRESS!" << progress << std::endl;
+        ReportStatsProgress("IILE indirect pass", progress);
+        // This thread isn't one of pbrt's workers, so its statistics are
+        // only merged, and seen by stats snapshots, when it reports them.
+        ReportThreadStats();
 
     }
 
@@ -600,6 +609,7 @@ void IisptRenderRunner::run(const Scene &scene)
 // Render direct illumination components
 void IisptRenderRunner::run_direct(const Scene &scene)
 {
+    ProfilePhase _(Prof::IntegratorRender);
     std::cerr << "iisptrenderrunner.cpp: Thread " << thread_no << " " << "iisptrenderrunner.cpp: starting direct illumination pass\n";
 
     std::unique_ptr<Sampler> directSampler = sampler->Clone(6284 + 17 * thread_no);
@@ -626,6 +636,8 @@ void IisptRenderRunner::run_direct(const Scene &scene)
 
         float progress = ((float) (directPassNumber + 1)) / PbrtOptions.iileDirectSamples;
         std::cout << "#DIRECTPROGRESS!" << progress << std::endl;
+        ReportStatsProgress("IILE direct pass", progress);
+        ReportThreadStats();
 
     }
 }
@@ -1047,6 +1059,7 @@ void IisptRenderRunner::normalizeMapsDownstream(
         float &bmean
         )
 {
+    ProfilePhase _(Prof::IILENormalize);
     // Intensity --------------------------------------------------------------
 
     // Compute mean of intensity
@@ -1101,6 +1114,7 @@ void IisptRenderRunner::transformMapsUpstream(
         float bmean
         )
 {
+    ProfilePhase _(Prof::IILENormalize);
     std::shared_ptr<ImageFilm> intensityFilm = intensity->get_image_film();
 
     // Log inverse
@@ -60,7 +60,8 @@ private:
 
     Bounds2i pixel_bounds;
 
-    std::unique_ptr<LightDistribution> lightDistribution;
+    // Light sample strategy of the hemisphere renders' integrator
+    std::string light_sample_strategy;
 
     // Private methods --------------------------------------------------------
 
@@ -146,7 +147,8 @@ public:
             std::shared_ptr<Sampler> sampler,
             int thread_no,
             Bounds2i pixel_bounds,
-            std::shared_ptr<IisptNnConnector> nnConnector
+            std::shared_ptr<IisptNnConnector> nnConnector,
+            const std::string &lightSampleStrategy = "spatial"
             );
 
     // Public methods ---------------------------------------------------------
@@ -175,6 +175,7 @@ void MLTIntegrator::Render(const Scene &scene) {
         lightToIndex[scene.lights[i].get()] = i;
 
     // Generate bootstrap samples and compute normalization constant $b$
+    const uint64_t seedOffset = (uint64_t)seed << 32;
     int nBootstrapSamples = nBootstrap * (maxDepth + 1);
     std::vector<Float> bootstrapWeights(nBootstrapSamples, 0);
     if (scene.lights.size() > 0) {
@@ -187,8 +188,9 @@ void MLTIntegrator::Render(const Scene &scene) {
             MemoryArena &arena = bootstrapThreadArenas[ThreadIndex];
             for (int depth = 0; depth <= maxDepth; ++depth) {
                 int rngIndex = i * (maxDepth + 1) + depth;
-                MLTSampler sampler(mutationsPerPixel, rngIndex, sigma,
-                                   largeStepProbability, nSampleStreams);
+                MLTSampler sampler(mutationsPerPixel, seedOffset + rngIndex,
+                                   sigma, largeStepProbability,
+                                   nSampleStreams);
                 Point2f pRaster;
                 bootstrapWeights[rngIndex] =
                     L(scene, arena, lightDistr, lightToIndex, sampler, depth, &pRaster).y();
@@ -203,61 +205,86 @@ void MLTIntegrator::Render(const Scene &scene) {
 
     // Run _nChains_ Markov chains in parallel
     Film &film = *camera->film;
+    film.UseThreadSplatImages();
     int64_t nTotalMutations =
         (int64_t)mutationsPerPixel * (int64_t)film.GetSampleBounds().Area();
     if (scene.lights.size() > 0) {
         const int progressFrequency = 32768;
         ProgressReporter progress(nTotalMutations / progressFrequency,
                                   "Rendering");
-        ParallelFor([&](int i) {
-            int64_t nChainMutations =
-                std::min((i + 1) * nTotalMutations / nChains, nTotalMutations) -
-                i * nTotalMutations / nChains;
-            // Follow {i}th Markov chain for _nChainMutations_
-            MemoryArena arena;
-
-            // Select initial state from the set of bootstrap samples
-            RNG rng(i);
-            int bootstrapIndex = bootstrap.SampleDiscrete(rng.UniformFloat());
-            int depth = bootstrapIndex % (maxDepth + 1);
-
-            // Initialize local variables for selected state
-            MLTSampler sampler(mutationsPerPixel, bootstrapIndex, sigma,
-                               largeStepProbability, nSampleStreams);
-            Point2f pCurrent;
-            Spectrum LCurrent =
-                L(scene, arena, lightDistr, lightToIndex, sampler, depth, &pCurrent);
-
-            // Run the Markov chain for _nChainMutations_ steps
-            for (int64_t j = 0; j < nChainMutations; ++j) {
-                sampler.StartIteration();
-                Point2f pProposed;
-                Spectrum LProposed =
-                    L(scene, arena, lightDistr, lightToIndex, sampler, depth, &pProposed);
-                // Compute acceptance probability for proposed sample
-                Float accept = std::min((Float)1, LProposed.y() / LCurrent.y());
-
-                // Splat both current and proposed samples to _film_
-                if (accept > 0)
-                    film.AddSplat(pProposed,
-                                  LProposed * accept / LProposed.y());
-                film.AddSplat(pCurrent, LCurrent * (1 - accept) / LCurrent.y());
-
-                // Accept or reject the proposal
-                if (rng.UniformFloat() < accept) {
-                    pCurrent = pProposed;
-                    LCurrent = LProposed;
-                    sampler.Accept();
-                    ++acceptedMutations;
-                } else
-                    sampler.Reject();
-                ++totalMutations;
-                if ((i * nTotalMutations / nChains + j) % progressFrequency ==
-                    0)
-                    progress.Update();
-                arena.Reset();
+        // Chains run in batches of _writeFrequency_; the per-thread splat
+        // images are reduced and an intermediate image is written after
+        // each batch but the last.
+        int chainsPerBatch = writeFrequency > 0 ? writeFrequency : nChains;
+        for (int firstChain = 0; firstChain < nChains;
+             firstChain += chainsPerBatch) {
+            int endChain = std::min(firstChain + chainsPerBatch, nChains);
+            ParallelFor([&](int64_t c) {
+                int i = firstChain + (int)c;
+                int64_t nChainMutations =
+                    std::min((i + 1) * nTotalMutations / nChains,
+                             nTotalMutations) -
+                    i * nTotalMutations / nChains;
+                // Follow {i}th Markov chain for _nChainMutations_
+                MemoryArena arena;
+
+                // Select initial state from the set of bootstrap samples
+                RNG rng(seedOffset + i);
+                int bootstrapIndex =
+                    bootstrap.SampleDiscrete(rng.UniformFloat());
+                int depth = bootstrapIndex % (maxDepth + 1);
+
+                // Initialize local variables for selected state
+                MLTSampler sampler(mutationsPerPixel,
+                                   seedOffset + bootstrapIndex, sigma,
+                                   largeStepProbability, nSampleStreams);
+                Point2f pCurrent;
+                Spectrum LCurrent = L(scene, arena, lightDistr, lightToIndex,
+                                      sampler, depth, &pCurrent);
+
+                // Run the Markov chain for _nChainMutations_ steps
+                for (int64_t j = 0; j < nChainMutations; ++j) {
+                    sampler.StartIteration();
+                    Point2f pProposed;
+                    Spectrum LProposed = L(scene, arena, lightDistr,
+                                           lightToIndex, sampler, depth,
+                                           &pProposed);
+                    // Compute acceptance probability for proposed sample
+                    Float accept =
+                        std::min((Float)1, LProposed.y() / LCurrent.y());
+
+                    // Splat both current and proposed samples to _film_
+                    if (accept > 0)
+                        film.AddSplat(pProposed,
+                                      LProposed * accept / LProposed.y());
+                    film.AddSplat(pCurrent,
+                                  LCurrent * (1 - accept) / LCurrent.y());
+
+                    // Accept or reject the proposal
+                    if (rng.UniformFloat() < accept) {
+                        pCurrent = pProposed;
+                        LCurrent = LProposed;
+                        sampler.Accept();
+                        ++acceptedMutations;
+                    } else
+                        sampler.Reject();
+                    ++totalMutations;
+                    if ((i * nTotalMutations / nChains + j) %
+                            progressFrequency ==
+                        0)
+                        progress.Update();
+                    arena.Reset();
+                }
+            }, endChain - firstChain);
+
+            // Write intermediate image, scaled for the mutations so far
+            if (endChain < nChains) {
+                int64_t nMutationsDone = endChain * nTotalMutations / nChains;
+                if (nMutationsDone > 0)
+                    film.WriteImage(b / mutationsPerPixel *
+                                    ((Float)nTotalMutations / nMutationsDone));
             }
-        }, nChains);
+        }
         progress.Done();
     }
 
@@ -274,12 +301,15 @@ MLTIntegrator *CreateMLTIntegrator(const ParamSet &params,
     Float largeStepProbability =
         params.FindOneFloat("largestepprobability", 0.3f);
     Float sigma = params.FindOneFloat("sigma", .01f);
+    int seed = params.FindOneInt("seed", 0);
+    int writeFreq = params.FindOneInt("imagewritefrequency", 0);
     if (PbrtOptions.quickRender) {
         mutationsPerPixel = std::max(1, mutationsPerPixel / 16);
         nBootstrap = std::max(1, nBootstrap / 16);
     }
     return new MLTIntegrator(camera, maxDepth, nBootstrap, nChains,
-                             mutationsPerPixel, sigma, largeStepProbability);
+                             mutationsPerPixel, sigma, largeStepProbability,
+                             seed, writeFreq);
 }
 
 }  // namespace pbrt
@@ -53,7 +53,7 @@ namespace pbrt {
 class MLTSampler : public Sampler {
   public:
     // MLTSampler Public Methods
-    MLTSampler(int mutationsPerPixel, int rngSequenceIndex, Float sigma,
+    MLTSampler(int mutationsPerPixel, uint64_t rngSequenceIndex, Float sigma,
                Float largeStepProbability, int streamCount)
         : Sampler(mutationsPerPixel),
           rng(rngSequenceIndex),
@@ -109,14 +109,17 @@ class MLTIntegrator : public Integrator {
     // MLTIntegrator Public Methods
     MLTIntegrator(std::shared_ptr<const Camera> camera, int maxDepth,
                   int nBootstrap, int nChains, int mutationsPerPixel,
-                  Float sigma, Float largeStepProbability)
+                  Float sigma, Float largeStepProbability, int seed = 0,
+                  int writeFrequency = 0)
         : camera(camera),
           maxDepth(maxDepth),
           nBootstrap(nBootstrap),
           nChains(nChains),
           mutationsPerPixel(mutationsPerPixel),
           sigma(sigma),
-          largeStepProbability(largeStepProbability) {}
+          largeStepProbability(largeStepProbability),
+          seed(seed),
+          writeFrequency(writeFrequency) {}
     void Render(const Scene &scene);
     Spectrum L(const Scene &scene, MemoryArena &arena,
                const std::unique_ptr<Distribution1D> &lightDistr,
@@ -131,6 +134,11 @@ class MLTIntegrator : public Integrator {
     const int nChains;
     const int mutationsPerPixel;
     const Float sigma, largeStepProbability;
+    // RNG sequences are offset by _seed_, so that renders with different
+    // seeds are independent and renders with the same seed are identical
+    const int seed;
+    // Number of chains between intermediate image writes; 0 disables them
+    const int writeFrequency;
 };
 
 MLTIntegrator *CreateMLTIntegrator(const ParamSet &params,
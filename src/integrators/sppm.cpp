@@ -44,6 +44,7 @@
 #include "sampling.h"
 #include "samplers/halton.h"
 #include "stats.h"
+#include <algorithm>
 
 namespace pbrt {
 
@@ -84,11 +85,50 @@ struct SPPMPixel {
     Spectrum tau;
 };
 
-struct SPPMPixelListNode {
-    SPPMPixel *pixel;
-    SPPMPixelListNode *next;
+// Visible point stored in the SPPM grid. It copies the fields that photon
+// lookups test, so that scanning a grid cell only touches the grid's
+// contiguous entry array.
+struct SPPMGridEntry {
+    Point3f p;
+    Float radius2;
+    int pixelIndex;
 };
 
+// Photon contributions are buffered per thread and applied to the pixels'
+// atomic $\Phi$ and $M$ in pixel order, after merging repeated pixels.
+struct SPPMPhotonContribution {
+    int pixelIndex;
+    Spectrum Phi;
+};
+struct
+#ifdef PBRT_HAVE_ALIGNAS
+alignas(PBRT_L1_CACHE_LINE_SIZE)
+#endif // PBRT_HAVE_ALIGNAS
+    SPPMContributionBuffer {
+    std::vector<SPPMPhotonContribution> contributions;
+};
+static PBRT_CONSTEXPR size_t ContributionBufferSize = 4096;
+
+static void FlushContributions(SPPMContributionBuffer &buffer,
+                               SPPMPixel *pixels) {
+    std::vector<SPPMPhotonContribution> &c = buffer.contributions;
+    std::sort(c.begin(), c.end(), [](const SPPMPhotonContribution &a,
+                                     const SPPMPhotonContribution &b) {
+        return a.pixelIndex < b.pixelIndex;
+    });
+    for (size_t i = 0; i < c.size();) {
+        int pixelIndex = c[i].pixelIndex;
+        Spectrum Phi(0.f);
+        int M = 0;
+        for (; i < c.size() && c[i].pixelIndex == pixelIndex; ++i, ++M)
+            Phi += c[i].Phi;
+        SPPMPixel &pixel = pixels[pixelIndex];
+        for (int j = 0; j < Spectrum::nSamples; ++j) pixel.Phi[j].Add(Phi[j]);
+        pixel.M += M;
+    }
+    c.clear();
+}
+
 static bool ToGrid(const Point3f &p, const Bounds3f &bounds,
                    const int gridRes[3], Point3i *pi) {
     bool inBounds = true;
@@ -107,6 +147,23 @@ inline unsigned int hash(const Point3i &p, int hashSize) {
            hashSize;
 }
 
+// Calls _func_ with the hashed index of each grid cell that overlaps the
+// sphere of radius _radius_ around _p_; returns the number of cells.
+template <typename F>
+static int ForEachGridCell(const Point3f &p, Float radius,
+                           const Bounds3f &bounds, const int gridRes[3],
+                           int hashSize, F func) {
+    Point3i pMin, pMax;
+    ToGrid(p - Vector3f(radius, radius, radius), bounds, gridRes, &pMin);
+    ToGrid(p + Vector3f(radius, radius, radius), bounds, gridRes, &pMax);
+    for (int z = pMin.z; z <= pMax.z; ++z)
+        for (int y = pMin.y; y <= pMax.y; ++y)
+            for (int x = pMin.x; x <= pMax.x; ++x)
+                func(hash(Point3i(x, y, z), hashSize));
+    return (1 + pMax.x - pMin.x) * (1 + pMax.y - pMin.y) *
+           (1 + pMax.z - pMin.z);
+}
+
 // SPPM Method Definitions
 void SPPMIntegrator::Render(const Scene &scene) {
     ProfilePhase p(Prof::IntegratorRender);
@@ -129,6 +186,14 @@ void SPPMIntegrator::Render(const Scene &scene) {
     const int tileSize = 16;
     Point2i nTiles((pixelExtent.x + tileSize - 1) / tileSize,
                    (pixelExtent.y + tileSize - 1) / tileSize);
+    // Allocate SPPM visible point grid storage, reused by all iterations
+    const int hashSize = nPixels;
+    std::unique_ptr<std::atomic<int>[]> cellCursor(
+        new std::atomic<int>[hashSize]);
+    std::vector<int> cellStart(hashSize + 1);
+    std::vector<SPPMGridEntry> gridEntries;
+    std::vector<SPPMContributionBuffer> contributionBuffers(MaxThreadIndex());
+
     ProgressReporter progress(2 * nIterations, "Rendering");
     for (int iter = 0; iter < nIterations; ++iter) {
         // Generate SPPM visible points
@@ -239,9 +304,6 @@ void SPPMIntegrator::Render(const Scene &scene) {
         // Create grid of all SPPM visible points
         int gridRes[3];
         Bounds3f gridBounds;
-        // Allocate grid for SPPM visible points
-        const int hashSize = nPixels;
-        std::vector<std::atomic<SPPMPixelListNode *>> grid(hashSize);
         {
             ProfilePhase _(Prof::SPPMGridConstruction);
 
@@ -263,38 +325,38 @@ void SPPMIntegrator::Render(const Scene &scene) {
             for (int i = 0; i < 3; ++i)
                 gridRes[i] = std::max((int)(baseGridRes * diag[i] / maxDiag), 1);
 
-            // Add visible points to SPPM grid
+            // Add visible points to the SPPM grid with a counting sort:
+            // count the entries of each cell, turn the counts into cell
+            // offsets, and then scatter the entries into their cells.
+            for (int h = 0; h < hashSize; ++h) cellCursor[h] = 0;
             ParallelFor([&](int pixelIndex) {
-                MemoryArena &arena = perThreadArenas[ThreadIndex];
-                SPPMPixel &pixel = pixels[pixelIndex];
-                if (!pixel.vp.beta.IsBlack()) {
-                    // Add pixel's visible point to applicable grid cells
-                    Float radius = pixel.radius;
-                    Point3i pMin, pMax;
-                    ToGrid(pixel.vp.p - Vector3f(radius, radius, radius),
-                           gridBounds, gridRes, &pMin);
-                    ToGrid(pixel.vp.p + Vector3f(radius, radius, radius),
-                           gridBounds, gridRes, &pMax);
-                    for (int z = pMin.z; z <= pMax.z; ++z)
-                        for (int y = pMin.y; y <= pMax.y; ++y)
-                            for (int x = pMin.x; x <= pMax.x; ++x) {
-                                // Add visible point to grid cell $(x, y, z)$
-                                int h = hash(Point3i(x, y, z), hashSize);
-                                SPPMPixelListNode *node =
-                                    arena.Alloc<SPPMPixelListNode>();
-                                node->pixel = &pixel;
-
-                                // Atomically add _node_ to the start of
-                                // _grid[h]_'s linked list
-                                node->next = grid[h];
-                                while (grid[h].compare_exchange_weak(
-                                           node->next, node) == false)
-                                    ;
-                            }
-                    ReportValue(gridCellsPerVisiblePoint,
-                                (1 + pMax.x - pMin.x) * (1 + pMax.y - pMin.y) *
-                                    (1 + pMax.z - pMin.z));
-                }
+                const SPPMPixel &pixel = pixels[pixelIndex];
+                if (pixel.vp.beta.IsBlack()) return;
+                int nCells = ForEachGridCell(
+                    pixel.vp.p, pixel.radius, gridBounds, gridRes, hashSize,
+                    [&](int h) {
+                        cellCursor[h].fetch_add(1, std::memory_order_relaxed);
+                    });
+                ReportValue(gridCellsPerVisiblePoint, nCells);
+            }, nPixels, 4096);
+            int nEntries = 0;
+            for (int h = 0; h < hashSize; ++h) {
+                cellStart[h] = nEntries;
+                nEntries += cellCursor[h].load(std::memory_order_relaxed);
+                cellCursor[h].store(cellStart[h], std::memory_order_relaxed);
+            }
+            cellStart[hashSize] = nEntries;
+            gridEntries.resize(nEntries);
+            ParallelFor([&](int pixelIndex) {
+                const SPPMPixel &pixel = pixels[pixelIndex];
+                if (pixel.vp.beta.IsBlack()) return;
+                SPPMGridEntry entry{pixel.vp.p, pixel.radius * pixel.radius,
+                                    pixelIndex};
+                ForEachGridCell(pixel.vp.p, pixel.radius, gridBounds, gridRes,
+                                hashSize, [&](int h) {
+                                    gridEntries[cellCursor[h].fetch_add(
+                                        1, std::memory_order_relaxed)] = entry;
+                                });
             }, nPixels, 4096);
         }
 
@@ -304,6 +366,8 @@ void SPPMIntegrator::Render(const Scene &scene) {
             std::vector<MemoryArena> photonShootArenas(MaxThreadIndex());
             ParallelFor([&](int photonIndex) {
                 MemoryArena &arena = photonShootArenas[ThreadIndex];
+                SPPMContributionBuffer &buffer =
+                    contributionBuffers[ThreadIndex];
                 // Follow photon path for _photonIndex_
                 uint64_t haltonIndex =
                     (uint64_t)iter * (uint64_t)photonsPerIteration +
@@ -351,24 +415,26 @@ void SPPMIntegrator::Render(const Scene &scene) {
                                    &photonGridIndex)) {
                             int h = hash(photonGridIndex, hashSize);
                             // Add photon contribution to visible points in
-                            // _grid[h]_
-                            for (SPPMPixelListNode *node =
-                                     grid[h].load(std::memory_order_relaxed);
-                                 node != nullptr; node = node->next) {
+                            // grid cell _h_
+                            for (int e = cellStart[h]; e < cellStart[h + 1];
+                                 ++e) {
                                 ++visiblePointsChecked;
-                                SPPMPixel &pixel = *node->pixel;
-                                Float radius = pixel.radius;
-                                if (DistanceSquared(pixel.vp.p, isect.p) >
-                                    radius * radius)
+                                const SPPMGridEntry &entry = gridEntries[e];
+                                if (DistanceSquared(entry.p, isect.p) >
+                                    entry.radius2)
                                     continue;
-                                // Update _pixel_ $\Phi$ and $M$ for nearby
-                                // photon
+                                // Queue _pixel_ $\Phi$ and $M$ update for
+                                // nearby photon
+                                const SPPMPixel &pixel =
+                                    pixels[entry.pixelIndex];
                                 Vector3f wi = -photonRay.d;
                                 Spectrum Phi =
                                     beta * pixel.vp.bsdf->f(pixel.vp.wo, wi);
-                                for (int i = 0; i < Spectrum::nSamples; ++i)
-                                    pixel.Phi[i].Add(Phi[i]);
-                                ++pixel.M;
+                                buffer.contributions.push_back(
+                                    {entry.pixelIndex, Phi});
+                                if (buffer.contributions.size() >=
+                                    ContributionBufferSize)
+                                    FlushContributions(buffer, pixels.get());
                             }
                         }
                     }
@@ -408,6 +474,9 @@ void SPPMIntegrator::Render(const Scene &scene) {
                 }
                 arena.Reset();
             }, photonsPerIteration, 8192);
+            ParallelFor([&](int64_t i) {
+                FlushContributions(contributionBuffers[i], pixels.get());
+            }, contributionBuffers.size());
             progress.Update();
             photonPaths += photonsPerIteration;
         }
@@ -86,10 +86,8 @@ Spectrum VolPathIntegrator::Li(const RayDifferential &r, const Scene &scene,
 
             ++volumeInteractions;
             // Handle scattering at point in medium for volumetric path tracer
-            const Distribution1D *lightDistrib =
-                lightDistribution->Lookup(mi.p);
-            L += beta * UniformSampleOneLight(mi, scene, arena, sampler, true,
-                                              lightDistrib);
+            L += beta * UniformSampleOneLight(mi, scene, arena, sampler,
+                                              *lightDistribution, true);
 
             Vector3f wo = -ray.d, wi;
             mi.phase->Sample_p(wo, &wi, sampler.Get2D());
@@ -122,10 +120,8 @@ Spectrum VolPathIntegrator::Li(const RayDifferential &r, const Scene &scene,
 
             // Sample illumination from lights to find attenuated path
             // contribution
-            const Distribution1D *lightDistrib =
-                lightDistribution->Lookup(isect.p);
             L += beta * UniformSampleOneLight(isect, scene, arena, sampler,
-                                              true, lightDistrib);
+                                              *lightDistribution, true);
 
             // Sample BSDF to get new path direction
             Vector3f wo = -ray.d, wi;
@@ -160,8 +156,8 @@ Spectrum VolPathIntegrator::Li(const RayDifferential &r, const Scene &scene,
                 // Account for the attenuated direct subsurface scattering
                 // component
                 L += beta *
-                     UniformSampleOneLight(pi, scene, arena, sampler, true,
-                                           lightDistribution->Lookup(pi.p));
+                     UniformSampleOneLight(pi, scene, arena, sampler,
+                                           *lightDistribution, true);
 
                 // Account for the indirect subsurface scattering component
                 Spectrum f = pi.bsdf->Sample_f(pi.wo, &wi, sampler.Get2D(),
@@ -209,8 +205,13 @@ VolPathIntegrator *CreateVolPathIntegrator(
     Float rrThreshold = params.FindOneFloat("rrthreshold", 1.);
     std::string lightStrategy =
         params.FindOneString("lightsamplestrategy", "spatial");
-    return new VolPathIntegrator(maxDepth, camera, sampler, pixelBounds,
-                                 rrThreshold, lightStrategy);
+    VolPathIntegrator *integrator = new VolPathIntegrator(
+        maxDepth, camera, sampler, pixelBounds, rrThreshold, lightStrategy);
+    Float adaptiveThreshold = params.FindOneFloat("adaptivethreshold", 0);
+    if (adaptiveThreshold > 0)
+        integrator->SetAdaptiveSampling(
+            adaptiveThreshold, params.FindOneInt("adaptiveminsamples", 8));
+    return integrator;
 }
 
 VolPathIntegrator *CreateVolPathIntegrator(
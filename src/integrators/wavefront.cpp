@@ -0,0 +1,502 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+// integrators/wavefront.cpp*
+#include "integrators/wavefront.h"
+#include "bssrdf.h"
+#include "camera.h"
+#include "film.h"
+#include "interaction.h"
+#include "paramset.h"
+#include "parallel.h"
+#include "primitive.h"
+#include "progressreporter.h"
+#include "reflection.h"
+#include "rng.h"
+#include "sampler.h"
+#include "sampling.h"
+#include "scene.h"
+#include "stats.h"
+#include <algorithm>
+
+namespace pbrt {
+
+STAT_INT_DISTRIBUTION("Integrator/Wavefront path length", pathLength);
+STAT_COUNTER("Integrator/Wavefront shadow rays", nShadowRays);
+STAT_RATIO("Integrator/Material groups per shading pass", nMaterialGroups,
+           nShadingPasses);
+
+// Sample values each path takes from the _Sampler_ per bounce: light
+// selection (1), light position (2), BSDF direction (2) and Russian
+// roulette (1). Bounces past _MaxSampledBounces_ and BSSRDF sampling use
+// the path's own _RNG_ instead.
+static PBRT_CONSTEXPR int DimsPerBounce = 6;
+static PBRT_CONSTEXPR int MaxSampledBounces = 16;
+static PBRT_CONSTEXPR int WavefrontTileSize = 16;
+
+// PathQueue Declarations
+struct PathQueue {
+    PathQueue(int capacity, int nSampledBounces)
+        : capacity(capacity),
+          nSampledBounces(nSampledBounces),
+          ray(capacity),
+          beta(capacity),
+          L(capacity),
+          pFilm(capacity),
+          filmWeight(capacity),
+          etaScale(capacity),
+          scatterPdf(capacity),
+          bounces(capacity),
+          specularBounce(capacity),
+          prevIsect(capacity),
+          rng(capacity),
+          u(capacity * nSampledBounces * DimsPerBounce),
+          isect(capacity) {}
+    Float U(int path, int bounce, int dim) {
+        if (bounce < nSampledBounces)
+            return u[(path * nSampledBounces + bounce) * DimsPerBounce + dim];
+        return rng[path].UniformFloat();
+    }
+
+    // PathQueue Public Data
+    const int capacity, nSampledBounces;
+    int size = 0;
+
+    // Path state, one entry per path
+    std::vector<RayDifferential> ray;
+    std::vector<Spectrum> beta, L;
+    std::vector<Point2f> pFilm;
+    std::vector<Float> filmWeight, etaScale, scatterPdf;
+    std::vector<int> bounces;
+    std::vector<uint8_t> specularBounce;
+    std::vector<Interaction> prevIsect;
+    std::vector<RNG> rng;
+    std::vector<Float> u;
+    std::vector<SurfaceInteraction> isect;
+
+    // Work lists of path indices for the current bounce
+    std::vector<int> active, scattering, next;
+    std::vector<std::pair<const Material *, int>> hits;
+
+    // Shadow ray queue
+    std::vector<Ray> shadowRay;
+    std::vector<Spectrum> shadowLd;
+    std::vector<int> shadowPath;
+};
+
+// WavefrontPathIntegrator Method Definitions
+WavefrontPathIntegrator::WavefrontPathIntegrator(
+    int maxDepth, std::shared_ptr<const Camera> camera,
+    std::shared_ptr<Sampler> sampler, const Bounds2i &pixelBounds,
+    Float rrThreshold, const std::string &lightSampleStrategy, int queueSize)
+    : camera(camera),
+      sampler(sampler),
+      pixelBounds(pixelBounds),
+      maxDepth(maxDepth),
+      rrThreshold(rrThreshold),
+      lightSampleStrategy(lightSampleStrategy),
+      queueSize(queueSize) {}
+
+void WavefrontPathIntegrator::Render(const Scene &scene) {
+    lightDistribution =
+        CreateLightSampleDistribution(lightSampleStrategy, scene);
+    lightToIndex.clear();
+    for (size_t i = 0; i < scene.lights.size(); ++i)
+        lightToIndex[scene.lights[i].get()] = i;
+
+    // Render image tiles in parallel, reusing one _PathQueue_ per thread
+    Vector2i sampleExtent = camera->film->GetSampleBounds().Diagonal();
+    Point2i nTiles((sampleExtent.x + WavefrontTileSize - 1) / WavefrontTileSize,
+                   (sampleExtent.y + WavefrontTileSize - 1) / WavefrontTileSize);
+    int nSampledBounces = std::min(maxDepth, MaxSampledBounces);
+    std::vector<std::unique_ptr<PathQueue>> queues(MaxThreadIndex());
+    ProgressReporter reporter(nTiles.x * nTiles.y, "Rendering");
+    ParallelFor2D([&](Point2i tile) {
+        std::unique_ptr<PathQueue> &queue = queues[ThreadIndex];
+        if (!queue) queue.reset(new PathQueue(queueSize, nSampledBounces));
+        RenderTile(scene, tile, *queue);
+        reporter.Update();
+    }, nTiles);
+    reporter.Done();
+    LOG(INFO) << "Rendering finished";
+    camera->film->WriteImage();
+}
+
+void WavefrontPathIntegrator::RenderTile(const Scene &scene,
+                                         const Point2i &tile,
+                                         PathQueue &q) const {
+    MemoryArena arena;
+    Bounds2i sampleBounds = camera->film->GetSampleBounds();
+    Vector2i sampleExtent = sampleBounds.Diagonal();
+    int nTilesX = (sampleExtent.x + WavefrontTileSize - 1) / WavefrontTileSize;
+    std::unique_ptr<Sampler> tileSampler =
+        sampler->Clone(tile.y * nTilesX + tile.x);
+
+    // Compute sample bounds for tile
+    int x0 = sampleBounds.pMin.x + tile.x * WavefrontTileSize;
+    int x1 = std::min(x0 + WavefrontTileSize, sampleBounds.pMax.x);
+    int y0 = sampleBounds.pMin.y + tile.y * WavefrontTileSize;
+    int y1 = std::min(y0 + WavefrontTileSize, sampleBounds.pMax.y);
+    Bounds2i tileBounds(Point2i(x0, y0), Point2i(x1, y1));
+    std::unique_ptr<FilmTile> filmTile = camera->film->GetFilmTile(tileBounds);
+
+    // Push waves of paths through the pipeline until the tile is done
+    int pixelIndex = 0;
+    bool inPixel = false;
+    while (GeneratePaths(tileBounds, *tileSampler, &pixelIndex, &inPixel, q)) {
+        while (!q.active.empty()) {
+            IntersectPaths(scene, q);
+            ShadePaths(q, arena);
+            SampleLights(scene, q);
+            SampleBSDFs(scene, q, arena);
+            TraceShadowRays(scene, q);
+            std::swap(q.active, q.next);
+            arena.Reset();
+        }
+
+        // Add the wave's radiance estimates to the film tile
+        for (int i = 0; i < q.size; ++i) {
+            Spectrum &L = q.L[i];
+            if (L.HasNaNs()) {
+                LOG(ERROR) << "Not-a-number radiance value returned by "
+                              "wavefront path. Setting to black.";
+                L = Spectrum(0.f);
+            } else if (L.y() < -1e-5) {
+                LOG(ERROR) << StringPrintf(
+                    "Negative luminance value, %f, returned by wavefront "
+                    "path. Setting to black.", L.y());
+                L = Spectrum(0.f);
+            } else if (std::isinf(L.y())) {
+                LOG(ERROR) << "Infinite luminance value returned by "
+                              "wavefront path. Setting to black.";
+                L = Spectrum(0.f);
+            }
+            filmTile->AddSample(q.pFilm[i], L, q.filmWeight[i]);
+        }
+    }
+    camera->film->MergeFilmTile(std::move(filmTile));
+}
+
+bool WavefrontPathIntegrator::GeneratePaths(const Bounds2i &tileBounds,
+                                            Sampler &sampler, int *pixelIndex,
+                                            bool *inPixel,
+                                            PathQueue &q) const {
+    // Take samples in the same order as _SamplerIntegrator_ does; a pixel's
+    // samples may be split across consecutive waves.
+    q.size = 0;
+    q.active.clear();
+    int width = tileBounds.pMax.x - tileBounds.pMin.x;
+    int nPixels = tileBounds.Area();
+    Vector2i sampleExtent = camera->film->GetSampleBounds().Diagonal();
+    while (q.size < q.capacity && *pixelIndex < nPixels) {
+        Point2i pixel(tileBounds.pMin.x + *pixelIndex % width,
+                      tileBounds.pMin.y + *pixelIndex / width);
+        if (!*inPixel) {
+            {
+                ProfilePhase pp(Prof::StartPixel);
+                sampler.StartPixel(pixel);
+            }
+            if (!InsideExclusive(pixel, pixelBounds)) {
+                ++*pixelIndex;
+                continue;
+            }
+            *inPixel = true;
+        }
+
+        // Initialize path state for the current sample
+        int i = q.size++;
+        CameraSample cameraSample = sampler.GetCameraSample(pixel);
+        q.filmWeight[i] =
+            camera->GenerateRayDifferential(cameraSample, &q.ray[i]);
+        q.ray[i].ScaleDifferentials(1 / std::sqrt((Float)sampler.samplesPerPixel));
+        q.pFilm[i] = cameraSample.pFilm;
+        q.beta[i] = Spectrum(1.f);
+        q.L[i] = Spectrum(0.f);
+        q.etaScale[i] = 1;
+        q.bounces[i] = 0;
+        q.specularBounce[i] = false;
+        Vector2i pOffset = pixel - camera->film->GetSampleBounds().pMin;
+        q.rng[i].SetSequence(
+            ((uint64_t)pOffset.y * sampleExtent.x + pOffset.x) *
+                sampler.samplesPerPixel + sampler.CurrentSampleNumber());
+        for (int b = 0; b < q.nSampledBounces; ++b) {
+            Float *u = &q.u[(i * q.nSampledBounces + b) * DimsPerBounce];
+            u[0] = sampler.Get1D();
+            Point2f uLight = sampler.Get2D();
+            Point2f uScattering = sampler.Get2D();
+            u[1] = uLight.x;
+            u[2] = uLight.y;
+            u[3] = uScattering.x;
+            u[4] = uScattering.y;
+            u[5] = sampler.Get1D();
+        }
+        if (q.filmWeight[i] > 0) q.active.push_back(i);
+
+        if (!sampler.StartNextSample()) {
+            ++*pixelIndex;
+            *inPixel = false;
+        }
+    }
+    return q.size > 0;
+}
+
+void WavefrontPathIntegrator::IntersectPaths(const Scene &scene,
+                                             PathQueue &q) const {
+    // Find each path's next vertex and add emitted light
+    q.hits.clear();
+    for (int i : q.active) {
+        SurfaceInteraction &isect = q.isect[i];
+        if (!scene.Intersect(q.ray[i], &isect)) {
+            for (const auto &light : scene.infiniteLights)
+                q.L[i] += q.beta[i] * light->Le(q.ray[i]) *
+                          EmissionWeight(q, i, light.get());
+            FinishPath(q, i);
+            continue;
+        }
+        Spectrum Le = isect.Le(-q.ray[i].d);
+        if (!Le.IsBlack())
+            q.L[i] += q.beta[i] * Le *
+                      EmissionWeight(q, i, isect.primitive->GetAreaLight());
+        if (q.bounces[i] >= maxDepth) {
+            FinishPath(q, i);
+            continue;
+        }
+        q.hits.push_back(std::make_pair(isect.primitive->GetMaterial(), i));
+    }
+}
+
+void WavefrontPathIntegrator::ShadePaths(PathQueue &q,
+                                         MemoryArena &arena) const {
+    // Group hits by material so that each material's code and textures are
+    // used for a run of paths rather than for scattered single paths
+    std::sort(q.hits.begin(), q.hits.end());
+    ++nShadingPasses;
+    q.scattering.clear();
+    q.next.clear();
+    for (size_t h = 0; h < q.hits.size(); ++h) {
+        if (h == 0 || q.hits[h].first != q.hits[h - 1].first)
+            ++nMaterialGroups;
+        int i = q.hits[h].second;
+        SurfaceInteraction &isect = q.isect[i];
+        isect.ComputeScatteringFunctions(q.ray[i], arena, true);
+        if (!isect.bsdf) {
+            // Skip over medium boundaries without counting a bounce
+            q.ray[i] = isect.SpawnRay(q.ray[i].d);
+            q.next.push_back(i);
+        } else
+            q.scattering.push_back(i);
+    }
+}
+
+void WavefrontPathIntegrator::SampleLights(const Scene &scene,
+                                           PathQueue &q) const {
+    q.shadowRay.clear();
+    q.shadowLd.clear();
+    q.shadowPath.clear();
+    for (int i : q.scattering) {
+        const SurfaceInteraction &isect = q.isect[i];
+        // Skip light sampling for perfectly specular BSDFs
+        if (scene.lights.empty() ||
+            isect.bsdf->NumComponents(
+                BxDFType(BSDF_ALL & ~BSDF_SPECULAR)) == 0)
+            continue;
+        int bounce = q.bounces[i];
+        SampleLight(scene, isect, q.U(i, bounce, 0),
+                    Point2f(q.U(i, bounce, 1), q.U(i, bounce, 2)), i, q);
+    }
+}
+
+void WavefrontPathIntegrator::SampleLight(const Scene &scene,
+                                          const SurfaceInteraction &it,
+                                          Float uLight, const Point2f &u,
+                                          int path, PathQueue &q) const {
+    // Sample a point on a light and queue a shadow ray towards it. The
+    // MIS weight accounts for BSDF sampling, whose hits on emitters are
+    // weighted in _EmissionWeight()_.
+    Float lightSelectPdf;
+    int lightNum =
+        lightDistribution->Sample(it.p, it.n, uLight, &lightSelectPdf);
+    if (lightSelectPdf == 0) return;
+    const Light &light = *scene.lights[lightNum];
+    Vector3f wi;
+    Float lightPdf;
+    VisibilityTester visibility;
+    Spectrum Li = light.Sample_Li(it, u, &wi, &lightPdf, &visibility);
+    if (Li.IsBlack() || lightPdf == 0) return;
+    Spectrum f = it.bsdf->f(it.wo, wi) * AbsDot(wi, it.shading.n);
+    if (f.IsBlack()) return;
+    lightPdf *= lightSelectPdf;
+    Float weight = 1;
+    if (!IsDeltaLight(light.flags))
+        weight = PowerHeuristic(1, lightPdf, 1, it.bsdf->Pdf(it.wo, wi));
+    q.shadowRay.push_back(visibility.P0().SpawnRayTo(visibility.P1()));
+    q.shadowLd.push_back(q.beta[path] * f * Li * weight / lightPdf);
+    q.shadowPath.push_back(path);
+}
+
+Float WavefrontPathIntegrator::EmissionWeight(const PathQueue &q, int path,
+                                              const Light *light) const {
+    if (q.bounces[path] == 0 || q.specularBounce[path]) return 1;
+    auto iter = lightToIndex.find(light);
+    CHECK(iter != lightToIndex.end());
+    const Interaction &prev = q.prevIsect[path];
+    Float lightPdf = lightDistribution->Pmf(prev.p, prev.n, iter->second) *
+                     light->Pdf_Li(prev, q.ray[path].d);
+    return PowerHeuristic(1, q.scatterPdf[path], 1, lightPdf);
+}
+
+void WavefrontPathIntegrator::SampleBSDFs(const Scene &scene, PathQueue &q,
+                                          MemoryArena &arena) const {
+    for (int i : q.scattering) {
+        const SurfaceInteraction &isect = q.isect[i];
+        int bounce = q.bounces[i];
+        Spectrum &beta = q.beta[i];
+
+        // Sample BSDF to get new path direction
+        Vector3f wo = -q.ray[i].d, wi;
+        Float pdf;
+        BxDFType flags;
+        Spectrum f = isect.bsdf->Sample_f(
+            wo, &wi, Point2f(q.U(i, bounce, 3), q.U(i, bounce, 4)), &pdf,
+            BSDF_ALL, &flags);
+        if (f.IsBlack() || pdf == 0.f) {
+            FinishPath(q, i);
+            continue;
+        }
+        beta *= f * AbsDot(wi, isect.shading.n) / pdf;
+        if (beta.y() < 0.f || isNaN(beta.y())) {
+            FinishPath(q, i);
+            continue;
+        }
+        q.specularBounce[i] = (flags & BSDF_SPECULAR) != 0;
+        if ((flags & BSDF_SPECULAR) && (flags & BSDF_TRANSMISSION)) {
+            Float eta = isect.bsdf->eta;
+            q.etaScale[i] *=
+                (Dot(wo, isect.n) > 0) ? (eta * eta) : 1 / (eta * eta);
+        }
+        q.scatterPdf[i] = pdf;
+        q.prevIsect[i] = isect;
+        q.ray[i] = isect.SpawnRay(wi);
+
+        // Account for subsurface scattering, if applicable
+        if (isect.bssrdf && (flags & BSDF_TRANSMISSION)) {
+            RNG &rng = q.rng[i];
+            SurfaceInteraction pi;
+            Float u1 = rng.UniformFloat();
+            Point2f u2(rng.UniformFloat(), rng.UniformFloat());
+            Spectrum S = isect.bssrdf->Sample_S(scene, u1, u2, arena, &pi, &pdf);
+            if (S.IsBlack() || pdf == 0) {
+                FinishPath(q, i);
+                continue;
+            }
+            beta *= S / pdf;
+
+            // Queue the direct subsurface scattering component
+            if (!scene.lights.empty()) {
+                Float uLight = rng.UniformFloat();
+                Point2f u(rng.UniformFloat(), rng.UniformFloat());
+                SampleLight(scene, pi, uLight, u, i, q);
+            }
+
+            // Continue the path from the exit point
+            Point2f u(rng.UniformFloat(), rng.UniformFloat());
+            f = pi.bsdf->Sample_f(pi.wo, &wi, u, &pdf, BSDF_ALL, &flags);
+            if (f.IsBlack() || pdf == 0) {
+                FinishPath(q, i);
+                continue;
+            }
+            beta *= f * AbsDot(wi, pi.shading.n) / pdf;
+            q.specularBounce[i] = (flags & BSDF_SPECULAR) != 0;
+            q.scatterPdf[i] = pdf;
+            q.prevIsect[i] = pi;
+            q.ray[i] = pi.SpawnRay(wi);
+        }
+
+        // Possibly terminate the path with Russian roulette
+        Spectrum rrBeta = beta * q.etaScale[i];
+        if (rrBeta.MaxComponentValue() < rrThreshold && bounce > 3) {
+            Float rrQ = std::max((Float).05, 1 - rrBeta.MaxComponentValue());
+            if (q.U(i, bounce, 5) < rrQ) {
+                FinishPath(q, i);
+                continue;
+            }
+            beta /= 1 - rrQ;
+        }
+        q.bounces[i] = bounce + 1;
+        q.next.push_back(i);
+    }
+}
+
+void WavefrontPathIntegrator::TraceShadowRays(const Scene &scene,
+                                              PathQueue &q) const {
+    for (size_t s = 0; s < q.shadowRay.size(); ++s) {
+        ++nShadowRays;
+        if (!scene.IntersectP(q.shadowRay[s]))
+            q.L[q.shadowPath[s]] += q.shadowLd[s];
+    }
+}
+
+void WavefrontPathIntegrator::FinishPath(PathQueue &q, int path) const {
+    ReportValue(pathLength, q.bounces[path]);
+}
+
+WavefrontPathIntegrator *CreateWavefrontPathIntegrator(
+    const ParamSet &params, std::shared_ptr<Sampler> sampler,
+    std::shared_ptr<const Camera> camera) {
+    int maxDepth = params.FindOneInt("maxdepth", 5);
+    int np;
+    const int *pb = params.FindInt("pixelbounds", &np);
+    Bounds2i pixelBounds = camera->film->GetSampleBounds();
+    if (pb) {
+        if (np != 4)
+            Error("Expected four values for \"pixelbounds\" parameter. Got %d.",
+                  np);
+        else {
+            pixelBounds = Intersect(pixelBounds,
+                                    Bounds2i{{pb[0], pb[2]}, {pb[1], pb[3]}});
+            if (pixelBounds.Area() == 0)
+                Error("Degenerate \"pixelbounds\" specified.");
+        }
+    }
+    Float rrThreshold = params.FindOneFloat("rrthreshold", 1.);
+    std::string lightStrategy =
+        params.FindOneString("lightsamplestrategy", "spatial");
+    int queueSize = params.FindOneInt("queuesize", 4096);
+    if (queueSize < 1) {
+        Error("\"queuesize\" must be positive. Using 4096.");
+        queueSize = 4096;
+    }
+    return new WavefrontPathIntegrator(maxDepth, camera, sampler, pixelBounds,
+                                       rrThreshold, lightStrategy, queueSize);
+}
+
+}  // namespace pbrt
@@ -0,0 +1,106 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_INTEGRATORS_WAVEFRONT_H
+#define PBRT_INTEGRATORS_WAVEFRONT_H
+
+// integrators/wavefront.h*
+#include "pbrt.h"
+#include "integrator.h"
+#include "lightdistrib.h"
+#include <unordered_map>
+
+namespace pbrt {
+
+struct PathQueue;
+
+// WavefrontPathIntegrator Declarations
+
+// Computes the same estimate as _PathIntegrator_, but instead of following
+// one path at a time it advances a whole queue of paths through each stage
+// of the path tracer in turn: camera ray generation, intersection,
+// shading (grouped by material), light sampling, BSDF sampling and shadow
+// ray tests. Subsurface scattering is supported; participating media are
+// not.
+class WavefrontPathIntegrator : public Integrator {
+  public:
+    // WavefrontPathIntegrator Public Methods
+    WavefrontPathIntegrator(int maxDepth, std::shared_ptr<const Camera> camera,
+                            std::shared_ptr<Sampler> sampler,
+                            const Bounds2i &pixelBounds, Float rrThreshold = 1,
+                            const std::string &lightSampleStrategy = "spatial",
+                            int queueSize = 4096);
+    void Render(const Scene &scene);
+
+  private:
+    // WavefrontPathIntegrator Private Methods
+    void RenderTile(const Scene &scene, const Point2i &tile,
+                    PathQueue &queue) const;
+    bool GeneratePaths(const Bounds2i &tileBounds, Sampler &sampler,
+                       int *pixelIndex, bool *inPixel, PathQueue &q) const;
+    void IntersectPaths(const Scene &scene, PathQueue &q) const;
+    void ShadePaths(PathQueue &q, MemoryArena &arena) const;
+    void SampleLights(const Scene &scene, PathQueue &q) const;
+    void SampleBSDFs(const Scene &scene, PathQueue &q,
+                     MemoryArena &arena) const;
+    void TraceShadowRays(const Scene &scene, PathQueue &q) const;
+    void SampleLight(const Scene &scene, const SurfaceInteraction &it,
+                     Float uLight, const Point2f &u, int path,
+                     PathQueue &q) const;
+    Float EmissionWeight(const PathQueue &q, int path,
+                         const Light *light) const;
+    void FinishPath(PathQueue &q, int path) const;
+
+    // WavefrontPathIntegrator Private Data
+    std::shared_ptr<const Camera> camera;
+    std::shared_ptr<Sampler> sampler;
+    const Bounds2i pixelBounds;
+    const int maxDepth;
+    const Float rrThreshold;
+    const std::string lightSampleStrategy;
+    const int queueSize;
+    std::unique_ptr<LightDistribution> lightDistribution;
+    std::unordered_map<const Light *, size_t> lightToIndex;
+};
+
+WavefrontPathIntegrator *CreateWavefrontPathIntegrator(
+    const ParamSet &params, std::shared_ptr<Sampler> sampler,
+    std::shared_ptr<const Camera> camera);
+
+}  // namespace pbrt
+
+#endif  // PBRT_INTEGRATORS_WAVEFRONT_H
@@ -65,6 +65,19 @@ Spectrum DiffuseAreaLight::Power() const {
     return (twoSided ? 2 : 1) * Lemit * area * Pi;
 }
 
+bool DiffuseAreaLight::Bounds(LightBounds *lb) const {
+    lb->bounds = shape->WorldBound();
+    lb->phi = Power().y();
+    if (!shape->NormalBounds(&lb->w, &lb->cosTheta_o)) {
+        lb->w = Vector3f(0, 0, 1);
+        lb->cosTheta_o = -1;
+    }
+    // Diffuse emission covers the hemisphere around the normal
+    lb->cosTheta_e = 0;
+    lb->twoSided = twoSided;
+    return true;
+}
+
 Spectrum DiffuseAreaLight::Sample_Li(const Interaction &ref, const Point2f &u,
                                      Vector3f *wi, Float *pdf,
                                      VisibilityTester *vis) const {
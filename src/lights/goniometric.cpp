@@ -58,6 +58,14 @@ Spectrum GonioPhotometricLight::Power() const {
                                  SpectrumType::Illuminant);
 }
 
+bool GonioPhotometricLight::Bounds(LightBounds *lb) const {
+    lb->bounds = Bounds3f(pLight);
+    lb->phi = Power().y();
+    lb->cosTheta_o = -1;
+    lb->cosTheta_e = 0;
+    return true;
+}
+
 Float GonioPhotometricLight::Pdf_Li(const Interaction &,
                                     const Vector3f &) const {
     return 0.f;
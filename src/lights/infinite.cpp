@@ -32,17 +32,121 @@
 
 // lights/infinite.cpp*
 #include "lights/infinite.h"
+#include "fileutil.h"
 #include "imageio.h"
 #include "paramset.h"
 #include "sampling.h"
 #include "stats.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#ifdef PBRT_HAVE_MMAP
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif  // PBRT_HAVE_MMAP
 
 namespace pbrt {
 
+// InfiniteAreaLight Local Definitions
+STAT_COUNTER("Lights/Environment map distributions read from cache",
+             nDistributionCacheHits);
+STAT_MEMORY_COUNTER("Memory/Environment map distributions",
+                    distributionBytes);
+
+// Cells of a reduced-resolution distribution are refined if they are
+// _RefineThreshold_ times brighter than the average cell.
+static PBRT_CONSTEXPR Float RefineThreshold = 8;
+
+// Distribution cache files start with a 32 byte header: the
+// _DistributionMagic_ bytes and the 64-bit key, followed by the
+// distribution's resolution, the resolution of refined cells and the
+// number of refined cells as 32-bit integers. The refined cells' indices
+// follow, then the tables of each _Distribution2D_, starting at the next
+// multiple of 8 bytes.
+static const char DistributionMagic[8] = {'P', 'B', 'R', 'T',
+                                          'E', 'N', 'V', '1'};
+static PBRT_CONSTEXPR size_t DistributionHeaderSize = 32;
+
+static uint64_t MurmurHash64A(const unsigned char *key, size_t len,
+                              uint64_t seed) {
+    const uint64_t m = 0xc6a4a7935bd1e995ull;
+    const int r = 47;
+    uint64_t h = seed ^ (len * m);
+    const unsigned char *end = key + 8 * (len / 8);
+    while (key != end) {
+        uint64_t k;
+        std::memcpy(&k, key, sizeof(uint64_t));
+        key += 8;
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    switch (len & 7) {
+    case 7: h ^= uint64_t(key[6]) << 48;
+    case 6: h ^= uint64_t(key[5]) << 40;
+    case 5: h ^= uint64_t(key[4]) << 32;
+    case 4: h ^= uint64_t(key[3]) << 24;
+    case 3: h ^= uint64_t(key[2]) << 16;
+    case 2: h ^= uint64_t(key[1]) << 8;
+    case 1:
+        h ^= uint64_t(key[0]);
+        h *= m;
+    };
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+// Returns the number of _Float_ values stored for a _Distribution2D_ of
+// the given resolution: the marginal distribution's and then each
+// conditional distribution's function values, CDF and integral.
+static size_t DistributionTableSize(int nu, int nv) {
+    return size_t(2 * nv + 2) + size_t(nv) * size_t(2 * nu + 2);
+}
+
+static void AppendTables(const Distribution1D &d, std::vector<Float> *tables) {
+    tables->insert(tables->end(), d.func.begin(), d.func.end());
+    tables->insert(tables->end(), d.cdf.begin(), d.cdf.end());
+    tables->push_back(d.funcInt);
+}
+
+static void AppendTables(const Distribution2D &d, std::vector<Float> *tables) {
+    AppendTables(d.Marginal(), tables);
+    for (int v = 0; v < d.Marginal().Count(); ++v)
+        AppendTables(d.Conditional(v), tables);
+}
+
+static std::unique_ptr<Distribution1D> ReadTables(const Float **tables,
+                                                  int n) {
+    const Float *t = *tables;
+    *tables += 2 * n + 2;
+    return std::unique_ptr<Distribution1D>(
+        new Distribution1D(t, t + n, t[2 * n + 1], n));
+}
+
+static std::unique_ptr<Distribution2D> ReadTables(const Float **tables, int nu,
+                                                  int nv) {
+    std::unique_ptr<Distribution1D> marginal = ReadTables(tables, nv);
+    std::vector<std::unique_ptr<Distribution1D>> conditional;
+    conditional.reserve(nv);
+    for (int v = 0; v < nv; ++v) conditional.push_back(ReadTables(tables, nu));
+    return std::unique_ptr<Distribution2D>(
+        new Distribution2D(std::move(conditional), std::move(marginal)));
+}
+
 // InfiniteAreaLight Method Definitions
 InfiniteAreaLight::InfiniteAreaLight(const Transform &LightToWorld,
                                      const Spectrum &L, int nSamples,
-                                     const std::string &texmap)
+                                     const std::string &texmap,
+                                     int distributionResolution,
+                                     bool cacheDistribution)
     : Light((int)LightFlags::Infinite, LightToWorld, MediumInterface(),
             nSamples) {
     // Read texel data from _texmap_ and initialize _Lmap_
@@ -58,13 +162,51 @@ InfiniteAreaLight::InfiniteAreaLight(const Transform &LightToWorld,
         resolution.x = resolution.y = 1;
         texels = std::unique_ptr<RGBSpectrum[]>(new RGBSpectrum[1]);
         texels[0] = L.ToRGBSpectrum();
+        cacheDistribution = false;
     }
     Lmap.reset(new MIPMap<RGBSpectrum>(resolution, texels.get()));
 
     // Initialize sampling PDFs for infinite area light
+    int fullResolution = 2 * Lmap->Width();
+    int distribResolution = fullResolution;
+    if (distributionResolution > 0)
+        distribResolution = std::min(distributionResolution, fullResolution);
+
+    // Compute distribution cache key from texels and resolution
+    std::string cacheFilename;
+    uint64_t key = 0;
+    if (cacheDistribution) {
+        cacheFilename = texmap + ".pbrtdist";
+        key = MurmurHash64A((const unsigned char *)texels.get(),
+                            sizeof(RGBSpectrum) * resolution.x * resolution.y,
+                            0);
+        int32_t params[4] = {resolution.x, resolution.y, distribResolution,
+                             int32_t(sizeof(Float))};
+        key = MurmurHash64A((const unsigned char *)params, sizeof(params),
+                            key);
+    }
+
+    if (!cacheFilename.empty() && ReadDistribution(cacheFilename, key))
+        ++nDistributionCacheHits;
+    else {
+        ComputeDistribution(distribResolution);
+        if (!cacheFilename.empty() && !WriteDistribution(cacheFilename, key))
+            Warning("%s: unable to write environment map distribution cache",
+                    cacheFilename.c_str());
+    }
+    size_t tableSize = DistributionTableSize(distribution->Conditional(0).Count(),
+                                             distribution->Marginal().Count());
+    for (const auto &r : refined)
+        tableSize += DistributionTableSize(r->Conditional(0).Count(),
+                                           r->Marginal().Count());
+    distributionBytes += tableSize * sizeof(Float) +
+                         refinedCell.size() * sizeof(int);
+}
 
+void InfiniteAreaLight::ComputeDistribution(int resolution) {
     // Compute scalar-valued image _img_ from environment map
-    int width = 2 * Lmap->Width(), height = 2 * Lmap->Height();
+    int width = resolution;
+    int height = std::max(1, resolution * Lmap->Height() / Lmap->Width());
     std::unique_ptr<Float[]> img(new Float[width * height]);
     float fwidth = 0.5f / std::min(width, height);
     ParallelFor(
@@ -81,6 +223,179 @@ InfiniteAreaLight::InfiniteAreaLight(const Transform &LightToWorld,
 
     // Compute sampling distributions for rows and columns of image
     distribution.reset(new Distribution2D(img.get(), width, height));
+
+    // Refine bright cells of a reduced-resolution distribution
+    int cellResolution = 2 * Lmap->Width() / width;
+    if (cellResolution < 2) return;
+    Float threshold = RefineThreshold * distribution->Marginal().funcInt;
+    std::vector<int> cells;
+    for (int i = 0; i < width * height; ++i)
+        if (img[i] > threshold) cells.push_back(i);
+    if (cells.empty()) return;
+    refinedCell.assign(width * height, -1);
+    refined.resize(cells.size());
+    float cellFilterWidth = fwidth / cellResolution;
+    ParallelFor(
+        [&](int64_t c) {
+            int iu = cells[c] % width, iv = cells[c] / width;
+            std::vector<Float> cellImg(cellResolution * cellResolution);
+            for (int v = 0; v < cellResolution; ++v) {
+                Float vp = (iv + (v + .5f) / cellResolution) / height;
+                Float sinTheta = std::sin(Pi * vp);
+                for (int u = 0; u < cellResolution; ++u) {
+                    Float up = (iu + (u + .5f) / cellResolution) / width;
+                    cellImg[u + v * cellResolution] =
+                        Lmap->Lookup(Point2f(up, vp), cellFilterWidth).y() *
+                        sinTheta;
+                }
+            }
+            // Sample the cell uniformly if the finer lookups are all zero
+            if (std::all_of(cellImg.begin(), cellImg.end(),
+                            [](Float f) { return f == 0; }))
+                std::fill(cellImg.begin(), cellImg.end(), Float(1));
+            refined[c].reset(new Distribution2D(
+                cellImg.data(), cellResolution, cellResolution));
+            refinedCell[cells[c]] = c;
+        },
+        cells.size(), 16);
+}
+
+bool InfiniteAreaLight::ReadDistribution(const std::string &filename,
+                                         uint64_t key) {
+    std::vector<char> contents;
+    const char *data = nullptr;
+    size_t length = 0;
+#ifdef PBRT_HAVE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+    struct stat stat;
+    if (fstat(fd, &stat) != 0 || stat.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    length = stat.st_size;
+    void *ptr = mmap(0, length, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) return false;
+    data = (const char *)ptr;
+#else
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) return false;
+    contents.assign(std::istreambuf_iterator<char>(in),
+                    std::istreambuf_iterator<char>());
+    data = contents.data();
+    length = contents.size();
+#endif  // PBRT_HAVE_MMAP
+
+    // Validate the header before copying the distribution's tables
+    bool valid = false;
+    uint64_t fileKey;
+    int32_t header[4] = {0, 0, 0, 0};
+    if (length >= DistributionHeaderSize &&
+        memcmp(data, DistributionMagic, sizeof(DistributionMagic)) == 0) {
+        memcpy(&fileKey, data + 8, sizeof(fileKey));
+        memcpy(header, data + 16, sizeof(header));
+        valid = fileKey == key && header[0] > 0 && header[1] > 0 &&
+                header[2] >= 0 && header[3] >= 0;
+    }
+    int nu = header[0], nv = header[1], cellResolution = header[2];
+    int nRefined = header[3];
+    size_t tablesOffset = 0;
+    if (valid) {
+        tablesOffset =
+            (DistributionHeaderSize + nRefined * sizeof(int32_t) + 7) &
+            ~size_t(7);
+        size_t tableSize =
+            DistributionTableSize(nu, nv) +
+            nRefined * DistributionTableSize(cellResolution, cellResolution);
+        valid = length == tablesOffset + tableSize * sizeof(Float);
+    }
+    if (valid) {
+        std::vector<int32_t> cells(nRefined);
+        memcpy(cells.data(), data + DistributionHeaderSize,
+               nRefined * sizeof(int32_t));
+        for (int32_t c : cells)
+            if (c < 0 || c >= nu * nv) valid = false;
+        if (valid) {
+            const Float *tables = (const Float *)(data + tablesOffset);
+            distribution = ReadTables(&tables, nu, nv);
+            if (nRefined > 0) refinedCell.assign(nu * nv, -1);
+            for (int i = 0; i < nRefined; ++i) {
+                refined.push_back(
+                    ReadTables(&tables, cellResolution, cellResolution));
+                refinedCell[cells[i]] = i;
+            }
+        }
+    }
+#ifdef PBRT_HAVE_MMAP
+    if (munmap((void *)data, length) != 0) Warning("munmap: %s", strerror(errno));
+#endif  // PBRT_HAVE_MMAP
+    return valid;
+}
+
+bool InfiniteAreaLight::WriteDistribution(const std::string &filename,
+                                          uint64_t key) const {
+    int nu = distribution->Conditional(0).Count();
+    int nv = distribution->Marginal().Count();
+    int cellResolution =
+        refined.empty() ? 0 : refined[0]->Conditional(0).Count();
+    std::vector<int32_t> cells(refined.size());
+    for (size_t i = 0; i < refinedCell.size(); ++i)
+        if (refinedCell[i] != -1) cells[refinedCell[i]] = i;
+    std::vector<Float> tables;
+    AppendTables(*distribution, &tables);
+    for (const auto &r : refined) AppendTables(*r, &tables);
+
+    std::vector<char> header(DistributionHeaderSize, 0);
+    int32_t res[4] = {nu, nv, cellResolution, int32_t(refined.size())};
+    memcpy(&header[0], DistributionMagic, sizeof(DistributionMagic));
+    memcpy(&header[8], &key, sizeof(key));
+    memcpy(&header[16], res, sizeof(res));
+    size_t cellsSize = cells.size() * sizeof(int32_t);
+    size_t padding =
+        ((DistributionHeaderSize + cellsSize + 7) & ~size_t(7)) -
+        (DistributionHeaderSize + cellsSize);
+    const char zeros[8] = {0};
+
+    return WriteFileAtomically(filename, [&](std::ostream &out) {
+        out.write(header.data(), header.size());
+        out.write((const char *)cells.data(), cellsSize);
+        out.write(zeros, padding);
+        out.write((const char *)tables.data(), tables.size() * sizeof(Float));
+    });
+}
+
+Point2f InfiniteAreaLight::SampleDistribution(const Point2f &u,
+                                              Float *pdf) const {
+    Point2f uv = distribution->SampleContinuous(u, pdf);
+    if (refinedCell.empty() || *pdf == 0) return uv;
+
+    // Sample the refined distribution of the sampled cell, if any
+    int nu = distribution->Conditional(0).Count();
+    int nv = distribution->Marginal().Count();
+    int iu = Clamp(int(uv[0] * nu), 0, nu - 1);
+    int iv = Clamp(int(uv[1] * nv), 0, nv - 1);
+    int index = refinedCell[iv * nu + iu];
+    if (index == -1) return uv;
+    Point2f uCell(std::min(uv[0] * nu - iu, OneMinusEpsilon),
+                  std::min(uv[1] * nv - iv, OneMinusEpsilon));
+    Float cellPdf;
+    Point2f uvCell = refined[index]->SampleContinuous(uCell, &cellPdf);
+    *pdf *= cellPdf;
+    return Point2f((iu + uvCell[0]) / nu, (iv + uvCell[1]) / nv);
+}
+
+Float InfiniteAreaLight::DistributionPdf(const Point2f &uv) const {
+    Float pdf = distribution->Pdf(uv);
+    if (refinedCell.empty() || pdf == 0) return pdf;
+    int nu = distribution->Conditional(0).Count();
+    int nv = distribution->Marginal().Count();
+    int iu = Clamp(int(uv[0] * nu), 0, nu - 1);
+    int iv = Clamp(int(uv[1] * nv), 0, nv - 1);
+    int index = refinedCell[iv * nu + iu];
+    if (index == -1) return pdf;
+    return pdf *
+           refined[index]->Pdf(Point2f(uv[0] * nu - iu, uv[1] * nv - iv));
 }
 
 Spectrum InfiniteAreaLight::Power() const {
@@ -101,7 +416,7 @@ Spectrum InfiniteAreaLight::Sample_Li(const Interaction &ref, const Point2f &u,
     ProfilePhase _(Prof::LightSample);
     // Find $(u,v)$ sample coordinates in infinite light texture
     Float mapPdf;
-    Point2f uv = distribution->SampleContinuous(u, &mapPdf);
+    Point2f uv = SampleDistribution(u, &mapPdf);
     if (mapPdf == 0) return Spectrum(0.f);
 
     // Convert infinite light sample point to direction
@@ -127,7 +442,7 @@ Float InfiniteAreaLight::Pdf_Li(const Interaction &, const Vector3f &w) const {
     Float theta = SphericalTheta(wi), phi = SphericalPhi(wi);
     Float sinTheta = std::sin(theta);
     if (sinTheta == 0) return 0;
-    return distribution->Pdf(Point2f(phi * Inv2Pi, theta * InvPi)) /
+    return DistributionPdf(Point2f(phi * Inv2Pi, theta * InvPi)) /
            (2 * Pi * Pi * sinTheta);
 }
 
@@ -140,7 +455,7 @@ Spectrum InfiniteAreaLight::Sample_Le(const Point2f &u1, const Point2f &u2,
 
     // Find $(u,v)$ sample coordinates in infinite light texture
     Float mapPdf;
-    Point2f uv = distribution->SampleContinuous(u, &mapPdf);
+    Point2f uv = SampleDistribution(u, &mapPdf);
     if (mapPdf == 0) return Spectrum(0.f);
     Float theta = uv[1] * Pi, phi = uv[0] * 2.f * Pi;
     Float cosTheta = std::cos(theta), sinTheta = std::sin(theta);
@@ -168,7 +483,7 @@ void InfiniteAreaLight::Pdf_Le(const Ray &ray, const Normal3f &, Float *pdfPos,
     Vector3f d = -WorldToLight(ray.d);
     Float theta = SphericalTheta(d), phi = SphericalPhi(d);
     Point2f uv(phi * Inv2Pi, theta * InvPi);
-    Float mapPdf = distribution->Pdf(uv);
+    Float mapPdf = DistributionPdf(uv);
     *pdfDir = mapPdf / (2 * Pi * Pi * std::sin(theta));
     *pdfPos = 1 / (Pi * worldRadius * worldRadius);
 }
@@ -180,9 +495,13 @@ std::shared_ptr<InfiniteAreaLight> CreateInfiniteLight(
     std::string texmap = paramSet.FindOneFilename("mapname", "");
     int nSamples = paramSet.FindOneInt("samples",
                                        paramSet.FindOneInt("nsamples", 1));
+    int distributionResolution =
+        paramSet.FindOneInt("distributionresolution", 0);
+    bool cacheDistribution = paramSet.FindOneBool("cachedistribution", false);
     if (PbrtOptions.quickRender) nSamples = std::max(1, nSamples / 4);
     return std::make_shared<InfiniteAreaLight>(light2world, L * sc, nSamples,
-                                               texmap);
+                                               texmap, distributionResolution,
+                                               cacheDistribution);
 }
 
 }  // namespace pbrt
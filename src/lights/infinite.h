@@ -53,7 +53,9 @@ class InfiniteAreaLight : public Light {
   public:
     // InfiniteAreaLight Public Methods
     InfiniteAreaLight(const Transform &LightToWorld, const Spectrum &power,
-                      int nSamples, const std::string &texmap);
+                      int nSamples, const std::string &texmap,
+                      int distributionResolution = 0,
+                      bool cacheDistribution = false);
     void Preprocess(const Scene &scene) {
         scene.WorldBound().BoundingSphere(&worldCenter, &worldRadius);
     }
@@ -69,11 +71,22 @@ class InfiniteAreaLight : public Light {
                 Float *pdfDir) const;
 
   private:
+    // InfiniteAreaLight Private Methods
+    void ComputeDistribution(int resolution);
+    bool ReadDistribution(const std::string &filename, uint64_t key);
+    bool WriteDistribution(const std::string &filename, uint64_t key) const;
+    Point2f SampleDistribution(const Point2f &u, Float *pdf) const;
+    Float DistributionPdf(const Point2f &uv) const;
+
     // InfiniteAreaLight Private Data
     std::unique_ptr<MIPMap<RGBSpectrum>> Lmap;
     Point3f worldCenter;
     Float worldRadius;
     std::unique_ptr<Distribution2D> distribution;
+    // Bright cells of a reduced-resolution _distribution_ are refined
+    // with a finer distribution over the cell.
+    std::vector<int> refinedCell;
+    std::vector<std::unique_ptr<Distribution2D>> refined;
 };
 
 std::shared_ptr<InfiniteAreaLight> CreateInfiniteLight(
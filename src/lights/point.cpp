@@ -54,6 +54,14 @@ Spectrum PointLight::Sample_Li(const Interaction &ref, const Point2f &u,
 
 Spectrum PointLight::Power() const { return 4 * Pi * I; }
 
+bool PointLight::Bounds(LightBounds *lb) const {
+    lb->bounds = Bounds3f(pLight);
+    lb->phi = Power().y();
+    lb->cosTheta_o = -1;
+    lb->cosTheta_e = 0;
+    return true;
+}
+
 Float PointLight::Pdf_Li(const Interaction &, const Vector3f &) const {
     return 0;
 }
@@ -106,6 +106,14 @@ Spectrum ProjectionLight::Power() const {
            I * 2 * Pi * (1.f - cosTotalWidth);
 }
 
+bool ProjectionLight::Bounds(LightBounds *lb) const {
+    lb->bounds = Bounds3f(pLight);
+    lb->phi = Power().y();
+    lb->cosTheta_o = -1;
+    lb->cosTheta_e = 0;
+    return true;
+}
+
 Float ProjectionLight::Pdf_Li(const Interaction &, const Vector3f &) const {
     return 0.f;
 }
@@ -76,6 +76,17 @@ Spectrum SpotLight::Power() const {
     return I * 2 * Pi * (1 - .5f * (cosFalloffStart + cosTotalWidth));
 }
 
+bool SpotLight::Bounds(LightBounds *lb) const {
+    // Use the power of an isotropic light with the spotlight's peak
+    // intensity; the cone accounts for the directions it doesn't reach.
+    lb->bounds = Bounds3f(pLight);
+    lb->phi = 4 * Pi * I.y();
+    lb->w = Normalize(LightToWorld(Vector3f(0, 0, 1)));
+    lb->cosTheta_o = 1;
+    lb->cosTheta_e = cosTotalWidth;
+    return true;
+}
+
 Float SpotLight::Pdf_Li(const Interaction &, const Vector3f &) const {
     return 0.f;
 }
@@ -55,6 +55,43 @@ Rendering options:
   --quick              Automatically reduce a number of quality settings to
                        render more quickly.
   --quiet              Suppress all text output other than error messages.
+  --texcachemb <num>   Page image texture MIP map tiles in and out of a
+                       cache with the given memory budget, in megabytes.
+  --geomcachemb <num>  Tessellate subdivision surfaces, NURBS and
+                       heightfields when rays first reach them, keeping the
+                       triangles within the given memory budget, in
+                       megabytes.
+  --iothreads <num>    Number of threads used to compress EXR images.
+                       Default: all cores.
+  --exrfloat           Write EXR images with 32-bit float channels rather
+                       than 16-bit halfs.
+  --exrtilesize <num>  Write EXR images in tiles of the given size in pixels
+                       rather than in scanlines.
+  --reuseinstances     Keep object instance BVHs across the frames of a
+                       multi-frame file when their geometry is unchanged.
+  --progressive        Render all of the image in rounds of samples per
+                       pixel, writing the image after each checkpoint.
+  --timebudget <sec>   Render progressively and stop after the round that
+                       exceeds the given number of seconds.
+  --checkpoint <file>  Render progressively, periodically saving the film to
+                       the given file and resuming from it if it exists.
+  --checkpointinterval <sec>
+                       Seconds between checkpoints. Default: 300.
+  --profile <prefix>   Write the profile's phase stacks to <prefix>.folded
+                       for flame graphs and a timeline of its samples to
+                       <prefix>.trace.json for chrome://tracing. Sending
+                       SIGUSR1 pauses and resumes profiling.
+  --profilepaused      Start with profiling paused until SIGUSR1 is received.
+  --stats <file>       Write snapshots of all statistics, profile times and
+                       progress to the given file as JSON lines, or as CSV
+                       if its name ends in ".csv".
+  --statsinterval <sec>
+                       Seconds between statistics snapshots while rendering;
+                       0 only writes them at the end of each frame.
+                       Default: 10.
+  --bssrdfcache <dir>  Store the subsurface scattering profile tables that
+                       are computed in the given directory and reuse them
+                       in later runs.
   --reference=<nTiles>
                        Enables the reference mode with nTiles per dimension
   --reference_samples=<nsamples>
@@ -72,6 +109,9 @@ Rendering options:
                        Number of indirect tasks to be rendered
   --iileDirect=<samples>
                        Number of direct pass samples
+  --iileDirectAdaptive=<relerr>
+                       Stop direct pass sampling in pixels whose relative
+                       error is below the given threshold
   --iileControl=<controlDirPath>
                        Enable and set control directory for use with IILE GUI
 
@@ -88,7 +128,9 @@ Reformatting options:
                        standard output. Does not render an image.
   --toply              Print a reformatted version of the input file(s) to
                        standard output and convert all triangle meshes to
-                       PLY files. Does not render an image.
+                       PLY files and the density values of large
+                       heterogeneous media to volume files. Does not render
+                       an image.
 )");
 }
 
@@ -133,6 +175,94 @@ int main(int argc, char *argv[]) {
             options.quickRender = true;
         } else if (!strcmp(argv[i], "--quiet") || !strcmp(argv[i], "-quiet")) {
             options.quiet = true;
+        } else if (!strcmp(argv[i], "--texcachemb") ||
+                   !strcmp(argv[i], "-texcachemb")) {
+            if (i + 1 == argc)
+                usage("missing value after --texcachemb argument");
+            options.textureCacheMB = atoi(argv[++i]);
+        } else if (!strncmp(argv[i], "--texcachemb=", 13)) {
+            options.textureCacheMB = atoi(&argv[i][13]);
+        } else if (!strcmp(argv[i], "--geomcachemb") ||
+                   !strcmp(argv[i], "-geomcachemb")) {
+            if (i + 1 == argc)
+                usage("missing value after --geomcachemb argument");
+            options.geometryCacheMB = atoi(argv[++i]);
+        } else if (!strncmp(argv[i], "--geomcachemb=", 14)) {
+            options.geometryCacheMB = atoi(&argv[i][14]);
+        } else if (!strcmp(argv[i], "--iothreads") ||
+                   !strcmp(argv[i], "-iothreads")) {
+            if (i + 1 == argc)
+                usage("missing value after --iothreads argument");
+            options.imageIOThreads = atoi(argv[++i]);
+        } else if (!strncmp(argv[i], "--iothreads=", 12)) {
+            options.imageIOThreads = atoi(&argv[i][12]);
+        } else if (!strcmp(argv[i], "--exrfloat") ||
+                   !strcmp(argv[i], "-exrfloat")) {
+            options.exrFloat = true;
+        } else if (!strcmp(argv[i], "--exrtilesize") ||
+                   !strcmp(argv[i], "-exrtilesize")) {
+            if (i + 1 == argc)
+                usage("missing value after --exrtilesize argument");
+            options.exrTileSize = atoi(argv[++i]);
+        } else if (!strncmp(argv[i], "--exrtilesize=", 14)) {
+            options.exrTileSize = atoi(&argv[i][14]);
+        } else if (!strcmp(argv[i], "--progressive") ||
+                   !strcmp(argv[i], "-progressive")) {
+            options.progressive = true;
+        } else if (!strcmp(argv[i], "--timebudget") ||
+                   !strcmp(argv[i], "-timebudget")) {
+            if (i + 1 == argc)
+                usage("missing value after --timebudget argument");
+            options.timeBudget = atof(argv[++i]);
+        } else if (!strncmp(argv[i], "--timebudget=", 13)) {
+            options.timeBudget = atof(&argv[i][13]);
+        } else if (!strcmp(argv[i], "--checkpoint") ||
+                   !strcmp(argv[i], "-checkpoint")) {
+            if (i + 1 == argc)
+                usage("missing value after --checkpoint argument");
+            options.checkpointFile = argv[++i];
+        } else if (!strncmp(argv[i], "--checkpoint=", 13)) {
+            options.checkpointFile = &argv[i][13];
+        } else if (!strcmp(argv[i], "--checkpointinterval") ||
+                   !strcmp(argv[i], "-checkpointinterval")) {
+            if (i + 1 == argc)
+                usage("missing value after --checkpointinterval argument");
+            options.checkpointInterval = atof(argv[++i]);
+        } else if (!strncmp(argv[i], "--checkpointinterval=", 21)) {
+            options.checkpointInterval = atof(&argv[i][21]);
+        } else if (!strcmp(argv[i], "--profile") ||
+                   !strcmp(argv[i], "-profile")) {
+            if (i + 1 == argc)
+                usage("missing value after --profile argument");
+            options.profileFile = argv[++i];
+        } else if (!strncmp(argv[i], "--profile=", 10)) {
+            options.profileFile = &argv[i][10];
+        } else if (!strcmp(argv[i], "--profilepaused") ||
+                   !strcmp(argv[i], "-profilepaused")) {
+            options.profilePaused = true;
+        } else if (!strcmp(argv[i], "--stats") || !strcmp(argv[i], "-stats")) {
+            if (i + 1 == argc)
+                usage("missing value after --stats argument");
+            options.statsFile = argv[++i];
+        } else if (!strncmp(argv[i], "--stats=", 8)) {
+            options.statsFile = &argv[i][8];
+        } else if (!strcmp(argv[i], "--statsinterval") ||
+                   !strcmp(argv[i], "-statsinterval")) {
+            if (i + 1 == argc)
+                usage("missing value after --statsinterval argument");
+            options.statsInterval = atof(argv[++i]);
+        } else if (!strncmp(argv[i], "--statsinterval=", 16)) {
+            options.statsInterval = atof(&argv[i][16]);
+        } else if (!strcmp(argv[i], "--bssrdfcache") ||
+                   !strcmp(argv[i], "-bssrdfcache")) {
+            if (i + 1 == argc)
+                usage("missing value after --bssrdfcache argument");
+            options.bssrdfCacheDir = argv[++i];
+        } else if (!strncmp(argv[i], "--bssrdfcache=", 14)) {
+            options.bssrdfCacheDir = &argv[i][14];
+        } else if (!strcmp(argv[i], "--reuseinstances") ||
+                   !strcmp(argv[i], "-reuseinstances")) {
+            options.reuseInstances = true;
         } else if (!strcmp(argv[i], "--cat") || !strcmp(argv[i], "-cat")) {
             options.cat = true;
         } else if (!strcmp(argv[i], "--toply") || !strcmp(argv[i], "-toply")) {
@@ -176,6 +306,10 @@ int main(int argc, char *argv[]) {
             options.iileDirectSamples = atoi(&argv[i][13]);
             std::cerr << "Set IILE direct samples to " << options.iileDirectSamples << std::endl;
         }
+        else if (!strncmp(argv[i], "--iileDirectAdaptive=", 21)) {
+            options.iileDirectAdaptive = atof(&argv[i][21]);
+            std::cerr << "Set IILE direct adaptive threshold to " << options.iileDirectAdaptive << std::endl;
+        }
         else if (!strncmp(argv[i], "--iileControl=", 14)) {
             options.iileControl = &argv[i][14];
             std::cerr << "Set IILE control directory to " << options.iileControl << std::endl;
@@ -32,13 +32,20 @@
 
 // materials/fourier.cpp*
 #include "materials/fourier.h"
+#include "fileutil.h"
 #include "interaction.h"
 #include "paramset.h"
+#include "stats.h"
+#include <mutex>
+#ifdef PBRT_HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif  // PBRT_HAVE_MMAP
 
 namespace pbrt {
 
-std::map<std::string, std::unique_ptr<FourierBSDFTable>>
-    FourierMaterial::loadedBSDFs;
+STAT_COUNTER("Scene/Fourier BSDF tables read", fourierTablesRead);
+STAT_MEMORY_COUNTER("Memory/Fourier BSDF tables", fourierTableBytes);
 
 // FourierMaterial Method Definitions
 /*
@@ -91,22 +98,18 @@ std::map<std::string, std::unique_ptr<FourierBSDFTable>>
   to port them from Mitsuba.)
 */
 
-inline bool IsBigEndian() {
-    uint32_t i = 0x01020304;
-    char c[4];
-    memcpy(c, &i, 4);
-    return (c[0] == 1);
-}
-
 static inline uint32_t ByteSwap32(uint32_t x) {
     return ((((x)&0xFF) << 24) | (((x)&0xFF00) << 8) | (((x)&0xFF0000) >> 8) |
             (((x)&0xFF000000) >> 24));
 }
 
+// FourierBSDFTable files start with a 64 byte header, followed by _mu_,
+// _cdf_, the offsets and lengths of the coefficient series and the
+// coefficients themselves, all stored as 32-bit values.
+static PBRT_CONSTEXPR size_t FourierHeaderSize = 64;
+
 bool FourierBSDFTable::Read(const std::string &filename,
                             FourierBSDFTable *bsdfTable) {
-    bsdfTable->mu = bsdfTable->cdf = bsdfTable->a = nullptr;
-    bsdfTable->aOffset = bsdfTable->m = nullptr;
     bsdfTable->nChannels = 0;
 
     FILE *f = fopen(filename.c_str(), "rb");
@@ -118,7 +121,7 @@ bool FourierBSDFTable::Read(const std::string &filename,
 
     auto read32 = [&](void *target, size_t count) -> bool {
         if (fread(target, sizeof(int), count, f) != count) return false;
-        if (IsBigEndian()) {
+        if (!HostIsLittleEndian()) {
             int32_t *tmp = (int32_t *)target;
             for (size_t i = 0; i < count; ++i) {
                 tmp[i] = ByteSwap32(tmp[i]);
@@ -134,13 +137,21 @@ bool FourierBSDFTable::Read(const std::string &filename,
         for (size_t i = 0; i < count; ++i) target[i] = buf[i];
         return ret;
     };
+    auto fail = [&]() {
+        bsdfTable->nChannels = 0;
+        fclose(f);
+        Error(
+            "Tabulated BSDF file \"%s\" has an incompatible file format or "
+            "version.",
+            filename.c_str());
+        return false;
+    };
 
     const char header_exp[8] = {'S', 'C', 'A', 'T', 'F', 'U', 'N', '\x01'};
     char header[8];
-    std::unique_ptr<int[]> offsetAndLength;
 
     if (fread(header, 1, 8, f) != 8 || memcmp(header, header_exp, 8) != 0)
-        goto fail;
+        return fail();
 
     int flags, nCoeffs, nBases, unused[4];
 
@@ -149,66 +160,117 @@ bool FourierBSDFTable::Read(const std::string &filename,
         !read32(&bsdfTable->nChannels, 1) || !read32(&nBases, 1) ||
         !read32(unused, 3) || !readfloat(&bsdfTable->eta, 1) ||
         !read32(&unused, 4))
-        goto fail;
+        return fail();
 
     /* Only a subset of BSDF files are supported for simplicity, in particular:
        monochromatic and
        RGB files with uniform (i.e. non-textured) material properties */
     if (flags != 1 ||
         (bsdfTable->nChannels != 1 && bsdfTable->nChannels != 3) || nBases != 1)
-        goto fail;
-
-    bsdfTable->mu = new Float[bsdfTable->nMu];
-    bsdfTable->cdf = new Float[bsdfTable->nMu * bsdfTable->nMu];
-    bsdfTable->a0 = new Float[bsdfTable->nMu * bsdfTable->nMu];
-    offsetAndLength.reset(new int[bsdfTable->nMu * bsdfTable->nMu * 2]);
-    bsdfTable->aOffset = new int[bsdfTable->nMu * bsdfTable->nMu];
-    bsdfTable->m = new int[bsdfTable->nMu * bsdfTable->nMu];
-    bsdfTable->a = new Float[nCoeffs];
-
-    if (!readfloat(bsdfTable->mu, bsdfTable->nMu) ||
-        !readfloat(bsdfTable->cdf, bsdfTable->nMu * bsdfTable->nMu) ||
-        !read32(offsetAndLength.get(), bsdfTable->nMu * bsdfTable->nMu * 2) ||
-        !readfloat(bsdfTable->a, nCoeffs))
-        goto fail;
-
-    for (int i = 0; i < bsdfTable->nMu * bsdfTable->nMu; ++i) {
+        return fail();
+
+    int nMu = bsdfTable->nMu, nMu2 = nMu * nMu;
+    if (nMu <= 0 || nCoeffs < 0 || bsdfTable->mMax <= 0) return fail();
+    size_t fileLength = FourierHeaderSize +
+                        sizeof(float) * ((size_t)nMu + nMu2 + nCoeffs) +
+                        sizeof(int32_t) * 2 * (size_t)nMu2;
+
+    // Map the table's data directly from the file if its layout matches
+    // _Float_ in memory; otherwise read it into _floatData_
+    const int32_t *offsetAndLength = nullptr;
+    std::vector<int32_t> offsetAndLengthData;
+#ifdef PBRT_HAVE_MMAP
+    if (sizeof(Float) == sizeof(float) && HostIsLittleEndian()) {
+        struct stat stat;
+        if (fstat(fileno(f), &stat) == 0 &&
+            (size_t)stat.st_size >= fileLength) {
+            void *ptr = mmap(0, stat.st_size, PROT_READ, MAP_FILE | MAP_SHARED,
+                             fileno(f), 0);
+            if (ptr != MAP_FAILED) {
+                bsdfTable->mappedData = ptr;
+                bsdfTable->mappedLength = stat.st_size;
+                const Float *data =
+                    (const Float *)((const char *)ptr + FourierHeaderSize);
+                bsdfTable->mu = data;
+                bsdfTable->cdf = data + nMu;
+                offsetAndLength = (const int32_t *)(data + nMu + nMu2);
+                bsdfTable->a = (const Float *)(offsetAndLength + 2 * nMu2);
+            }
+        }
+    }
+#endif  // PBRT_HAVE_MMAP
+    size_t nRead = bsdfTable->mappedData ? 0 : nMu + nMu2 + nCoeffs;
+    bsdfTable->floatData.resize(nRead + nMu2 + bsdfTable->mMax);
+    bsdfTable->intData.resize(2 * nMu2);
+    Float *floatData = bsdfTable->floatData.data();
+    if (!bsdfTable->mappedData) {
+        offsetAndLengthData.resize(2 * nMu2);
+        if (!readfloat(floatData, nMu) ||
+            !readfloat(floatData + nMu, nMu2) ||
+            !read32(offsetAndLengthData.data(), 2 * nMu2) ||
+            !readfloat(floatData + nMu + nMu2, nCoeffs))
+            return fail();
+        bsdfTable->mu = floatData;
+        bsdfTable->cdf = floatData + nMu;
+        bsdfTable->a = floatData + nMu + nMu2;
+        offsetAndLength = offsetAndLengthData.data();
+    }
+
+    int *aOffset = bsdfTable->intData.data(), *m = aOffset + nMu2;
+    Float *a0 = floatData + nRead, *recip = a0 + nMu2;
+    for (int i = 0; i < nMu2; ++i) {
         int offset = offsetAndLength[2 * i],
             length = offsetAndLength[2 * i + 1];
+        if (offset < 0 || length < 0 || length > bsdfTable->mMax ||
+            (int64_t)offset + (int64_t)length * bsdfTable->nChannels > nCoeffs)
+            return fail();
 
-        bsdfTable->aOffset[i] = offset;
-        bsdfTable->m[i] = length;
+        aOffset[i] = offset;
+        m[i] = length;
 
-        bsdfTable->a0[i] = length > 0 ? bsdfTable->a[offset] : (Float)0;
+        a0[i] = length > 0 ? bsdfTable->a[offset] : (Float)0;
     }
+    bsdfTable->aOffset = aOffset;
+    bsdfTable->m = m;
+    bsdfTable->a0 = a0;
 
-    bsdfTable->recip = new Float[bsdfTable->mMax];
     for (int i = 0; i < bsdfTable->mMax; ++i)
-        bsdfTable->recip[i] = 1 / (Float)i;
+        recip[i] = 1 / (Float)i;
+    bsdfTable->recip = recip;
 
+    fourierTableBytes += fileLength;
     fclose(f);
     return true;
-fail:
-    bsdfTable->nChannels = 0;
-    fclose(f);
-    Error(
-        "Tabulated BSDF file \"%s\" has an incompatible file format or "
-        "version.",
-        filename.c_str());
-    return false;
 }
 
-FourierMaterial::FourierMaterial(const std::string &filename,
-                                 const std::shared_ptr<Texture<Float>> &bumpMap)
-    : bumpMap(bumpMap) {
-    if (loadedBSDFs.find(filename) == loadedBSDFs.end()) {
-        std::unique_ptr<FourierBSDFTable> table(new FourierBSDFTable);
+FourierBSDFTable::~FourierBSDFTable() {
+#ifdef PBRT_HAVE_MMAP
+    if (mappedData) munmap(mappedData, mappedLength);
+#endif  // PBRT_HAVE_MMAP
+}
+
+std::shared_ptr<FourierBSDFTable> FourierBSDFTable::Get(
+    const std::string &filename) {
+    // Tables are shared by all materials that use the same file for as
+    // long as any of them exist
+    static std::mutex mutex;
+    static std::map<std::string, std::weak_ptr<FourierBSDFTable>> tables;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::weak_ptr<FourierBSDFTable> &entry = tables[AbsolutePath(filename)];
+    std::shared_ptr<FourierBSDFTable> table = entry.lock();
+    if (!table) {
+        table = std::make_shared<FourierBSDFTable>();
         FourierBSDFTable::Read(filename, table.get());
-        loadedBSDFs[filename] = std::move(table);
+        entry = table;
+        ++fourierTablesRead;
     }
-    bsdfTable = loadedBSDFs[filename].get();
+    return table;
 }
 
+FourierMaterial::FourierMaterial(const std::string &filename,
+                                 const std::shared_ptr<Texture<Float>> &bumpMap)
+    : bsdfTable(FourierBSDFTable::Get(filename)), bumpMap(bumpMap) {}
+
 void FourierMaterial::ComputeScatteringFunctions(
     SurfaceInteraction *si, MemoryArena &arena, TransportMode mode,
     bool allowMultipleLobes) const {
@@ -43,7 +43,6 @@
 #include "material.h"
 #include "reflection.h"
 #include "interpolation.h"
-#include <map>
 
 namespace pbrt {
 
@@ -59,9 +58,8 @@ class FourierMaterial : public Material {
 
   private:
     // FourierMaterial Private Data
-    FourierBSDFTable *bsdfTable;
+    std::shared_ptr<FourierBSDFTable> bsdfTable;
     std::shared_ptr<Texture<Float>> bumpMap;
-    static std::map<std::string, std::unique_ptr<FourierBSDFTable>> loadedBSDFs;
 };
 
 FourierMaterial *CreateFourierMaterial(const TextureParams &mp);
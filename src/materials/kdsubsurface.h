@@ -70,9 +70,7 @@ class KdSubsurfaceMaterial : public Material {
           bumpMap(bumpMap),
           eta(eta),
           remapRoughness(remapRoughness),
-          table(100, 64) {
-        ComputeBeamDiffusionBSSRDF(g, eta, &table);
-    }
+          table(GetBeamDiffusionBSSRDF(g, eta)) {}
     void ComputeScatteringFunctions(SurfaceInteraction *si, MemoryArena &arena,
                                     TransportMode mode,
                                     bool allowMultipleLobes) const;
@@ -85,7 +83,7 @@ class KdSubsurfaceMaterial : public Material {
     std::shared_ptr<Texture<Float>> bumpMap;
     Float eta;
     bool remapRoughness;
-    BSSRDFTable table;
+    std::shared_ptr<const BSSRDFTable> table;
 };
 
 KdSubsurfaceMaterial *CreateKdSubsurfaceMaterial(const TextureParams &mp);
@@ -37,12 +37,399 @@
 #include "sampler.h"
 #include "stats.h"
 #include "interaction.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#ifdef PBRT_HAVE_MMAP
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif  // PBRT_HAVE_MMAP
 
 namespace pbrt {
 
 STAT_RATIO("Media/Grid steps per Tr() call", nTrSteps, nTrCalls);
+STAT_PERCENT("Media/Nonempty volume bricks", nNonemptyBricks, nVolumeBricks);
+STAT_MEMORY_COUNTER("Memory/Mapped volume files", mappedVolumeBytes);
+
+// GridVolume Local Definitions
+// Volume files start with a 32 byte header: the _GridVolumeMagic_ bytes,
+// then _nx_, _ny_, _nz_, the _GridEncoding_ and the number of stored
+// bricks as little-endian 32-bit integers, and 4 bytes of padding. The
+// brick index table and brick info table follow, and the brick data
+// starts at the next multiple of 64 bytes.
+static const char GridVolumeMagic[8] = {'P', 'B', 'R', 'T', 'V', 'O', 'L', '1'};
+static PBRT_CONSTEXPR size_t GridVolumeHeaderSize = 32;
+
+static size_t BrickDataOffset(size_t nBricks, size_t nStoredBricks) {
+    size_t offset = GridVolumeHeaderSize + nBricks * sizeof(int32_t) +
+                    nStoredBricks * 3 * sizeof(float);
+    return (offset + 63) & ~size_t(63);
+}
+
+static size_t EncodedValueSize(GridEncoding encoding) {
+    switch (encoding) {
+    case GridEncoding::Float:
+        return sizeof(float);
+    case GridEncoding::Half:
+        return sizeof(uint16_t);
+    default:
+        return sizeof(uint8_t);
+    }
+}
+
+// Converts _f_ to the nearest half-precision float, rounding ties to even
+static uint16_t FloatToHalf(float f) {
+    uint32_t bits = FloatToBits(f);
+    uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t mantissa = bits & 0x7fffff;
+    int floatExponent = (bits >> 23) & 0xff;
+    if (floatExponent == 0xff)
+        // Infinity or NaN
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    int exponent = floatExponent - 127 + 15;
+    if (exponent >= 31) return sign | 0x7c00;
+    if (exponent <= 0) {
+        // Denormalized half or zero
+        if (exponent < -10) return sign;
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t h = mantissa >> shift;
+        uint32_t rem = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+        if (rem > halfway || (rem == halfway && (h & 1))) ++h;
+        return sign | h;
+    }
+    // Rounding may carry into the exponent, which gives the right result
+    uint32_t h = (exponent << 10) | (mantissa >> 13);
+    uint32_t rem = mantissa & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) ++h;
+    return sign | h;
+}
+
+// GridVolume Method Definitions
+bool ParseGridEncoding(const std::string &name, GridEncoding *encoding) {
+    if (name == "float")
+        *encoding = GridEncoding::Float;
+    else if (name == "half")
+        *encoding = GridEncoding::Half;
+    else if (name == "byte")
+        *encoding = GridEncoding::Byte;
+    else {
+        Error("Volume encoding \"%s\" unknown; must be \"float\", \"half\" "
+              "or \"byte\".", name.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<GridVolume> GridVolume::Encode(int nx, int ny, int nz,
+                                               const Float *d,
+                                               GridEncoding encoding) {
+    int nb[3] = {(nx + BrickSize - 1) / BrickSize,
+                 (ny + BrickSize - 1) / BrickSize,
+                 (nz + BrickSize - 1) / BrickSize};
+    size_t nBricks = size_t(nb[0]) * nb[1] * nb[2];
+    auto brickRange = [&](int bx, int by, int bz, Bounds3i *b) {
+        *b = Bounds3i(Point3i(bx * BrickSize, by * BrickSize, bz * BrickSize),
+                      Point3i(std::min(nx, (bx + 1) * BrickSize),
+                              std::min(ny, (by + 1) * BrickSize),
+                              std::min(nz, (bz + 1) * BrickSize)));
+    };
+    auto value = [&](int x, int y, int z) {
+        return d[(size_t(z) * ny + y) * nx + x];
+    };
+
+    // Find the bricks with nonzero values
+    std::vector<int32_t> index(nBricks, -1);
+    int32_t nStored = 0;
+    for (int bz = 0; bz < nb[2]; ++bz)
+        for (int by = 0; by < nb[1]; ++by)
+            for (int bx = 0; bx < nb[0]; ++bx) {
+                Bounds3i b;
+                brickRange(bx, by, bz, &b);
+                bool empty = true;
+                for (int z = b.pMin.z; empty && z < b.pMax.z; ++z)
+                    for (int y = b.pMin.y; empty && y < b.pMax.y; ++y)
+                        for (int x = b.pMin.x; x < b.pMax.x; ++x)
+                            if (value(x, y, z) != 0) {
+                                empty = false;
+                                break;
+                            }
+                if (!empty)
+                    index[(size_t(bz) * nb[1] + by) * nb[0] + bx] = nStored++;
+            }
+
+    // Lay out the header and tables
+    size_t valueSize = EncodedValueSize(encoding);
+    size_t brickBytes = BrickSize * BrickSize * BrickSize * valueSize;
+    size_t dataOffset = BrickDataOffset(nBricks, nStored);
+    std::unique_ptr<GridVolume> volume(new GridVolume);
+    std::vector<uint8_t> &buf = volume->ownedData;
+    buf.resize(dataOffset + nStored * brickBytes, 0);
+    int32_t header[6] = {nx, ny, nz, int32_t(encoding), nStored, 0};
+    memcpy(&buf[0], GridVolumeMagic, sizeof(GridVolumeMagic));
+    memcpy(&buf[sizeof(GridVolumeMagic)], header, sizeof(header));
+    memcpy(&buf[GridVolumeHeaderSize], index.data(),
+           nBricks * sizeof(int32_t));
+    float *info =
+        (float *)&buf[GridVolumeHeaderSize + nBricks * sizeof(int32_t)];
+
+    // Encode the values of each stored brick
+    for (int bz = 0; bz < nb[2]; ++bz)
+        for (int by = 0; by < nb[1]; ++by)
+            for (int bx = 0; bx < nb[0]; ++bx) {
+                int32_t brick = index[(size_t(bz) * nb[1] + by) * nb[0] + bx];
+                if (brick < 0) continue;
+                Bounds3i b;
+                brickRange(bx, by, bz, &b);
+                Float minValue = Infinity, maxValue = -Infinity;
+                for (int z = b.pMin.z; z < b.pMax.z; ++z)
+                    for (int y = b.pMin.y; y < b.pMax.y; ++y)
+                        for (int x = b.pMin.x; x < b.pMax.x; ++x) {
+                            minValue = std::min(minValue, value(x, y, z));
+                            maxValue = std::max(maxValue, value(x, y, z));
+                        }
+                Float scale = (maxValue - minValue) / 255;
+                info[3 * brick] = minValue;
+                info[3 * brick + 1] = scale;
+
+                uint8_t *brickData = &buf[dataOffset + brick * brickBytes];
+                Float decodedMax = -Infinity;
+                const int m = BrickSize - 1;
+                for (int z = b.pMin.z; z < b.pMax.z; ++z)
+                    for (int y = b.pMin.y; y < b.pMax.y; ++y)
+                        for (int x = b.pMin.x; x < b.pMax.x; ++x) {
+                            int offset = ((((z & m) << LogBrickSize) +
+                                           (y & m))
+                                          << LogBrickSize) +
+                                         (x & m);
+                            Float v = value(x, y, z), decoded;
+                            if (encoding == GridEncoding::Float) {
+                                ((float *)brickData)[offset] = v;
+                                decoded = (float)v;
+                            } else if (encoding == GridEncoding::Half) {
+                                uint16_t h = FloatToHalf(v);
+                                ((uint16_t *)brickData)[offset] = h;
+                                decoded = HalfToFloat(h);
+                            } else {
+                                uint8_t q = 0;
+                                if (scale > 0)
+                                    q = (uint8_t)Clamp(
+                                        std::round((v - minValue) / scale), 0,
+                                        255);
+                                brickData[offset] = q;
+                                decoded =
+                                    info[3 * brick] + info[3 * brick + 1] * q;
+                            }
+                            decodedMax = std::max(decodedMax, decoded);
+                        }
+                info[3 * brick + 2] = decodedMax;
+            }
+    CHECK(volume->Init(&buf[0], buf.size(), "memory"));
+    densityBytes += buf.size();
+    return volume;
+}
+
+// Volume files are little-endian; volumes encoded in memory use the host's
+// byte order and so work anywhere, but can only be exchanged as files on
+// little-endian hosts.
+static bool CheckVolumeFileEndianness(const std::string &filename) {
+    if (HostIsLittleEndian()) return true;
+    Error("%s: volume files are only supported on little-endian hosts",
+          filename.c_str());
+    return false;
+}
+
+std::unique_ptr<GridVolume> GridVolume::Read(const std::string &filename) {
+    if (!CheckVolumeFileEndianness(filename)) return nullptr;
+    std::unique_ptr<GridVolume> volume(new GridVolume);
+#ifdef PBRT_HAVE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        return nullptr;
+    }
+    struct stat stat;
+    if (fstat(fd, &stat) != 0) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+    size_t len = stat.st_size;
+    void *ptr = len > 0 ? mmap(0, len, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0)
+                        : MAP_FAILED;
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        Error("%s: unable to map volume file", filename.c_str());
+        return nullptr;
+    }
+    volume->mappedData = ptr;
+    volume->mappedLength = len;
+    if (!volume->Init((const uint8_t *)ptr, len, filename)) return nullptr;
+    mappedVolumeBytes += len;
+#else
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+        Error("%s: unable to open volume file", filename.c_str());
+        return nullptr;
+    }
+    volume->ownedData.assign(std::istreambuf_iterator<char>(in),
+                             std::istreambuf_iterator<char>());
+    if (!volume->Init(volume->ownedData.data(), volume->ownedData.size(),
+                      filename))
+        return nullptr;
+    densityBytes += volume->ownedData.size();
+#endif  // PBRT_HAVE_MMAP
+    return volume;
+}
+
+bool GridVolume::Init(const uint8_t *data, size_t length,
+                      const std::string &source) {
+    if (length < GridVolumeHeaderSize ||
+        memcmp(data, GridVolumeMagic, sizeof(GridVolumeMagic)) != 0) {
+        Error("%s: not a pbrt volume file", source.c_str());
+        return false;
+    }
+    int32_t header[6];
+    memcpy(header, data + sizeof(GridVolumeMagic), sizeof(header));
+    nx = header[0];
+    ny = header[1];
+    nz = header[2];
+    nStoredBricks = header[4];
+    if (nx <= 0 || ny <= 0 || nz <= 0 || header[3] < 0 || header[3] > 2 ||
+        nStoredBricks < 0) {
+        Error("%s: invalid volume file header", source.c_str());
+        return false;
+    }
+    encoding = GridEncoding(header[3]);
+    nBricks[0] = (nx + BrickSize - 1) / BrickSize;
+    nBricks[1] = (ny + BrickSize - 1) / BrickSize;
+    nBricks[2] = (nz + BrickSize - 1) / BrickSize;
+    size_t nTotal = size_t(nBricks[0]) * nBricks[1] * nBricks[2];
+    size_t dataOffset = BrickDataOffset(nTotal, nStoredBricks);
+    size_t brickBytes =
+        BrickSize * BrickSize * BrickSize * EncodedValueSize(encoding);
+    if (length < dataOffset + nStoredBricks * brickBytes) {
+        Error("%s: volume file is truncated", source.c_str());
+        return false;
+    }
+    brickIndex = (const int32_t *)(data + GridVolumeHeaderSize);
+    brickInfo = (const float *)(data + GridVolumeHeaderSize +
+                                nTotal * sizeof(int32_t));
+    brickData = data + dataOffset;
+    for (size_t i = 0; i < nTotal; ++i)
+        if (brickIndex[i] < -1 || brickIndex[i] >= nStoredBricks) {
+            Error("%s: invalid brick index in volume file", source.c_str());
+            return false;
+        }
+    this->data = data;
+    dataLength = length;
+    nVolumeBricks += nTotal;
+    nNonemptyBricks += nStoredBricks;
+    return true;
+}
+
+bool GridVolume::Write(const std::string &filename) const {
+    if (!CheckVolumeFileEndianness(filename)) return false;
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (!f) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        return false;
+    }
+    bool ok = fwrite(data, 1, dataLength, f) == dataLength;
+    if (fclose(f) != 0) ok = false;
+    if (!ok) Error("%s: error writing volume file", filename.c_str());
+    return ok;
+}
+
+GridVolume::~GridVolume() {
+#ifdef PBRT_HAVE_MMAP
+    if (mappedData && munmap(mappedData, mappedLength) != 0)
+        Warning("munmap: %s", strerror(errno));
+#endif  // PBRT_HAVE_MMAP
+}
+
 
 // GridDensityMedium Method Definitions
+GridDensityMedium::GridDensityMedium(const Spectrum &sigma_a,
+                                     const Spectrum &sigma_s, Float g, int nx,
+                                     int ny, int nz,
+                                     const Transform &mediumToWorld,
+                                     const Float *d)
+    : GridDensityMedium(sigma_a, sigma_s, g,
+                        GridVolume::Encode(nx, ny, nz, d, GridEncoding::Float),
+                        mediumToWorld) {}
+
+GridDensityMedium::GridDensityMedium(const Spectrum &sigma_a,
+                                     const Spectrum &sigma_s, Float g,
+                                     std::unique_ptr<GridVolume> vol,
+                                     const Transform &mediumToWorld)
+    : sigma_a(sigma_a),
+      sigma_s(sigma_s),
+      g(g),
+      volume(std::move(vol)),
+      nx(volume->nx),
+      ny(volume->ny),
+      nz(volume->nz),
+      WorldToMedium(Inverse(mediumToWorld)) {
+    // Precompute values for Monte Carlo sampling of _GridDensityMedium_
+    sigma_t = (sigma_a + sigma_s)[0];
+    if (Spectrum(sigma_t) != sigma_a + sigma_s)
+        Error(
+            "GridDensityMedium requires a spectrally uniform attenuation "
+            "coefficient!");
+
+    // Compute the maximum density in each majorant grid cell. Sample _i_
+    // along an axis is interpolated by lookups between samples _i-1_ and
+    // _i+1_, so each stored sample raises the maximum of the cells that
+    // overlap that range; empty bricks are skipped.
+    const int nCells = MajorantRes * MajorantRes * MajorantRes;
+    maxDensityGrid.reset(new Float[nCells]);
+    std::fill(maxDensityGrid.get(), maxDensityGrid.get() + nCells, Float(0));
+    densityBytes += nCells * sizeof(Float);
+    int res[3] = {nx, ny, nz};
+    std::vector<int> cellMin[3], cellMax[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        for (int i = 0; i < res[axis]; ++i) {
+            Float x0 = (i - .5f) / res[axis], x1 = (i + 1.5f) / res[axis];
+            cellMin[axis].push_back(
+                Clamp((int)std::floor(x0 * MajorantRes), 0, MajorantRes - 1));
+            cellMax[axis].push_back(
+                Clamp((int)std::floor(x1 * MajorantRes), 0, MajorantRes - 1));
+        }
+    }
+    const int BrickSize = GridVolume::BrickSize;
+    for (int bz = 0; bz < volume->nBricks[2]; ++bz)
+        for (int by = 0; by < volume->nBricks[1]; ++by)
+            for (int bx = 0; bx < volume->nBricks[0]; ++bx) {
+                if (volume->BrickMax(bx, by, bz) == 0) continue;
+                for (int z = bz * BrickSize;
+                     z < std::min(nz, (bz + 1) * BrickSize); ++z)
+                    for (int y = by * BrickSize;
+                         y < std::min(ny, (by + 1) * BrickSize); ++y)
+                        for (int x = bx * BrickSize;
+                             x < std::min(nx, (bx + 1) * BrickSize); ++x) {
+                            Float d = volume->Lookup(x, y, z);
+                            if (d <= 0) continue;
+                            for (int cz = cellMin[2][z]; cz <= cellMax[2][z];
+                                 ++cz)
+                                for (int cy = cellMin[1][y];
+                                     cy <= cellMax[1][y]; ++cy)
+                                    for (int cx = cellMin[0][x];
+                                         cx <= cellMax[0][x]; ++cx) {
+                                        Float &m = maxDensityGrid
+                                            [(cz * MajorantRes + cy) *
+                                                 MajorantRes +
+                                             cx];
+                                        m = std::max(m, d);
+                                    }
+                        }
+            }
+}
+
 Float GridDensityMedium::Density(const Point3f &p) const {
     // Compute voxel coordinates and offsets for _p_
     Point3f pSamples(p.x * nx - .5f, p.y * ny - .5f, p.z * nz - .5f);
@@ -59,6 +446,59 @@ Float GridDensityMedium::Density(const Point3f &p) const {
     return Lerp(d.z, d0, d1);
 }
 
+// Calls _callback(t0, t1, maxDensity)_ for each majorant grid cell that
+// _ray_ passes through over $[\tmin, \tmax]$, in order, until the
+// callback returns false. _ray_ is in medium space, where the grid
+// covers $[0,1]^3$.
+template <typename F>
+void GridDensityMedium::TraverseMajorants(const Ray &ray, Float tMin,
+                                          Float tMax, F callback) const {
+    // Set up 3D DDA for _ray_ through the majorant grid
+    Point3f pGrid = ray(tMin) * Float(MajorantRes);
+    Point3i cell;
+    Float nextCrossingT[3], deltaT[3];
+    int step[3], out[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        cell[axis] = Clamp((int)pGrid[axis], 0, MajorantRes - 1);
+        if (ray.d[axis] == 0) {
+            // Handle ray parallel to the grid planes
+            nextCrossingT[axis] = Infinity;
+            deltaT[axis] = Infinity;
+            step[axis] = 0;
+            out[axis] = -1;
+            continue;
+        }
+        deltaT[axis] = 1 / (std::abs(ray.d[axis]) * MajorantRes);
+        if (ray.d[axis] > 0) {
+            Float next = Float(cell[axis] + 1) / MajorantRes;
+            nextCrossingT[axis] = tMin + (next - ray(tMin)[axis]) / ray.d[axis];
+            step[axis] = 1;
+            out[axis] = MajorantRes;
+        } else {
+            Float next = Float(cell[axis]) / MajorantRes;
+            nextCrossingT[axis] = tMin + (next - ray(tMin)[axis]) / ray.d[axis];
+            step[axis] = -1;
+            out[axis] = -1;
+        }
+    }
+
+    // Walk the ray through majorant cells
+    Float t0 = tMin;
+    while (t0 < tMax) {
+        // Find the axis whose cell boundary the ray crosses first
+        int axis = (nextCrossingT[0] < nextCrossingT[1])
+                       ? ((nextCrossingT[0] < nextCrossingT[2]) ? 0 : 2)
+                       : ((nextCrossingT[1] < nextCrossingT[2]) ? 1 : 2);
+        Float t1 = std::min(tMax, nextCrossingT[axis]);
+        if (t1 > t0 && !callback(t0, t1, MaxDensity(cell))) return;
+        t0 = t1;
+        if (step[axis] == 0) return;
+        cell[axis] += step[axis];
+        if (cell[axis] == out[axis]) return;
+        nextCrossingT[axis] += deltaT[axis];
+    }
+}
+
 Spectrum GridDensityMedium::Sample(const Ray &rWorld, Sampler &sampler,
                                    MemoryArena &arena,
                                    MediumInteraction *mi) const {
@@ -70,20 +510,32 @@ Spectrum GridDensityMedium::Sample(const Ray &rWorld, Sampler &sampler,
     Float tMin, tMax;
     if (!b.IntersectP(ray, &tMin, &tMax)) return Spectrum(1.f);
 
-    // Run delta-tracking iterations to sample a medium interaction
-    Float t = tMin;
-    while (true) {
-        t -= std::log(1 - sampler.Get1D()) * invMaxDensity / sigma_t;
-        if (t >= tMax) break;
-        if (Density(ray(t)) * invMaxDensity > sampler.Get1D()) {
-            // Populate _mi_ with medium interaction information and return
-            PhaseFunction *phase = ARENA_ALLOC(arena, HenyeyGreenstein)(g);
-            *mi = MediumInteraction(rWorld(t), -rWorld.d, rWorld.time, this,
-                                    phase);
-            return sigma_s / sigma_t;
+    // Run delta-tracking iterations to sample a medium interaction, using
+    // each majorant cell's maximum density along the way; cells with zero
+    // density are skipped.
+    bool scattered = false;
+    Float tScatter = 0;
+    TraverseMajorants(ray, tMin, tMax, [&](Float t0, Float t1,
+                                           Float maxDensity) {
+        if (maxDensity == 0) return true;
+        Float t = t0;
+        while (true) {
+            t -= std::log(1 - sampler.Get1D()) / (maxDensity * sigma_t);
+            if (t >= t1) return true;
+            if (Density(ray(t)) > sampler.Get1D() * maxDensity) {
+                scattered = true;
+                tScatter = t;
+                return false;
+            }
         }
-    }
-    return Spectrum(1.f);
+    });
+    if (!scattered) return Spectrum(1.f);
+
+    // Populate _mi_ with medium interaction information and return
+    PhaseFunction *phase = ARENA_ALLOC(arena, HenyeyGreenstein)(g);
+    *mi = MediumInteraction(rWorld(tScatter), -rWorld.d, rWorld.time, this,
+                            phase);
+    return sigma_s / sigma_t;
 }
 
 Spectrum GridDensityMedium::Tr(const Ray &rWorld, Sampler &sampler) const {
@@ -97,23 +549,32 @@ Spectrum GridDensityMedium::Tr(const Ray &rWorld, Sampler &sampler) const {
     Float tMin, tMax;
     if (!b.IntersectP(ray, &tMin, &tMax)) return Spectrum(1.f);
 
-    // Perform ratio tracking to estimate the transmittance value
-    Float Tr = 1, t = tMin;
-    while (true) {
-        ++nTrSteps;
-        t -= std::log(1 - sampler.Get1D()) * invMaxDensity / sigma_t;
-        if (t >= tMax) break;
-        Float density = Density(ray(t));
-        Tr *= 1 - std::max((Float)0, density * invMaxDensity);
-        // Added after book publication: when transmittance gets low,
-        // start applying Russian roulette to terminate sampling.
-        const Float rrThreshold = .1;
-        if (Tr < rrThreshold) {
-            Float q = std::max((Float).05, 1 - Tr);
-            if (sampler.Get1D() < q) return 0;
-            Tr /= 1 - q;
+    // Perform ratio tracking to estimate the transmittance value, with
+    // each majorant cell's maximum density as the local majorant
+    Float Tr = 1;
+    TraverseMajorants(ray, tMin, tMax, [&](Float t0, Float t1,
+                                           Float maxDensity) {
+        if (maxDensity == 0) return true;
+        Float t = t0;
+        while (true) {
+            ++nTrSteps;
+            t -= std::log(1 - sampler.Get1D()) / (maxDensity * sigma_t);
+            if (t >= t1) return true;
+            Float density = Density(ray(t));
+            Tr *= 1 - std::max((Float)0, density / maxDensity);
+            // Added after book publication: when transmittance gets low,
+            // start applying Russian roulette to terminate sampling.
+            const Float rrThreshold = .1;
+            if (Tr < rrThreshold) {
+                Float q = std::max((Float).05, 1 - Tr);
+                if (sampler.Get1D() < q) {
+                    Tr = 0;
+                    return false;
+                }
+                Tr /= 1 - q;
+            }
         }
-    }
+    });
     return Spectrum(Tr);
 }
 
@@ -42,59 +42,141 @@
 #include "medium.h"
 #include "transform.h"
 #include "stats.h"
+#include <memory>
+#include <string>
 
 namespace pbrt {
 
 STAT_MEMORY_COUNTER("Memory/Volume density grid", densityBytes);
 
+// How GridVolume stores density values: as 32-bit floats, as 16-bit
+// (half precision) floats, or quantized to 8 bits over each brick's range
+enum class GridEncoding { Float = 0, Half = 1, Byte = 2 };
+
+// Parses "float", "half" or "byte"; reports an error for anything else
+bool ParseGridEncoding(const std::string &name, GridEncoding *encoding);
+
+// GridVolume Declarations
+// GridVolume stores an _nx_*_ny_*_nz_ grid of density values in bricks of
+// _BrickSize_^3 samples. Bricks where all values are zero aren't stored.
+// Its storage has the same layout as the volume files written by
+// Write(); Read() memory-maps those files where possible, so that large
+// volumes are neither parsed nor copied.
+class GridVolume {
+  public:
+    // GridVolume Public Methods
+    static std::unique_ptr<GridVolume> Encode(int nx, int ny, int nz,
+                                              const Float *d,
+                                              GridEncoding encoding);
+    static std::unique_ptr<GridVolume> Read(const std::string &filename);
+    bool Write(const std::string &filename) const;
+    ~GridVolume();
+    Float Lookup(int x, int y, int z) const {
+        if (x < 0 || x >= nx || y < 0 || y >= ny || z < 0 || z >= nz)
+            return 0;
+        int brick = brickIndex[((z >> LogBrickSize) * nBricks[1] +
+                                (y >> LogBrickSize)) *
+                                   nBricks[0] +
+                               (x >> LogBrickSize)];
+        if (brick < 0) return 0;
+        int m = BrickSize - 1;
+        size_t offset = (size_t(brick) << (3 * LogBrickSize)) +
+                        ((((z & m) << LogBrickSize) + (y & m))
+                         << LogBrickSize) +
+                        (x & m);
+        switch (encoding) {
+        case GridEncoding::Float:
+            return ((const float *)brickData)[offset];
+        case GridEncoding::Half:
+            return HalfToFloat(((const uint16_t *)brickData)[offset]);
+        default:
+            return brickInfo[3 * brick] +
+                   brickInfo[3 * brick + 1] * brickData[offset];
+        }
+    }
+    // Returns the maximum value in the given brick
+    Float BrickMax(int bx, int by, int bz) const {
+        int brick = brickIndex[(bz * nBricks[1] + by) * nBricks[0] + bx];
+        return brick < 0 ? 0 : brickInfo[3 * brick + 2];
+    }
+
+    // GridVolume Public Data
+    static PBRT_CONSTEXPR int LogBrickSize = 3;
+    static PBRT_CONSTEXPR int BrickSize = 1 << LogBrickSize;
+    int nx, ny, nz;
+    int nBricks[3];
+    int nStoredBricks;
+
+  private:
+    // GridVolume Private Methods
+    GridVolume() {}
+    bool Init(const uint8_t *data, size_t length, const std::string &source);
+    static inline float HalfToFloat(uint16_t h);
+
+    // GridVolume Private Data
+    GridEncoding encoding;
+    std::vector<uint8_t> ownedData;
+    void *mappedData = nullptr;
+    size_t mappedLength = 0;
+    const uint8_t *data = nullptr;
+    size_t dataLength = 0;
+    // Index of each brick in the stored bricks, or -1 if it is empty
+    const int32_t *brickIndex;
+    // Per stored brick: offset and scale for _GridEncoding::Byte_ values
+    // and the maximum value
+    const float *brickInfo;
+    const uint8_t *brickData;
+};
+
+inline float GridVolume::HalfToFloat(uint16_t h) {
+    uint32_t sign = uint32_t(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f, mantissa = h & 0x3ff;
+    if (exponent == 0)
+        // Zero or denormalized half
+        return BitsToFloat(FloatToBits(mantissa * (1.f / (1 << 24))) | sign);
+    if (exponent == 31)
+        return BitsToFloat(sign | 0x7f800000 | (mantissa << 13));
+    return BitsToFloat(sign | ((exponent - 15 + 127) << 23) |
+                       (mantissa << 13));
+}
+
 // GridDensityMedium Declarations
 class GridDensityMedium : public Medium {
   public:
     // GridDensityMedium Public Methods
     GridDensityMedium(const Spectrum &sigma_a, const Spectrum &sigma_s, Float g,
                       int nx, int ny, int nz, const Transform &mediumToWorld,
-                      const Float *d)
-        : sigma_a(sigma_a),
-          sigma_s(sigma_s),
-          g(g),
-          nx(nx),
-          ny(ny),
-          nz(nz),
-          WorldToMedium(Inverse(mediumToWorld)),
-          density(new Float[nx * ny * nz]) {
-        densityBytes += nx * ny * nz * sizeof(Float);
-        memcpy((Float *)density.get(), d, sizeof(Float) * nx * ny * nz);
-        // Precompute values for Monte Carlo sampling of _GridDensityMedium_
-        sigma_t = (sigma_a + sigma_s)[0];
-        if (Spectrum(sigma_t) != sigma_a + sigma_s)
-            Error(
-                "GridDensityMedium requires a spectrally uniform attenuation "
-                "coefficient!");
-        Float maxDensity = 0;
-        for (int i = 0; i < nx * ny * nz; ++i)
-            maxDensity = std::max(maxDensity, density[i]);
-        invMaxDensity = 1 / maxDensity;
-    }
-
+                      const Float *d);
+    GridDensityMedium(const Spectrum &sigma_a, const Spectrum &sigma_s, Float g,
+                      std::unique_ptr<GridVolume> volume,
+                      const Transform &mediumToWorld);
     Float Density(const Point3f &p) const;
-    Float D(const Point3i &p) const {
-        Bounds3i sampleBounds(Point3i(0, 0, 0), Point3i(nx, ny, nz));
-        if (!InsideExclusive(p, sampleBounds)) return 0;
-        return density[(p.z * ny + p.y) * nx + p.x];
-    }
+    Float D(const Point3i &p) const { return volume->Lookup(p.x, p.y, p.z); }
     Spectrum Sample(const Ray &ray, Sampler &sampler, MemoryArena &arena,
                     MediumInteraction *mi) const;
     Spectrum Tr(const Ray &ray, Sampler &sampler) const;
 
   private:
+    // GridDensityMedium Private Methods
+    Float MaxDensity(const Point3i &p) const {
+        return maxDensityGrid[(p.z * MajorantRes + p.y) * MajorantRes + p.x];
+    }
+    template <typename F>
+    void TraverseMajorants(const Ray &ray, Float tMin, Float tMax,
+                           F callback) const;
+
     // GridDensityMedium Private Data
     const Spectrum sigma_a, sigma_s;
     const Float g;
+    std::unique_ptr<GridVolume> volume;
     const int nx, ny, nz;
     const Transform WorldToMedium;
-    std::unique_ptr<Float[]> density;
     Float sigma_t;
-    Float invMaxDensity;
+    // Maximum density in each cell of a coarse grid over the medium's
+    // bounds, used as the local majorant for delta and ratio tracking;
+    // cells over empty bricks are skipped.
+    static PBRT_CONSTEXPR int MajorantRes = 16;
+    std::unique_ptr<Float[]> maxDensityGrid;
 };
 
 }  // namespace pbrt
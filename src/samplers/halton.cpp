@@ -63,8 +63,10 @@ static void extendedGCD(uint64_t a, uint64_t b, int64_t *x, int64_t *y) {
 
 // HaltonSampler Method Definitions
 HaltonSampler::HaltonSampler(int samplesPerPixel, const Bounds2i &sampleBounds,
-                             bool sampleAtPixelCenter)
-    : GlobalSampler(samplesPerPixel), sampleAtPixelCenter(sampleAtPixelCenter) {
+                             bool sampleAtPixelCenter,
+                             int nPrecomputedDimensions)
+    : GlobalSampler(samplesPerPixel, nPrecomputedDimensions),
+      sampleAtPixelCenter(sampleAtPixelCenter) {
     // Generate random digit permutations for Halton sampler
     if (radicalInversePermutations.empty()) {
         RNG rng;
@@ -126,6 +128,16 @@ Float HaltonSampler::SampleDimension(int64_t index, int dim) const {
                                        PermutationForDimension(dim));
 }
 
+void HaltonSampler::SampleDimensions(const int64_t *indices, int n, int dim,
+                                     Float *samples) const {
+    if (dim < 2) {
+        GlobalSampler::SampleDimensions(indices, n, dim, samples);
+        return;
+    }
+    ScrambledRadicalInverse(dim, reinterpret_cast<const uint64_t *>(indices),
+                            n, PermutationForDimension(dim), samples);
+}
+
 std::unique_ptr<Sampler> HaltonSampler::Clone(int seed) {
     return std::unique_ptr<Sampler>(new HaltonSampler(*this));
 }
@@ -135,7 +147,9 @@ HaltonSampler *CreateHaltonSampler(const ParamSet &params,
     int nsamp = params.FindOneInt("pixelsamples", 16);
     if (PbrtOptions.quickRender) nsamp = 1;
     bool sampleAtCenter = params.FindOneBool("samplepixelcenter", false);
-    return new HaltonSampler(nsamp, sampleBounds, sampleAtCenter);
+    int nPrecomputed = params.FindOneInt("precomputeddimensions", 32);
+    return new HaltonSampler(nsamp, sampleBounds, sampleAtCenter,
+                             nPrecomputed);
 }
 
 HaltonSampler* CreateHaltonSampler(
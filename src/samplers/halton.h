@@ -49,9 +49,11 @@ class HaltonSampler : public GlobalSampler {
   public:
     // HaltonSampler Public Methods
     HaltonSampler(int nsamp, const Bounds2i &sampleBounds,
-                  bool sampleAtCenter = false);
+                  bool sampleAtCenter = false, int nPrecomputedDimensions = 0);
     int64_t GetIndexForSample(int64_t sampleNum) const;
     Float SampleDimension(int64_t index, int dimension) const;
+    void SampleDimensions(const int64_t *indices, int n, int dimension,
+                          Float *samples) const;
     std::unique_ptr<Sampler> Clone(int seed);
 
   private:
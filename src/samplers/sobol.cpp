@@ -58,6 +58,22 @@ Float SobolSampler::SampleDimension(int64_t index, int dim) const {
     return s;
 }
 
+void SobolSampler::SampleDimensions(const int64_t *indices, int n, int dim,
+                                    Float *samples) const {
+    if (dim >= NumSobolDimensions) {
+        GlobalSampler::SampleDimensions(indices, n, dim, samples);
+        return;
+    }
+    SobolSample(indices, n, dim, samples);
+    // Remap Sobol$'$ dimensions used for pixel samples
+    if (dim == 0 || dim == 1) {
+        for (int i = 0; i < n; ++i) {
+            Float s = samples[i] * resolution + sampleBounds.pMin[dim];
+            samples[i] = Clamp(s - currentPixel[dim], (Float)0, OneMinusEpsilon);
+        }
+    }
+}
+
 std::unique_ptr<Sampler> SobolSampler::Clone(int seed) {
     return std::unique_ptr<Sampler>(new SobolSampler(*this));
 }
@@ -67,7 +83,8 @@ SobolSampler *CreateSobolSampler(const ParamSet &params,
     int nsamp = params.FindOneInt("pixelsamples", 16);
     LOG(INFO) << "CreateSobolSampler: pixelsamples = ["<< nsamp <<"]";
     if (PbrtOptions.quickRender) nsamp = 1;
-    return new SobolSampler(nsamp, sampleBounds);
+    int nPrecomputed = params.FindOneInt("precomputeddimensions", 32);
+    return new SobolSampler(nsamp, sampleBounds, nPrecomputed);
 }
 
 SobolSampler *CreateSobolSampler(
@@ -61,8 +61,9 @@ public:
 
     std::unique_ptr<Sampler> Clone(int seed);
 
-    SobolSampler(int64_t samplesPerPixel, const Bounds2i &sampleBounds)
-        : GlobalSampler(RoundUpPow2(samplesPerPixel)),
+    SobolSampler(int64_t samplesPerPixel, const Bounds2i &sampleBounds,
+                 int nPrecomputedDimensions = 0)
+        : GlobalSampler(RoundUpPow2(samplesPerPixel), nPrecomputedDimensions),
           sampleBounds(sampleBounds) {
         if (!IsPowerOf2(samplesPerPixel))
             Warning("Non power-of-two sample count rounded up to %" PRId64
@@ -82,6 +83,9 @@ public:
 
     Float SampleDimension(int64_t index, int dimension) const;
 
+    void SampleDimensions(const int64_t *indices, int n, int dimension,
+                          Float *samples) const;
+
 
 };
 
@@ -120,35 +120,38 @@ std::vector<std::shared_ptr<Shape>> CreateCurve(
     return segments;
 }
 
-Bounds3f Curve::ObjectBound() const {
-    // Compute object-space control points for curve segment, _cpObj_
-    Point3f cpObj[4];
+void Curve::ControlPoints(Point3f cpObj[4]) const {
     cpObj[0] = BlossomBezier(common->cpObj, uMin, uMin, uMin);
     cpObj[1] = BlossomBezier(common->cpObj, uMin, uMin, uMax);
     cpObj[2] = BlossomBezier(common->cpObj, uMin, uMax, uMax);
     cpObj[3] = BlossomBezier(common->cpObj, uMax, uMax, uMax);
+}
+
+Bounds3f Curve::ObjectBound() const {
+    // Compute object-space control points for curve segment, _cpObj_
+    Point3f cpObj[4];
+    ControlPoints(cpObj);
     Bounds3f b =
         Union(Bounds3f(cpObj[0], cpObj[1]), Bounds3f(cpObj[2], cpObj[3]));
-    Float width[2] = {Lerp(uMin, common->width[0], common->width[1]),
-                      Lerp(uMax, common->width[0], common->width[1])};
-    return Expand(b, std::max(width[0], width[1]) * 0.5f);
+    return Expand(b, MaxWidth() * 0.5f);
 }
 
 bool Curve::Intersect(const Ray &r, Float *tHit, SurfaceInteraction *isect,
                       bool testAlphaTexture) const {
+    // Compute object-space control points for curve segment, _cpObj_
+    Point3f cpObj[4];
+    ControlPoints(cpObj);
+    return IntersectSegment(r, cpObj, tHit, isect);
+}
+
+bool Curve::IntersectSegment(const Ray &r, const Point3f cpObj[4],
+                             Float *tHit, SurfaceInteraction *isect) const {
     ProfilePhase p(isect ? Prof::CurveIntersect : Prof::CurveIntersectP);
     ++nTests;
     // Transform _Ray_ to object space
     Vector3f oErr, dErr;
     Ray ray = (*WorldToObject)(r, &oErr, &dErr);
 
-    // Compute object-space control points for curve segment, _cpObj_
-    Point3f cpObj[4];
-    cpObj[0] = BlossomBezier(common->cpObj, uMin, uMin, uMin);
-    cpObj[1] = BlossomBezier(common->cpObj, uMin, uMin, uMax);
-    cpObj[2] = BlossomBezier(common->cpObj, uMin, uMax, uMax);
-    cpObj[3] = BlossomBezier(common->cpObj, uMax, uMax, uMax);
-
     // Project curve control points to plane perpendicular to ray
 
     // Be careful to set the "up" direction passed to LookAt() to equal the
@@ -177,8 +180,7 @@ bool Curve::Intersect(const Ray &r, Float *tHit, SurfaceInteraction *isect,
     // the curve's bounding box. We start with the y dimension, since the y
     // extent is generally the smallest (and is often tiny) due to our
     // careful orientation of the ray coordinate ysstem above.
-    Float maxWidth = std::max(Lerp(uMin, common->width[0], common->width[1]),
-                              Lerp(uMax, common->width[0], common->width[1]));
+    Float maxWidth = MaxWidth();
     if (std::max(std::max(cp[0].y, cp[1].y), std::max(cp[2].y, cp[3].y)) +
             0.5f * maxWidth < 0 ||
         std::min(std::min(cp[0].y, cp[1].y), std::min(cp[2].y, cp[3].y)) -
@@ -376,10 +378,7 @@ bool Curve::recursiveIntersect(const Ray &ray, Float *tHit,
 Float Curve::Area() const {
     // Compute object-space control points for curve segment, _cpObj_
     Point3f cpObj[4];
-    cpObj[0] = BlossomBezier(common->cpObj, uMin, uMin, uMin);
-    cpObj[1] = BlossomBezier(common->cpObj, uMin, uMin, uMax);
-    cpObj[2] = BlossomBezier(common->cpObj, uMin, uMax, uMax);
-    cpObj[3] = BlossomBezier(common->cpObj, uMax, uMax, uMax);
+    ControlPoints(cpObj);
     Float width0 = Lerp(uMin, common->width[0], common->width[1]);
     Float width1 = Lerp(uMax, common->width[0], common->width[1]);
     Float avgWidth = (width0 + width1) * 0.5f;
@@ -75,6 +75,18 @@ class Curve : public Shape {
     Float Area() const;
     Interaction Sample(const Point2f &u, Float *pdf) const;
 
+    // Returns the object-space Bezier control points of the curve's
+    // segment.
+    void ControlPoints(Point3f cpObj[4]) const;
+    Float MaxWidth() const {
+        return std::max(Lerp(uMin, common->width[0], common->width[1]),
+                        Lerp(uMax, common->width[0], common->width[1]));
+    }
+    // Intersect() for callers that have already computed the segment's
+    // control points with ControlPoints().
+    bool IntersectSegment(const Ray &ray, const Point3f cpObj[4], Float *tHit,
+                          SurfaceInteraction *isect) const;
+
   private:
     // Curve Private Methods
     bool recursiveIntersect(const Ray &r, Float *tHit,
@@ -126,6 +126,14 @@ Float Disk::Area() const {
     return phiMax * 0.5 * (radius * radius - innerRadius * innerRadius);
 }
 
+bool Disk::NormalBounds(Vector3f *w, Float *cosTheta) const {
+    Normal3f n = Normalize((*ObjectToWorld)(Normal3f(0, 0, 1)));
+    if (reverseOrientation) n *= -1;
+    *w = Vector3f(n);
+    *cosTheta = 1;
+    return true;
+}
+
 Interaction Disk::Sample(const Point2f &u, Float *pdf) const {
     Point2f pd = ConcentricSampleDisk(u);
     Point3f pObj(pd.x * radius, pd.y * radius, height);
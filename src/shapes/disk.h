@@ -60,6 +60,7 @@ class Disk : public Shape {
                    bool testAlphaTexture) const;
     bool IntersectP(const Ray &ray, bool testAlphaTexture) const;
     Float Area() const;
+    bool NormalBounds(Vector3f *w, Float *cosTheta) const;
     Interaction Sample(const Point2f &u, Float *pdf) const;
 
   private:
@@ -42,48 +42,69 @@ namespace pbrt {
 std::vector<std::shared_ptr<Shape>> CreateHeightfield(
     const Transform *ObjectToWorld, const Transform *WorldToObject,
     bool reverseOrientation, const ParamSet &params) {
+    Bounds3f worldBound;
+    ShapeTessellator tessellate = CreateHeightfieldTessellator(
+        ObjectToWorld, WorldToObject, reverseOrientation, params, &worldBound);
+    return tessellate();
+}
+
+ShapeTessellator CreateHeightfieldTessellator(const Transform *ObjectToWorld,
+                                              const Transform *WorldToObject,
+                                              bool reverseOrientation,
+                                              const ParamSet &params,
+                                              Bounds3f *worldBound) {
     int nx = params.FindOneInt("nu", -1);
     int ny = params.FindOneInt("nv", -1);
     int nitems;
-    const Float *z = params.FindFloat("Pz", &nitems);
+    const Float *zp = params.FindFloat("Pz", &nitems);
     CHECK_EQ(nitems, nx * ny);
-    CHECK(nx != -1 && ny != -1 && z != nullptr);
-
-    int ntris = 2 * (nx - 1) * (ny - 1);
-    std::unique_ptr<int[]> indices(new int[3 * ntris]);
-    std::unique_ptr<Point3f[]> P(new Point3f[nx * ny]);
-    std::unique_ptr<Point2f[]> uvs(new Point2f[nx * ny]);
-    int nverts = nx * ny;
-    // Compute heightfield vertex positions
-    int pos = 0;
-    for (int y = 0; y < ny; ++y) {
-        for (int x = 0; x < nx; ++x) {
-            P[pos].x = uvs[pos].x = (float)x / (float)(nx - 1);
-            P[pos].y = uvs[pos].y = (float)y / (float)(ny - 1);
-            P[pos].z = z[pos];
-            ++pos;
+    CHECK(nx != -1 && ny != -1 && zp != nullptr);
+    std::vector<Float> z(zp, zp + nitems);
+
+    // The heightfield spans $[0,1]^2$ in $x$ and $y$
+    Float zMin = *std::min_element(z.begin(), z.end());
+    Float zMax = *std::max_element(z.begin(), z.end());
+    *worldBound =
+        (*ObjectToWorld)(Bounds3f(Point3f(0, 0, zMin), Point3f(1, 1, zMax)));
+
+    return [=]() {
+        int ntris = 2 * (nx - 1) * (ny - 1);
+        std::unique_ptr<int[]> indices(new int[3 * ntris]);
+        std::unique_ptr<Point3f[]> P(new Point3f[nx * ny]);
+        std::unique_ptr<Point2f[]> uvs(new Point2f[nx * ny]);
+        int nverts = nx * ny;
+        // Compute heightfield vertex positions
+        int pos = 0;
+        for (int y = 0; y < ny; ++y) {
+            for (int x = 0; x < nx; ++x) {
+                P[pos].x = uvs[pos].x = (float)x / (float)(nx - 1);
+                P[pos].y = uvs[pos].y = (float)y / (float)(ny - 1);
+                P[pos].z = z[pos];
+                ++pos;
+            }
         }
-    }
 
-    // Fill in heightfield vertex offset array
-    int *vp = indices.get();
-    for (int y = 0; y < ny - 1; ++y) {
-        for (int x = 0; x < nx - 1; ++x) {
+        // Fill in heightfield vertex offset array
+        int *vp = indices.get();
+        for (int y = 0; y < ny - 1; ++y) {
+            for (int x = 0; x < nx - 1; ++x) {
 #define VERT(x, y) ((x) + (y)*nx)
-            *vp++ = VERT(x, y);
-            *vp++ = VERT(x + 1, y);
-            *vp++ = VERT(x + 1, y + 1);
-
-            *vp++ = VERT(x, y);
-            *vp++ = VERT(x + 1, y + 1);
-            *vp++ = VERT(x, y + 1);
-        }
+                *vp++ = VERT(x, y);
+                *vp++ = VERT(x + 1, y);
+                *vp++ = VERT(x + 1, y + 1);
+
+                *vp++ = VERT(x, y);
+                *vp++ = VERT(x + 1, y + 1);
+                *vp++ = VERT(x, y + 1);
+            }
 #undef VERT
-    }
+        }
 
-    return CreateTriangleMesh(ObjectToWorld, WorldToObject, reverseOrientation,
-                              ntris, indices.get(), nverts, P.get(), nullptr,
-                              nullptr, uvs.get(), nullptr, nullptr);
+        return CreateTriangleMesh(ObjectToWorld, WorldToObject,
+                                  reverseOrientation, ntris, indices.get(),
+                                  nverts, P.get(), nullptr, nullptr, uvs.get(),
+                                  nullptr, nullptr);
+    };
 }
 
 }  // namespace pbrt
@@ -48,6 +48,12 @@ std::vector<std::shared_ptr<Shape>> CreateHeightfield(const Transform *o2w,
                                                       const Transform *w2o,
                                                       bool ro,
                                                       const ParamSet &params);
+// Returns a function that creates the heightfield's triangles and sets
+// _*worldBound_ to bounds that they'll lie within.
+ShapeTessellator CreateHeightfieldTessellator(const Transform *o2w,
+                                              const Transform *w2o, bool ro,
+                                              const ParamSet &params,
+                                              Bounds3f *worldBound);
 
 }  // namespace pbrt
 
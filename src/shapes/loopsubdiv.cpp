@@ -403,6 +403,18 @@ std::vector<std::shared_ptr<Shape>> CreateLoopSubdiv(const Transform *o2w,
                                                      const Transform *w2o,
                                                      bool reverseOrientation,
                                                      const ParamSet &params) {
+    Bounds3f worldBound;
+    ShapeTessellator tessellate = CreateLoopSubdivTessellator(
+        o2w, w2o, reverseOrientation, params, &worldBound);
+    if (!tessellate) return std::vector<std::shared_ptr<Shape>>();
+    return tessellate();
+}
+
+ShapeTessellator CreateLoopSubdivTessellator(const Transform *o2w,
+                                             const Transform *w2o,
+                                             bool reverseOrientation,
+                                             const ParamSet &params,
+                                             Bounds3f *worldBound) {
     int nLevels = params.FindOneInt("levels",
                                     params.FindOneInt("nlevels", 3));
     int nps, nIndices;
@@ -410,17 +422,28 @@ std::vector<std::shared_ptr<Shape>> CreateLoopSubdiv(const Transform *o2w,
     const Point3f *P = params.FindPoint3f("P", &nps);
     if (!vertexIndices) {
         Error("Vertex indices \"indices\" not provided for LoopSubdiv shape.");
-        return std::vector<std::shared_ptr<Shape>>();
+        return nullptr;
     }
     if (!P) {
         Error("Vertex positions \"P\" not provided for LoopSubdiv shape.");
-        return std::vector<std::shared_ptr<Shape>>();
+        return nullptr;
     }
 
     // don't actually use this for now...
     std::string scheme = params.FindOneString("scheme", "loop");
-    return LoopSubdivide(o2w, w2o, reverseOrientation, nLevels, nIndices,
-                         vertexIndices, nps, P);
+
+    // Loop subdivision only takes convex combinations of vertex positions,
+    // so the limit surface lies within the control points' bounds.
+    Bounds3f objectBound;
+    for (int i = 0; i < nps; ++i) objectBound = Union(objectBound, P[i]);
+    *worldBound = (*o2w)(objectBound);
+
+    std::vector<int> indices(vertexIndices, vertexIndices + nIndices);
+    std::vector<Point3f> p(P, P + nps);
+    return [=]() {
+        return LoopSubdivide(o2w, w2o, reverseOrientation, nLevels, nIndices,
+                             indices.data(), nps, p.data());
+    };
 }
 
 static Point3f weightOneRing(SDVertex *vert, Float beta) {
@@ -48,6 +48,14 @@ std::vector<std::shared_ptr<Shape>> CreateLoopSubdiv(const Transform *o2w,
                                                      const Transform *w2o,
                                                      bool reverseOrientation,
                                                      const ParamSet &params);
+// Returns a function that subdivides the surface into triangles and sets
+// _*worldBound_ to bounds that they'll lie within, or returns an empty
+// function if the parameters are invalid.
+ShapeTessellator CreateLoopSubdivTessellator(const Transform *o2w,
+                                             const Transform *w2o,
+                                             bool reverseOrientation,
+                                             const ParamSet &params,
+                                             Bounds3f *worldBound);
 
 }  // namespace pbrt
 
@@ -35,13 +35,27 @@
 #include "shapes/triangle.h"
 #include "textures/constant.h"
 #include "paramset.h"
+#include "parallel.h"
+#include "stats.h"
 #include "ext/rply.h"
 
+#include <atomic>
 #include <iostream>
+#include <sstream>
+#ifdef PBRT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif  // PBRT_HAVE_MMAP
 
 namespace pbrt {
 using namespace std;
 
+STAT_COUNTER("Scene/PLY files read natively", nNativePlyFiles);
+STAT_COUNTER("Scene/PLY files read via rply", nRplyFiles);
+
 struct CallbackContext {
     Point3f *p;
     Normal3f *n;
@@ -154,20 +168,401 @@ int rply_face_callback(p_ply_argument argument) {
     return 1;
 }
 
-std::vector<std::shared_ptr<Shape>> CreatePLYMesh(
-    const Transform *o2w, const Transform *w2o, bool reverseOrientation,
-    const ParamSet &params,
-    std::map<std::string, std::shared_ptr<Texture<Float>>> *floatTextures) {
-    const std::string filename = params.FindOneFilename("filename", "");
+#ifdef PBRT_HAVE_MMAP
+// Native Binary PLY Reader Declarations
+
+// Binary little-endian PLY files with a fixed per-element layout (which
+// covers nearly every large mesh we see in practice) are decoded directly
+// from a memory-mapped view of the file, in parallel, rather than through
+// rply's per-scalar callbacks.  Anything else falls back to rply.
+enum class PlyType {
+    Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Invalid
+};
+
+struct PlyProperty {
+    std::string name;
+    PlyType type = PlyType::Invalid;
+    bool isList = false;
+    PlyType countType = PlyType::Invalid;
+    // Byte offset of the property from the start of its element record;
+    // only meaningful for elements with a fixed layout.
+    int offset = 0;
+};
+
+struct PlyElement {
+    std::string name;
+    int64_t count = 0;
+    std::vector<PlyProperty> properties;
+};
+
+static PlyType PlyTypeFromString(const std::string &s) {
+    if (s == "char" || s == "int8") return PlyType::Int8;
+    if (s == "uchar" || s == "uint8") return PlyType::UInt8;
+    if (s == "short" || s == "int16") return PlyType::Int16;
+    if (s == "ushort" || s == "uint16") return PlyType::UInt16;
+    if (s == "int" || s == "int32") return PlyType::Int32;
+    if (s == "uint" || s == "uint32") return PlyType::UInt32;
+    if (s == "float" || s == "float32") return PlyType::Float32;
+    if (s == "double" || s == "float64") return PlyType::Float64;
+    return PlyType::Invalid;
+}
+
+static int PlyTypeSize(PlyType type) {
+    switch (type) {
+    case PlyType::Int8:
+    case PlyType::UInt8:
+        return 1;
+    case PlyType::Int16:
+    case PlyType::UInt16:
+        return 2;
+    case PlyType::Int32:
+    case PlyType::UInt32:
+    case PlyType::Float32:
+        return 4;
+    case PlyType::Float64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+template <typename T>
+inline T LoadUnaligned(const uint8_t *ptr) {
+    T v;
+    memcpy(&v, ptr, sizeof(T));
+    return v;
+}
+
+inline double ReadPlyValue(const uint8_t *ptr, PlyType type) {
+    switch (type) {
+    case PlyType::Int8:
+        return LoadUnaligned<int8_t>(ptr);
+    case PlyType::UInt8:
+        return LoadUnaligned<uint8_t>(ptr);
+    case PlyType::Int16:
+        return LoadUnaligned<int16_t>(ptr);
+    case PlyType::UInt16:
+        return LoadUnaligned<uint16_t>(ptr);
+    case PlyType::Int32:
+        return LoadUnaligned<int32_t>(ptr);
+    case PlyType::UInt32:
+        return LoadUnaligned<uint32_t>(ptr);
+    case PlyType::Float32:
+        return LoadUnaligned<float>(ptr);
+    case PlyType::Float64:
+        return LoadUnaligned<double>(ptr);
+    default:
+        LOG(FATAL) << "Unexpected PLY type";
+        return 0;
+    }
+}
+
+inline int64_t ReadPlyInt(const uint8_t *ptr, PlyType type) {
+    switch (type) {
+    case PlyType::Int8:
+        return LoadUnaligned<int8_t>(ptr);
+    case PlyType::UInt8:
+        return LoadUnaligned<uint8_t>(ptr);
+    case PlyType::Int16:
+        return LoadUnaligned<int16_t>(ptr);
+    case PlyType::UInt16:
+        return LoadUnaligned<uint16_t>(ptr);
+    case PlyType::Int32:
+        return LoadUnaligned<int32_t>(ptr);
+    case PlyType::UInt32:
+        return LoadUnaligned<uint32_t>(ptr);
+    default:
+        // Float-typed indices are legal PLY, if unusual.
+        return (int64_t)ReadPlyValue(ptr, type);
+    }
+}
+
+// Returns the size in bytes of a record of _elem_ if all of its properties
+// are scalars, and -1 otherwise.
+static int FixedRecordSize(PlyElement &elem) {
+    int size = 0;
+    for (PlyProperty &prop : elem.properties) {
+        if (prop.isList) return -1;
+        prop.offset = size;
+        size += PlyTypeSize(prop.type);
+    }
+    return size;
+}
+
+static const PlyProperty *FindProperty(const PlyElement &elem,
+                                       const char *name) {
+    for (const PlyProperty &prop : elem.properties)
+        if (prop.name == name) return &prop;
+    return nullptr;
+}
+
+// Attempts to read _filename_ with the native reader. Returns false if
+// the file can't be handled here, in which case the caller should fall
+// back to rply; note that this includes I/O errors, so that rply gets a
+// chance to report them. On success, _context_ holds the mesh and its
+// _error_ member records whether the mesh data itself was invalid.
+static bool ReadBinaryPLY(const std::string &filename,
+                          CallbackContext *context) {
+    if (!HostIsLittleEndian()) return false;
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+    struct stat stat;
+    if (fstat(fd, &stat) != 0) {
+        close(fd);
+        return false;
+    }
+    size_t len = stat.st_size;
+    void *ptr = len > 0 ? mmap(0, len, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0)
+                        : MAP_FAILED;
+    close(fd);
+    if (ptr == MAP_FAILED) return false;
+
+    // Make sure the mapping is released however we leave this function.
+    struct Unmapper {
+        void *ptr;
+        size_t len;
+        ~Unmapper() {
+            if (munmap(ptr, len) != 0)
+                Warning("munmap: %s", strerror(errno));
+        }
+    } unmapper{ptr, len};
+    const uint8_t *data = (const uint8_t *)ptr;
+
+    // Parse the PLY header
+    const char *endHeader = "end_header";
+    const char *headerStart = (const char *)data;
+    const char *headerEnd = nullptr;
+    for (size_t i = 0; i + strlen(endHeader) < len; ++i)
+        if ((i == 0 || headerStart[i - 1] == '\n') &&
+            strncmp(headerStart + i, endHeader, strlen(endHeader)) == 0) {
+            headerEnd = headerStart + i + strlen(endHeader);
+            break;
+        }
+    if (!headerEnd) return false;
+    // Skip the remainder of the end_header line.
+    while ((const uint8_t *)headerEnd < data + len && *headerEnd != '\n')
+        ++headerEnd;
+    if ((const uint8_t *)headerEnd == data + len) return false;
+    ++headerEnd;
+
+    std::istringstream header(std::string(headerStart, headerEnd));
+    std::string line;
+    std::vector<PlyElement> elements;
+    bool sawFormat = false;
+    while (std::getline(header, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        std::istringstream tokens(line);
+        std::string keyword;
+        tokens >> keyword;
+        if (keyword == "format") {
+            std::string format;
+            tokens >> format;
+            if (format != "binary_little_endian") return false;
+            sawFormat = true;
+        } else if (keyword == "element") {
+            PlyElement elem;
+            if (!(tokens >> elem.name >> elem.count) || elem.count < 0)
+                return false;
+            elements.push_back(elem);
+        } else if (keyword == "property") {
+            if (elements.empty()) return false;
+            PlyProperty prop;
+            std::string type;
+            tokens >> type;
+            if (type == "list") {
+                std::string countType, indexType;
+                tokens >> countType >> indexType;
+                prop.isList = true;
+                prop.countType = PlyTypeFromString(countType);
+                prop.type = PlyTypeFromString(indexType);
+                if (prop.countType == PlyType::Invalid) return false;
+            } else
+                prop.type = PlyTypeFromString(type);
+            if (!(tokens >> prop.name) || prop.type == PlyType::Invalid)
+                return false;
+            elements.back().properties.push_back(prop);
+        }
+        // "ply", "comment", "obj_info" and "end_header" are ignored.
+    }
+    if (!sawFormat) return false;
+
+    // Locate the vertex and face records; any elements that precede them
+    // must have a fixed layout so that they can be skipped.
+    const uint8_t *dataEnd = data + len;
+    const uint8_t *pos = (const uint8_t *)headerEnd;
+    PlyElement *vertexElem = nullptr, *faceElem = nullptr;
+    const uint8_t *vertexData = nullptr, *faceData = nullptr;
+    int vertexStride = 0;
+    for (PlyElement &elem : elements) {
+        if (elem.name == "face") {
+            faceElem = &elem;
+            faceData = pos;
+            break;
+        }
+        int recordSize = FixedRecordSize(elem);
+        if (recordSize < 0) return false;
+        if (elem.name == "vertex") {
+            vertexElem = &elem;
+            vertexData = pos;
+            vertexStride = recordSize;
+        }
+        if ((uint64_t)(dataEnd - pos) < (uint64_t)elem.count * recordSize)
+            return false;
+        pos += elem.count * recordSize;
+    }
+    // Let rply diagnose files that are missing the elements we need.
+    if (!vertexElem || !faceElem || vertexElem->count == 0 ||
+        faceElem->count == 0)
+        return false;
+
+    // The face element must be a single list of vertex indices followed
+    // by optional scalars; the length of the first list determines the
+    // layout that every face has to follow.
+    if (faceElem->properties.empty() || !faceElem->properties[0].isList)
+        return false;
+    const PlyProperty &indexList = faceElem->properties[0];
+    if (indexList.name != "vertex_indices" && indexList.name != "vertex_index")
+        return false;
+    int countSize = PlyTypeSize(indexList.countType);
+    int indexSize = PlyTypeSize(indexList.type);
+    if (dataEnd - faceData < countSize) return false;
+    int64_t verticesPerFace = ReadPlyInt(faceData, indexList.countType);
+    if (verticesPerFace != 3 && verticesPerFace != 4) return false;
+    int faceStride = countSize + verticesPerFace * indexSize;
+    const PlyProperty *faceIndexProp = nullptr;
+    for (size_t i = 1; i < faceElem->properties.size(); ++i) {
+        PlyProperty &prop = faceElem->properties[i];
+        if (prop.isList) return false;
+        prop.offset = faceStride;
+        faceStride += PlyTypeSize(prop.type);
+        if (prop.name == "face_indices") faceIndexProp = &prop;
+    }
+    // Face indices are not supported for quads by the rply path either.
+    if (faceIndexProp && verticesPerFace == 4) return false;
+    if ((uint64_t)(dataEnd - faceData) <
+        (uint64_t)faceElem->count * faceStride)
+        return false;
+
+    // Find vertex properties, following the rply path's UV name conventions
+    const PlyProperty *px = FindProperty(*vertexElem, "x");
+    const PlyProperty *py = FindProperty(*vertexElem, "y");
+    const PlyProperty *pz = FindProperty(*vertexElem, "z");
+    if (!px || !py || !pz) return false;
+    const PlyProperty *nx = FindProperty(*vertexElem, "nx");
+    const PlyProperty *ny = FindProperty(*vertexElem, "ny");
+    const PlyProperty *nz = FindProperty(*vertexElem, "nz");
+    bool hasNormals = nx && ny && nz;
+    const PlyProperty *pu = nullptr, *pv = nullptr;
+    const char *uvNames[][2] = {{"u", "v"},
+                                {"s", "t"},
+                                {"texture_u", "texture_v"},
+                                {"texture_s", "texture_t"}};
+    for (const auto &names : uvNames) {
+        pu = FindProperty(*vertexElem, names[0]);
+        pv = FindProperty(*vertexElem, names[1]);
+        if (pu && pv) break;
+    }
+    bool hasUV = pu && pv;
+
+    // Allocate the mesh arrays
+    int64_t vertexCount = vertexElem->count, faceCount = faceElem->count;
+    if (vertexCount > std::numeric_limits<int>::max() ||
+        faceCount * 6 > std::numeric_limits<int>::max())
+        return false;
+    context->vertexCount = vertexCount;
+    context->p = new Point3f[vertexCount];
+    if (hasNormals) context->n = new Normal3f[vertexCount];
+    if (hasUV) context->uv = new Point2f[vertexCount];
+    int indicesPerFace = verticesPerFace == 4 ? 6 : 3;
+    context->indices = new int[faceCount * indicesPerFace];
+    if (faceIndexProp) context->faceIndices = new int[faceCount];
+
+    // Decode vertex and face records in parallel chunks
+    const int64_t chunkSize = 16384;
+    int64_t nVertexChunks = (vertexCount + chunkSize - 1) / chunkSize;
+    int64_t nFaceChunks = (faceCount + chunkSize - 1) / chunkSize;
+    std::atomic<bool> layoutMismatch{false}, indexError{false};
+    ParallelFor([&](int64_t chunk) {
+        if (chunk < nVertexChunks) {
+            int64_t start = chunk * chunkSize;
+            int64_t end = std::min(start + chunkSize, vertexCount);
+            for (int64_t i = start; i < end; ++i) {
+                const uint8_t *rec = vertexData + i * vertexStride;
+                context->p[i] = Point3f(ReadPlyValue(rec + px->offset, px->type),
+                                        ReadPlyValue(rec + py->offset, py->type),
+                                        ReadPlyValue(rec + pz->offset, pz->type));
+                if (hasNormals)
+                    context->n[i] =
+                        Normal3f(ReadPlyValue(rec + nx->offset, nx->type),
+                                 ReadPlyValue(rec + ny->offset, ny->type),
+                                 ReadPlyValue(rec + nz->offset, nz->type));
+                if (hasUV)
+                    context->uv[i] =
+                        Point2f(ReadPlyValue(rec + pu->offset, pu->type),
+                                ReadPlyValue(rec + pv->offset, pv->type));
+            }
+        } else {
+            int64_t start = (chunk - nVertexChunks) * chunkSize;
+            int64_t end = std::min(start + chunkSize, faceCount);
+            for (int64_t i = start; i < end; ++i) {
+                const uint8_t *rec = faceData + i * faceStride;
+                if (ReadPlyInt(rec, indexList.countType) != verticesPerFace) {
+                    layoutMismatch = true;
+                    return;
+                }
+                int v[4];
+                for (int j = 0; j < verticesPerFace; ++j) {
+                    int64_t value = ReadPlyInt(
+                        rec + countSize + j * indexSize, indexList.type);
+                    if (value < 0 || value >= vertexCount) {
+                        if (!indexError.exchange(true))
+                            Error("plymesh: Vertex reference %d is out of "
+                                  "bounds! Valid range is [0..%d)",
+                                  (int)value, (int)vertexCount);
+                        value = 0;
+                    }
+                    v[j] = value;
+                }
+                int *indices = context->indices + i * indicesPerFace;
+                indices[0] = v[0];
+                indices[1] = v[1];
+                indices[2] = v[2];
+                if (verticesPerFace == 4) {
+                    indices[3] = v[3];
+                    indices[4] = v[0];
+                    indices[5] = v[2];
+                }
+                if (faceIndexProp)
+                    context->faceIndices[i] = ReadPlyInt(
+                        rec + faceIndexProp->offset, faceIndexProp->type);
+            }
+        }
+    }, nVertexChunks + nFaceChunks);
+
+    // Mixed triangles and quads; let rply handle the variable layout.
+    if (layoutMismatch) return false;
+    context->indexCtr = faceCount * indicesPerFace;
+    context->faceIndexCtr = faceIndexProp ? faceCount : 0;
+    context->error = indexError;
+    return true;
+}
+#endif  // PBRT_HAVE_MMAP
+
+// Reads _filename_ through rply's callback interface, which handles ASCII
+// and big-endian files as well as variable face layouts. Returns false
+// (after reporting the error) if the file couldn't be read.
+static bool ReadPLYWithRply(const std::string &filename,
+                            CallbackContext *context) {
     p_ply ply = ply_open(filename.c_str(), rply_message_callback, 0, nullptr);
     if (!ply) {
         Error("Couldn't open PLY file \"%s\"", filename.c_str());
-        return std::vector<std::shared_ptr<Shape>>();
+        return false;
     }
 
     if (!ply_read_header(ply)) {
         Error("Unable to read the header of PLY file \"%s\"", filename.c_str());
-        return std::vector<std::shared_ptr<Shape>>();
+        return false;
     }
 
     p_ply_element element = nullptr;
@@ -188,73 +583,95 @@ std::vector<std::shared_ptr<Shape>> CreatePLYMesh(
     if (vertexCount == 0 || faceCount == 0) {
         Error("%s: PLY file is invalid! No face/vertex elements found!",
               filename.c_str());
-        return std::vector<std::shared_ptr<Shape>>();
+        return false;
     }
 
-    CallbackContext context;
-
-    if (ply_set_read_cb(ply, "vertex", "x", rply_vertex_callback, &context,
+    if (ply_set_read_cb(ply, "vertex", "x", rply_vertex_callback, context,
                         0x030) &&
-        ply_set_read_cb(ply, "vertex", "y", rply_vertex_callback, &context,
+        ply_set_read_cb(ply, "vertex", "y", rply_vertex_callback, context,
                         0x031) &&
-        ply_set_read_cb(ply, "vertex", "z", rply_vertex_callback, &context,
+        ply_set_read_cb(ply, "vertex", "z", rply_vertex_callback, context,
                         0x032)) {
-        context.p = new Point3f[vertexCount];
+        context->p = new Point3f[vertexCount];
     } else {
         Error("%s: Vertex coordinate property not found!",
               filename.c_str());
-        return std::vector<std::shared_ptr<Shape>>();
+        return false;
     }
 
-    if (ply_set_read_cb(ply, "vertex", "nx", rply_vertex_callback, &context,
+    if (ply_set_read_cb(ply, "vertex", "nx", rply_vertex_callback, context,
                         0x130) &&
-        ply_set_read_cb(ply, "vertex", "ny", rply_vertex_callback, &context,
+        ply_set_read_cb(ply, "vertex", "ny", rply_vertex_callback, context,
                         0x131) &&
-        ply_set_read_cb(ply, "vertex", "nz", rply_vertex_callback, &context,
+        ply_set_read_cb(ply, "vertex", "nz", rply_vertex_callback, context,
                         0x132))
-        context.n = new Normal3f[vertexCount];
+        context->n = new Normal3f[vertexCount];
 
     /* There seem to be lots of different conventions regarding UV coordinate
      * names */
-    if ((ply_set_read_cb(ply, "vertex", "u", rply_vertex_callback, &context,
+    if ((ply_set_read_cb(ply, "vertex", "u", rply_vertex_callback, context,
                          0x220) &&
-         ply_set_read_cb(ply, "vertex", "v", rply_vertex_callback, &context,
+         ply_set_read_cb(ply, "vertex", "v", rply_vertex_callback, context,
                          0x221)) ||
-        (ply_set_read_cb(ply, "vertex", "s", rply_vertex_callback, &context,
+        (ply_set_read_cb(ply, "vertex", "s", rply_vertex_callback, context,
                          0x220) &&
-         ply_set_read_cb(ply, "vertex", "t", rply_vertex_callback, &context,
+         ply_set_read_cb(ply, "vertex", "t", rply_vertex_callback, context,
                          0x221)) ||
         (ply_set_read_cb(ply, "vertex", "texture_u", rply_vertex_callback,
-                         &context, 0x220) &&
+                         context, 0x220) &&
          ply_set_read_cb(ply, "vertex", "texture_v", rply_vertex_callback,
-                         &context, 0x221)) ||
+                         context, 0x221)) ||
         (ply_set_read_cb(ply, "vertex", "texture_s", rply_vertex_callback,
-                         &context, 0x220) &&
+                         context, 0x220) &&
          ply_set_read_cb(ply, "vertex", "texture_t", rply_vertex_callback,
-                         &context, 0x221)))
-        context.uv = new Point2f[vertexCount];
+                         context, 0x221)))
+        context->uv = new Point2f[vertexCount];
 
     /* Allocate enough space in case all faces are quads */
-    context.indices = new int[faceCount * 6];
-    context.vertexCount = vertexCount;
+    context->indices = new int[faceCount * 6];
+    context->vertexCount = vertexCount;
 
-    ply_set_read_cb(ply, "face", "vertex_indices", rply_face_callback, &context,
+    ply_set_read_cb(ply, "face", "vertex_indices", rply_face_callback, context,
                     0);
-    if (ply_set_read_cb(ply, "face", "face_indices", rply_face_callback, &context,
+    if (ply_set_read_cb(ply, "face", "face_indices", rply_face_callback, context,
                         1))
         // Extra space in case they're quads
-        context.faceIndices = new int[faceCount];
+        context->faceIndices = new int[faceCount];
 
     if (!ply_read(ply)) {
         Error("%s: unable to read the contents of PLY file",
               filename.c_str());
         ply_close(ply);
-        return std::vector<std::shared_ptr<Shape>>();
+        return false;
     }
 
     ply_close(ply);
+    return true;
+}
+
+std::vector<std::shared_ptr<Shape>> CreatePLYMesh(
+    const Transform *o2w, const Transform *w2o, bool reverseOrientation,
+    const ParamSet &params,
+    std::map<std::string, std::shared_ptr<Texture<Float>>> *floatTextures) {
+    const std::string filename = params.FindOneFilename("filename", "");
+
+    std::unique_ptr<CallbackContext> context(new CallbackContext);
+    bool readNatively = false;
+#ifdef PBRT_HAVE_MMAP
+    readNatively = ReadBinaryPLY(filename, context.get());
+#endif
+    if (readNatively)
+        ++nNativePlyFiles;
+    else {
+        // Start over with a clean context in case the native reader gave
+        // up partway through.
+        context.reset(new CallbackContext);
+        if (!ReadPLYWithRply(filename, context.get()))
+            return std::vector<std::shared_ptr<Shape>>();
+        ++nRplyFiles;
+    }
 
-    if (context.error) return std::vector<std::shared_ptr<Shape>>();
+    if (context->error) return std::vector<std::shared_ptr<Shape>>();
 
     // Look up an alpha texture, if applicable
     std::shared_ptr<Texture<Float>> alphaTex;
@@ -283,10 +700,10 @@ std::vector<std::shared_ptr<Shape>> CreatePLYMesh(
         shadowAlphaTex.reset(new ConstantTexture<Float>(0.f));
 
     return CreateTriangleMesh(o2w, w2o, reverseOrientation,
-                              context.indexCtr / 3, context.indices,
-                              vertexCount, context.p, nullptr, context.n,
-                              context.uv, alphaTex, shadowAlphaTex,
-                              context.faceIndices);
+                              context->indexCtr / 3, context->indices,
+                              context->vertexCount, context->p, nullptr,
+                              context->n, context->uv, alphaTex, shadowAlphaTex,
+                              context->faceIndices);
 }
 
 }  // namespace pbrt
@@ -51,6 +51,8 @@ static void PlyErrorCallback(p_ply, const char *message) {
 
 // Triangle Method Definitions
 STAT_RATIO("Scene/Triangles per triangle mesh", nTris, nMeshes);
+PBRT_THREAD_LOCAL bool CountTriangleMeshStats = true;
+
 TriangleMesh::TriangleMesh(
     const Transform &ObjectToWorld, int nTriangles, const int *vertexIndices,
     int nVertices, const Point3f *P, const Vector3f *S, const Normal3f *N,
@@ -62,12 +64,15 @@ TriangleMesh::TriangleMesh(
       vertexIndices(vertexIndices, vertexIndices + 3 * nTriangles),
       alphaMask(alphaMask),
       shadowAlphaMask(shadowAlphaMask) {
-    ++nMeshes;
-    nTris += nTriangles;
-    triMeshBytes += sizeof(*this) + this->vertexIndices.size() * sizeof(int) +
-                    nVertices * (sizeof(*P) + (N ? sizeof(*N) : 0) +
-                                 (S ? sizeof(*S) : 0) + (UV ? sizeof(*UV) : 0) +
-                                 (fIndices ? sizeof(*fIndices) : 0));
+    if (CountTriangleMeshStats) {
+        ++nMeshes;
+        nTris += nTriangles;
+        triMeshBytes +=
+            sizeof(*this) + this->vertexIndices.size() * sizeof(int) +
+            nVertices * (sizeof(*P) + (N ? sizeof(*N) : 0) +
+                         (S ? sizeof(*S) : 0) + (UV ? sizeof(*UV) : 0) +
+                         (fIndices ? sizeof(*fIndices) : 0));
+    }
 
     // Transform mesh vertices to world space
     p.reset(new Point3f[nVertices]);
@@ -551,6 +556,29 @@ Float Triangle::Area() const {
     return 0.5 * Cross(p1 - p0, p2 - p0).Length();
 }
 
+bool Triangle::NormalBounds(Vector3f *w, Float *cosTheta) const {
+    // Orient the geometric normal as Triangle::Sample() does; with
+    // per-vertex normals the orientation is only known if all three agree.
+    const Point3f &p0 = mesh->p[v[0]];
+    const Point3f &p1 = mesh->p[v[1]];
+    const Point3f &p2 = mesh->p[v[2]];
+    Vector3f n = Cross(p1 - p0, p2 - p0);
+    if (n.LengthSquared() == 0) return false;
+    n = Normalize(n);
+    if (mesh->n) {
+        Float d0 = Dot(n, mesh->n[v[0]]), d1 = Dot(n, mesh->n[v[1]]),
+              d2 = Dot(n, mesh->n[v[2]]);
+        if (d0 < 0 && d1 < 0 && d2 < 0)
+            n = -n;
+        else if (d0 < 0 || d1 < 0 || d2 < 0)
+            return false;
+    } else if (reverseOrientation ^ transformSwapsHandedness)
+        n = -n;
+    *w = n;
+    *cosTheta = 1;
+    return true;
+}
+
 Interaction Triangle::Sample(const Point2f &u, Float *pdf) const {
     Point2f b = UniformSampleTriangle(u);
     // Get triangle vertices in _p0_, _p1_, and _p2_
@@ -47,6 +47,11 @@ namespace pbrt {
 
 STAT_MEMORY_COUNTER("Memory/Triangle meshes", triMeshBytes);
 
+// Triangles and meshes created on a thread while this is false aren't
+// counted in the statistics; the GeometryCache clears it while it
+// re-creates the triangles of a shape whose tessellation it freed.
+extern PBRT_THREAD_LOCAL bool CountTriangleMeshStats;
+
 // Triangle Declarations
 struct TriangleMesh {
     // TriangleMesh Public Methods
@@ -76,7 +81,7 @@ class Triangle : public Shape {
              int triNumber)
         : Shape(ObjectToWorld, WorldToObject, reverseOrientation), mesh(mesh) {
         v = &mesh->vertexIndices[3 * triNumber];
-        triMeshBytes += sizeof(*this);
+        if (CountTriangleMeshStats) triMeshBytes += sizeof(*this);
         faceIndex = mesh->faceIndices.size() ? mesh->faceIndices[triNumber] : 0;
     }
     Bounds3f ObjectBound() const;
@@ -92,6 +97,7 @@ class Triangle : public Shape {
     // Returns the solid angle subtended by the triangle w.r.t. the given
     // reference point p.
     Float SolidAngle(const Point3f &p, int nSamples = 0) const;
+    bool NormalBounds(Vector3f *w, Float *cosTheta) const;
 
   private:
     // Triangle Private Methods
@@ -1,6 +1,9 @@
 
 #include "tests/gtest/gtest.h"
 #include "pbrt.h"
+#include <map>
+#include <mutex>
+#include <set>
 
 #include "accelerators/bvh.h"
 #include "api.h"
@@ -15,6 +18,7 @@
 #include "integrators/mlt.h"
 #include "integrators/path.h"
 #include "integrators/volpath.h"
+#include "integrators/wavefront.h"
 #include "lights/diffuse.h"
 #include "lights/point.h"
 #include "materials/matte.h"
@@ -313,6 +317,48 @@ std::vector<TestIntegrator> GetIntegrators() {
                                    scene});
         }
 
+        // Path tracing with the light BVH light distribution
+        for (auto sampler : GetSamplers(Bounds2i(Point2i(0, 0), resolution))) {
+            std::unique_ptr<Filter> filter(new BoxFilter(Vector2f(0.5, 0.5)));
+            Film *film =
+                new Film(resolution, Bounds2f(Point2f(0, 0), Point2f(1, 1)),
+                         std::move(filter), 1., inTestDir("test.exr"), 1.);
+            std::shared_ptr<Camera> camera =
+                std::make_shared<PerspectiveCamera>(
+                    identity, Bounds2f(Point2f(-1, -1), Point2f(1, 1)), 0., 1.,
+                    0., 10., 45, film, nullptr);
+
+            Integrator *integrator =
+                new PathIntegrator(8, camera, sampler.first,
+                                   film->croppedPixelBounds, 1, "lightbvh");
+            integrators.push_back({integrator, film,
+                                   "Path, depth 8, Perspective, light BVH, " +
+                                       sampler.second + ", " +
+                                       scene.description,
+                                   scene});
+        }
+
+        // Wavefront path tracing integrators
+        for (auto sampler : GetSamplers(Bounds2i(Point2i(0, 0), resolution))) {
+            std::unique_ptr<Filter> filter(new BoxFilter(Vector2f(0.5, 0.5)));
+            Film *film =
+                new Film(resolution, Bounds2f(Point2f(0, 0), Point2f(1, 1)),
+                         std::move(filter), 1., inTestDir("test.exr"), 1.);
+            std::shared_ptr<Camera> camera =
+                std::make_shared<PerspectiveCamera>(
+                    identity, Bounds2f(Point2f(-1, -1), Point2f(1, 1)), 0., 1.,
+                    0., 10., 45, film, nullptr);
+
+            Integrator *integrator =
+                new WavefrontPathIntegrator(8, camera, sampler.first,
+                                            film->croppedPixelBounds);
+            integrators.push_back({integrator, film,
+                                   "Wavefront, depth 8, Perspective, " +
+                                       sampler.second + ", " +
+                                       scene.description,
+                                   scene});
+        }
+
         // Volume path tracing integrators
         for (auto sampler : GetSamplers(Bounds2i(Point2i(0, 0), resolution))) {
             std::unique_ptr<Filter> filter(new BoxFilter(Vector2f(0.5, 0.5)));
@@ -438,3 +484,54 @@ TEST_P(RenderTest, RadianceMatches) {
 
 INSTANTIATE_TEST_CASE_P(AnalyticTestScenes, RenderTest,
                         testing::ValuesIn(GetIntegrators()));
+
+// Records the first 1D sample of every camera ray, indexed by sample number.
+class SampleRecordingIntegrator : public SamplerIntegrator {
+  public:
+    SampleRecordingIntegrator(std::shared_ptr<const Camera> camera,
+                              std::shared_ptr<Sampler> sampler,
+                              const Bounds2i &pixelBounds)
+        : SamplerIntegrator(camera, sampler, pixelBounds) {}
+    Spectrum Li(const RayDifferential &ray, const Scene &scene,
+                Sampler &sampler, MemoryArena &arena, int depth) const {
+        Float u = sampler.Get1D();
+        std::lock_guard<std::mutex> lock(mutex);
+        samples[sampler.CurrentSampleNumber()].push_back(u);
+        return Spectrum(0.f);
+    }
+
+    mutable std::mutex mutex;
+    mutable std::map<int64_t, std::vector<Float>> samples;
+};
+
+TEST(ProgressiveRender, RoundsUseDifferentRandomSamples) {
+    Options options;
+    options.quiet = true;
+    options.progressive = true;
+    pbrtInit(options);
+
+    Point2i resolution(10, 10);
+    AnimatedTransform identity(new Transform, 0, new Transform, 1);
+    std::unique_ptr<Filter> filter(new BoxFilter(Vector2f(0.5, 0.5)));
+    Film *film = new Film(resolution, Bounds2f(Point2f(0, 0), Point2f(1, 1)),
+                          std::move(filter), 1., inTestDir("test.exr"), 1.);
+    std::shared_ptr<Camera> camera = std::make_shared<PerspectiveCamera>(
+        identity, Bounds2f(Point2f(-1, -1), Point2f(1, 1)), 0., 1., 0., 10.,
+        45, film, nullptr);
+
+    // With two samples per pixel, progressive rendering takes one sample
+    // in each of two rounds.
+    SampleRecordingIntegrator integrator(
+        camera, std::make_shared<RandomSampler>(2), film->croppedPixelBounds);
+    integrator.Render(*GetScenes()[0].scene, false);
+    pbrtCleanup();
+
+    int nPixels = film->croppedPixelBounds.Area();
+    ASSERT_EQ(nPixels, integrator.samples[0].size());
+    ASSERT_EQ(nPixels, integrator.samples[1].size());
+    std::set<Float> firstRound(integrator.samples[0].begin(),
+                               integrator.samples[0].end());
+    int repeated = 0;
+    for (Float u : integrator.samples[1]) repeated += firstRound.count(u);
+    EXPECT_EQ(0, repeated);
+}
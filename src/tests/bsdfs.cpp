@@ -554,3 +554,79 @@ TEST(BSDFSampling, TR_std_0p05_0p1) {
         createFresnelBlend(bsdf, arena, false, false, 0.05, 0.1);
     }, "Fresnel blend Trowbridge-Reitz, std sample, alpha = 0.05/0.1");
 }
+
+// BSDF dispatches to the BxDFs it knows about without virtual calls;
+// wrapping each BxDF in a unit-scale ScaledBxDF forces the virtual path,
+// which must give identical results.
+static void TestDispatch(const std::function<void(BSDF *, MemoryArena &,
+                                                   bool)> &create) {
+    MemoryArena arena;
+    Transform t = RotateX(-90), tInv = Inverse(t);
+    Disk disk(&t, &tInv, false, 0., 1., 0, 360.);
+    Ray r(Point3f(0.1, 1, 0), Vector3f(0, -1, 0));
+    Float tHit;
+    SurfaceInteraction isect;
+    ASSERT_TRUE(disk.Intersect(r, &tHit, &isect, true));
+    BSDF *direct = ARENA_ALLOC(arena, BSDF)(isect, 1.5f);
+    BSDF *wrapped = ARENA_ALLOC(arena, BSDF)(isect, 1.5f);
+    create(direct, arena, false);
+    create(wrapped, arena, true);
+
+    RNG rng;
+    for (int i = 0; i < 1000; ++i) {
+        Vector3f wo = UniformSampleSphere({rng.UniformFloat(),
+                                           rng.UniformFloat()});
+        Vector3f wi = UniformSampleSphere({rng.UniformFloat(),
+                                           rng.UniformFloat()});
+        EXPECT_EQ(direct->f(wo, wi), wrapped->f(wo, wi));
+        EXPECT_EQ(direct->Pdf(wo, wi), wrapped->Pdf(wo, wi));
+
+        Point2f u(rng.UniformFloat(), rng.UniformFloat());
+        Vector3f wiDirect, wiWrapped;
+        Float pdfDirect, pdfWrapped;
+        BxDFType typeDirect, typeWrapped;
+        Spectrum fDirect = direct->Sample_f(wo, &wiDirect, u, &pdfDirect,
+                                            BSDF_ALL, &typeDirect);
+        Spectrum fWrapped = wrapped->Sample_f(wo, &wiWrapped, u, &pdfWrapped,
+                                              BSDF_ALL, &typeWrapped);
+        EXPECT_EQ(fDirect, fWrapped);
+        EXPECT_EQ(pdfDirect, pdfWrapped);
+        EXPECT_EQ(typeDirect, typeWrapped);
+        if (pdfDirect > 0) {
+            EXPECT_EQ(wiDirect, wiWrapped);
+        }
+    }
+}
+
+TEST(BSDFDispatch, SingleLobe) {
+    TestDispatch([](BSDF *bsdf, MemoryArena &arena, bool wrap) {
+        BxDF *bxdf = ARENA_ALLOC(arena, LambertianReflection)(Spectrum(.5));
+        if (wrap) bxdf = ARENA_ALLOC(arena, ScaledBxDF)(bxdf, Spectrum(1.));
+        bsdf->Add(bxdf);
+    });
+}
+
+TEST(BSDFDispatch, AllKinds) {
+    TestDispatch([](BSDF *bsdf, MemoryArena &arena, bool wrap) {
+        MicrofacetDistribution *distrib =
+            ARENA_ALLOC(arena, TrowbridgeReitzDistribution)(.3, .2);
+        Fresnel *fresnel = ARENA_ALLOC(arena, FresnelDielectric)(1, 1.5);
+        BxDF *bxdfs[] = {
+            ARENA_ALLOC(arena, LambertianReflection)(Spectrum(.5)),
+            ARENA_ALLOC(arena, LambertianTransmission)(Spectrum(.2)),
+            ARENA_ALLOC(arena, OrenNayar)(Spectrum(.3), 20),
+            ARENA_ALLOC(arena, MicrofacetReflection)(Spectrum(1.), distrib,
+                                                     fresnel),
+            ARENA_ALLOC(arena, MicrofacetTransmission)(
+                Spectrum(1.), distrib, 1, 1.5, TransportMode::Radiance),
+            ARENA_ALLOC(arena, FresnelBlend)(Spectrum(.4), Spectrum(.3),
+                                             distrib),
+            ARENA_ALLOC(arena, SpecularReflection)(Spectrum(1.), fresnel),
+            ARENA_ALLOC(arena, SpecularTransmission)(Spectrum(1.), 1, 1.5,
+                                                     TransportMode::Radiance)};
+        for (BxDF *bxdf : bxdfs) {
+            if (wrap) bxdf = ARENA_ALLOC(arena, ScaledBxDF)(bxdf, Spectrum(1.));
+            bsdf->Add(bxdf);
+        }
+    });
+}
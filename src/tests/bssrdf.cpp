@@ -0,0 +1,55 @@
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "bssrdf.h"
+#include <stdio.h>
+#include <cinttypes>
+
+using namespace pbrt;
+
+static void ExpectTablesEqual(const BSSRDFTable &a, const BSSRDFTable &b) {
+    ASSERT_EQ(a.nRhoSamples, b.nRhoSamples);
+    ASSERT_EQ(a.nRadiusSamples, b.nRadiusSamples);
+    for (int i = 0; i < a.nRhoSamples; ++i) {
+        EXPECT_EQ(a.rhoSamples[i], b.rhoSamples[i]);
+        EXPECT_EQ(a.rhoEff[i], b.rhoEff[i]);
+    }
+    for (int i = 0; i < a.nRhoSamples * a.nRadiusSamples; ++i) {
+        EXPECT_EQ(a.profile[i], b.profile[i]);
+        EXPECT_EQ(a.profileCDF[i], b.profileCDF[i]);
+    }
+}
+
+static std::string CacheFilename(Float g, Float eta) {
+    return StringPrintf("./beamdiffusion-%016" PRIx64 "-%016" PRIx64
+                        ".pbrtsss",
+                        uint64_t(FloatToBits(g)), uint64_t(FloatToBits(eta)));
+}
+
+TEST(BSSRDFTable, SharedAndCached) {
+    Options saved = PbrtOptions;
+    PbrtOptions.nThreads = 1;
+    PbrtOptions.bssrdfCacheDir = ".";
+    const Float g = .25f, eta = 1.37f;
+    std::string filename = CacheFilename(g, eta);
+    remove(filename.c_str());
+
+    // The first request computes the table and writes it to the cache
+    std::shared_ptr<const BSSRDFTable> table = GetBeamDiffusionBSSRDF(g, eta);
+    EXPECT_EQ(table.get(), GetBeamDiffusionBSSRDF(g, eta).get());
+    BSSRDFTable computed(100, 64);
+    ComputeBeamDiffusionBSSRDF(g, eta, &computed);
+    ExpectTablesEqual(computed, *table);
+
+    // Tables for other parameters are read from the cache if present; this
+    // one is given the first table's file to check that it's used.
+    const Float otherG = .5f, otherEta = 1.2f;
+    std::string otherFilename = CacheFilename(otherG, otherEta);
+    ASSERT_EQ(0, rename(filename.c_str(), otherFilename.c_str()));
+    std::shared_ptr<const BSSRDFTable> other =
+        GetBeamDiffusionBSSRDF(otherG, otherEta);
+    EXPECT_NE(table.get(), other.get());
+    ExpectTablesEqual(computed, *other);
+
+    EXPECT_EQ(0, remove(otherFilename.c_str()));
+    PbrtOptions = saved;
+}
@@ -0,0 +1,97 @@
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "paramset.h"
+#include "rng.h"
+#include "sampling.h"
+#include "accelerators/bvh.h"
+#include "accelerators/curvebundle.h"
+#include "shapes/curve.h"
+
+using namespace pbrt;
+
+// Creates a two-segment Bezier curve with random control points.
+static std::vector<std::shared_ptr<Shape>> RandomCurve(
+    const std::string &type, const Transform *o2w, const Transform *w2o,
+    RNG &rng) {
+    ParamSet params;
+    const int nCp = 7;
+    std::unique_ptr<Point3f[]> P(new Point3f[nCp]);
+    for (int i = 0; i < nCp; ++i)
+        P[i] = Point3f(Lerp(rng.UniformFloat(), -1, 1),
+                       Lerp(rng.UniformFloat(), -1, 1),
+                       Lerp(rng.UniformFloat(), -1, 1));
+    params.AddPoint3f("P", std::move(P), nCp);
+    std::unique_ptr<Float[]> width(new Float[1]{
+        Lerp(rng.UniformFloat(), .02f, .2f)});
+    params.AddFloat("width", std::move(width), 1);
+    std::unique_ptr<std::string[]> t(new std::string[1]{type});
+    params.AddString("type", std::move(t), 1);
+    if (type == "ribbon") {
+        std::unique_ptr<Normal3f[]> N(new Normal3f[3]);
+        for (int i = 0; i < 3; ++i)
+            N[i] = Normal3f(UniformSampleSphere(
+                Point2f(rng.UniformFloat(), rng.UniformFloat())));
+        params.AddNormal3f("N", std::move(N), 3);
+    }
+    return CreateCurveShape(o2w, w2o, false, params);
+}
+
+TEST(CurveBundle, MatchesCurves) {
+    RNG rng;
+    Transform objectToWorld = Rotate(30, Vector3f(1, 2, 3)) * Scale(2, 1, 1.5);
+    Transform worldToObject = Inverse(objectToWorld);
+
+    for (const char *type : {"flat", "cylinder", "ribbon"}) {
+        std::vector<std::shared_ptr<Primitive>> curvePrims, bundlePrims;
+        std::vector<std::shared_ptr<Shape>> allCurves;
+        for (int i = 0; i < 20; ++i) {
+            std::vector<std::shared_ptr<Shape>> curves =
+                RandomCurve(type, &objectToWorld, &worldToObject, rng);
+            ASSERT_EQ(16, curves.size());
+            for (const std::shared_ptr<Shape> &c : curves)
+                curvePrims.push_back(std::make_shared<GeometricPrimitive>(
+                    c, nullptr, nullptr, MediumInterface()));
+            std::vector<std::shared_ptr<Primitive>> bundles =
+                CreateCurveBundles(curves, nullptr, MediumInterface());
+            EXPECT_EQ((16 + CurveBundle::Width - 1) / CurveBundle::Width,
+                      bundles.size());
+            bundlePrims.insert(bundlePrims.end(), bundles.begin(),
+                               bundles.end());
+            allCurves.insert(allCurves.end(), curves.begin(), curves.end());
+        }
+        BVHAccel curveBVH(curvePrims), bundleBVH(bundlePrims);
+
+        int nHits = 0;
+        for (int i = 0; i < 5000; ++i) {
+            // Aim most rays close to a segment so that many of them hit.
+            Point3f o = Point3f(0, 0, 0) +
+                        6 * UniformSampleSphere(Point2f(rng.UniformFloat(),
+                                                        rng.UniformFloat()));
+            const Shape &curve =
+                *allCurves[rng.UniformUInt32(allCurves.size())];
+            Bounds3f b = curve.WorldBound();
+            Point3f target = b.Lerp(Point3f(rng.UniformFloat(),
+                                            rng.UniformFloat(),
+                                            rng.UniformFloat()));
+            Ray curveRay(o, target - o), bundleRay(o, target - o);
+            EXPECT_EQ(curveBVH.IntersectP(curveRay),
+                      bundleBVH.IntersectP(bundleRay));
+
+            SurfaceInteraction curveIsect, bundleIsect;
+            bool curveHit = curveBVH.Intersect(curveRay, &curveIsect);
+            bool bundleHit = bundleBVH.Intersect(bundleRay, &bundleIsect);
+            ASSERT_EQ(curveHit, bundleHit) << type << " ray " << i;
+            if (!curveHit) continue;
+            ++nHits;
+            // The bundles pass their hits on to the same Curve code, so
+            // hair materials see the same (u,v) and partial derivatives.
+            EXPECT_EQ(curveRay.tMax, bundleRay.tMax);
+            EXPECT_EQ(curveIsect.p, bundleIsect.p);
+            EXPECT_EQ(curveIsect.uv, bundleIsect.uv);
+            EXPECT_EQ(curveIsect.dpdu, bundleIsect.dpdu);
+            EXPECT_EQ(curveIsect.dpdv, bundleIsect.dpdv);
+            EXPECT_EQ(curveIsect.shape, bundleIsect.shape);
+        }
+        EXPECT_GT(nHits, 500) << type;
+    }
+}
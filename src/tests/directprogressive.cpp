@@ -0,0 +1,82 @@
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+
+#include <thread>
+
+#include "accelerators/bvh.h"
+#include "cameras/perspective.h"
+#include "film.h"
+#include "filters/box.h"
+#include "integrators/directprogressiveintegrator.h"
+#include "integrators/iisptfilmmonitor.h"
+#include "lights/point.h"
+#include "materials/matte.h"
+#include "samplers/random.h"
+#include "scene.h"
+#include "shapes/sphere.h"
+#include "textures/constant.h"
+
+using namespace pbrt;
+
+TEST(DirectProgressive, AdaptiveSkipsAcrossThreads) {
+    // Camera and point light at the center of a diffuse unit sphere, so
+    // every pixel sees the same radiance and converges immediately.
+    static Transform id;
+    std::shared_ptr<Shape> sphere = std::make_shared<Sphere>(
+        &id, &id, true /* reverse orientation */, 1, -1, 1, 360);
+    std::shared_ptr<Material> material = std::make_shared<MatteMaterial>(
+        std::make_shared<ConstantTexture<Spectrum>>(Spectrum(0.5)),
+        std::make_shared<ConstantTexture<Float>>(0.), nullptr);
+    std::vector<std::shared_ptr<Primitive>> prims;
+    prims.push_back(std::make_shared<GeometricPrimitive>(
+        sphere, material, nullptr, MediumInterface()));
+    std::vector<std::shared_ptr<Light>> lights;
+    lights.push_back(
+        std::make_shared<PointLight>(Transform(), nullptr, Spectrum(Pi)));
+    Scene scene(std::make_shared<BVHAccel>(prims), lights);
+
+    Point2i resolution(8, 8);
+    std::unique_ptr<Filter> filter(new BoxFilter(Vector2f(0.5, 0.5)));
+    Film *film = new Film(resolution, Bounds2f(Point2f(0, 0), Point2f(1, 1)),
+                          std::move(filter), 1., "test.pfm", 1.);
+    AnimatedTransform identity(&id, 0, &id, 1);
+    std::shared_ptr<Camera> camera = std::make_shared<PerspectiveCamera>(
+        identity, Bounds2f(Point2f(-1, -1), Point2f(1, 1)), 0., 1., 0., 10.,
+        45, film, nullptr);
+    RandomSampler sampler(1);
+
+    // Each thread renders with its own integrator, as IILE's render
+    // runners do. No thread takes adaptiveMinPasses passes by itself, so
+    // pixels are only skipped if the threads share their statistics.
+    const int nThreads = 4, nPasses = 3;
+    auto render = [&](IisptFilmMonitor *monitor) {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < nThreads; ++t)
+            threads.push_back(std::thread([&, t]() {
+                DirectProgressiveIntegrator integrator(
+                    camera, sampler.Clone(t), monitor->get_film_bounds());
+                integrator.preprocess(scene);
+                for (int pass = 0; pass < nPasses; ++pass)
+                    integrator.RenderOnePass(scene, monitor);
+            }));
+        for (std::thread &thread : threads) thread.join();
+    };
+
+    Float adaptive = PbrtOptions.iileDirectAdaptive;
+    IisptFilmMonitor full(film->GetSampleBounds());
+    PbrtOptions.iileDirectAdaptive = 0;
+    render(&full);
+
+    IisptFilmMonitor skipped(film->GetSampleBounds());
+    PbrtOptions.iileDirectAdaptive = .01;
+    render(&skipped);
+    PbrtOptions.iileDirectAdaptive = adaptive;
+
+    // is_converged() with an infinite error bound only checks the number
+    // of samples taken in the pixel.
+    for (Point2i p : film->croppedPixelBounds) {
+        EXPECT_TRUE(full.is_converged(p, nThreads * nPasses, Infinity));
+        EXPECT_TRUE(skipped.is_converged(p, 4, .01));
+        EXPECT_FALSE(skipped.is_converged(p, nThreads * nPasses, Infinity));
+    }
+}
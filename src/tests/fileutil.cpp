@@ -1,6 +1,9 @@
 
 #include "tests/gtest/gtest.h"
 #include "fileutil.h"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
 
 using namespace pbrt;
 
@@ -23,3 +26,22 @@ TEST(FileUtil, AbsolutePath) {
     EXPECT_TRUE(IsAbsolutePath("/foo/bar"));
     EXPECT_FALSE(IsAbsolutePath("foo/bar"));
 }
+
+TEST(FileUtil, WriteFileAtomically) {
+    std::string filename = "fileutil_atomic.bin";
+    EXPECT_TRUE(WriteFileAtomically(
+        filename, [](std::ostream &out) { out << "first"; }));
+    EXPECT_TRUE(WriteFileAtomically(
+        filename, [](std::ostream &out) { out << "second"; }));
+    std::ifstream in(filename);
+    std::string contents((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+    EXPECT_EQ("second", contents);
+    in.close();
+    EXPECT_EQ(0, remove(filename.c_str()));
+
+    // A write into a missing directory fails without leaving a file behind.
+    EXPECT_FALSE(WriteFileAtomically(
+        "no_such_directory/fileutil_atomic.bin",
+        [](std::ostream &out) { out << "data"; }));
+}
@@ -0,0 +1,196 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "film.h"
+#include "filters/box.h"
+#include "imageio.h"
+#include "parallel.h"
+#include <stdio.h>
+#include <thread>
+
+using namespace pbrt;
+
+TEST(Film, ConcurrentSplatsAndMerges) {
+    ParallelInit();
+
+    // An odd resolution so that the last row and column of film blocks
+    // are partial.
+    Point2i res(53, 37);
+    Film film(res, Bounds2f(Point2f(0, 0), Point2f(1, 1)),
+              std::unique_ptr<Filter>(new BoxFilter(Vector2f(.5f, .5f))),
+              35.f, "test_film.pfm", 1.f);
+
+    // Every thread splats onto every pixel, in different orders.
+    const int nSplats = 16;
+    ParallelFor([&](int64_t i) {
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x) {
+                int xx = (x + (int)i * 7) % res.x;
+                film.AddSplat(Point2f(xx + .5f, y + .5f), Spectrum(.25f));
+            }
+    }, nSplats, 1);
+
+    // Merge tiles that straddle block boundaries.
+    Bounds2i sampleBounds = film.GetSampleBounds();
+    Vector2i sampleExtent = sampleBounds.Diagonal();
+    const int tileSize = 13;
+    Point2i nTiles((sampleExtent.x + tileSize - 1) / tileSize,
+                   (sampleExtent.y + tileSize - 1) / tileSize);
+    ParallelFor2D([&](Point2i tile) {
+        int x0 = sampleBounds.pMin.x + tile.x * tileSize;
+        int x1 = std::min(x0 + tileSize, sampleBounds.pMax.x);
+        int y0 = sampleBounds.pMin.y + tile.y * tileSize;
+        int y1 = std::min(y0 + tileSize, sampleBounds.pMax.y);
+        std::unique_ptr<FilmTile> filmTile =
+            film.GetFilmTile(Bounds2i(Point2i(x0, y0), Point2i(x1, y1)));
+        for (int y = y0; y < y1; ++y)
+            for (int x = x0; x < x1; ++x)
+                filmTile->AddSample(Point2f(x + .5f, y + .5f), Spectrum(.5f));
+        film.MergeFilmTile(std::move(filmTile));
+    }, nTiles);
+
+    film.WriteImage(1);
+    Point2i readRes;
+    std::unique_ptr<RGBSpectrum[]> image = ReadImage("test_film.pfm", &readRes);
+    ASSERT_TRUE(image.get() != nullptr);
+    ASSERT_EQ(res, readRes);
+    for (int i = 0; i < res.x * res.y; ++i) {
+        Float rgb[3];
+        image[i].ToRGB(rgb);
+        for (int c = 0; c < 3; ++c)
+            EXPECT_NEAR(.5f + nSplats * .25f, rgb[c], 1e-3f) << i;
+    }
+    EXPECT_EQ(0, remove("test_film.pfm"));
+
+    ParallelCleanup();
+}
+
+TEST(Film, ThreadSplatImages) {
+    int nThreads = PbrtOptions.nThreads;
+    PbrtOptions.nThreads = 4;
+    ParallelInit();
+
+    Point2i res(21, 17);
+    Film film(res, Bounds2f(Point2f(0, 0), Point2f(1, 1)),
+              std::unique_ptr<Filter>(new BoxFilter(Vector2f(.5f, .5f))),
+              35.f, "test_film.pfm", 1.f);
+    film.UseThreadSplatImages();
+
+    // Splat in two rounds; each image write must fold in exactly the
+    // splats made since the previous one.
+    const int nSplats = 8;
+    for (int round = 1; round <= 2; ++round) {
+        ParallelFor([&](int64_t i) {
+            for (int y = 0; y < res.y; ++y)
+                for (int x = 0; x < res.x; ++x)
+                    film.AddSplat(Point2f(x + .5f, y + .5f), Spectrum(.25f));
+        }, nSplats, 1);
+
+        film.WriteImage(1);
+        Point2i readRes;
+        std::unique_ptr<RGBSpectrum[]> image =
+            ReadImage("test_film.pfm", &readRes);
+        ASSERT_TRUE(image.get() != nullptr);
+        ASSERT_EQ(res, readRes);
+        for (int i = 0; i < res.x * res.y; ++i) {
+            Float rgb[3];
+            image[i].ToRGB(rgb);
+            for (int c = 0; c < 3; ++c)
+                EXPECT_NEAR(round * nSplats * .25f, rgb[c], 1e-3f) << i;
+        }
+    }
+    EXPECT_EQ(0, remove("test_film.pfm"));
+
+    ParallelCleanup();
+    PbrtOptions.nThreads = nThreads;
+}
+
+TEST(Film, SplatsFromOtherThreads) {
+    ParallelInit();
+
+    // Threads that pbrt didn't launch splat concurrently with the thread
+    // that called ParallelInit(); none of their splats may be lost.
+    Point2i res(29, 19);
+    Film film(res, Bounds2f(Point2f(0, 0), Point2f(1, 1)),
+              std::unique_ptr<Filter>(new BoxFilter(Vector2f(.5f, .5f))),
+              35.f, "test_film.pfm", 1.f);
+    const int nThreads = 4, nRounds = 20;
+    auto splat = [&]() {
+        for (int round = 0; round < nRounds; ++round)
+            for (int y = 0; y < res.y; ++y)
+                for (int x = 0; x < res.x; ++x)
+                    film.AddSplat(Point2f(x + .5f, y + .5f), Spectrum(.25f));
+    };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; ++i) threads.push_back(std::thread(splat));
+    splat();
+    for (std::thread &thread : threads) thread.join();
+
+    film.WriteImage(1);
+    Point2i readRes;
+    std::unique_ptr<RGBSpectrum[]> image = ReadImage("test_film.pfm", &readRes);
+    ASSERT_TRUE(image.get() != nullptr);
+    ASSERT_EQ(res, readRes);
+    for (int i = 0; i < res.x * res.y; ++i) {
+        Float rgb[3];
+        image[i].ToRGB(rgb);
+        for (int c = 0; c < 3; ++c)
+            EXPECT_NEAR((nThreads + 1) * nRounds * .25f, rgb[c], 1e-3f) << i;
+    }
+    EXPECT_EQ(0, remove("test_film.pfm"));
+
+    ParallelCleanup();
+}
+
+TEST(Film, VarianceEstimator) {
+    VarianceEstimator ve;
+    EXPECT_EQ(Infinity, ve.RelativeError());
+    Float values[] = {1, 2, 3, 4, 5};
+    for (Float v : values) ve.Add(v);
+    EXPECT_EQ(5, ve.Count());
+    EXPECT_FLOAT_EQ(3, ve.Mean());
+    EXPECT_FLOAT_EQ(2.5, ve.Variance());
+    EXPECT_FLOAT_EQ(std::sqrt(2.5 / 5) / 3, ve.RelativeError());
+
+    // Constant black pixels have converged.
+    VarianceEstimator black;
+    for (int i = 0; i < 4; ++i) black.Add(0);
+    EXPECT_EQ(0, black.RelativeError());
+}
+
+TEST(Film, CheckpointRoundTrip) {
+    Point2i res(20, 10);
+    auto makeFilm = [&](const char *filename) {
+        return std::unique_ptr<Film>(
+            new Film(res, Bounds2f(Point2f(0, 0), Point2f(1, 1)),
+                     std::unique_ptr<Filter>(new BoxFilter(Vector2f(.5f, .5f))),
+                     35.f, filename, 1.f));
+    };
+    std::unique_ptr<Film> film = makeFilm("test_film_a.pfm");
+    std::unique_ptr<FilmTile> tile = film->GetFilmTile(film->GetSampleBounds());
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            tile->AddSample(Point2f(x + .5f, y + .5f), Spectrum(x + y * .1f));
+    film->MergeFilmTile(std::move(tile));
+    film->AddSplat(Point2f(3.5f, 4.5f), Spectrum(2.f));
+    ASSERT_TRUE(film->SaveCheckpoint("test_film.ckpt", 64, 16));
+
+    // A checkpoint for a different sample count is rejected.
+    std::unique_ptr<Film> resumed = makeFilm("test_film_b.pfm");
+    int64_t samplesTaken = 0;
+    EXPECT_FALSE(resumed->LoadCheckpoint("test_film.ckpt", 32, &samplesTaken));
+    ASSERT_TRUE(resumed->LoadCheckpoint("test_film.ckpt", 64, &samplesTaken));
+    EXPECT_EQ(16, samplesTaken);
+
+    film->WriteImage();
+    resumed->WriteImage();
+    Point2i resA, resB;
+    std::unique_ptr<RGBSpectrum[]> a = ReadImage("test_film_a.pfm", &resA);
+    std::unique_ptr<RGBSpectrum[]> b = ReadImage("test_film_b.pfm", &resB);
+    ASSERT_EQ(resA, resB);
+    for (int i = 0; i < res.x * res.y; ++i) EXPECT_EQ(a[i], b[i]);
+
+    EXPECT_EQ(0, remove("test_film.ckpt"));
+    EXPECT_EQ(0, remove("test_film_a.pfm"));
+    EXPECT_EQ(0, remove("test_film_b.pfm"));
+}
@@ -1,7 +1,9 @@
 
 #include "tests/gtest/gtest.h"
 #include "pbrt.h"
+#include "interpolation.h"
 #include "reflection.h"
+#include "rng.h"
 #include <cstdio>
 
 using namespace pbrt;
@@ -17337,3 +17339,48 @@ TEST(BSDFs, Fourier) {
     // Cleanup.
     EXPECT_EQ(0, remove(filename.c_str()));
 }
+
+TEST(BSDFs, FourierTableSharing) {
+    std::string filename = inTestDir("fourier_shared.out");
+    FILE *f = fopen(filename.c_str(), "wb");
+    ASSERT_TRUE(f);
+    int sz = sizeof(fourierData);
+    ASSERT_EQ(sz, fwrite(fourierData, 1, sz, f));
+    ASSERT_EQ(0, fclose(f));
+
+    // Different names for the same file share a single table
+    std::shared_ptr<FourierBSDFTable> table = FourierBSDFTable::Get(filename);
+    ASSERT_GT(table->nChannels, 0);
+    EXPECT_EQ(table.get(), FourierBSDFTable::Get("./" + filename).get());
+
+    FourierBSDFTable read;
+    ASSERT_TRUE(FourierBSDFTable::Read(filename, &read));
+    EXPECT_EQ(read.nMu, table->nMu);
+    EXPECT_EQ(read.mMax, table->mMax);
+    for (int i = 0; i < read.nMu * read.nMu; ++i) {
+        EXPECT_EQ(read.m[i], table->m[i]);
+        EXPECT_EQ(read.aOffset[i], table->aOffset[i]);
+        EXPECT_EQ(read.cdf[i], table->cdf[i]);
+    }
+
+    // The table is released once nothing uses it
+    std::weak_ptr<FourierBSDFTable> weak = table;
+    table.reset();
+    EXPECT_TRUE(weak.expired());
+
+    EXPECT_EQ(0, remove(filename.c_str()));
+}
+
+TEST(BSDFs, FourierSeries) {
+    RNG rng;
+    Float a[37];
+    for (Float &ak : a) ak = rng.UniformFloat() - .5f;
+    for (int m = 0; m <= 37; ++m) {
+        for (Float phi : {0.f, .3f, 1.f, 2.5f, Pi}) {
+            double ref = 0;
+            for (int k = 0; k < m; ++k) ref += a[k] * std::cos(k * phi);
+            EXPECT_NEAR(ref, Fourier(a, m, std::cos(phi)), 1e-5)
+                << "m = " << m << ", phi = " << phi;
+        }
+    }
+}
@@ -0,0 +1,129 @@
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "geomcache.h"
+#include "paramset.h"
+#include "rng.h"
+#include "sampling.h"
+#include "accelerators/bvh.h"
+#include "shapes/heightfield.h"
+#include "shapes/loopsubdiv.h"
+
+using namespace pbrt;
+
+static ParamSet OctahedronParams() {
+    ParamSet params;
+    const int indices[] = {0, 1, 2, 0, 2, 3, 0, 3, 4, 0, 4, 1,
+                           5, 2, 1, 5, 3, 2, 5, 4, 3, 5, 1, 4};
+    std::unique_ptr<int[]> idx(new int[24]);
+    std::copy(indices, indices + 24, idx.get());
+    params.AddInt("indices", std::move(idx), 24);
+    std::unique_ptr<Point3f[]> P(new Point3f[6]{
+        Point3f(0, 1, 0), Point3f(1, 0, 0), Point3f(0, 0, 1),
+        Point3f(-1, 0, 0), Point3f(0, 0, -1), Point3f(0, -1, 0)});
+    params.AddPoint3f("P", std::move(P), 6);
+    std::unique_ptr<int[]> levels(new int[1]{3});
+    params.AddInt("levels", std::move(levels), 1);
+    return params;
+}
+
+static ParamSet HeightfieldParams(RNG &rng) {
+    ParamSet params;
+    const int n = 16;
+    std::unique_ptr<int[]> nu(new int[1]{n}), nv(new int[1]{n});
+    params.AddInt("nu", std::move(nu), 1);
+    params.AddInt("nv", std::move(nv), 1);
+    std::unique_ptr<Float[]> z(new Float[n * n]);
+    for (int i = 0; i < n * n; ++i) z[i] = rng.UniformFloat();
+    params.AddFloat("Pz", std::move(z), n * n);
+    return params;
+}
+
+TEST(GeometryCache, MatchesEagerTessellation) {
+    RNG rng;
+    Transform octahedronToWorld = Scale(1.5, 1, 1);
+    Transform worldToOctahedron = Inverse(octahedronToWorld);
+    Transform heightfieldToWorld = Translate(Vector3f(-2, -.5, 0)) *
+                                   Scale(2, 2, .5);
+    Transform worldToHeightfield = Inverse(heightfieldToWorld);
+    ParamSet octahedron = OctahedronParams();
+    ParamSet heightfield = HeightfieldParams(rng);
+
+    // Render with the shapes' triangles created up front
+    std::vector<std::shared_ptr<Primitive>> eagerPrims;
+    std::vector<std::shared_ptr<Shape>> shapes =
+        CreateLoopSubdiv(&octahedronToWorld, &worldToOctahedron, false,
+                         octahedron);
+    std::vector<std::shared_ptr<Shape>> hfShapes = CreateHeightfield(
+        &heightfieldToWorld, &worldToHeightfield, false, heightfield);
+    shapes.insert(shapes.end(), hfShapes.begin(), hfShapes.end());
+    Bounds3f octahedronBound, heightfieldBound;
+    for (size_t i = 0; i < shapes.size(); ++i) {
+        eagerPrims.push_back(std::make_shared<GeometricPrimitive>(
+            shapes[i], nullptr, nullptr, MediumInterface()));
+        if (i < shapes.size() - hfShapes.size())
+            octahedronBound = Union(octahedronBound, shapes[i]->WorldBound());
+        else
+            heightfieldBound =
+                Union(heightfieldBound, shapes[i]->WorldBound());
+    }
+    BVHAccel eager(eagerPrims);
+
+    // A budget of a single byte makes each tessellation evict the other.
+    GeometryCache::Init(1);
+    // Free the cache even if an assertion below ends the test early.
+    struct CacheCleanup {
+        ~CacheCleanup() { GeometryCache::Cleanup(); }
+    } cacheCleanup;
+    std::vector<std::shared_ptr<Primitive>> lazyPrims;
+    Bounds3f bound;
+    ShapeTessellator tessellate = CreateLoopSubdivTessellator(
+        &octahedronToWorld, &worldToOctahedron, false, octahedron, &bound);
+    std::shared_ptr<TessellatedPrimitive> lazyOctahedron =
+        std::make_shared<TessellatedPrimitive>(
+            tessellate, bound, &octahedronToWorld, &worldToOctahedron, false,
+            nullptr, MediumInterface());
+    tessellate = CreateHeightfieldTessellator(
+        &heightfieldToWorld, &worldToHeightfield, false, heightfield, &bound);
+    std::shared_ptr<TessellatedPrimitive> lazyHeightfield =
+        std::make_shared<TessellatedPrimitive>(
+            tessellate, bound, &heightfieldToWorld, &worldToHeightfield, false,
+            nullptr, MediumInterface());
+    lazyPrims.push_back(lazyOctahedron);
+    lazyPrims.push_back(lazyHeightfield);
+    BVHAccel lazy(lazyPrims);
+    EXPECT_EQ(lazyOctahedron->WorldBound(),
+              Union(lazyOctahedron->WorldBound(), octahedronBound));
+    EXPECT_EQ(lazyHeightfield->WorldBound(),
+              Union(lazyHeightfield->WorldBound(), heightfieldBound));
+    EXPECT_FALSE(lazyOctahedron->IsTessellated());
+    EXPECT_FALSE(lazyHeightfield->IsTessellated());
+    EXPECT_EQ(0, GeometryCache::Get()->ResidentBytes());
+
+    int nHits = 0;
+    for (int i = 0; i < 1000; ++i) {
+        Point3f o = Point3f(0, 0, 0) +
+                    5 * UniformSampleSphere({rng.UniformFloat(),
+                                             rng.UniformFloat()});
+        Point3f target(Lerp(rng.UniformFloat(), -2.5, 1.5),
+                       Lerp(rng.UniformFloat(), -1.5, 1.5),
+                       Lerp(rng.UniformFloat(), -1, 1));
+        Ray eagerRay(o, target - o), lazyRay(o, target - o);
+        EXPECT_EQ(eager.IntersectP(eagerRay), lazy.IntersectP(lazyRay));
+
+        SurfaceInteraction eagerIsect, lazyIsect;
+        bool eagerHit = eager.Intersect(eagerRay, &eagerIsect);
+        bool lazyHit = lazy.Intersect(lazyRay, &lazyIsect);
+        ASSERT_EQ(eagerHit, lazyHit);
+        if (!eagerHit) continue;
+        ++nHits;
+        EXPECT_EQ(eagerRay.tMax, lazyRay.tMax);
+        EXPECT_EQ(eagerIsect.p, lazyIsect.p);
+        EXPECT_EQ(eagerIsect.n, lazyIsect.n);
+        EXPECT_TRUE(lazyIsect.primitive == lazyOctahedron.get() ||
+                    lazyIsect.primitive == lazyHeightfield.get());
+        // Only the most recent tessellation fits in the budget.
+        EXPECT_FALSE(lazyOctahedron->IsTessellated() &&
+                     lazyHeightfield->IsTessellated());
+    }
+    EXPECT_GT(nHits, 100);
+}
@@ -4,6 +4,7 @@
 #include "fileutil.h"
 #include "spectrum.h"
 #include "imageio.h"
+#include <ImfRgbaFile.h>
 
 using namespace pbrt;
 
@@ -84,6 +85,102 @@ TEST(ImageIO, RoundTripEXR) { TestRoundTrip("out.exr", false); }
 
 TEST(ImageIO, RoundTripPFM) { TestRoundTrip("out.pfm", false); }
 
+TEST(ImageIO, EXRAlpha) {
+    // EXR files get an opaque alpha channel, in both scanline and tiled
+    // files and with both channel types.
+    Point2i res(19, 11);
+    std::vector<Float> pixels(3 * res.x * res.y, Float(.5));
+    std::string filename = inTestDir("alpha.exr");
+    for (bool exrFloat : {false, true})
+        for (int tileSize : {0, 8}) {
+            PbrtOptions.exrFloat = exrFloat;
+            PbrtOptions.exrTileSize = tileSize;
+            WriteImage(filename, &pixels[0], Bounds2i({0, 0}, res), res);
+
+            Imf::RgbaInputFile file(filename.c_str());
+            EXPECT_EQ(Imf::WRITE_RGBA, file.channels() & Imf::WRITE_RGBA);
+            std::vector<Imf::Rgba> rgba(res.x * res.y);
+            file.setFrameBuffer(&rgba[0], 1, res.x);
+            file.readPixels(0, res.y - 1);
+            for (const Imf::Rgba &p : rgba) {
+                EXPECT_EQ(1.f, float(p.a));
+                EXPECT_EQ(.5f, float(p.g));
+            }
+        }
+    PbrtOptions.exrFloat = false;
+    PbrtOptions.exrTileSize = 0;
+    EXPECT_EQ(0, remove(filename.c_str()));
+}
+
 TEST(ImageIO, RoundTripTGA) { TestRoundTrip("out.tga", true); }
 
 TEST(ImageIO, RoundTripPNG) { TestRoundTrip("out.png", true); }
+
+TEST(ImageIO, AsyncWrites) {
+    // Queue a series of images for the same file and a second file; each
+    // read must see the most recently written image.
+    Point2i res(37, 23);
+    const char *filenames[2] = {"async_a.pfm", "async_b.pfm"};
+    for (int round = 0; round < 8; ++round) {
+        for (int f = 0; f < 2; ++f) {
+            std::unique_ptr<Float[]> rgb(new Float[3 * res.x * res.y]);
+            for (int i = 0; i < 3 * res.x * res.y; ++i)
+                rgb[i] = round + f + Float(i) / (3 * res.x * res.y);
+            WriteImageAsync(filenames[f], std::move(rgb),
+                            Bounds2i({0, 0}, res), res);
+        }
+
+        Point2i readRes;
+        auto readPixels = ReadImage(filenames[round % 2], &readRes);
+        ASSERT_TRUE(readPixels.get() != nullptr);
+        EXPECT_EQ(readRes, res);
+        for (int i = 0; i < res.x * res.y; ++i) {
+            Float rgb[3];
+            readPixels[i].ToRGB(rgb);
+            for (int c = 0; c < 3; ++c)
+                EXPECT_EQ(Float(round + round % 2 +
+                                Float(3 * i + c) / (3 * res.x * res.y)),
+                          rgb[c]);
+        }
+    }
+
+    FlushImageWrites();
+    for (const char *f : filenames) EXPECT_EQ(0, remove(f));
+}
+
+TEST(ImageIO, RowReader) {
+    Point2i res(19, 31);
+    std::vector<Float> pixels(3 * res.x * res.y);
+    for (size_t i = 0; i < pixels.size(); ++i) pixels[i] = Float(i) / 7;
+
+    // The pixels are written to a window of a larger image that doesn't
+    // start at the origin; only EXR files store that window, and their
+    // rows are read relative to it.
+    Point2i offset(3, 2), totalRes(res.x + 7, res.y + 4);
+    for (const char *filename : {"rows.pfm", "rows.png", "rows.exr"}) {
+        WriteImage(filename, &pixels[0], Bounds2i(offset, offset + res),
+                   totalRes);
+        Point2i readRes;
+        std::unique_ptr<RGBSpectrum[]> image = ReadImage(filename, &readRes);
+        ASSERT_TRUE(image.get() != nullptr);
+
+        // Read bands of rows that don't evenly divide the image, out of
+        // order.
+        std::unique_ptr<ImageRowReader> reader = CreateImageRowReader(filename);
+        ASSERT_TRUE(reader.get() != nullptr);
+        EXPECT_EQ(res, reader->Resolution());
+        const int bandRows = 5;
+        std::vector<RGBSpectrum> rows(bandRows * res.x);
+        for (int y0 = (res.y - 1) / bandRows * bandRows; y0 >= 0;
+             y0 -= bandRows) {
+            int y1 = std::min(y0 + bandRows, res.y);
+            ASSERT_TRUE(reader->ReadRows(y0, y1, &rows[0]));
+            for (int y = y0; y < y1; ++y)
+                for (int x = 0; x < res.x; ++x)
+                    EXPECT_EQ(image[y * res.x + x], rows[(y - y0) * res.x + x])
+                        << filename << " (" << x << ", " << y << ")";
+        }
+        reader.reset();
+        EXPECT_EQ(0, remove(filename));
+    }
+}
@@ -0,0 +1,179 @@
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "imageio.h"
+#include "interaction.h"
+#include "lights/infinite.h"
+#include "rng.h"
+#include "sampling.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+using namespace pbrt;
+
+// Writes a dim environment map with a small, bright "sun".
+static void WriteEnvironmentMap(const std::string &filename) {
+    Point2i res(64, 32);
+    std::vector<Float> rgb(3 * res.x * res.y);
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x) {
+            Float v = (x >= 40 && x < 42 && y >= 10 && y < 11) ? 1000
+                                                                : Float(x) / 64;
+            for (int c = 0; c < 3; ++c) rgb[3 * (y * res.x + x) + c] = v;
+        }
+    WriteImage(filename, &rgb[0], Bounds2i({0, 0}, res), res);
+}
+
+// Checks that the light's sampling PDF integrates to one and that
+// _Sample_Li()_ returns the same PDF as _Pdf_Li()_.
+static void CheckPdf(const InfiniteAreaLight &light) {
+    RNG rng;
+    Interaction ref(Point3f(0, 0, 0), 0, MediumInterface());
+    const int count = 100000;
+    double sum = 0;
+    for (int i = 0; i < count; ++i) {
+        Point2f u(rng.UniformFloat(), rng.UniformFloat());
+        Vector3f w = UniformSampleSphere(u);
+        sum += light.Pdf_Li(ref, w) / UniformSpherePdf();
+    }
+    EXPECT_NEAR(1, sum / count, .05);
+
+    for (int i = 0; i < 1000; ++i) {
+        Point2f u(rng.UniformFloat(), rng.UniformFloat());
+        Vector3f wi;
+        Float pdf;
+        VisibilityTester vis;
+        light.Sample_Li(ref, u, &wi, &pdf, &vis);
+        if (pdf == 0) continue;
+        EXPECT_NEAR(1, light.Pdf_Li(ref, wi) / pdf, 1e-3);
+    }
+}
+
+TEST(InfiniteLight, ReducedResolutionPdf) {
+    std::string filename = "test_envmap.pfm";
+    WriteEnvironmentMap(filename);
+    InfiniteAreaLight full(Transform(), Spectrum(1.f), 1, filename);
+    CheckPdf(full);
+    InfiniteAreaLight reduced(Transform(), Spectrum(1.f), 1, filename, 16);
+    CheckPdf(reduced);
+
+    // The refined cells should sample the sun nearly as well as the full
+    // resolution distribution does; without refinement, the sun's PDF
+    // would be spread over its entire cell.
+    Vector3f sun = SphericalDirection(std::sin(Pi * 10.5f / 32),
+                                      std::cos(Pi * 10.5f / 32),
+                                      2 * Pi * 41 / 64);
+    Interaction ref(Point3f(0, 0, 0), 0, MediumInterface());
+    EXPECT_NEAR(1, reduced.Pdf_Li(ref, sun) / full.Pdf_Li(ref, sun), .1);
+    EXPECT_EQ(0, remove(filename.c_str()));
+}
+
+TEST(InfiniteLight, DistributionCache) {
+    std::string filename = "test_envmap.pfm";
+    std::string cacheFilename = filename + ".pbrtdist";
+    WriteEnvironmentMap(filename);
+    for (int resolution : {0, 16}) {
+        InfiniteAreaLight computed(Transform(), Spectrum(1.f), 1, filename,
+                                   resolution, true);
+        InfiniteAreaLight cached(Transform(), Spectrum(1.f), 1, filename,
+                                 resolution, true);
+        // A different scale changes the key, so the cache is rebuilt.
+        InfiniteAreaLight scaled(Transform(), Spectrum(2.f), 1, filename,
+                                 resolution, true);
+        InfiniteAreaLight uncached(Transform(), Spectrum(1.f), 1, filename,
+                                   resolution, false);
+
+        RNG rng;
+        Interaction ref(Point3f(0, 0, 0), 0, MediumInterface());
+        for (int i = 0; i < 1000; ++i) {
+            Point2f u(rng.UniformFloat(), rng.UniformFloat());
+            Vector3f w = UniformSampleSphere(u);
+            Float pdf = uncached.Pdf_Li(ref, w);
+            EXPECT_EQ(pdf, computed.Pdf_Li(ref, w));
+            EXPECT_EQ(pdf, cached.Pdf_Li(ref, w));
+            EXPECT_NEAR(pdf, scaled.Pdf_Li(ref, w), 1e-3 * pdf);
+        }
+        EXPECT_EQ(0, remove(cacheFilename.c_str()));
+    }
+    EXPECT_EQ(0, remove(filename.c_str()));
+}
+
+static std::vector<char> ReadFileContents(const std::string &filename) {
+    std::ifstream in(filename, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(in),
+                             std::istreambuf_iterator<char>());
+}
+
+static void WriteFileContents(const std::string &filename,
+                              const std::vector<char> &contents,
+                              size_t length) {
+    std::ofstream out(filename, std::ios::binary);
+    out.write(contents.data(), length);
+}
+
+// Replaces the tables of a cached distribution that has no refined cells
+// with those of a uniform distribution over $(u,v)$.
+static void WriteUniformTables(const std::string &cacheFilename) {
+    std::vector<char> contents = ReadFileContents(cacheFilename);
+    ASSERT_GE(contents.size(), 32);
+    int32_t res[4];
+    memcpy(res, &contents[16], sizeof(res));
+    ASSERT_EQ(0, res[3]);
+    int nu = res[0], nv = res[1];
+    std::vector<Float> tables;
+    auto appendUniform = [&](int n) {
+        for (int i = 0; i < n; ++i) tables.push_back(1);
+        for (int i = 0; i <= n; ++i) tables.push_back(Float(i) / n);
+        tables.push_back(1);
+    };
+    appendUniform(nv);
+    for (int v = 0; v < nv; ++v) appendUniform(nu);
+    ASSERT_EQ(contents.size(), 32 + tables.size() * sizeof(Float));
+    memcpy(&contents[32], tables.data(), tables.size() * sizeof(Float));
+    WriteFileContents(cacheFilename, contents, contents.size());
+}
+
+TEST(InfiniteLight, DistributionCacheIsRead) {
+    std::string filename = "test_envmap.pfm";
+    std::string cacheFilename = filename + ".pbrtdist";
+    WriteEnvironmentMap(filename);
+    InfiniteAreaLight computed(Transform(), Spectrum(1.f), 1, filename, 0,
+                               true);
+    size_t cacheSize = ReadFileContents(cacheFilename).size();
+
+    // A light that reads the modified cache samples uniformly in $(u,v)$,
+    // unlike one that computes its distribution from the sunny map.
+    WriteUniformTables(cacheFilename);
+    InfiniteAreaLight cached(Transform(), Spectrum(1.f), 1, filename, 0, true);
+    InfiniteAreaLight uncached(Transform(), Spectrum(1.f), 1, filename, 0,
+                               false);
+    Interaction ref(Point3f(0, 0, 0), 0, MediumInterface());
+    RNG rng;
+    for (int i = 0; i < 1000; ++i) {
+        Vector3f w =
+            UniformSampleSphere(Point2f(rng.UniformFloat(), rng.UniformFloat()));
+        Float sinTheta = std::sin(SphericalTheta(w));
+        if (sinTheta == 0) continue;
+        Float uniformPdf = 1 / (2 * Pi * Pi * sinTheta);
+        EXPECT_NEAR(uniformPdf, cached.Pdf_Li(ref, w), 1e-3 * uniformPdf);
+    }
+    Vector3f sun = SphericalDirection(std::sin(Pi * 10.5f / 32),
+                                      std::cos(Pi * 10.5f / 32),
+                                      2 * Pi * 41 / 64);
+    EXPECT_GT(uncached.Pdf_Li(ref, sun), 10 * cached.Pdf_Li(ref, sun));
+
+    // A truncated cache file is ignored and then rewritten.
+    std::vector<char> contents = ReadFileContents(cacheFilename);
+    WriteFileContents(cacheFilename, contents, contents.size() - sizeof(Float));
+    InfiniteAreaLight truncated(Transform(), Spectrum(1.f), 1, filename, 0,
+                                true);
+    for (int i = 0; i < 1000; ++i) {
+        Vector3f w =
+            UniformSampleSphere(Point2f(rng.UniformFloat(), rng.UniformFloat()));
+        EXPECT_EQ(uncached.Pdf_Li(ref, w), truncated.Pdf_Li(ref, w));
+    }
+    EXPECT_EQ(cacheSize, ReadFileContents(cacheFilename).size());
+
+    EXPECT_EQ(0, remove(cacheFilename.c_str()));
+    EXPECT_EQ(0, remove(filename.c_str()));
+}
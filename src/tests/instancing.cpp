@@ -0,0 +1,92 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "accelerators/bvh.h"
+#include "accelerators/instancing.h"
+#include "interaction.h"
+#include "rng.h"
+#include "sampling.h"
+#include "shapes/sphere.h"
+
+using namespace pbrt;
+
+static std::vector<std::shared_ptr<Primitive>> MakeInstances(
+    std::shared_ptr<Primitive> blas, int n, Float jitter, RNG &rng,
+    std::vector<std::unique_ptr<Transform>> &transforms) {
+    std::vector<std::shared_ptr<Primitive>> instances;
+    for (int i = 0; i < n; ++i) {
+        Vector3f offset(i % 5 * 4 + jitter * rng.UniformFloat(),
+                        i / 5 % 5 * 4 + jitter * rng.UniformFloat(),
+                        i / 25 * 4 + jitter * rng.UniformFloat());
+        transforms.push_back(
+            std::unique_ptr<Transform>(new Transform(Translate(offset))));
+        Transform *t = transforms.back().get();
+        instances.push_back(std::make_shared<TransformedPrimitive>(
+            blas, AnimatedTransform(t, 0, t, 1)));
+    }
+    return instances;
+}
+
+static void CheckIntersections(
+    const Primitive &accel,
+    const std::vector<std::shared_ptr<Primitive>> &instances, RNG &rng) {
+    for (int i = 0; i < 1000; ++i) {
+        Point3f o(30 * rng.UniformFloat() - 5, 30 * rng.UniformFloat() - 5,
+                  -20);
+        Vector3f d = UniformSampleSphere(
+            Point2f(rng.UniformFloat(), rng.UniformFloat()));
+        if (d.z < 0) d.z = -d.z;
+
+        // Find the closest intersection by testing every instance
+        Ray bruteRay(o, d);
+        SurfaceInteraction bruteIsect;
+        bool bruteHit = false;
+        for (const auto &inst : instances)
+            bruteHit |= inst->Intersect(bruteRay, &bruteIsect);
+
+        Ray ray(o, d);
+        SurfaceInteraction isect;
+        EXPECT_EQ(bruteHit, accel.Intersect(ray, &isect));
+        EXPECT_EQ(bruteHit, accel.IntersectP(Ray(o, d)));
+        if (bruteHit) {
+            EXPECT_EQ(bruteRay.tMax, ray.tMax);
+        }
+    }
+}
+
+TEST(Instancing, TopLevelRefit) {
+    Transform identity, sphereOffset = Translate(Vector3f(1.5, 0, 0));
+    std::vector<std::shared_ptr<Primitive>> spheres = {
+        std::make_shared<GeometricPrimitive>(
+            std::make_shared<Sphere>(&identity, &identity, false, 1, -1, 1,
+                                     360),
+            nullptr, nullptr, MediumInterface()),
+        std::make_shared<GeometricPrimitive>(
+            std::make_shared<Sphere>(&sphereOffset, &sphereOffset, false, .5,
+                                     -.5, .5, 360),
+            nullptr, nullptr, MediumInterface())};
+    std::shared_ptr<Primitive> blas = std::make_shared<BVHAccel>(spheres);
+
+    RNG rng;
+    std::vector<std::unique_ptr<Transform>> transforms;
+    std::vector<std::shared_ptr<Primitive>> instances =
+        MakeInstances(blas, 100, .5, rng, transforms);
+    std::shared_ptr<Primitive> tlas = BuildTopLevelBVH(instances);
+    CheckIntersections(*tlas, instances, rng);
+    EndInstancingFrame();
+
+    // Moving the instances slightly refits the existing BVH.
+    instances = MakeInstances(blas, 100, .5, rng, transforms);
+    std::shared_ptr<Primitive> refit = BuildTopLevelBVH(instances);
+    EXPECT_EQ(tlas, refit);
+    CheckIntersections(*refit, instances, rng);
+    EndInstancingFrame();
+
+    // A different number of instances requires a new BVH.
+    instances = MakeInstances(blas, 60, 3, rng, transforms);
+    std::shared_ptr<Primitive> rebuilt = BuildTopLevelBVH(instances);
+    EXPECT_NE(tlas, rebuilt);
+    CheckIntersections(*rebuilt, instances, rng);
+
+    ClearInstancingCaches();
+}
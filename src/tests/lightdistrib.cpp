@@ -0,0 +1,101 @@
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "accelerators/bvh.h"
+#include "lightdistrib.h"
+#include "lights/diffuse.h"
+#include "lights/distant.h"
+#include "lights/point.h"
+#include "lights/spot.h"
+#include "primitive.h"
+#include "rng.h"
+#include "sampling.h"
+#include "scene.h"
+#include "shapes/triangle.h"
+
+using namespace pbrt;
+
+// Creates a scene with a mix of point, spot and (one-sided and two-sided)
+// triangle area lights scattered around the origin, and optionally a
+// distant light that the light BVH can't bound.
+static std::unique_ptr<Scene> ManyLightsScene(bool distant) {
+    RNG rng;
+    auto pRandom = [&rng]() {
+        return Point3f(-5 + 10 * rng.UniformFloat(),
+                       -5 + 10 * rng.UniformFloat(),
+                       -5 + 10 * rng.UniformFloat());
+    };
+    static Transform identity;
+    std::vector<std::shared_ptr<Light>> lights;
+    std::vector<std::shared_ptr<Primitive>> prims;
+    for (int i = 0; i < 20; ++i)
+        lights.push_back(std::make_shared<PointLight>(
+            Translate(Vector3f(pRandom())), MediumInterface(),
+            Spectrum(1 + rng.UniformFloat())));
+    for (int i = 0; i < 5; ++i)
+        lights.push_back(std::make_shared<SpotLight>(
+            Inverse(LookAt(pRandom(), Point3f(0, 0, 0), Vector3f(0, 1, 0))),
+            MediumInterface(), Spectrum(10), 30, 25));
+    for (int i = 0; i < 20; ++i) {
+        int indices[3] = {0, 1, 2};
+        Point3f p[3] = {pRandom(), pRandom(), pRandom()};
+        std::shared_ptr<Shape> tri = CreateTriangleMesh(
+            &identity, &identity, false, 1, indices, 3, p, nullptr, nullptr,
+            nullptr, nullptr, nullptr)[0];
+        auto area = std::make_shared<DiffuseAreaLight>(
+            identity, MediumInterface(), Spectrum(rng.UniformFloat()), 1, tri,
+            (i & 1) != 0);
+        lights.push_back(area);
+        prims.push_back(std::make_shared<GeometricPrimitive>(
+            tri, nullptr, area, MediumInterface()));
+    }
+    if (distant)
+        lights.push_back(std::make_shared<DistantLight>(
+            identity, Spectrum(1), Vector3f(0, 1, 0)));
+    return std::unique_ptr<Scene>(
+        new Scene(std::make_shared<BVHAccel>(prims), lights));
+}
+
+static void TestLightBVH(bool distant) {
+    std::unique_ptr<Scene> scene = ManyLightsScene(distant);
+    std::unique_ptr<LightDistribution> distrib =
+        CreateLightSampleDistribution("lightbvh", *scene);
+    RNG rng(17);
+    for (int i = 0; i < 100; ++i) {
+        Point3f p(-8 + 16 * rng.UniformFloat(), -8 + 16 * rng.UniformFloat(),
+                  -8 + 16 * rng.UniformFloat());
+        // Alternate between surface points and points in media
+        Normal3f n(0, 0, 0);
+        if (i & 1)
+            n = Normal3f(UniformSampleSphere(
+                Point2f(rng.UniformFloat(), rng.UniformFloat())));
+
+        // The light probabilities can sum to less than one, since
+        // traversal fails when both children of a node have zero
+        // importance, but every light that may illuminate the point must
+        // be sampled with nonzero probability. Point lights illuminate all
+        // points in media.
+        Float sum = 0;
+        for (size_t l = 0; l < scene->lights.size(); ++l) {
+            Float pmf = distrib->Pmf(p, n, l);
+            sum += pmf;
+            if (l < 20 && n == Normal3f(0, 0, 0)) {
+                EXPECT_GT(pmf, 0);
+            }
+        }
+        EXPECT_LE(sum, 1 + 1e-4) << p << ", " << n;
+
+        // Sample() and Pmf() should agree.
+        for (int j = 0; j < 50; ++j) {
+            Float pmf;
+            int light = distrib->Sample(p, n, rng.UniformFloat(), &pmf);
+            if (pmf == 0) continue;
+            ASSERT_GE(light, 0);
+            ASSERT_LT(light, (int)scene->lights.size());
+            EXPECT_NEAR(pmf, distrib->Pmf(p, n, light), 1e-5 * pmf);
+        }
+    }
+}
+
+TEST(LightBVH, PmfMatchesSample) { TestLightBVH(false); }
+
+TEST(LightBVH, PmfMatchesSampleWithDistantLight) { TestLightBVH(true); }
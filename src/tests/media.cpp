@@ -0,0 +1,123 @@
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "interaction.h"
+#include "media/grid.h"
+#include "memory.h"
+#include "rng.h"
+#include "samplers/random.h"
+
+using namespace pbrt;
+
+// Checks Tr() and the probability of Sample() scattering against the
+// transmittance along a ray through the middle of a grid that fills the
+// unit cube, where _d_ has the density values. _integral_ is the integral
+// of the (trilinearly interpolated) density along the ray.
+static void TestGridTransmittance(const std::vector<Float> &d, int n,
+                                  Float sigma_t, Float integral) {
+    GridDensityMedium medium(Spectrum(sigma_t / 2), Spectrum(sigma_t / 2), 0,
+                             n, n, n, Transform(), &d[0]);
+    Ray ray(Point3f(-1, .5, .5), Vector3f(1, 0, 0), 3);
+    Float expected = std::exp(-sigma_t * integral);
+
+    const int nSamples = 100000;
+    RandomSampler sampler(nSamples);
+    sampler.StartPixel(Point2i(0, 0));
+    Float sumTr = 0;
+    for (int i = 0; i < nSamples; ++i) sumTr += medium.Tr(ray, sampler).y();
+    EXPECT_NEAR(expected, sumTr / nSamples, .01);
+
+    MemoryArena arena;
+    int nScattered = 0;
+    for (int i = 0; i < nSamples; ++i) {
+        MediumInteraction mi;
+        medium.Sample(ray, sampler, arena, &mi);
+        if (mi.IsValid()) {
+            ++nScattered;
+            EXPECT_GE(mi.p.x, 0);
+            EXPECT_LE(mi.p.x, 1);
+        }
+        arena.Reset();
+    }
+    EXPECT_NEAR(1 - expected, Float(nScattered) / nSamples, .01);
+}
+
+TEST(GridDensityMedium, UniformTransmittance) {
+    const int n = 16;
+    std::vector<Float> d(n * n * n, 1.f);
+    // The density falls off over the half voxel at each end of the ray.
+    TestGridTransmittance(d, n, 2, 1 - .25f / n);
+}
+
+TEST(GridDensityMedium, HalfEmptyTransmittance) {
+    // Only the x < 1/2 half of the grid has nonzero density, so the ray
+    // passes through empty majorant cells.
+    const int n = 16;
+    std::vector<Float> d(n * n * n, 0.f);
+    for (int z = 0; z < n; ++z)
+        for (int y = 0; y < n; ++y)
+            for (int x = 0; x < n / 2; ++x) d[(z * n + y) * n + x] = 1;
+    TestGridTransmittance(d, n, 2, 7.875f / n);
+}
+
+TEST(GridDensityMedium, NonuniformTransmittance) {
+    // A dense slab with a thin tail; with a single global majorant most
+    // lookups would be in the tail.
+    const int n = 20;
+    std::vector<Float> d(n * n * n, 0.f);
+    for (int z = 0; z < n; ++z)
+        for (int y = 0; y < n; ++y) {
+            d[(z * n + y) * n + 3] = 40;
+            for (int x = 6; x < n; ++x) d[(z * n + y) * n + x] = .1;
+        }
+    // Integral over [x_2, x_4] from the density spike at x_3, plus the
+    // tail from x_5 to the end of the grid.
+    Float integral = 40.f / n + .1f * (.5f + (n - 7) + .75f * .5f) / n;
+    TestGridTransmittance(d, n, .1, integral);
+}
+
+TEST(GridVolume, EncodeAndRead) {
+    // A 20x12x9 grid that's empty apart from a few bricks
+    const int nx = 20, ny = 12, nz = 9;
+    std::vector<Float> d(nx * ny * nz, 0.f);
+    RNG rng;
+    for (int z = 0; z < nz; ++z)
+        for (int y = 0; y < ny; ++y)
+            for (int x = 0; x < nx; ++x)
+                if (x >= 16 || (x < 8 && y < 8 && z < 8))
+                    d[(z * ny + y) * nx + x] = 10 * rng.UniformFloat();
+
+    for (GridEncoding encoding :
+         {GridEncoding::Float, GridEncoding::Half, GridEncoding::Byte}) {
+        std::unique_ptr<GridVolume> volume =
+            GridVolume::Encode(nx, ny, nz, d.data(), encoding);
+        // Bricks at x >= 16 and the brick at the origin are stored.
+        EXPECT_EQ(1 * 2 * 2 + 1, volume->nStoredBricks);
+
+        const char *filename = "test.pbrtvol";
+        ASSERT_TRUE(volume->Write(filename));
+        std::unique_ptr<GridVolume> read = GridVolume::Read(filename);
+        ASSERT_TRUE(read.get() != nullptr);
+        EXPECT_EQ(0, remove(filename));
+
+        // Byte quantization is over each brick's range of [0,10).
+        Float tolerance = encoding == GridEncoding::Float
+                              ? 0
+                              : (encoding == GridEncoding::Half ? 1e-2 : .02);
+        for (int z = -1; z <= nz; ++z)
+            for (int y = -1; y <= ny; ++y)
+                for (int x = -1; x <= nx; ++x) {
+                    bool inside = x >= 0 && x < nx && y >= 0 && y < ny &&
+                                  z >= 0 && z < nz;
+                    Float expected = inside ? d[(z * ny + y) * nx + x] : 0;
+                    Float v = read->Lookup(x, y, z);
+                    EXPECT_EQ(volume->Lookup(x, y, z), v);
+                    EXPECT_NEAR(expected, v, tolerance);
+                    if (expected == 0) {
+                        EXPECT_EQ(0, v);
+                    }
+                    if (inside) {
+                        EXPECT_LE(v, read->BrickMax(x / 8, y / 8, z / 8));
+                    }
+                }
+    }
+}
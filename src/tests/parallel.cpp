@@ -37,3 +37,41 @@ TEST(Parallel, DoNothing) {
 
     ParallelCleanup();
 }
+
+TEST(Parallel, Nested) {
+    // Use several threads even on machines with few cores.
+    int nThreads = PbrtOptions.nThreads;
+    PbrtOptions.nThreads = 4;
+    ParallelInit();
+
+    std::atomic<int> counter{0};
+    ParallelFor([&](int64_t i) {
+        ParallelFor([&](int64_t j) {
+            ParallelFor2D([&](Point2i p) { ++counter; }, Point2i(3, 5));
+        }, 17, 2);
+    }, 23, 1);
+    EXPECT_EQ(23 * 17 * 3 * 5, counter);
+
+    ParallelCleanup();
+    PbrtOptions.nThreads = nThreads;
+}
+
+TEST(Parallel, UnevenWork) {
+    int nThreads = PbrtOptions.nThreads;
+    PbrtOptions.nThreads = 4;
+    ParallelInit();
+
+    // Iterations that vary widely in cost, so that threads that finish
+    // early have to steal the rest of the work.
+    std::vector<int> sums(2000, 0);
+    ParallelFor([&](int64_t i) {
+        int sum = 0;
+        for (int j = 0; j < (i % 97) * 1000; ++j) sum += j & 1;
+        sums[i] = sum;
+    }, sums.size(), 3);
+    for (size_t i = 0; i < sums.size(); ++i)
+        EXPECT_EQ((int(i) % 97) * 500, sums[i]);
+
+    ParallelCleanup();
+    PbrtOptions.nThreads = nThreads;
+}
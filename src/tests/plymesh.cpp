@@ -0,0 +1,84 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "parallel.h"
+#include "paramset.h"
+#include "rng.h"
+#include "shapes/plymesh.h"
+#include "shapes/triangle.h"
+#include <stdio.h>
+
+using namespace pbrt;
+
+static std::vector<std::shared_ptr<Shape>> ReadPly(const std::string &fn) {
+    ParamSet params;
+    std::unique_ptr<std::string[]> name(new std::string[1]);
+    name[0] = fn;
+    params.AddString("filename", std::move(name), 1);
+    static Transform identity;
+    return CreatePLYMesh(&identity, &identity, false, params);
+}
+
+static void CheckMesh(const std::vector<std::shared_ptr<Shape>> &tris,
+                      const std::vector<Point3f> &p,
+                      const std::vector<int> &indices) {
+    ASSERT_EQ(indices.size() / 3, tris.size());
+    for (size_t i = 0; i < tris.size(); ++i) {
+        Bounds3f expected =
+            Union(Bounds3f(p[indices[3 * i]], p[indices[3 * i + 1]]),
+                  p[indices[3 * i + 2]]);
+        Bounds3f b = tris[i]->WorldBound();
+        EXPECT_EQ(expected.pMin, b.pMin);
+        EXPECT_EQ(expected.pMax, b.pMax);
+    }
+}
+
+TEST(PLYMesh, BinaryRoundTrip) {
+    ParallelInit();
+
+    // Enough geometry that decoding is split across several chunks.
+    RNG rng;
+    int nVertices = 40000, nTriangles = 50000;
+    std::vector<Point3f> p(nVertices);
+    std::vector<Point2f> uv(nVertices);
+    for (int i = 0; i < nVertices; ++i) {
+        p[i] = Point3f(rng.UniformFloat(), rng.UniformFloat(),
+                       rng.UniformFloat());
+        uv[i] = Point2f(rng.UniformFloat(), rng.UniformFloat());
+    }
+    std::vector<int> indices(3 * nTriangles);
+    for (int &index : indices) index = rng.UniformUInt32(nVertices);
+
+    const char *fn = "test_binary.ply";
+    ASSERT_TRUE(WritePlyFile(fn, nTriangles, indices.data(), nVertices,
+                             p.data(), nullptr, nullptr, uv.data(), nullptr));
+    CheckMesh(ReadPly(fn), p, indices);
+    EXPECT_EQ(0, remove(fn));
+
+    ParallelCleanup();
+}
+
+TEST(PLYMesh, AsciiQuads) {
+    ParallelInit();
+
+    // ASCII files with mixed triangles and quads go through rply.
+    const char *fn = "test_ascii.ply";
+    FILE *f = fopen(fn, "w");
+    ASSERT_TRUE(f != nullptr);
+    fprintf(f,
+            "ply\nformat ascii 1.0\nelement vertex 5\n"
+            "property float x\nproperty float y\nproperty float z\n"
+            "element face 2\nproperty list uchar int vertex_indices\n"
+            "end_header\n"
+            "0 0 0\n1 0 0\n1 1 0\n0 1 0\n0 0 1\n"
+            "4 0 1 2 3\n3 0 1 4\n");
+    fclose(f);
+
+    std::vector<Point3f> p = {Point3f(0, 0, 0), Point3f(1, 0, 0),
+                              Point3f(1, 1, 0), Point3f(0, 1, 0),
+                              Point3f(0, 0, 1)};
+    CheckMesh(ReadPly(fn), p, {0, 1, 2, 3, 0, 2, 0, 1, 4});
+    EXPECT_EQ(0, remove(fn));
+
+    ParallelCleanup();
+}
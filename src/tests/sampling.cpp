@@ -6,6 +6,7 @@
 #include "rng.h"
 #include "sampling.h"
 #include "lowdiscrepancy.h"
+#include "samplers/halton.h"
 #include "samplers/maxmin.h"
 #include "samplers/sobol.h"
 #include "samplers/zerotwosequence.h"
@@ -133,6 +134,69 @@ TEST(LowDiscrepancy, Sobol) {
     }
 }
 
+TEST(LowDiscrepancy, BatchMatchesScalar) {
+    RNG rng;
+    std::vector<uint16_t> perms = ComputeRadicalInversePermutations(rng);
+    std::vector<int64_t> indices;
+    for (int i = 0; i < 37; ++i) indices.push_back(i * 6 + 5);
+    indices.push_back(0);
+    indices.push_back(1ll << 40);
+    int n = indices.size();
+    std::vector<Float> samples(n);
+
+    for (int dim = 0; dim < 40; ++dim) {
+        ScrambledRadicalInverse(
+            dim, reinterpret_cast<const uint64_t *>(&indices[0]), n,
+            &perms[PrimeSums[dim]], &samples[0]);
+        for (int i = 0; i < n; ++i)
+            EXPECT_EQ(ScrambledRadicalInverse(dim, indices[i],
+                                              &perms[PrimeSums[dim]]),
+                      samples[i]);
+
+        SobolSample(&indices[0], n, dim, &samples[0]);
+        for (int i = 0; i < n; ++i)
+            EXPECT_EQ(SobolSample(indices[i], dim), samples[i]);
+    }
+}
+
+// Precomputing blocks of samples mustn't change the sample values.
+TEST(LowDiscrepancy, PrecomputedSamplesMatch) {
+    auto checkSamplers = [](Sampler &a, Sampler &b) {
+        a.Request1DArray(3);
+        b.Request1DArray(3);
+        a.Request2DArray(2);
+        b.Request2DArray(2);
+        for (Point2i p : {Point2i(0, 0), Point2i(5, 3), Point2i(7, 7)}) {
+            a.StartPixel(p);
+            b.StartPixel(p);
+            // Skip ahead into the second block, then back to the start
+            for (int64_t sampleNum : {int64_t(70), int64_t(0)}) {
+                a.SetSampleNumber(sampleNum);
+                b.SetSampleNumber(sampleNum);
+                do {
+                    for (int dim = 0; dim < 8; ++dim) {
+                        EXPECT_EQ(a.Get1D(), b.Get1D());
+                        Point2f pa = a.Get2D(), pb = b.Get2D();
+                        EXPECT_EQ(pa.x, pb.x);
+                        EXPECT_EQ(pa.y, pb.y);
+                    }
+                    const Float *aa = a.Get1DArray(3), *ba = b.Get1DArray(3);
+                    for (int i = 0; i < 3; ++i) EXPECT_EQ(aa[i], ba[i]);
+                    const Point2f *a2 = a.Get2DArray(2),
+                                  *b2 = b.Get2DArray(2);
+                    for (int i = 0; i < 2; ++i) EXPECT_EQ(a2[i], b2[i]);
+                } while (a.StartNextSample() && b.StartNextSample());
+            }
+        }
+    };
+
+    Bounds2i bounds(Point2i(0, 0), Point2i(8, 8));
+    HaltonSampler h0(100, bounds, false, 0), h1(100, bounds, false, 10);
+    checkSamplers(h0, h1);
+    SobolSampler s0(128, bounds, 0), s1(128, bounds, 10);
+    checkSamplers(s0, s1);
+}
+
 // Make sure samplers that are supposed to generate a single sample in
 // each of the elementary intervals actually do so.
 // TODO: check Halton (where the elementary intervals are (2^i, 3^j)).
@@ -0,0 +1,132 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "stats.h"
+#include "rapidjson/document.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+using namespace pbrt;
+
+STAT_COUNTER("Test/Telemetry counter", telemetryTestCounter);
+
+static std::string ReadFileContents(const std::string &filename) {
+    std::ifstream in(filename);
+    return std::string(std::istreambuf_iterator<char>(in),
+                       std::istreambuf_iterator<char>());
+}
+
+TEST(Profiler, CollapsedStacks) {
+    uint64_t render = ProfToBits(Prof::IntegratorRender);
+    uint64_t li = render | ProfToBits(Prof::SamplerIntegratorLi);
+    std::map<uint64_t, uint64_t> stateCounts = {{render, 3}, {li, 2}};
+    std::string filename = "test_profile.folded";
+    ASSERT_TRUE(WriteCollapsedStacks(filename, stateCounts));
+
+    std::string renderName = ProfNames[(int)Prof::IntegratorRender];
+    std::string liName = ProfNames[(int)Prof::SamplerIntegratorLi];
+    EXPECT_EQ(renderName + " 3\n" + renderName + ";" + liName + " 2\n",
+              ReadFileContents(filename));
+    EXPECT_EQ(0, remove(filename.c_str()));
+}
+
+TEST(Profiler, ChromeTrace) {
+    uint64_t render = ProfToBits(Prof::IntegratorRender);
+    uint64_t li = render | ProfToBits(Prof::SamplerIntegratorLi);
+    // Samples are taken every 100 units of 100us; thread 1's sample comes
+    // first to check that the writer sorts them by thread.
+    std::vector<ProfileTraceSample> samples = {
+        {render, 1, 50}, {render, 0, 0}, {render, 0, 100}, {li, 0, 200}};
+    std::string filename = "test_profile.trace.json";
+    ASSERT_TRUE(WriteChromeTrace(filename, samples));
+
+    std::string contents = ReadFileContents(filename);
+    rapidjson::Document doc;
+    doc.Parse(contents.c_str());
+    ASSERT_FALSE(doc.HasParseError());
+    ASSERT_TRUE(doc.IsObject() && doc.HasMember("traceEvents"));
+    const rapidjson::Value &events = doc["traceEvents"];
+    ASSERT_TRUE(events.IsArray());
+    ASSERT_EQ(3u, events.Size());
+
+    // Each event covers its samples and the sampling period after the
+    // last one, in microseconds.
+    struct Event {
+        const char *name;
+        int tid, ts, dur;
+    } expected[3] = {
+        {ProfNames[(int)Prof::SamplerIntegratorLi], 0, 20000, 10000},
+        {ProfNames[(int)Prof::IntegratorRender], 0, 0, 30000},
+        {ProfNames[(int)Prof::IntegratorRender], 1, 5000, 10000}};
+    for (int i = 0; i < 3; ++i) {
+        const rapidjson::Value &e = events[i];
+        EXPECT_STREQ(expected[i].name, e["name"].GetString());
+        EXPECT_STREQ("X", e["ph"].GetString());
+        EXPECT_EQ(expected[i].tid, e["tid"].GetInt());
+        EXPECT_EQ(expected[i].ts, e["ts"].GetInt());
+        EXPECT_EQ(expected[i].dur, e["dur"].GetInt());
+    }
+    EXPECT_EQ(0, remove(filename.c_str()));
+}
+
+TEST(StatsTelemetry, JSONLines) {
+    std::string filename = "test_telemetry.jsonl";
+    ClearStats();
+    InitStatsTelemetry(filename, 0);
+    telemetryTestCounter += 5;
+    ReportThreadStats();
+    ReportStatsProgress("Test pass", .5f);
+    WriteStatsTelemetry(true);
+    CleanupStatsTelemetry();
+
+    std::string contents = ReadFileContents(filename);
+    ASSERT_FALSE(contents.empty());
+    EXPECT_EQ('\n', contents.back());
+    // The file holds a single snapshot, written as one line
+    EXPECT_EQ(contents.size() - 1, contents.find('\n'));
+    rapidjson::Document doc;
+    doc.Parse(contents.c_str());
+    ASSERT_FALSE(doc.HasParseError());
+    ASSERT_TRUE(doc.IsObject());
+    EXPECT_TRUE(doc["time"].IsNumber());
+    EXPECT_EQ(0, doc["frame"].GetInt());
+    EXPECT_TRUE(doc["final"].GetBool());
+    for (const char *member : {"counters", "memory", "percentages", "ratios",
+                               "profile", "progress"})
+        EXPECT_TRUE(doc.HasMember(member) && doc[member].IsObject())
+            << member;
+    EXPECT_EQ(5, doc["counters"]["Test/Telemetry counter"].GetInt64());
+    EXPECT_NEAR(.5, doc["progress"]["Test pass"].GetDouble(), 1e-4);
+    EXPECT_EQ(0, remove(filename.c_str()));
+}
+
+TEST(StatsTelemetry, CSV) {
+    std::string filename = "test_telemetry.csv";
+    ClearStats();
+    InitStatsTelemetry(filename, 0);
+    telemetryTestCounter += 3;
+    ReportThreadStats();
+    WriteStatsTelemetry(true);
+    CleanupStatsTelemetry();
+
+    std::istringstream in(ReadFileContents(filename));
+    std::string line;
+    ASSERT_TRUE(bool(std::getline(in, line)));
+    EXPECT_EQ("time,frame,final,type,name,value,total", line);
+    int nRows = 0;
+    bool foundCounter = false;
+    while (std::getline(in, line)) {
+        ++nRows;
+        // Every row has the seven columns of the header
+        EXPECT_EQ(6, std::count(line.begin(), line.end(), ',')) << line;
+        std::string fields = line.substr(line.find(',') + 1);
+        if (fields == "0,1,counter,Test/Telemetry counter,3,")
+            foundCounter = true;
+    }
+    EXPECT_GT(nRows, 0);
+    EXPECT_TRUE(foundCounter);
+    EXPECT_EQ(0, remove(filename.c_str()));
+}
@@ -0,0 +1,64 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "mipmap.h"
+#include "parallel.h"
+#include "rng.h"
+#include "texcache.h"
+
+using namespace pbrt;
+
+TEST(TextureTileCache, MatchesResidentMIPMap) {
+    ParallelInit();
+
+    RNG rng;
+    Point2i res(300, 200);
+    std::vector<Float> texels(res.x * res.y);
+    for (Float &t : texels) t = rng.UniformFloat();
+
+    MIPMap<Float> resident(res, texels.data());
+    // A budget of a few tiles forces constant eviction and reloading.
+    TextureTileCache::Init(64 * 1024);
+    {
+        MIPMap<Float> cached(res, texels.data());
+        for (int i = 0; i < 10000; ++i) {
+            Point2f st(rng.UniformFloat(), rng.UniformFloat());
+            Vector2f dst0(.05f * rng.UniformFloat(), 0.f);
+            Vector2f dst1(0.f, .01f * rng.UniformFloat());
+            EXPECT_EQ(resident.Lookup(st, dst0, dst1),
+                      cached.Lookup(st, dst0, dst1));
+            Float width = rng.UniformFloat();
+            EXPECT_EQ(resident.Lookup(st, width), cached.Lookup(st, width));
+        }
+    }
+    TextureTileCache::Cleanup();
+
+    ParallelCleanup();
+}
+
+TEST(TextureTileCache, FreeTilesKeepsPinnedTiles) {
+    TextureTileCache::Init(1 << 20);
+    TextureTileCache *cache = TextureTileCache::Get();
+    ASSERT_TRUE(cache != nullptr);
+
+    // Tiles whose ids differ by the number of per-thread tile handles use
+    // the same handle, so looking up the second one releases the first.
+    std::vector<int> tileIds;
+    std::vector<uint8_t> data(4096);
+    for (int i = 0; i < 17; ++i) {
+        for (size_t j = 0; j < data.size(); ++j) data[j] = uint8_t(i + j);
+        tileIds.push_back(cache->AddTile(data.data(), data.size()));
+    }
+
+    const uint8_t *pinned = (const uint8_t *)cache->GetTile(tileIds[0]);
+    EXPECT_EQ(4096, cache->ResidentBytes());
+    cache->FreeTiles(tileIds[0], 1);
+    EXPECT_EQ(4096, cache->ResidentBytes());
+    for (size_t j = 0; j < data.size(); ++j)
+        EXPECT_EQ(uint8_t(j), pinned[j]);
+
+    cache->GetTile(tileIds[16]);
+    EXPECT_EQ(4096, cache->ResidentBytes());
+
+    TextureTileCache::Cleanup();
+}
@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <algorithm>
+#include <functional>
 #include "fileutil.h"
 #include "imageio.h"
 #include "pbrt.h"
@@ -33,6 +34,9 @@ static void usage(const char *msg = nullptr, ...) {
 
 commands: assemble, cat, convert, diff, info, makesky
 
+Commands given several images process them in parallel. EXR and PFM images
+are read a band of rows at a time by "diff" and "info".
+
 assemble option:
     --outfile          Output image filename.
 
@@ -54,6 +58,10 @@ convert options:
     --flipy            Flip the image along the y axis
     --maxluminance <n> Luminance value mapped to white by tonemapping.
                        Default: 1
+    --outdir <dir>     Convert all of the given images, writing each one to a
+                       file with the same name in <dir>.
+    --outext <ext>     With --outdir, replace the extension of each output
+                       filename with <ext> (e.g. ".png").
     --preservecolors   By default, out-of-gammut colors have each component
                        clamped to [0,1] when written to non-HDR formats. With
                        this option enabled, such colors are scaled by their
@@ -67,8 +75,12 @@ convert options:
 diff options:
     --difftol <v>      Acceptable image difference percentage before differences
                        are reported. Default: 0
+    --metrics          Print the MSE, relative MSE and SSIM of each pair of
+                       images, even if they don't differ.
     --outfile <name>   Filename to use for saving an image that encodes the
                        absolute value of per-pixel differences.
+    --refdir <dir>     Compare each of the given images to the image with the
+                       same name in <dir>.
 
 makesky options:
     --albedo <a>       Albedo of ground-plane (range 0-1). Default: 0.5
@@ -84,6 +96,59 @@ makesky options:
     exit(1);
 }
 
+// Images are read and processed in bands of rows holding about this many
+// pixels.
+static PBRT_CONSTEXPR int bandPixels = 1 << 22;
+// SSIM is computed over square blocks of pixels of this size.
+static PBRT_CONSTEXPR int ssimBlockSize = 8;
+
+// Returns the number of rows in a band of an image of the given width; it's
+// a multiple of the SSIM block size, so that blocks don't straddle bands.
+static int BandRows(int width) {
+    int rows = std::max(1, bandPixels / width);
+    return std::max(ssimBlockSize, rows / ssimBlockSize * ssimBlockSize);
+}
+
+// Appends printf-style formatted text to _output_.
+static void AppendPrintf(std::string *output, const char *fmt, ...) {
+    va_list args, argsCopy;
+    va_start(args, fmt);
+    va_copy(argsCopy, args);
+    size_t length = vsnprintf(nullptr, 0, fmt, args);
+    va_end(args);
+    std::vector<char> buf(length + 1);
+    vsnprintf(&buf[0], buf.size(), fmt, argsCopy);
+    va_end(argsCopy);
+    *output += &buf[0];
+}
+
+static std::string BaseName(const std::string &filename) {
+    size_t slash = filename.find_last_of('/');
+    return slash == std::string::npos ? filename : filename.substr(slash + 1);
+}
+
+// Runs _func_ for each of _n_ files, in parallel if there are several, and
+// then prints the text that each one produced in order. _func_ is told to
+// parallelize its own work when it's given the only file. Returns the
+// largest of the returned exit statuses.
+static int ForEachFile(
+    int n, std::function<int(int, bool, std::string *)> func) {
+    std::vector<std::string> output(n);
+    std::vector<int> status(n, 0);
+    if (n == 1)
+        status[0] = func(0, true, &output[0]);
+    else
+        ParallelFor([&](int64_t i) {
+            status[i] = func(int(i), false, &output[i]);
+        }, n);
+    int err = 0;
+    for (int i = 0; i < n; ++i) {
+        fputs(output[i].c_str(), stdout);
+        err = std::max(err, status[i]);
+    }
+    return err;
+}
+
 int makesky(int argc, char *argv[]) {
     const char *outfile = "sky.exr";
     float albedo = 0.5;
@@ -155,7 +220,6 @@ int makesky(int argc, char *argv[]) {
 
     int nTheta = resolution, nPhi = 2 * nTheta;
     std::vector<Float> img(3 * nTheta * nPhi, 0.f);
-    ParallelInit();
     ParallelFor([&](int64_t t) {
         Float theta = float(t + 0.5) / nTheta * Pi;
         if (theta > Pi / 2.) return;
@@ -183,7 +247,6 @@ int makesky(int argc, char *argv[]) {
 
     WriteImage(outfile, (Float *)&img[0], Bounds2i({0, 0}, {nPhi, nTheta}),
                {nPhi, nTheta});
-    ParallelCleanup();
     return 0;
 }
 
@@ -330,9 +393,186 @@ int cat(int argc, char *argv[]) {
     return 0;
 }
 
-int diff(int argc, char *argv[]) {
+// Differences between two images, accumulated over bands of rows.
+struct DiffStats {
+    double sum[2] = {0., 0.};
+    double mse = 0., relMSE = 0., ssim = 0.;
+    int64_t smallDiff = 0, bigDiff = 0, nSSIMBlocks = 0;
+
+    void Add(const DiffStats &s) {
+        for (int i = 0; i < 2; ++i) sum[i] += s.sum[i];
+        mse += s.mse;
+        relMSE += s.relMSE;
+        ssim += s.ssim;
+        smallDiff += s.smallDiff;
+        bigDiff += s.bigDiff;
+        nSSIMBlocks += s.nSSIMBlocks;
+    }
+};
+
+// Compares up to _ssimBlockSize_ rows of two images, making a single pass
+// over their pixels. The absolute differences are stored in _diffRows_ if
+// it's non-null.
+static DiffStats DiffBlockRow(const RGBSpectrum *rows0,
+                              const RGBSpectrum *rows1, RGBSpectrum *diffRows,
+                              int width, int nRows) {
+    DiffStats stats;
+    // Sums of the two images' luminances, their squares and their product
+    // in each SSIM block.
+    int nBlocks = (width + ssimBlockSize - 1) / ssimBlockSize;
+    std::vector<double> moments(5 * nBlocks, 0.);
+    for (int i = 0; i < width * nRows; ++i) {
+        Float rgb[2][3];
+        rows0[i].ToRGB(rgb[0]);
+        rows1[i].ToRGB(rgb[1]);
+
+        Float diffRGB[3];
+        for (int c = 0; c < 3; ++c) {
+            Float c0 = rgb[0][c], c1 = rgb[1][c];
+            diffRGB[c] = std::abs(c0 - c1);
+
+            if (c0 == 0 && c1 == 0) continue;
+
+            stats.sum[0] += c0;
+            stats.sum[1] += c1;
+
+            float d = std::abs(c0 - c1) / c0;
+            stats.mse += (c0 - c1) * (c0 - c1);
+            // Relative error is normalized by the first image's value, with
+            // a small epsilon so that nearly black pixels don't dominate.
+            stats.relMSE += (c0 - c1) * (c0 - c1) / (c0 * c0 + 1e-2);
+            if (d > .005) ++stats.smallDiff;
+            if (d > .05) ++stats.bigDiff;
+        }
+        if (diffRows) diffRows[i] = RGBSpectrum::FromRGB(diffRGB);
+
+        double y0 = rows0[i].y(), y1 = rows1[i].y();
+        double *m = &moments[5 * ((i % width) / ssimBlockSize)];
+        m[0] += y0;
+        m[1] += y1;
+        m[2] += y0 * y0;
+        m[3] += y1 * y1;
+        m[4] += y0 * y1;
+    }
+
+    // Compute the SSIM of each block's luminance, using the constants from
+    // Wang et al. 2004 for a dynamic range of one.
+    const double C1 = .01 * .01, C2 = .03 * .03;
+    for (int b = 0; b < nBlocks; ++b) {
+        const double *m = &moments[5 * b];
+        int n = nRows * (std::min(width, (b + 1) * ssimBlockSize) -
+                         b * ssimBlockSize);
+        double mu0 = m[0] / n, mu1 = m[1] / n;
+        double var0 = m[2] / n - mu0 * mu0, var1 = m[3] / n - mu1 * mu1;
+        double cov = m[4] / n - mu0 * mu1;
+        stats.ssim += ((2 * mu0 * mu1 + C1) * (2 * cov + C2)) /
+                      ((mu0 * mu0 + mu1 * mu1 + C1) * (var0 + var1 + C2));
+        ++stats.nSSIMBlocks;
+    }
+    return stats;
+}
+
+struct DiffOptions {
     float tol = 0.;
+    bool metrics = false;
     const char *outfile = nullptr;
+};
+
+static int DiffFiles(const std::string &filename0,
+                     const std::string &filename1, const DiffOptions &options,
+                     bool parallel, std::string *output) {
+    const std::string filename[2] = {filename0, filename1};
+    std::unique_ptr<ImageRowReader> readers[2];
+    Point2i res[2];
+    for (int i = 0; i < 2; ++i) {
+        readers[i] = CreateImageRowReader(filename[i]);
+        if (!readers[i]) {
+            fprintf(stderr, "%s: unable to read image\n", filename[i].c_str());
+            return 1;
+        }
+        res[i] = readers[i]->Resolution();
+    }
+    if (res[0] != res[1]) {
+        fprintf(stderr,
+                "imgtool: image resolutions don't match \"%s\": (%d, %d) "
+                "\"%s\": (%d, %d)\n",
+                filename[0].c_str(), res[0].x, res[0].y, filename[1].c_str(),
+                res[1].x, res[1].y);
+        return 1;
+    }
+
+    std::unique_ptr<RGBSpectrum[]> diffImage;
+    if (options.outfile) diffImage.reset(new RGBSpectrum[res[0].x * res[0].y]);
+
+    // Compare the images a band at a time; the rows of SSIM blocks within
+    // each band are compared in parallel unless other images are being
+    // compared concurrently.
+    int width = res[0].x, bandRows = BandRows(width);
+    std::vector<RGBSpectrum> bands[2];
+    for (int i = 0; i < 2; ++i) bands[i].resize(bandRows * width);
+    DiffStats stats;
+    for (int y0 = 0; y0 < res[0].y; y0 += bandRows) {
+        int y1 = std::min(y0 + bandRows, res[0].y);
+        for (int i = 0; i < 2; ++i)
+            if (!readers[i]->ReadRows(y0, y1, &bands[i][0])) {
+                fprintf(stderr, "%s: unable to read image\n",
+                        filename[i].c_str());
+                return 1;
+            }
+
+        int nBlockRows = (y1 - y0 + ssimBlockSize - 1) / ssimBlockSize;
+        std::vector<DiffStats> blockRowStats(nBlockRows);
+        auto diffBlockRow = [&](int64_t b) {
+            int y = y0 + int(b) * ssimBlockSize;
+            int offset = (y - y0) * width;
+            blockRowStats[b] = DiffBlockRow(
+                &bands[0][offset], &bands[1][offset],
+                diffImage ? &diffImage[y * width] : nullptr, width,
+                std::min(ssimBlockSize, y1 - y));
+        };
+        if (parallel)
+            ParallelFor(diffBlockRow, nBlockRows);
+        else
+            for (int b = 0; b < nBlockRows; ++b) diffBlockRow(b);
+        // Sum in order so that the results don't depend on scheduling.
+        for (const DiffStats &s : blockRowStats) stats.Add(s);
+    }
+
+    double nComponents = 3. * res[0].x * res[0].y;
+    double avg[2] = {stats.sum[0] / nComponents, stats.sum[1] / nComponents};
+    double avgDelta = (avg[0] - avg[1]) / std::min(avg[0], avg[1]);
+    double mse = stats.mse / nComponents, relMSE = stats.relMSE / nComponents;
+    double ssim = stats.ssim / stats.nSSIMBlocks;
+    if (options.metrics)
+        AppendPrintf(output, "%s %s: MSE %g, relMSE %g, SSIM %.6f\n",
+                     filename[0].c_str(), filename[1].c_str(), mse, relMSE,
+                     ssim);
+    float tol = options.tol;
+    if ((tol == 0. && (stats.bigDiff > 0 || stats.smallDiff > 0)) ||
+        (tol > 0. && 100.f * std::abs(avgDelta) > tol)) {
+        AppendPrintf(
+            output,
+            "%s %s\n\tImages differ: %d big (%.2f%%), %d small (%.2f%%)\n"
+            "\tavg 1 = %g, avg2 = %g (%f%% delta)\n"
+            "\tMSE = %g, RMS = %.3f%%, relMSE = %g, SSIM = %.6f\n",
+            filename[0].c_str(), filename[1].c_str(), int(stats.bigDiff),
+            100.f * float(stats.bigDiff) / nComponents, int(stats.smallDiff),
+            100.f * float(stats.smallDiff) / nComponents, avg[0], avg[1],
+            100. * avgDelta, mse, 100. * sqrt(mse), relMSE, ssim);
+        if (options.outfile) {
+            // FIXME: diffImage cast is bad.
+            WriteImage(options.outfile, (Float *)diffImage.get(),
+                       Bounds2i(Point2i(0, 0), res[0]), res[0]);
+        }
+        return 1;
+    }
+
+    return 0;
+}
+
+int diff(int argc, char *argv[]) {
+    DiffOptions options;
+    const char *refdir = nullptr;
 
     int i;
     for (i = 0; i < argc; ++i) {
@@ -341,9 +581,19 @@ int diff(int argc, char *argv[]) {
             !strcmp(argv[i], "-o")) {
             if (i + 1 == argc)
                 usage("missing filename after %s option", argv[i]);
-            outfile = argv[++i];
+            options.outfile = argv[++i];
         } else if (!strncmp(argv[i], "--outfile=", 10)) {
-            outfile = &argv[i][10];
+            options.outfile = &argv[i][10];
+        } else if (!strcmp(argv[i], "--refdir") ||
+                   !strcmp(argv[i], "-refdir")) {
+            if (i + 1 == argc)
+                usage("missing directory after %s option", argv[i]);
+            refdir = argv[++i];
+        } else if (!strncmp(argv[i], "--refdir=", 9)) {
+            refdir = &argv[i][9];
+        } else if (!strcmp(argv[i], "--metrics") ||
+                   !strcmp(argv[i], "-metrics")) {
+            options.metrics = true;
         } else if (!strcmp(argv[i], "--difftol") ||
                    !strcmp(argv[i], "-difftol") || !strcmp(argv[i], "-d")) {
             if (i + 1 == argc)
@@ -351,119 +601,65 @@ int diff(int argc, char *argv[]) {
             ++i;
             if (!isdigit(argv[i][0]) && argv[i][0] != '.')
                 usage("argument after %s doesn't look like a number", argv[i]);
-            tol = atof(argv[i]);
+            options.tol = atof(argv[i]);
         } else if (!strncmp(argv[i], "--difftol=", 10))
-            tol = atof(&argv[i][10]);
+            options.tol = atof(&argv[i][10]);
         else
             usage("unknown \"diff\" option");
     }
 
     if (i >= argc)
         usage("missing filenames for \"diff\"");
-    else if (i + 1 >= argc)
+    if (refdir) {
+        if (options.outfile)
+            usage("--outfile can't be used with --refdir");
+        char **files = argv + i;
+        return ForEachFile(argc - i, [&](int f, bool parallel,
+                                         std::string *output) {
+            return DiffFiles(std::string(refdir) + "/" + BaseName(files[f]),
+                             files[f], options, parallel, output);
+        });
+    }
+    if (i + 1 >= argc)
         usage("missing second filename for \"diff\"");
     else if (i + 2 < argc)
         usage("excess filenames provided to \"diff\"");
 
     const char *filename[2] = {argv[i], argv[i + 1]};
-    Point2i res[2];
-    std::unique_ptr<RGBSpectrum[]> imgs[2] = {ReadImage(filename[0], &res[0]),
-                                              ReadImage(filename[1], &res[1])};
-    if (!imgs[0]) {
-        fprintf(stderr, "%s: unable to read image\n", filename[0]);
-        return 1;
-    }
-    if (!imgs[1]) {
-        fprintf(stderr, "%s: unable to read image\n", filename[1]);
-        return 1;
-    }
-    if (res[0] != res[1]) {
-        fprintf(stderr,
-                "imgtool: image resolutions don't match \"%s\": (%d, %d) "
-                "\"%s\": (%d, %d)\n",
-                filename[0], res[0].x, res[0].y, filename[1], res[1].x,
-                res[1].y);
-        return 1;
-    }
-
-    std::unique_ptr<RGBSpectrum[]> diffImage;
-    if (outfile) diffImage.reset(new RGBSpectrum[res[0].x * res[0].y]);
-
-    double sum[2] = {0., 0.};
-    int smallDiff = 0, bigDiff = 0;
-    double mse = 0.f;
-    for (int i = 0; i < res[0].x * res[0].y; ++i) {
-        Float rgb[2][3];
-        imgs[0][i].ToRGB(rgb[0]);
-        imgs[1][i].ToRGB(rgb[1]);
-
-        Float diffRGB[3];
-        for (int c = 0; c < 3; ++c) {
-            Float c0 = rgb[0][c], c1 = rgb[1][c];
-            diffRGB[c] = std::abs(c0 - c1);
-
-            if (c0 == 0 && c1 == 0) continue;
-
-            sum[0] += c0;
-            sum[1] += c1;
-
-            float d = std::abs(c0 - c1) / c0;
-            mse += (c0 - c1) * (c0 - c1);
-            if (d > .005) ++smallDiff;
-            if (d > .05) ++bigDiff;
-        }
-        if (diffImage) diffImage[i] = RGBSpectrum::FromRGB(diffRGB);
-    }
+    return ForEachFile(1, [&](int, bool parallel, std::string *output) {
+        return DiffFiles(filename[0], filename[1], options, parallel, output);
+    });
+}
 
-    double avg[2] = {sum[0] / (3. * res[0].x * res[0].y),
-                     sum[1] / (3. * res[0].x * res[0].y)};
-    double avgDelta = (avg[0] - avg[1]) / std::min(avg[0], avg[1]);
-    if ((tol == 0. && (bigDiff > 0 || smallDiff > 0)) ||
-        (tol > 0. && 100.f * std::abs(avgDelta) > tol)) {
-        printf(
-            "%s %s\n\tImages differ: %d big (%.2f%%), %d small (%.2f%%)\n"
-            "\tavg 1 = %g, avg2 = %g (%f%% delta)\n"
-            "\tMSE = %g, RMS = %.3f%%\n",
-            filename[0], filename[1], bigDiff,
-            100.f * float(bigDiff) / (3 * res[0].x * res[0].y), smallDiff,
-            100.f * float(smallDiff) / (3 * res[0].x * res[0].y), avg[0],
-            avg[1], 100. * avgDelta, mse / (3. * res[0].x * res[0].y),
-            100. * sqrt(mse / (3. * res[0].x * res[0].y)));
-        if (outfile) {
-            // FIXME: diffImage cast is bad.
-            WriteImage(outfile, (Float *)diffImage.get(),
-                       Bounds2i(Point2i(0, 0), res[0]), res[0]);
-        }
+static int InfoFile(const char *filename, std::string *output) {
+    std::unique_ptr<ImageRowReader> reader = CreateImageRowReader(filename);
+    if (!reader) {
+        fprintf(stderr, "%s: unable to load image.\n", filename);
         return 1;
     }
 
-    return 0;
-}
-
-int info(int argc, char *argv[]) {
-    int err = 0;
-    for (int i = 0; i < argc; ++i) {
-        Point2i res;
-        std::unique_ptr<RGBSpectrum[]> image = ReadImage(argv[i], &res);
-        if (!image) {
-            fprintf(stderr, "%s: unable to load image.\n", argv[i]);
-            err = 1;
-            continue;
+    Point2i res = reader->Resolution();
+    AppendPrintf(output, "%s: resolution %d, %d\n", filename, res.x, res.y);
+    Float min[3] = {Infinity, Infinity, Infinity};
+    Float max[3] = {-Infinity, -Infinity, -Infinity};
+    double sum[3] = {0., 0., 0.};
+    double logYSum = 0.;
+    int nNaN = 0, nInf = 0, nValid[3] = { 0, 0, 0 };
+    int bandRows = BandRows(res.x);
+    std::vector<RGBSpectrum> band(bandRows * res.x);
+    for (int y0 = 0; y0 < res.y; y0 += bandRows) {
+        int y1 = std::min(y0 + bandRows, res.y);
+        if (!reader->ReadRows(y0, y1, &band[0])) {
+            fprintf(stderr, "%s: unable to load image.\n", filename);
+            return 1;
         }
-
-        printf("%s: resolution %d, %d\n", argv[i], res.x, res.y);
-        Float min[3] = {Infinity, Infinity, Infinity};
-        Float max[3] = {-Infinity, -Infinity, -Infinity};
-        double sum[3] = {0., 0., 0.};
-        double logYSum = 0.;
-        int nNaN = 0, nInf = 0, nValid[3] = { 0, 0, 0 };
-        for (int i = 0; i < res.x * res.y; ++i) {
-            Float y = image[i].y();
+        for (int i = 0; i < (y1 - y0) * res.x; ++i) {
+            Float y = band[i].y();
             if (!std::isnan(y) && !std::isinf(y))
                 logYSum += std::log(Float(1e-6) + y);
 
             Float rgb[3];
-            image[i].ToRGB(rgb);
+            band[i].ToRGB(rgb);
             for (int c = 0; c < 3; ++c) {
                 if (std::isnan(rgb[c]))
                     ++nNaN;
@@ -477,16 +673,26 @@ int info(int argc, char *argv[]) {
                 }
             }
         }
-        printf("%s: %d infinite pixel components, %d NaN, (%d, %d, %d) valid.\n",
-               argv[i], nInf, nNaN, nValid[0], nValid[1], nValid[2]);
-        printf("%s: log average luminance %f\n", argv[i],
-               std::exp(logYSum / (res.x * res.y)));
-        printf("%s: min rgb (%f, %f, %f)\n", argv[i], min[0], min[1], min[2]);
-        printf("%s: max rgb (%f, %f, %f)\n", argv[i], max[0], max[1], max[2]);
-        printf("%s: avg rgb (%f, %f, %f)\n", argv[i], sum[0] / nValid[0],
-               sum[1] / nValid[1], sum[2] / nValid[2]);
     }
-    return err;
+    AppendPrintf(output,
+                 "%s: %d infinite pixel components, %d NaN, (%d, %d, %d) "
+                 "valid.\n",
+                 filename, nInf, nNaN, nValid[0], nValid[1], nValid[2]);
+    AppendPrintf(output, "%s: log average luminance %f\n", filename,
+                 std::exp(logYSum / (res.x * res.y)));
+    AppendPrintf(output, "%s: min rgb (%f, %f, %f)\n", filename, min[0],
+                 min[1], min[2]);
+    AppendPrintf(output, "%s: max rgb (%f, %f, %f)\n", filename, max[0],
+                 max[1], max[2]);
+    AppendPrintf(output, "%s: avg rgb (%f, %f, %f)\n", filename,
+                 sum[0] / nValid[0], sum[1] / nValid[1], sum[2] / nValid[2]);
+    return 0;
+}
+
+int info(int argc, char *argv[]) {
+    return ForEachFile(argc, [&](int i, bool, std::string *output) {
+        return InfoFile(argv[i], output);
+    });
 }
 
 std::unique_ptr<RGBSpectrum[]> bloom(std::unique_ptr<RGBSpectrum[]> image,
@@ -582,7 +788,7 @@ std::unique_ptr<RGBSpectrum[]> bloom(std::unique_ptr<RGBSpectrum[]> image,
     return image;
 }
 
-int convert(int argc, char *argv[]) {
+struct ConvertOptions {
     float scale = 1.f;
     int repeat = 1;
     bool flipy = false;
@@ -594,68 +800,10 @@ int convert(int argc, char *argv[]) {
     Float maxY = 1.;
     Float despikeLimit = Infinity;
     bool preserveColors = false;
+};
 
-    int i;
-    auto parseArg = [&]() -> std::pair<std::string, double> {
-        const char *ptr = argv[i];
-        // Skip over a leading dash or two.
-        CHECK_EQ(*ptr, '-');
-        ++ptr;
-        if (*ptr == '-') ++ptr;
-
-        // Copy the flag name to the string.
-        std::string flag;
-        while (*ptr && *ptr != '=') flag += *ptr++;
-
-        if (!*ptr && i + 1 == argc)
-            usage("missing value after %s flag", argv[i]);
-        const char *value = (*ptr == '=') ? (ptr + 1) : argv[++i];
-        return {flag, atof(value)};
-    };
-
-    std::pair<std::string, double> arg;
-    for (i = 0; i < argc; ++i) {
-        if (argv[i][0] != '-') break;
-        if (!strcmp(argv[i], "--flipy") || !strcmp(argv[i], "-flipy"))
-            flipy = !flipy;
-        else if (!strcmp(argv[i], "--tonemap") || !strcmp(argv[i], "-tonemap"))
-            tonemap = !tonemap;
-        else if (!strcmp(argv[i], "--preservecolors") || !strcmp(argv[i], "-preservecolors"))
-            preserveColors = !preserveColors;
-        else {
-            std::pair<std::string, double> arg = parseArg();
-            if (std::get<0>(arg) == "maxluminance") {
-                maxY = std::get<1>(arg);
-                if (maxY <= 0)
-                    usage("--maxluminance value must be greater than zero");
-            } else if (std::get<0>(arg) == "repeatpix") {
-                repeat = int(std::get<1>(arg));
-                if (repeat <= 0)
-                    usage("--repeatpix value must be greater than zero");
-            } else if (std::get<0>(arg) == "scale") {
-                scale = std::get<1>(arg);
-                if (scale == 0) usage("--scale value must be non-zero");
-            } else if (std::get<0>(arg) == "bloomlevel")
-                bloomLevel = std::get<1>(arg);
-            else if (std::get<0>(arg) == "bloomwidth")
-                bloomWidth = int(std::get<1>(arg));
-            else if (std::get<0>(arg) == "bloomscale")
-                bloomScale = std::get<1>(arg);
-            else if (std::get<0>(arg) == "bloomiters")
-                bloomIters = int(std::get<1>(arg));
-            else if (std::get<0>(arg) == "despike")
-                despikeLimit = std::get<1>(arg);
-            else
-                usage();
-        }
-    }
-
-    if (i + 1 >= argc)
-        usage("missing second filename for \"convert\"");
-    else if (i >= argc)
-        usage("missing filenames for \"convert\"");
-
-    const char *inFilename = argv[i], *outFilename = argv[i + 1];
+static int ConvertImage(const char *inFilename, const std::string &outFilename,
+                        const ConvertOptions &options) {
     Point2i res;
     std::unique_ptr<RGBSpectrum[]> image(ReadImage(inFilename, &res));
     if (!image) {
@@ -663,15 +811,15 @@ int convert(int argc, char *argv[]) {
         return 1;
     }
 
-    for (int i = 0; i < res.x * res.y; ++i) image[i] *= scale;
+    for (int i = 0; i < res.x * res.y; ++i) image[i] *= options.scale;
 
-    if (despikeLimit < Infinity) {
+    if (options.despikeLimit < Infinity) {
         std::unique_ptr<RGBSpectrum[]> filteredImg(
             new RGBSpectrum[res.x * res.y]);
         int despikeCount = 0;
         for (int y = 0; y < res.y; ++y) {
             for (int x = 0; x < res.x; ++x) {
-                if (image[y * res.x + x].y() < despikeLimit) {
+                if (image[y * res.x + x].y() < options.despikeLimit) {
                     filteredImg[y * res.x + x] = image[y * res.x + x];
                     continue;
                 }
@@ -703,11 +851,13 @@ int convert(int argc, char *argv[]) {
         fprintf(stderr, "%s: despiked %d pixels\n", inFilename, despikeCount);
     }
 
-    if (bloomLevel < Infinity)
-        image = bloom(std::move(image), res, bloomLevel, bloomWidth, bloomScale,
-                      bloomIters);
+    if (options.bloomLevel < Infinity)
+        image = bloom(std::move(image), res, options.bloomLevel,
+                      options.bloomWidth, options.bloomScale,
+                      options.bloomIters);
 
-    if (tonemap) {
+    if (options.tonemap) {
+        Float maxY = options.maxY;
         for (int i = 0; i < res.x * res.y; ++i) {
             Float y = image[i].y();
             // Reinhard et al. photographic tone mapping operator.
@@ -716,7 +866,7 @@ int convert(int argc, char *argv[]) {
         }
     }
 
-    if (preserveColors) {
+    if (options.preserveColors) {
         for (int i = 0; i < res.x * res.y; ++i) {
             Float rgb[3];
             image[i].ToRGB(rgb);
@@ -730,6 +880,7 @@ int convert(int argc, char *argv[]) {
         }
     }
 
+    int repeat = options.repeat;
     if (repeat > 1) {
         std::unique_ptr<RGBSpectrum[]> rscale(
             new RGBSpectrum[repeat * res.x * repeat * res.y]);
@@ -746,7 +897,7 @@ int convert(int argc, char *argv[]) {
         image = std::move(rscale);
     }
 
-    if (flipy) {
+    if (options.flipy) {
         for (int y = 0; y < res.y / 2; ++y) {
             int yo = res.y - 1 - y;
             for (int x = 0; x < res.x; ++x)
@@ -761,26 +912,127 @@ int convert(int argc, char *argv[]) {
     return 0;
 }
 
+int convert(int argc, char *argv[]) {
+    ConvertOptions options;
+    const char *outdir = nullptr, *outext = nullptr;
+
+    int i;
+    auto parseArg = [&]() -> std::pair<std::string, double> {
+        const char *ptr = argv[i];
+        // Skip over a leading dash or two.
+        CHECK_EQ(*ptr, '-');
+        ++ptr;
+        if (*ptr == '-') ++ptr;
+
+        // Copy the flag name to the string.
+        std::string flag;
+        while (*ptr && *ptr != '=') flag += *ptr++;
+
+        if (!*ptr && i + 1 == argc)
+            usage("missing value after %s flag", argv[i]);
+        const char *value = (*ptr == '=') ? (ptr + 1) : argv[++i];
+        return {flag, atof(value)};
+    };
+
+    std::pair<std::string, double> arg;
+    for (i = 0; i < argc; ++i) {
+        if (argv[i][0] != '-') break;
+        if (!strcmp(argv[i], "--flipy") || !strcmp(argv[i], "-flipy"))
+            options.flipy = !options.flipy;
+        else if (!strcmp(argv[i], "--tonemap") || !strcmp(argv[i], "-tonemap"))
+            options.tonemap = !options.tonemap;
+        else if (!strcmp(argv[i], "--preservecolors") || !strcmp(argv[i], "-preservecolors"))
+            options.preserveColors = !options.preserveColors;
+        else if (!strcmp(argv[i], "--outdir") || !strcmp(argv[i], "-outdir")) {
+            if (i + 1 == argc)
+                usage("missing directory for %s parameter", argv[i]);
+            outdir = argv[++i];
+        } else if (!strncmp(argv[i], "--outdir=", 9))
+            outdir = &argv[i][9];
+        else if (!strcmp(argv[i], "--outext") || !strcmp(argv[i], "-outext")) {
+            if (i + 1 == argc)
+                usage("missing extension for %s parameter", argv[i]);
+            outext = argv[++i];
+        } else if (!strncmp(argv[i], "--outext=", 9))
+            outext = &argv[i][9];
+        else {
+            std::pair<std::string, double> arg = parseArg();
+            if (std::get<0>(arg) == "maxluminance") {
+                options.maxY = std::get<1>(arg);
+                if (options.maxY <= 0)
+                    usage("--maxluminance value must be greater than zero");
+            } else if (std::get<0>(arg) == "repeatpix") {
+                options.repeat = int(std::get<1>(arg));
+                if (options.repeat <= 0)
+                    usage("--repeatpix value must be greater than zero");
+            } else if (std::get<0>(arg) == "scale") {
+                options.scale = std::get<1>(arg);
+                if (options.scale == 0) usage("--scale value must be non-zero");
+            } else if (std::get<0>(arg) == "bloomlevel")
+                options.bloomLevel = std::get<1>(arg);
+            else if (std::get<0>(arg) == "bloomwidth")
+                options.bloomWidth = int(std::get<1>(arg));
+            else if (std::get<0>(arg) == "bloomscale")
+                options.bloomScale = std::get<1>(arg);
+            else if (std::get<0>(arg) == "bloomiters")
+                options.bloomIters = int(std::get<1>(arg));
+            else if (std::get<0>(arg) == "despike")
+                options.despikeLimit = std::get<1>(arg);
+            else
+                usage();
+        }
+    }
+
+    if (outdir) {
+        if (i >= argc) usage("missing filenames for \"convert\"");
+        char **files = argv + i;
+        return ForEachFile(argc - i, [&](int f, bool, std::string *) {
+            std::string outFilename =
+                std::string(outdir) + "/" + BaseName(files[f]);
+            if (outext) {
+                size_t dot = outFilename.find_last_of('.');
+                if (dot != std::string::npos &&
+                    dot > outFilename.find_last_of('/'))
+                    outFilename.erase(dot);
+                outFilename += outext;
+            }
+            return ConvertImage(files[f], outFilename, options);
+        });
+    }
+
+    if (i + 1 >= argc)
+        usage("missing second filename for \"convert\"");
+    else if (i >= argc)
+        usage("missing filenames for \"convert\"");
+
+    return ConvertImage(argv[i], argv[i + 1], options);
+}
+
 int main(int argc, char *argv[]) {
     google::InitGoogleLogging(argv[0]);
     FLAGS_stderrthreshold = 1; // Warning and above.
 
     if (argc < 2) usage();
 
+    std::function<int(int, char *[])> command;
     if (!strcmp(argv[1], "assemble"))
-        return assemble(argc - 2, argv + 2);
+        command = assemble;
     else if (!strcmp(argv[1], "cat"))
-        return cat(argc - 2, argv + 2);
+        command = cat;
     else if (!strcmp(argv[1], "convert"))
-        return convert(argc - 2, argv + 2);
+        command = convert;
     else if (!strcmp(argv[1], "diff"))
-        return diff(argc - 2, argv + 2);
+        command = diff;
     else if (!strcmp(argv[1], "info"))
-        return info(argc - 2, argv + 2);
+        command = info;
     else if (!strcmp(argv[1], "makesky"))
-        return makesky(argc - 2, argv + 2);
+        command = makesky;
     else
         usage("unknown command \"%s\"", argv[1]);
 
-    return 0;
+    ParallelInit();
+    InitImageIO();
+    int status = command(argc - 2, argv + 2);
+    ParallelCleanup();
+    return status;
 }